@@ -20,6 +20,13 @@
 
 #define TAG "Application"
 
+// 提醒 TTS 上传：帧长跟随会话协商的上行帧长，环形缓冲 480ms，预缓冲 120ms 后开始上传
+#define REMINDER_TTS_RING_MS 480
+#define REMINDER_TTS_PREBUFFER_MS 120
+#define REMINDER_TTS_URL "http://120.25.213.109:8081/api/text_to_pcm"
+#define REMINDER_TTS_VOICE "zh-CN-XiaoxiaoNeural"
+#define REMINDER_TTS_PREFETCH_BYTES (64 * 1024)     // PSRAM，约 30 秒以上的提醒语音
+
 // ========== 新增：提醒功能静态成员 ==========
 int64_t Application::g_last_channel_open_time_ = 0;
 
@@ -39,7 +46,7 @@ static const char* const STATE_STRINGS[] = {
     "invalid_state"
 };
 
-Application::Application() {
+Application::Application() : reminder_tts_prefetch_(REMINDER_TTS_PREFETCH_BYTES) {
     event_group_ = xEventGroupCreate();
 
 #if CONFIG_USE_DEVICE_AEC && CONFIG_USE_SERVER_AEC
@@ -354,29 +361,54 @@ void Application::Start() {
     callbacks.on_vad_change = [this](bool speaking) {
         xEventGroupSetBits(event_group_, MAIN_EVENT_VAD_CHANGE);
     };
+#if CONFIG_USE_AUDIO_REPLAY
+    // 回放测试的聆听会话：待机时像聆听状态一样运行音频处理器 (VAD、上行 DTX)，但不连接服务器
+    callbacks.on_replay_listening = [this](bool listening) {
+        Schedule([this, listening]() {
+            if (device_state_ != kDeviceStateIdle) {
+                return;
+            }
+            if (listening) {
+                audio_service_.EnableWakeWordDetection(false);
+                audio_service_.EnableUplinkDtx(true);
+                audio_service_.EnableVoiceProcessing(true);
+            } else {
+                audio_service_.EnableVoiceProcessing(false);
+                audio_service_.EnableWakeWordDetection(true);
+            }
+        });
+    };
+#endif
     audio_service_.SetCallbacks(callbacks);
 
     // ========== 新增：初始化提醒管理器 ==========
     ReminderManager::GetInstance().Initialize();
     ReminderManager::GetInstance().SetServerUrl("http://120.25.213.109:8081");
+#if CONFIG_USE_REMINDER_TTS_CACHE
+    // 新同步到的提醒提前下载语音，到点时直接从缓存上传
+    ReminderManager::GetInstance().OnUpcomingReminder([this](const Reminder& reminder) {
+        QueueReminderTtsPrefetch(reminder, false);
+    });
+#endif
+    // 提醒被删除时取消正在进行或已完成的预取
+    ReminderManager::GetInstance().OnReminderRemoved([this](const std::string& id) {
+        reminder_tts_prefetch_.Cancel(id);
+    });
 
     // Flag to trigger initial sync after network is ready
     pending_initial_sync_ = true;  
 
-    // ========== 新增：创建提醒 Opus 编码器 ==========
-    reminder_opus_encoder_ = std::make_unique<OpusEncoderWrapper>(16000, 1, 60);
-
     // ========== 新增：创建提醒 TTS 任务和队列 ==========
-    reminder_queue_ = xQueueCreate(5, sizeof(std::string*));
+    reminder_queue_ = xQueueCreate(5, sizeof(ReminderTtsRequest*));
     if (reminder_queue_ == nullptr) {
         ESP_LOGE(TAG, "Failed to create reminder queue");
     } else {
-        // 12KB 栈：HTTP + PCM处理 + Opus编码 + WebSocket发送
+        // 20KB 栈：HTTP + PCM处理 + Opus编码（写入缓存） + SPIFFS 读写
         xTaskCreate([](void* arg) {
             Application* app = static_cast<Application*>(arg);
             app->ReminderTtsTask();
             vTaskDelete(NULL);
-        }, "reminder_tts", 12288, this, 3, &reminder_tts_task_handle_);
+        }, "reminder_tts", 20480, this, 3, &reminder_tts_task_handle_);
     }
 
     /* Start the clock timer to update the status bar */
@@ -440,13 +472,19 @@ void Application::Start() {
     //     protocol_ = std::make_unique<MqttProtocol>();
     // }
 
+    UpdatePreferredFrameDuration();
     protocol_->OnNetworkError([this](const std::string& message) {
         last_error_message_ = message;
         xEventGroupSetBits(event_group_, MAIN_EVENT_ERROR);
     });
+    protocol_->SetPacketAllocator([this]() {
+        return audio_service_.AcquirePacket();
+    });
     protocol_->OnIncomingAudio([this](std::unique_ptr<AudioStreamPacket> packet) {
         if (device_state_ == kDeviceStateSpeaking) {
             audio_service_.PushPacketToDecodeQueue(std::move(packet));
+        } else {
+            audio_service_.ReleasePacket(std::move(packet));
         }
     });
     protocol_->OnAudioChannelOpened([this, codec, &board]() {
@@ -457,6 +495,8 @@ void Application::Start() {
         }
         // Record the time when audio channel is opened for reminder logic
         g_last_channel_open_time_ = esp_timer_get_time();
+        // 上行帧长以 hello 协商结果为准
+        audio_service_.SetFrameDuration(protocol_->uplink_frame_duration());
 
         Schedule([this]() {
             // 在对话页面或通过提醒触发开启通道时，自动激活对话状态
@@ -473,19 +513,19 @@ void Application::Start() {
             SetDeviceState(kDeviceStateIdle);
         });
     });
-    protocol_->OnIncomingJson([this, display](const cJSON* root) {
-        // Parse JSON data
-        auto type = cJSON_GetObjectItem(root, "type");
-        if (strcmp(type->valuestring, "tts") == 0) {
-            auto state = cJSON_GetObjectItem(root, "state");
-            if (strcmp(state->valuestring, "start") == 0) {
+    protocol_->OnIncomingJson([this, display](const JsonValue& root) {
+        // Only the members read here are scanned, the text stays in the protocol's buffer
+        auto type = root.Get("type");
+        if (type.Equals("tts")) {
+            auto state = root.Get("state");
+            if (state.Equals("start")) {
                 Schedule([this]() {
                     aborted_ = false;
                     if (device_state_ == kDeviceStateIdle || device_state_ == kDeviceStateListening) {
                         SetDeviceState(kDeviceStateSpeaking);
                     }
                 });
-            } else if (strcmp(state->valuestring, "stop") == 0) {
+            } else if (state.Equals("stop")) {
                 // AI回复结束，记录完整对话
                 RecordAIResponse("", true);  // true = 立即记录完整对话
                 Schedule([this]() {
@@ -497,10 +537,10 @@ void Application::Start() {
                         }
                     }
                 });
-            } else if (strcmp(state->valuestring, "sentence_start") == 0) {
-                auto text = cJSON_GetObjectItem(root, "text");
-                if (cJSON_IsString(text)) {
-                    std::string ai_text(text->valuestring);
+            } else if (state.Equals("sentence_start")) {
+                auto text = root.Get("text");
+                if (text.IsString()) {
+                    std::string ai_text = text.ToString();
                     ESP_LOGI(TAG, "<< %s", ai_text.c_str());
                     Schedule([this, display, message = ai_text]() {
                         display->SetChatMessage("assistant", message.c_str());
@@ -509,10 +549,10 @@ void Application::Start() {
                     RecordAIResponse(ai_text, false);  // false = 不立即记录
                 }
             }
-        } else if (strcmp(type->valuestring, "stt") == 0) {
-            auto text = cJSON_GetObjectItem(root, "text");
-            if (cJSON_IsString(text)) {
-                std::string user_text(text->valuestring);
+        } else if (type.Equals("stt")) {
+            auto text = root.Get("text");
+            if (text.IsString()) {
+                std::string user_text = text.ToString();
                 ESP_LOGI(TAG, ">> %s", user_text.c_str());
                 Schedule([this, display, message = user_text]() {
                     display->SetChatMessage("user", message.c_str());
@@ -520,48 +560,49 @@ void Application::Start() {
                 // 记录用户输入
                 RecordUserInput(user_text);
             }
-        } else if (strcmp(type->valuestring, "llm") == 0) {
-            auto emotion = cJSON_GetObjectItem(root, "emotion");
-            if (cJSON_IsString(emotion)) {
-                Schedule([this, display, emotion_str = std::string(emotion->valuestring)]() {
+        } else if (type.Equals("llm")) {
+            auto emotion = root.Get("emotion");
+            if (emotion.IsString()) {
+                Schedule([this, display, emotion_str = emotion.ToString()]() {
                     display->SetEmotion(emotion_str.c_str());
                 });
             }
-        } else if (strcmp(type->valuestring, "mcp") == 0) {
-            auto payload = cJSON_GetObjectItem(root, "payload");
-            if (cJSON_IsObject(payload)) {
+        } else if (type.Equals("mcp")) {
+            auto payload = root.Get("payload");
+            if (payload.IsObject()) {
                 McpServer::GetInstance().ParseMessage(payload);
             }
-        } else if (strcmp(type->valuestring, "system") == 0) {
-            auto command = cJSON_GetObjectItem(root, "command");
-            if (cJSON_IsString(command)) {
-                ESP_LOGI(TAG, "System command: %s", command->valuestring);
-                if (strcmp(command->valuestring, "reboot") == 0) {
+        } else if (type.Equals("system")) {
+            auto command = root.Get("command");
+            if (command.IsString()) {
+                auto command_str = command.ToString();
+                ESP_LOGI(TAG, "System command: %s", command_str.c_str());
+                if (command_str == "reboot") {
                     // Do a reboot if user requests a OTA update
                     Schedule([this]() {
                         Reboot();
                     });
                 } else {
-                    ESP_LOGW(TAG, "Unknown system command: %s", command->valuestring);
+                    ESP_LOGW(TAG, "Unknown system command: %s", command_str.c_str());
                 }
             }
-        } else if (strcmp(type->valuestring, "alert") == 0) {
-            auto status = cJSON_GetObjectItem(root, "status");
-            auto message = cJSON_GetObjectItem(root, "message");
-            auto emotion = cJSON_GetObjectItem(root, "emotion");
-            if (cJSON_IsString(status) && cJSON_IsString(message) && cJSON_IsString(emotion)) {
+        } else if (type.Equals("alert")) {
+            auto status = root.Get("status");
+            auto message = root.Get("message");
+            auto emotion = root.Get("emotion");
+            if (status.IsString() && message.IsString() && emotion.IsString()) {
                 // 确保调用 Alert 时能更新音频活动，并在播放声音前唤醒硬件
                 audio_service_.UpdateAudioActivity();
-                Alert(status->valuestring, message->valuestring, emotion->valuestring, Lang::Sounds::OGG_POPUP);
+                Alert(status.ToString().c_str(), message.ToString().c_str(), emotion.ToString().c_str(), Lang::Sounds::OGG_POPUP);
             } else {
                 ESP_LOGW(TAG, "Alert command requires status, message and emotion");
             }
 #if CONFIG_RECEIVE_CUSTOM_MESSAGE
-        } else if (strcmp(type->valuestring, "custom") == 0) {
-            auto payload = cJSON_GetObjectItem(root, "payload");
-            ESP_LOGI(TAG, "Received custom message: %s", cJSON_PrintUnformatted(root));
-            if (cJSON_IsObject(payload)) {
-                Schedule([this, display, payload_str = std::string(cJSON_PrintUnformatted(payload))]() {
+        } else if (type.Equals("custom")) {
+            auto payload = root.Get("payload");
+            ESP_LOGI(TAG, "Received custom message: %.*s", (int)root.size(), root.data());
+            if (payload.IsObject()) {
+                Schedule([this, display, payload_str = std::string(payload.data(), payload.size())]() {
                     display->SetChatMessage("system", payload_str.c_str());
                 });
             } else {
@@ -569,7 +610,7 @@ void Application::Start() {
             }
 #endif
         } else {
-            ESP_LOGW(TAG, "Unknown message type: %s", type->valuestring);
+            ESP_LOGW(TAG, "Unknown message type: %s", type.ToString().c_str());
         }
     });
     bool protocol_started = protocol_->Start();
@@ -600,6 +641,7 @@ void Application::OnClockTimer() {
         // SystemInfo::PrintTaskCpuUsage(pdMS_TO_TICKS(1000));
         // SystemInfo::PrintTaskList();
         // SystemInfo::PrintHeapStats();
+        // audio_service_.LogDebugStatistics();
     }
 
 
@@ -623,6 +665,18 @@ void Application::OnClockTimer() {
 
         // 1. 预唤醒逻辑：快到时间了（15秒内）且处于空闲状态，提前拉起网络连接
         if (reminder.timestamp > now && reminder.timestamp <= now + 15) {
+            // 同时在后台预取提醒语音，到点后不再等待 TTS 服务器。
+            // 预取按当前帧长编码；通道打开后会话可能协商出不同帧长，此时丢弃旧的预取，按新帧长重新预取
+            int frame_duration = audio_service_.frame_duration_ms();
+            if (reminder.tts_prefetch_frame_duration != frame_duration) {
+                if (reminder.tts_prefetch_frame_duration != 0) {
+                    ESP_LOGI(TAG, "Frame duration changed to %d ms, prefetching reminder %s again",
+                        frame_duration, reminder.id.c_str());
+                    reminder_tts_prefetch_.Invalidate(reminder.id);
+                }
+                reminder.tts_prefetch_frame_duration = frame_duration;
+                QueueReminderTtsPrefetch(reminder, true);
+            }
             if (GetDeviceState() == kDeviceStateIdle) {
                 ESP_LOGI(TAG, "Pre-warming: Opening audio channel for upcoming reminder: %s", reminder.content.c_str());
                 SetDeviceState(kDeviceStateConnecting);
@@ -699,10 +753,9 @@ void Application::MainEventLoop() {
         }
 
         if (bits & MAIN_EVENT_SEND_AUDIO) {
-            while (auto packet = audio_service_.PopPacketFromSendQueue()) {
-                if (!protocol_->SendAudio(std::move(packet))) {
-                    break;
-                }
+            // Everything queued goes out in one batch, e.g. the frames that piled up during a Wi-Fi stall
+            if (audio_service_.PopPacketsFromSendQueue(send_batch_) > 0) {
+                SendAudioBatch();
             }
         }
 
@@ -739,8 +792,6 @@ void Application::OnWakeWordDetected() {
             ESP_LOGI(TAG, "Re-awakened during listening, resetting connection...");
         }
 
-        audio_service_.EncodeWakeWord();
-
         if (!protocol_->IsAudioChannelOpened()) {
             SetDeviceState(kDeviceStateConnecting);
             if (!protocol_->OpenAudioChannel()) {
@@ -755,10 +806,11 @@ void Application::OnWakeWordDetected() {
         auto wake_word = audio_service_.GetLastWakeWord();
         ESP_LOGI(TAG, "Wake word detected: %s", wake_word.c_str());
 #if CONFIG_USE_AFE_WAKE_WORD || CONFIG_USE_CUSTOM_WAKE_WORD
-        // Encode and send the wake word data to the server
+        // Send the wake word audio recorded so far; the rest follows ahead of the listening stream
         while (auto packet = audio_service_.PopWakeWordPacket()) {
-            protocol_->SendAudio(std::move(packet));
+            send_batch_.push_back(std::move(packet));
         }
+        SendAudioBatch();
         // Set the chat state to wake word detected
         protocol_->SendWakeWordDetected(wake_word);
         SetListeningMode(aec_mode_ == kAecOff ? kListeningModeAutoStop : kListeningModeRealtime);
@@ -785,6 +837,26 @@ void Application::SetListeningMode(ListeningMode mode) {
     SetDeviceState(kDeviceStateListening);
 }
 
+void Application::SendAudioBatch() {
+    // 没有音频通道时（如待机时的回放测试）直接丢弃
+    if (protocol_ && protocol_->IsAudioChannelOpened()) {
+        size_t sent = protocol_->SendAudioBatch(send_batch_);
+        if (sent < send_batch_.size()) {
+            ESP_LOGW(TAG, "Sent %u of %u audio packets", (unsigned)sent, (unsigned)send_batch_.size());
+        }
+    }
+    for (auto& packet : send_batch_) {
+        audio_service_.ReleasePacket(std::move(packet));
+    }
+    send_batch_.clear();
+}
+
+void Application::UpdatePreferredFrameDuration() {
+    // 实时对话用短帧降低延迟，单轮对话用长帧减少包数，下次打开音频通道时生效
+    protocol_->SetPreferredFrameDuration(aec_mode_ == kAecOff ?
+        CONFIG_OPUS_AUTO_FRAME_DURATION_MS : CONFIG_OPUS_REALTIME_FRAME_DURATION_MS);
+}
+
 void Application::SetDeviceState(DeviceState state) {
     if (device_state_ == state) {
         return;
@@ -820,6 +892,8 @@ void Application::SetDeviceState(DeviceState state) {
             display->SetEmotion("neutral");
 
             audio_service_.EnableWakeWordDetection(false);
+            // 实时对话中用户长时间不说话时不再连续上传静音，仅在服务器 hello 确认支持 DTX 时启用
+            audio_service_.EnableUplinkDtx(listening_mode_ == kListeningModeRealtime && protocol_->uplink_dtx());
             audio_service_.EnableVoiceProcessing(true);
             
             // 如果连接已开启但服务器未进入监听，发送指令
@@ -919,8 +993,11 @@ void Application::SetAecMode(AecMode mode) {
         }
 
         // If the AEC mode is changed, close the audio channel
-        if (protocol_ && protocol_->IsAudioChannelOpened()) {
-            protocol_->CloseAudioChannel();
+        if (protocol_) {
+            UpdatePreferredFrameDuration();
+            if (protocol_->IsAudioChannelOpened()) {
+                protocol_->CloseAudioChannel();
+            }
         }
     });
 }
@@ -931,40 +1008,8 @@ void Application::PlaySound(const std::string_view& sound) {
 
 // ========== 新增：提醒 TTS 实现 ==========
 
-void Application::QueueReminderTts(const std::string& content) {
-    if (reminder_queue_ != nullptr) {
-        // 分配新的字符串并复制内容，避免悬空指针
-        std::string* content_ptr = new std::string(content);
-         if (xQueueSend(reminder_queue_, &content_ptr, 0) != pdTRUE) {
-            ESP_LOGW(TAG, "Reminder queue full, dropping: %s", content.c_str());
-            delete content_ptr;
-        }
-    }
-}
-
-void Application::ReminderTtsTask() {
-    ESP_LOGI(TAG, "Reminder TTS task started");
-
-    std::string* content_ptr;
-    while (true) {
-        if (xQueueReceive(reminder_queue_, &content_ptr, portMAX_DELAY)) {
-            ESP_LOGI(TAG, "Received reminder from queue: %s", content_ptr->c_str());
-            ProcessReminderTts(*content_ptr);
-            delete content_ptr;  // 释放内存
-            
-        }
-    }
-}
-
-void Application::ProcessReminderTts(const std::string& content) {
-    // 设置标志：正在处理系统提醒（防止AI误添加提醒）
-    // 注意：此标志将在 RecordAIResponse(complete=true) 时清除
-    ReminderManager::SetProcessingReminder(true);
-    ESP_LOGI(TAG, "System reminder flag set: blocking reminder.add");
-
-    // 设置标志：正在处理提醒 TTS
-    processing_reminder_tts_ = true;
-
+// 清洗提醒内容，生成最终 TTS 文案（同时作为提醒语音缓存的键）
+static std::string BuildReminderTtsText(const std::string& content) {
     std::string clean_content = content;
     
     // [优化] 深度清洗：移除常见的 AI 回复冗余词汇和固定称呼（如“轩轩爸爸”）
@@ -1016,93 +1061,256 @@ void Application::ProcessReminderTts(const std::string& content) {
     //text = "提醒我一下：现在该去 " + clean_content + " 了，并且告诉我"+ clean_content + " 的好处。";
     text = "【系统提醒】请对用户说:现在该去" + clean_content + "了。";
         
-    ESP_LOGI(TAG, "ProcessReminderTts: [清洗后内容: %s] [最终文案: %s]", clean_content.c_str(), text.c_str());
+    return text;
+}
+
+void Application::QueueReminderTts(const std::string& content) {
+    QueueReminderTtsRequest(new ReminderTtsRequest{kReminderTtsRequestSpeak, content, "", 0});
+}
+
+void Application::QueueReminderTtsPrefetch(const Reminder& reminder, bool prewarm) {
+    auto type = prewarm ? kReminderTtsRequestPrewarm : kReminderTtsRequestCache;
+    QueueReminderTtsRequest(new ReminderTtsRequest{type, reminder.content, reminder.id, reminder.timestamp});
+}
+
+void Application::QueueReminderTtsRequest(ReminderTtsRequest* request) {
+    // 请求由提醒任务释放，内容已复制，避免悬空指针
+    if (reminder_queue_ == nullptr || xQueueSend(reminder_queue_, &request, 0) != pdTRUE) {
+        ESP_LOGW(TAG, "Reminder queue full, dropping: %s", request->content.c_str());
+        delete request;
+    }
+}
+
+void Application::ReminderTtsTask() {
+    ESP_LOGI(TAG, "Reminder TTS task started");
+#if CONFIG_USE_REMINDER_TTS_CACHE
+    reminder_tts_cache_ = std::make_unique<ReminderTtsCache>(CONFIG_REMINDER_TTS_CACHE_BUDGET_KB * 1024);
+    if (!reminder_tts_cache_->Initialize()) {
+        reminder_tts_cache_.reset();
+    }
+#endif
 
-    std::string url = "http://120.25.213.109:8081/api/text_to_pcm";
+    ReminderTtsRequest* request;
+    while (true) {
+        if (xQueueReceive(reminder_queue_, &request, portMAX_DELAY)) {
+            if (request->type != kReminderTtsRequestSpeak) {
+                PrefetchReminderTts(*request);
+            } else {
+                ESP_LOGI(TAG, "Received reminder from queue: %s", request->content.c_str());
+                ProcessReminderTts(request->content);
+            }
+            delete request;  // 释放内存
+        }
+    }
+}
+
+void Application::SelectReminderFrameDuration() {
+    // 提醒语音的帧长必须与会话上行帧长一致；预唤醒时通道可能还没打开，沿用上次协商的帧长
+    int frame_duration = audio_service_.frame_duration_ms();
+    if (frame_duration == reminder_frame_duration_) {
+        return;
+    }
+    reminder_stream_.reset();
+    reminder_stream_ = std::make_unique<PacedPcmStream>(16000, frame_duration,
+        REMINDER_TTS_RING_MS / frame_duration, REMINDER_TTS_PREBUFFER_MS / frame_duration);
+    reminder_opus_encoder_.reset();
+    reminder_opus_encoder_ = std::make_unique<OpusEncoderWrapper>(16000, 1, frame_duration);
+    reminder_frame_duration_ = frame_duration;
+}
 
+void Application::PrefetchReminderTts(const ReminderTtsRequest& request) {
+    SelectReminderFrameDuration();
+    std::string text = BuildReminderTtsText(request.content);
+    std::string cache_key = ReminderTtsCache::MakeKey(text, REMINDER_TTS_VOICE, reminder_frame_duration_);
+    // 已在 flash 缓存中的不必再下载，从缓存读取本身不在关键路径上
+    if (reminder_tts_cache_ && reminder_tts_cache_->Contains(cache_key)) {
+        return;
+    }
+    bool prewarm = request.type == kReminderTtsRequestPrewarm &&
+        reminder_tts_prefetch_.Begin(cache_key, request.reminder_id, request.due_time, reminder_frame_duration_);
+    if (!prewarm && !reminder_tts_cache_) {
+        return;
+    }
+    ESP_LOGI(TAG, "Prefetching reminder TTS%s: %s", prewarm ? " (pre-warm)" : "", text.c_str());
+    bool ok = FetchReminderTts(text, cache_key, false, prewarm);
+    if (prewarm) {
+        reminder_tts_prefetch_.End(ok);
+    }
+}
+
+bool Application::FetchReminderTts(const std::string& text, const std::string& cache_key, bool upload, bool prewarm) {
     auto network = Board::GetInstance().GetNetwork();
-    if (!network) return;
+    if (!network) return false;
 
     auto http = network->CreateHttp(1);
-    if (!http) return;
+    if (!http) return false;
 
     cJSON* root = cJSON_CreateObject();
     cJSON_AddStringToObject(root, "text", text.c_str());
-    cJSON_AddStringToObject(root, "voice", "zh-CN-XiaoxiaoNeural"); // 使用用户之前提到的音色或默认
+    cJSON_AddStringToObject(root, "voice", REMINDER_TTS_VOICE); // 使用用户之前提到的音色或默认
     char* json_str = cJSON_PrintUnformatted(root);
 
     http->SetHeader("Content-Type", "application/json");
     http->SetContent(json_str);
 
-    if (!http->Open("POST", url.c_str())) {
+    if (!http->Open("POST", REMINDER_TTS_URL)) {
         cJSON_free(json_str);
         cJSON_Delete(root);
-        return;
+        return false;
     }
 
     cJSON_free(json_str);
     cJSON_Delete(root);
 
-    auto& audio_service = Application::GetInstance().GetAudioService();
+    // 边下载边编码为 Opus 写入缓存（与上传用同一份 PCM），下次同样的提醒不再请求 TTS 服务器
+    bool status_ok = http->GetStatusCode() == 200;
+    bool caching = reminder_tts_cache_ && status_ok && reminder_tts_cache_->BeginWrite(cache_key);
+    // 预取时同一份 Opus 也写入 PSRAM，到点后直接发送
+    bool encoding = caching || (prewarm && status_ok);
+    reminder_opus_encoder_->ResetState();
+    // 按整帧编码：cache_pcm 和 cache_opus 只分配一次，编码器不会取走它们的缓冲
+    size_t frame_samples = reminder_frame_duration_ * 16;
+    std::vector<int16_t> cache_pcm;
+    std::vector<uint8_t> cache_opus;
+    cache_pcm.reserve(frame_samples);
+    int pending_byte = -1;  // 被两次读取拆开的半个采样
+    auto encode_frame = [&]() {
+        bool encoded = reminder_opus_encoder_->Encode(std::move(cache_pcm), cache_opus);
+        cache_pcm.clear();
+        if (!encoded) {
+            return;
+        }
+        if (caching) {
+            reminder_tts_cache_->Append(cache_opus);
+        }
+        if (prewarm) {
+            reminder_tts_prefetch_.Append(cache_opus);
+        }
+    };
+    auto add_sample = [&](int16_t sample) {
+        cache_pcm.push_back(sample);
+        if (cache_pcm.size() == frame_samples) {
+            encode_frame();
+        }
+    };
+    auto read = [&](char* buffer, size_t size) -> int {
+        if (prewarm && reminder_tts_prefetch_.cancelled()) {
+            return -1;
+        }
+        int bytes_read = http->Read(buffer, size);
+        if (bytes_read > 0 && encoding) {
+            const uint8_t* data = (const uint8_t*)buffer;
+            size_t remaining = bytes_read;
+            if (pending_byte >= 0) {
+                add_sample((int16_t)(pending_byte | (data[0] << 8)));
+                data++;
+                remaining--;
+                pending_byte = -1;
+            }
+            for (; remaining >= 2; data += 2, remaining -= 2) {
+                add_sample((int16_t)(data[0] | (data[1] << 8)));
+            }
+            if (remaining == 1) {
+                pending_byte = data[0];
+            }
+        }
+        return bytes_read;
+    };
 
-    // [Step 1] 挂起麦克风采集，防止环境音混入提醒语音回传
-    bool was_processor_running = audio_service.IsAudioProcessorRunning();
-    if (was_processor_running) {
-        audio_service.EnableVoiceProcessing(false);
+    bool ok;
+    if (upload) {
+        auto& audio_service = GetAudioService();
+        ESP_LOGI(TAG, "Streaming PCM data to AudioService for upload...");
+        // [FIX] 匀速上传：HTTP 数据直接读入固定环形缓冲，由定时器按帧长匀速送入编码队列，
+        // 网络卡顿时不会在恢复后突发补发
+        ok = reminder_stream_->Run(read, [&audio_service](std::vector<int16_t>&& pcm, uint32_t timestamp) {
+            // [Step 2] 注入编码队列上传至服务器 (由服务端识别并以 AI 音色回应)
+            audio_service.PushTaskToEncodeQueue(kAudioTaskTypeEncodeToSendQueue, std::move(pcm), timestamp);
+            audio_service.UpdateAudioActivity();
+        });
+        ESP_LOGI(TAG, "Reminder audio upload finished, total %lu bytes", reminder_stream_->statistics().bytes);
+    } else {
+        char buffer[512];
+        int bytes_read;
+        while ((bytes_read = read(buffer, sizeof(buffer))) > 0) {
+        }
+        ok = bytes_read == 0;
     }
+    http->Close();
 
-    const size_t FRAME_SIZE = 960; // 60ms @ 16kHz
-    const size_t FRAME_BYTES = FRAME_SIZE * 2;
-    auto buffer = std::unique_ptr<uint8_t[]>(new uint8_t[FRAME_BYTES]);
+    if (encoding && ok && !cache_pcm.empty()) {
+        // 最后不足一帧的部分补静音，与上传时一致
+        cache_pcm.resize(frame_samples, 0);
+        encode_frame();
+    }
+    if (caching) {
+        reminder_tts_cache_->EndWrite(ok);
+    }
+    return ok && status_ok;
+}
 
-    ESP_LOGI(TAG, "Streaming PCM data to AudioService for upload...");
-    size_t total_bytes = 0;
+bool Application::SendCachedReminderTts(const std::string& cache_key) {
+    auto& audio_service = GetAudioService();
     uint32_t timestamp = 0;
-    
-    // [FIX] 匀速上传控制：记录开始时间，确保以 1.0x 速率回传，防止服务端识别异常
-    uint32_t start_time_ms = esp_timer_get_time() / 1000;
-    uint32_t total_sent_ms = 0;
+    TickType_t last_wake_time = xTaskGetTickCount();
+    // 预取或缓存命中：Opus 包直接按帧长匀速放入发送队列，不请求 TTS 服务器，也不经过编码器
+    auto send_packet = [&](std::vector<uint8_t>& opus) {
+        auto packet = audio_service.AcquirePacket();
+        packet->sample_rate = 16000;
+        packet->frame_duration = reminder_frame_duration_;
+        packet->timestamp = timestamp;
+        packet->sequence = 0;
+        packet->local = false;
+        packet->capture_time = 0;
+        packet->payload.swap(opus);
+        audio_service.PushPacketToSendQueue(std::move(packet));
+        audio_service.UpdateAudioActivity();
+        timestamp += reminder_frame_duration_;
+        vTaskDelayUntil(&last_wake_time, pdMS_TO_TICKS(reminder_frame_duration_));
+    };
+    if (reminder_tts_prefetch_.Take(cache_key, reminder_frame_duration_, send_packet)) {
+        return true;
+    }
+    return reminder_tts_cache_ && reminder_tts_cache_->Read(cache_key, send_packet);
+}
 
-    // 字节对齐缓冲区，确保每次 PushTaskToEncodeQueue 都是完整的 60ms 帧 (1920 字节)
-    std::vector<uint8_t> pcm_buffer;
-    pcm_buffer.reserve(FRAME_BYTES);
+void Application::ProcessReminderTts(const std::string& content) {
+    // 设置标志：正在处理系统提醒（防止AI误添加提醒）
+    // 注意：此标志将在 RecordAIResponse(complete=true) 时清除
+    ReminderManager::SetProcessingReminder(true);
+    ESP_LOGI(TAG, "System reminder flag set: blocking reminder.add");
 
-    while (true) {
-        int bytes_read = http->Read((char*)buffer.get(), FRAME_BYTES);
-        if (bytes_read < 0) {
-            ESP_LOGE(TAG, "Failed to read PCM data");
-            break;
-        }
-        if (bytes_read == 0) break;
+    // 设置标志：正在处理提醒 TTS
+    processing_reminder_tts_ = true;
 
-        // 将新读取的数据存入缓存
-        pcm_buffer.insert(pcm_buffer.end(), buffer.get(), buffer.get() + bytes_read);
+    std::string text = BuildReminderTtsText(content);
+    ESP_LOGI(TAG, "ProcessReminderTts: [最终文案: %s]", text.c_str());
+    SelectReminderFrameDuration();
+    std::string cache_key = ReminderTtsCache::MakeKey(text, REMINDER_TTS_VOICE, reminder_frame_duration_);
 
-        // 只要缓存够一帧，就处理一帧
-        while (pcm_buffer.size() >= FRAME_BYTES) {
-            std::vector<int16_t> pcm_frame(FRAME_SIZE);
-            memcpy(pcm_frame.data(), pcm_buffer.data(), FRAME_BYTES);
-            // 移除已处理的数据
-            pcm_buffer.erase(pcm_buffer.begin(), pcm_buffer.begin() + FRAME_BYTES);
+    auto& audio_service = GetAudioService();
 
-            // [Step 2] 注入编码队列上传至服务器 (由服务端识别并以 AI 音色回应)
-            audio_service.PushTaskToEncodeQueue(kAudioTaskTypeEncodeToSendQueue, std::move(pcm_frame), timestamp);
-            audio_service.UpdateAudioActivity();
-            
-            total_bytes += FRAME_BYTES;
-            timestamp += 60;
-            total_sent_ms += 60;
-
-            // [FIX] 计算时差，维持匀速回传，防止网络波动导致回传过快/过慢产生噪音
-            uint32_t current_time_ms = esp_timer_get_time() / 1000;
-            uint32_t elapsed_ms = current_time_ms - start_time_ms;
-            if (total_sent_ms > elapsed_ms) {
-                vTaskDelay(pdMS_TO_TICKS(total_sent_ms - elapsed_ms));
-            }
-        }
+    // [Step 1] 挂起麦克风采集，防止环境音混入提醒语音回传
+    bool was_processor_running = audio_service.IsAudioProcessorRunning();
+    if (was_processor_running) {
+        audio_service.EnableVoiceProcessing(false);
+    }
+
+    if (SendCachedReminderTts(cache_key)) {
+        ESP_LOGI(TAG, "Reminder TTS sent without waiting for the TTS server");
+    } else {
+        FetchReminderTts(text, cache_key, true, false);
+    }
+    auto prefetch_statistics = reminder_tts_prefetch_.GetStatistics();
+    ESP_LOGI(TAG, "Reminder TTS prefetch: %lu started, %lu ready, %lu cancelled, %lu used, %lu stale, lead %lld ms (min %lld ms)",
+        prefetch_statistics.started, prefetch_statistics.completed, prefetch_statistics.cancelled,
+        prefetch_statistics.used, prefetch_statistics.stale, prefetch_statistics.last_lead_ms,
+        prefetch_statistics.min_lead_ms);
+    if (reminder_tts_cache_) {
+        auto statistics = reminder_tts_cache_->GetStatistics();
+        ESP_LOGI(TAG, "Reminder TTS cache: %lu hits, %lu misses, %lu entries, %u/%u bytes", statistics.hits,
+            statistics.misses, statistics.entries, (unsigned)statistics.bytes, (unsigned)statistics.budget);
     }
-    http->Close();
-    ESP_LOGI(TAG, "Reminder audio upload finished, total %u bytes", total_bytes);
 
     // [FIX] 关键步骤：发送“停止监听”指令，告知服务端音频流结束，触发立即响应
     if (protocol_) {
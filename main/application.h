@@ -17,6 +17,11 @@
 #include "audio_service.h"
 #include "device_state_event.h"
 #include "opus_encoder.h"
+#include "paced_pcm_stream.h"
+#include "reminder_tts_cache.h"
+#include "reminder_tts_prefetch.h"
+
+struct Reminder;
 
 #define MAIN_EVENT_SCHEDULE (1 << 0)
 #define MAIN_EVENT_SEND_AUDIO (1 << 1)
@@ -83,6 +88,7 @@ private:
     AecMode aec_mode_ = kAecOff;
     std::string last_error_message_;
     AudioService audio_service_;
+    std::vector<std::unique_ptr<AudioStreamPacket>> send_batch_;  // Reused by SendAudioBatch, main task only
 
     bool has_server_time_ = false;
     bool aborted_ = false;
@@ -91,10 +97,25 @@ private:
     bool processing_reminder_tts_ = false;  // Flag: 正在处理提醒 TTS
 
     // ========== 新增：提醒 TTS 任务 ==========
+    enum ReminderTtsRequestType {
+        kReminderTtsRequestSpeak,       // 到期：上传给服务端
+        kReminderTtsRequestCache,       // 新同步到的提醒：只下载到 flash 缓存
+        kReminderTtsRequestPrewarm,     // 预唤醒窗口：下载到 PSRAM，到期后立即发送
+    };
+    struct ReminderTtsRequest {
+        ReminderTtsRequestType type;
+        std::string content;
+        std::string reminder_id;
+        long long due_time;
+    };
     TaskHandle_t reminder_tts_task_handle_ = nullptr;
     QueueHandle_t reminder_queue_ = nullptr;
     static int64_t g_last_channel_open_time_;
     std::unique_ptr<OpusEncoderWrapper> reminder_opus_encoder_;
+    std::unique_ptr<PacedPcmStream> reminder_stream_;
+    int reminder_frame_duration_ = 0;   // Of reminder_opus_encoder_ and reminder_stream_
+    std::unique_ptr<ReminderTtsCache> reminder_tts_cache_;
+    ReminderTtsPrefetch reminder_tts_prefetch_;
 
     TaskHandle_t check_new_version_task_handle_ = nullptr;
 
@@ -106,10 +127,18 @@ private:
     void ShowActivationCode(const std::string& code, const std::string& message);
     void OnClockTimer();
     void SetListeningMode(ListeningMode mode);
+    void UpdatePreferredFrameDuration();
+    void SendAudioBatch();
 
     // ========== 新增：提醒 TTS 实现 ==========
     void ReminderTtsTask();
     void ProcessReminderTts(const std::string& content);
+    void SelectReminderFrameDuration();
+    void QueueReminderTtsPrefetch(const Reminder& reminder, bool prewarm);
+    void QueueReminderTtsRequest(ReminderTtsRequest* request);
+    void PrefetchReminderTts(const ReminderTtsRequest& request);
+    bool FetchReminderTts(const std::string& text, const std::string& cache_key, bool upload, bool prewarm);
+    bool SendCachedReminderTts(const std::string& cache_key);
 };
 
 #endif // _APPLICATION_H_
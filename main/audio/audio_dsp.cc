@@ -0,0 +1,154 @@
+#include "audio_dsp.h"
+
+#include <cstring>
+
+namespace AudioDsp {
+
+static inline int16_t Saturate(int32_t value) {
+    return value > INT16_MAX ? INT16_MAX : value < -INT16_MAX ? -INT16_MAX : static_cast<int16_t>(value);
+}
+
+void Deinterleave(const int16_t* interleaved, int16_t* left, int16_t* right, size_t frames) {
+    size_t i = 0;
+    for (; i + 4 <= frames; i += 4) {
+        const int16_t* s = interleaved + i * 2;
+        left[i] = s[0];
+        right[i] = s[1];
+        left[i + 1] = s[2];
+        right[i + 1] = s[3];
+        left[i + 2] = s[4];
+        right[i + 2] = s[5];
+        left[i + 3] = s[6];
+        right[i + 3] = s[7];
+    }
+    for (; i < frames; i++) {
+        left[i] = interleaved[i * 2];
+        right[i] = interleaved[i * 2 + 1];
+    }
+}
+
+void ExtractLeft(const int16_t* interleaved, int16_t* dest, size_t frames) {
+    // Reading always runs ahead of writing, so in-place works front to back
+    size_t i = 0;
+    for (; i + 4 <= frames; i += 4) {
+        const int16_t* s = interleaved + i * 2;
+        int16_t a = s[0], b = s[2], c = s[4], d = s[6];
+        dest[i] = a;
+        dest[i + 1] = b;
+        dest[i + 2] = c;
+        dest[i + 3] = d;
+    }
+    for (; i < frames; i++) {
+        dest[i] = interleaved[i * 2];
+    }
+}
+
+void Interleave(const int16_t* left, const int16_t* right, int16_t* interleaved, size_t frames) {
+    size_t i = 0;
+    for (; i + 4 <= frames; i += 4) {
+        int16_t* d = interleaved + i * 2;
+        d[0] = left[i];
+        d[1] = right[i];
+        d[2] = left[i + 1];
+        d[3] = right[i + 1];
+        d[4] = left[i + 2];
+        d[5] = right[i + 2];
+        d[6] = left[i + 3];
+        d[7] = right[i + 3];
+    }
+    for (; i < frames; i++) {
+        interleaved[i * 2] = left[i];
+        interleaved[i * 2 + 1] = right[i];
+    }
+}
+
+void DownmixStereo(const int16_t* interleaved, int16_t* dest, size_t frames) {
+    for (size_t i = 0; i < frames; i++) {
+        // The sum of two int16 fits in int32, and the average fits back into int16
+        dest[i] = static_cast<int16_t>((int32_t(interleaved[i * 2]) + interleaved[i * 2 + 1]) >> 1);
+    }
+}
+
+void ShiftSaturateToS16(const int32_t* src, int16_t* dest, size_t samples, int shift) {
+    size_t i = 0;
+    for (; i + 4 <= samples; i += 4) {
+        int32_t a = src[i] >> shift;
+        int32_t b = src[i + 1] >> shift;
+        int32_t c = src[i + 2] >> shift;
+        int32_t d = src[i + 3] >> shift;
+        dest[i] = Saturate(a);
+        dest[i + 1] = Saturate(b);
+        dest[i + 2] = Saturate(c);
+        dest[i + 3] = Saturate(d);
+    }
+    for (; i < samples; i++) {
+        dest[i] = Saturate(src[i] >> shift);
+    }
+}
+
+void ScaleToS32(const int16_t* src, int32_t* dest, size_t samples, int32_t factor) {
+    // |src| <= 32768 and factor <= 65536, so the product stays within int32 and needs no clamp
+    if (factor > 65536) {
+        factor = 65536;
+    } else if (factor < 0) {
+        factor = 0;
+    }
+    size_t i = 0;
+    for (; i + 4 <= samples; i += 4) {
+        dest[i] = src[i] * factor;
+        dest[i + 1] = src[i + 1] * factor;
+        dest[i + 2] = src[i + 2] * factor;
+        dest[i + 3] = src[i + 3] * factor;
+    }
+    for (; i < samples; i++) {
+        dest[i] = src[i] * factor;
+    }
+}
+
+void GainQ15(const int16_t* src, int16_t* dest, size_t samples, int32_t gain) {
+    if (gain >= 32768) {
+        if (dest != src) {
+            memcpy(dest, src, samples * sizeof(int16_t));
+        }
+        return;
+    }
+    if (gain < 0) {
+        gain = 0;
+    }
+    size_t i = 0;
+    for (; i + 4 <= samples; i += 4) {
+        dest[i] = static_cast<int16_t>((src[i] * gain) >> 15);
+        dest[i + 1] = static_cast<int16_t>((src[i + 1] * gain) >> 15);
+        dest[i + 2] = static_cast<int16_t>((src[i + 2] * gain) >> 15);
+        dest[i + 3] = static_cast<int16_t>((src[i + 3] * gain) >> 15);
+    }
+    for (; i < samples; i++) {
+        dest[i] = static_cast<int16_t>((src[i] * gain) >> 15);
+    }
+}
+
+void GainRampQ15(const int16_t* src, int16_t* dest, size_t samples, int32_t gain_from, int32_t gain_to) {
+    if (gain_from == gain_to) {
+        GainQ15(src, dest, samples, gain_from);
+        return;
+    }
+    // 8 fractional bits keep the ramp smooth over a whole frame without overflowing int32
+    int32_t gain_q8 = gain_from << 8;
+    int32_t step_q8 = samples > 0 ? ((gain_to - gain_from) << 8) / static_cast<int32_t>(samples) : 0;
+    for (size_t i = 0; i < samples; i++) {
+        dest[i] = static_cast<int16_t>((src[i] * (gain_q8 >> 8)) >> 15);
+        gain_q8 += step_q8;
+    }
+}
+
+void MixRampQ15(const int16_t* src, int16_t* dest, size_t samples, int32_t gain_from, int32_t gain_to) {
+    int32_t gain_q8 = gain_from << 8;
+    int32_t step_q8 = samples > 0 ? ((gain_to - gain_from) << 8) / static_cast<int32_t>(samples) : 0;
+    for (size_t i = 0; i < samples; i++) {
+        int32_t value = dest[i] + ((src[i] * (gain_q8 >> 8)) >> 15);
+        dest[i] = value > INT16_MAX ? INT16_MAX : value < INT16_MIN ? INT16_MIN : static_cast<int16_t>(value);
+        gain_q8 += step_q8;
+    }
+}
+
+} // namespace AudioDsp
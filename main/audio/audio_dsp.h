@@ -0,0 +1,38 @@
+#ifndef AUDIO_DSP_H
+#define AUDIO_DSP_H
+
+#include <cstdint>
+#include <cstddef>
+
+/*
+ * Small PCM kernels for the audio hot paths (codec I/O, channel split, gain).
+ *
+ * All kernels are bit-exact with the plain per-sample loops they replace. They are plain
+ * C++, unrolled so the compiler can keep the Xtensa / RISC-V pipelines busy; no esp-dsp
+ * or PIE code is used. In-place use is allowed where noted.
+ */
+namespace AudioDsp {
+
+// Split interleaved stereo into two mono buffers
+void Deinterleave(const int16_t* interleaved, int16_t* left, int16_t* right, size_t frames);
+// Keep only the left channel; in-place (dest == interleaved) is allowed
+void ExtractLeft(const int16_t* interleaved, int16_t* dest, size_t frames);
+// Merge two mono buffers into interleaved stereo
+void Interleave(const int16_t* left, const int16_t* right, int16_t* interleaved, size_t frames);
+// Average both channels into mono; in-place is allowed
+void DownmixStereo(const int16_t* interleaved, int16_t* dest, size_t frames);
+
+// dest = clamp(src >> shift, -INT16_MAX, INT16_MAX), for 32-bit I2S slots
+void ShiftSaturateToS16(const int32_t* src, int16_t* dest, size_t samples, int shift);
+// dest = src * factor, factor in [0, 65536] (Q16 volume) so the product never overflows
+void ScaleToS32(const int16_t* src, int32_t* dest, size_t samples, int32_t factor);
+// dest = (src * gain) >> 15, gain in Q15; gain >= 32768 copies. In-place is allowed
+void GainQ15(const int16_t* src, int16_t* dest, size_t samples, int32_t gain);
+// Like GainQ15, with the gain moving linearly from gain_from to gain_to (both in [0, 32768])
+void GainRampQ15(const int16_t* src, int16_t* dest, size_t samples, int32_t gain_from, int32_t gain_to);
+// dest = saturate(dest + ((src * gain) >> 15)), gain ramping linearly as in GainRampQ15
+void MixRampQ15(const int16_t* src, int16_t* dest, size_t samples, int32_t gain_from, int32_t gain_to);
+
+} // namespace AudioDsp
+
+#endif // AUDIO_DSP_H
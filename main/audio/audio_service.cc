@@ -1,6 +1,7 @@
 #include "audio_service.h"
+#include "audio_dsp.h"
+#include <algorithm>
 #include <esp_log.h>
-#include <cstring>
 
 #if CONFIG_USE_AUDIO_PROCESSOR
 #include "processors/afe_audio_processor.h"
@@ -19,7 +20,25 @@
 #define TAG "AudioService"
 
 
-AudioService::AudioService() {
+AudioService::AudioService()
+    : decoder_channels_(MAX_DECODER_CHANNELS),
+      encoder_controller_(0, OPUS_MAX_COMPLEXITY, 0),
+      uplink_dtx_(UPLINK_DTX_HANGOVER_MS, UPLINK_DTX_PREROLL_MS, UPLINK_DTX_KEEPALIVE_MS),
+      dtx_preroll_(UPLINK_DTX_MAX_PREROLL_FRAMES),
+      audio_decode_queue_(AUDIO_TESTING_MAX_DURATION_MS / OPUS_MIN_FRAME_DURATION_MS),  // Large enough to replay the testing queue
+      audio_send_queue_(MAX_SEND_PACKETS_IN_QUEUE),
+      audio_testing_queue_(AUDIO_TESTING_MAX_DURATION_MS / OPUS_MIN_FRAME_DURATION_MS + MAX_ENCODE_TASKS_IN_QUEUE),
+      audio_encode_queue_(MAX_ENCODE_TASKS_IN_QUEUE),
+      audio_playback_queue_(MAX_PLAYBACK_TASKS_IN_QUEUE),
+      sound_playback_queue_(MAX_PLAYBACK_TASKS_IN_QUEUE),
+      // The jitter buffer holds up to another decode queue worth of packets
+      packet_pool_(2 * MAX_DECODE_PACKETS_IN_QUEUE + MAX_SEND_PACKETS_IN_QUEUE),
+      encode_task_pool_(ENCODE_TASK_POOL_SIZE),
+      playback_task_pool_(PLAYBACK_TASK_POOL_SIZE),
+      jitter_buffer_(MAX_DECODE_PACKETS_IN_QUEUE),
+      time_stretcher_(TIME_STRETCH_TARGET_MS, TIME_STRETCH_LOW_MS, TIME_STRETCH_MAX_SPEEDUP_PERCENT, TIME_STRETCH_MAX_SLOWDOWN_PERCENT),
+      sound_queue_(MAX_SOUNDS_IN_QUEUE),
+      sound_cache_(SOUND_CACHE_BUDGET_BYTES) {
     event_group_ = xEventGroupCreate();
 }
 
@@ -35,15 +54,64 @@ void AudioService::Initialize(AudioCodec* codec) {
     codec_->Start();
 
     /* Setup the audio codec */
-    opus_decoder_ = std::make_unique<OpusDecoderWrapper>(codec->output_sample_rate(), 1, OPUS_FRAME_DURATION_MS);
-    opus_encoder_ = std::make_unique<OpusEncoderWrapper>(16000, 1, OPUS_FRAME_DURATION_MS);
-    opus_encoder_->SetComplexity(0);
+    SelectDecoder(false, codec->output_sample_rate(), OPUS_FRAME_DURATION_MS);
+    SelectEncoder(OPUS_FRAME_DURATION_MS);
 
     if (codec->input_sample_rate() != 16000) {
         input_resampler_.Configure(codec->input_sample_rate(), 16000);
         reference_resampler_.Configure(codec->input_sample_rate(), 16000);
     }
 
+    /* Pre-allocate the PCM buffers of the pooled tasks, large enough for the longest frame */
+    // As many tasks as can be in flight at the shortest frame duration, each with room for the longest
+    encode_task_pool_.Prefill(ENCODE_TASK_POOL_SIZE, [](AudioTask& task) {
+        task.pcm.reserve(OPUS_FRAME_DURATION_MS * 16000 / 1000);
+    });
+    // Room for a frame lengthened by the time stretcher (up to a 15ms period)
+    int output_frame_samples = (OPUS_FRAME_DURATION_MS + 15) * codec->output_sample_rate() / 1000;
+    playback_task_pool_.Prefill(PLAYBACK_TASK_POOL_SIZE, [output_frame_samples](AudioTask& task) {
+        task.pcm.reserve(output_frame_samples);
+    });
+
+    /* Sounds are mixed over the TTS stream, which is ducked while they play */
+    output_mixer_ = std::make_unique<OutputMixer>(kAudioVoiceCount, AUDIO_CODEC_DMA_FRAME_NUM,
+        [this](int voice, std::unique_ptr<AudioTask>& task) {
+            auto& queue = voice == kAudioVoiceSound ? sound_playback_queue_ : audio_playback_queue_;
+            if (!queue.Pop(task)) {
+                return false;
+            }
+            xEventGroupSetBits(event_group_, AS_EVENT_PLAYBACK_NOT_FULL);
+            int64_t now = esp_timer_get_time();
+            latency_trace_.Record(kLatencyStagePlaybackQueue, task->enqueue_time, now);
+            if (task->capture_time != 0) {
+                latency_trace_.Record(kLatencyStageDownlink, task->capture_time, now);
+            }
+            return true;
+        },
+        [this](std::unique_ptr<AudioTask> task) {
+            debug_statistics_.playback_count++;
+#if CONFIG_USE_SERVER_AEC
+            /* Record the timestamp for server AEC */
+            if (task->timestamp > 0) {
+                std::lock_guard<std::mutex> lock(timestamp_mutex_);
+                timestamp_queue_.push_back(task->timestamp);
+            }
+#endif
+            playback_task_pool_.Release(std::move(task));
+        });
+    output_mixer_->SetVoice(kAudioVoiceStream, AUDIO_MIXER_UNITY_GAIN, false, true);
+    output_mixer_->SetVoice(kAudioVoiceSound, AUDIO_MIXER_UNITY_GAIN, true, false);
+    output_mixer_->SetDucking(AUDIO_MIXER_DUCK_GAIN, codec->output_sample_rate() * AUDIO_MIXER_DUCK_RAMP_MS / 1000);
+
+#if CONFIG_USE_AUDIO_REPLAY
+    audio_replayer_ = std::make_unique<AudioReplayer>();
+    audio_replayer_->OnListeningChange([this](bool listening) {
+        if (callbacks_.on_replay_listening) {
+            callbacks_.on_replay_listening(listening);
+        }
+    });
+#endif
+
 #if CONFIG_USE_AUDIO_PROCESSOR
     audio_processor_ = std::make_unique<AfeAudioProcessor>();
 #else
@@ -61,10 +129,23 @@ void AudioService::Initialize(AudioCodec* codec) {
 #endif
 
     audio_processor_->OnOutput([this](std::vector<int16_t>&& data) {
+        latency_trace_.Record(kLatencyStageProcessor, processor_feed_time_, esp_timer_get_time());
+        if (wake_word_bridging_.exchange(false)) {
+            StopWakeWordBridge();
+        }
+#if CONFIG_USE_UPLINK_DTX
+        GateUplinkFrame(std::move(data));
+#else
         PushTaskToEncodeQueue(kAudioTaskTypeEncodeToSendQueue, std::move(data));
+#endif
     });
 
     audio_processor_->OnVadStateChange([this](bool speaking) {
+#if CONFIG_USE_AUDIO_REPLAY
+        if (audio_replayer_->active()) {
+            audio_replayer_->Report("vad", speaking ? "1" : "0");
+        }
+#endif
         voice_detected_ = speaking;
         if (callbacks_.on_vad_change) {
             callbacks_.on_vad_change(speaking);
@@ -73,6 +154,16 @@ void AudioService::Initialize(AudioCodec* codec) {
 
     if (wake_word_) {
         wake_word_->OnWakeWordDetected([this](const std::string& wake_word) {
+#if CONFIG_USE_AUDIO_REPLAY
+            if (audio_replayer_->active()) {
+                // Bench run: report and keep detecting, without starting a conversation
+                audio_replayer_->Report("wake", wake_word.c_str());
+                wake_word_->Start();
+                return;
+            }
+#endif
+            // Keep recording until the listening stream takes over, see StopWakeWordBridge()
+            wake_word_bridging_ = true;
             if (callbacks_.on_wake_word_detected) {
                 callbacks_.on_wake_word_detected(wake_word);
             }
@@ -128,12 +219,27 @@ void AudioService::Start() {
     }, "audio_output", 2048, this, 3, &audio_output_task_handle_);
 #endif
 
+#if CONFIG_USE_SEPARATE_OPUS_TASKS
+    /* Start the opus encoder and decoder tasks, so a decode burst never delays the uplink */
+    xTaskCreatePinnedToCore([](void* arg) {
+        AudioService* audio_service = (AudioService*)arg;
+        audio_service->OpusEncodeTask();
+        vTaskDelete(NULL);
+    }, "opus_encode", 1024 * 32, this, 2, &opus_codec_task_handle_, CONFIG_OPUS_ENCODE_TASK_CORE);
+
+    xTaskCreatePinnedToCore([](void* arg) {
+        AudioService* audio_service = (AudioService*)arg;
+        audio_service->OpusDecodeTask();
+        vTaskDelete(NULL);
+    }, "opus_decode", 1024 * 16, this, 2, &opus_decode_task_handle_, CONFIG_OPUS_DECODE_TASK_CORE);
+#else
     /* Start the opus codec task */
     xTaskCreate([](void* arg) {
         AudioService* audio_service = (AudioService*)arg;
         audio_service->OpusCodecTask();
         vTaskDelete(NULL);
     }, "opus_codec", 1024 * 32, this, 2, &opus_codec_task_handle_);
+#endif
 }
 
 void AudioService::Stop() {
@@ -143,15 +249,53 @@ void AudioService::Stop() {
         AS_EVENT_WAKE_WORD_RUNNING |
         AS_EVENT_AUDIO_PROCESSOR_RUNNING);
 
-    std::lock_guard<std::mutex> lock(audio_queue_mutex_);
-    audio_encode_queue_.clear();
-    audio_decode_queue_.clear();
-    audio_playback_queue_.clear();
-    audio_testing_queue_.clear();
-    audio_queue_cv_.notify_all();
+    ReleaseQueuedTasks(audio_encode_queue_, encode_task_pool_);
+    ReleaseQueuedPackets(audio_decode_queue_);
+    ReleaseQueuedTasks(audio_playback_queue_, playback_task_pool_);
+    ReleaseQueuedTasks(sound_playback_queue_, playback_task_pool_);
+    ReleaseQueuedPackets(audio_testing_queue_);
+    WakeAllQueueWaiters();
+}
+
+// Emptied queues give their objects back, so the next turn does not allocate them again
+size_t AudioService::ReleaseQueuedPackets(RingQueue<std::unique_ptr<AudioStreamPacket>>& queue) {
+    return queue.Drain([this](std::unique_ptr<AudioStreamPacket>&& packet) {
+        packet_pool_.Release(std::move(packet));
+    });
+}
+
+size_t AudioService::ReleaseQueuedTasks(RingQueue<std::unique_ptr<AudioTask>>& queue, ObjectPool<AudioTask>& pool) {
+    return queue.Drain([&pool](std::unique_ptr<AudioTask>&& task) {
+        pool.Release(std::move(task));
+    });
+}
+
+void AudioService::WakeAllQueueWaiters() {
+    xEventGroupSetBits(event_group_, AS_EVENT_PLAYBACK_NOT_EMPTY | AS_EVENT_PLAYBACK_NOT_FULL |
+        AS_EVENT_ENCODE_NOT_EMPTY | AS_EVENT_ENCODE_NOT_FULL |
+        AS_EVENT_DECODE_NOT_EMPTY | AS_EVENT_DECODE_NOT_FULL |
+        AS_EVENT_SEND_NOT_FULL);
 }
 
 bool AudioService::ReadAudioData(std::vector<int16_t>& data, int sample_rate, int samples) {
+#if CONFIG_USE_AUDIO_REPLAY
+    /* Replayed audio replaces the microphone, paced by the host instead of the codec */
+    if (audio_replayer_->active() && sample_rate == 16000) {
+        int channels = codec_->input_channels();
+        auto& replay = mic_channel_buffer_;
+        replay.resize(samples);
+        if (audio_replayer_->Read(replay.data(), samples)) {
+            // The reference channel, if any, stays silent
+            data.assign(samples * channels, 0);
+            for (int i = 0; i < samples; i++) {
+                data[i * channels] = replay[i];
+            }
+            debug_statistics_.input_count++;
+            return true;
+        }
+    }
+#endif
+
     if (!codec_->input_enabled()) {
         esp_timer_stop(audio_power_timer_);
         esp_timer_start_periodic(audio_power_timer_, AUDIO_POWER_CHECK_INTERVAL_MS * 1000);
@@ -160,35 +304,39 @@ bool AudioService::ReadAudioData(std::vector<int16_t>& data, int sample_rate, in
 
     if (codec_->input_sample_rate() != sample_rate) {
         data.resize(samples * codec_->input_sample_rate() / sample_rate * codec_->input_channels());
+        int64_t read_time = esp_timer_get_time();
         if (!codec_->InputData(data)) {
             return false;
         }
+        latency_trace_.Record(kLatencyStageCodecRead, read_time, esp_timer_get_time());
         if (codec_->input_channels() == 2) {
-            auto mic_channel = std::vector<int16_t>(data.size() / 2);
-            auto reference_channel = std::vector<int16_t>(data.size() / 2);
-            for (size_t i = 0, j = 0; i < mic_channel.size(); ++i, j += 2) {
-                mic_channel[i] = data[j];
-                reference_channel[i] = data[j + 1];
-            }
-            auto resampled_mic = std::vector<int16_t>(input_resampler_.GetOutputSamples(mic_channel.size()));
-            auto resampled_reference = std::vector<int16_t>(reference_resampler_.GetOutputSamples(reference_channel.size()));
+            auto& mic_channel = mic_channel_buffer_;
+            auto& reference_channel = reference_channel_buffer_;
+            mic_channel.resize(data.size() / 2);
+            reference_channel.resize(data.size() / 2);
+            AudioDsp::Deinterleave(data.data(), mic_channel.data(), reference_channel.data(), mic_channel.size());
+            auto& resampled_mic = resampled_mic_buffer_;
+            auto& resampled_reference = resampled_reference_buffer_;
+            resampled_mic.resize(input_resampler_.GetOutputSamples(mic_channel.size()));
+            resampled_reference.resize(reference_resampler_.GetOutputSamples(reference_channel.size()));
             input_resampler_.Process(mic_channel.data(), mic_channel.size(), resampled_mic.data());
             reference_resampler_.Process(reference_channel.data(), reference_channel.size(), resampled_reference.data());
             data.resize(resampled_mic.size() + resampled_reference.size());
-            for (size_t i = 0, j = 0; i < resampled_mic.size(); ++i, j += 2) {
-                data[j] = resampled_mic[i];
-                data[j + 1] = resampled_reference[i];
-            }
+            AudioDsp::Interleave(resampled_mic.data(), resampled_reference.data(), data.data(), resampled_mic.size());
         } else {
-            auto resampled = std::vector<int16_t>(input_resampler_.GetOutputSamples(data.size()));
+            auto& resampled = resampled_mic_buffer_;
+            resampled.resize(input_resampler_.GetOutputSamples(data.size()));
             input_resampler_.Process(data.data(), data.size(), resampled.data());
-            data = std::move(resampled);
+            // Swap instead of move, so both buffers keep their capacity for the next read
+            data.swap(resampled);
         }
     } else {
         data.resize(samples * codec_->input_channels());
+        int64_t read_time = esp_timer_get_time();
         if (!codec_->InputData(data)) {
             return false;
         }
+        latency_trace_.Record(kLatencyStageCodecRead, read_time, esp_timer_get_time());
     }
 
     /* Update the last input time */
@@ -207,6 +355,8 @@ bool AudioService::ReadAudioData(std::vector<int16_t>& data, int sample_rate, in
 }
 
 void AudioService::AudioInputTask() {
+    /* Reuse one buffer for all reads, consumers swap it with a pooled buffer of the same size */
+    auto& data = input_buffer_;
     while (true) {
         EventBits_t bits = xEventGroupWaitBits(event_group_, AS_EVENT_AUDIO_TESTING_RUNNING |
             AS_EVENT_WAKE_WORD_RUNNING | AS_EVENT_AUDIO_PROCESSOR_RUNNING,
@@ -223,21 +373,17 @@ void AudioService::AudioInputTask() {
 
         /* Used for audio testing in NetworkConfiguring mode by clicking the BOOT button */
         if (bits & AS_EVENT_AUDIO_TESTING_RUNNING) {
-            if (audio_testing_queue_.size() >= AUDIO_TESTING_MAX_DURATION_MS / OPUS_FRAME_DURATION_MS) {
+            if (audio_testing_queue_.size() >= AUDIO_TESTING_MAX_DURATION_MS / frame_duration_ms_) {
                 ESP_LOGW(TAG, "Audio testing queue is full, stopping audio testing");
                 EnableAudioTesting(false);
                 continue;
             }
-            std::vector<int16_t> data;
-            int samples = OPUS_FRAME_DURATION_MS * 16000 / 1000;
+            int samples = frame_duration_ms_ * 16000 / 1000;
             if (ReadAudioData(data, 16000, samples)) {
-                // If input channels is 2, we need to fetch the left channel data
+                // If input channels is 2, we need to fetch the left channel data (in place)
                 if (codec_->input_channels() == 2) {
-                    auto mono_data = std::vector<int16_t>(data.size() / 2);
-                    for (size_t i = 0, j = 0; i < mono_data.size(); ++i, j += 2) {
-                        mono_data[i] = data[j];
-                    }
-                    data = std::move(mono_data);
+                    AudioDsp::ExtractLeft(data.data(), data.data(), data.size() / 2);
+                    data.resize(data.size() / 2);
                 }
                 PushTaskToEncodeQueue(kAudioTaskTypeEncodeToTestingQueue, std::move(data));
                 continue;
@@ -246,11 +392,16 @@ void AudioService::AudioInputTask() {
 
         /* Feed the wake word */
         if (bits & AS_EVENT_WAKE_WORD_RUNNING) {
-            std::vector<int16_t> data;
             int samples = wake_word_->GetFeedSize();
             if (samples > 0) {
                 if (ReadAudioData(data, 16000, samples)) {
+#if CONFIG_USE_AUDIO_REPLAY
+                    int64_t feed_start = esp_timer_get_time();
                     wake_word_->Feed(data);
+                    audio_replayer_->AddFeedTime(esp_timer_get_time() - feed_start);
+#else
+                    wake_word_->Feed(data);
+#endif
                     continue;
                 }
             }
@@ -258,11 +409,20 @@ void AudioService::AudioInputTask() {
 
         /* Feed the audio processor */
         if (bits & AS_EVENT_AUDIO_PROCESSOR_RUNNING) {
-            std::vector<int16_t> data;
             int samples = audio_processor_->GetFeedSize();
             if (samples > 0) {
+                int64_t capture_time = esp_timer_get_time();
                 if (ReadAudioData(data, 16000, samples)) {
+                    capture_time_ = capture_time;
+                    if (wake_word_bridging_) {
+                        // Until the processor's first frame, so its start is covered by the pre-roll
+                        wake_word_->Feed(data);
+                    }
+                    processor_feed_time_ = esp_timer_get_time();
                     audio_processor_->Feed(std::move(data));
+#if CONFIG_USE_AUDIO_REPLAY
+                    audio_replayer_->AddFeedTime(esp_timer_get_time() - processor_feed_time_);
+#endif
                     continue;
                 }
             }
@@ -276,207 +436,564 @@ void AudioService::AudioInputTask() {
 }
 
 void AudioService::AudioOutputTask() {
-    while (true) {
-        std::unique_lock<std::mutex> lock(audio_queue_mutex_);
-        audio_queue_cv_.wait(lock, [this]() { return !audio_playback_queue_.empty() || service_stopped_; });
-        if (service_stopped_) {
-            break;
+    while (!service_stopped_) {
+        auto pcm = output_mixer_->Next();
+        if (pcm == nullptr) {
+            xEventGroupWaitBits(event_group_, AS_EVENT_PLAYBACK_NOT_EMPTY, pdTRUE, pdFALSE, portMAX_DELAY);
+            continue;
         }
 
-        auto task = std::move(audio_playback_queue_.front());
-        audio_playback_queue_.pop_front();
-        audio_queue_cv_.notify_all();
-        lock.unlock();
-
         if (!codec_->output_enabled()) {
             esp_timer_stop(audio_power_timer_);
             esp_timer_start_periodic(audio_power_timer_, AUDIO_POWER_CHECK_INTERVAL_MS * 1000);
             codec_->EnableOutput(true);
         }
-        codec_->OutputData(task->pcm);
+        int64_t write_time = esp_timer_get_time();
+        codec_->OutputData(*pcm);
+        latency_trace_.Record(kLatencyStageDmaWrite, write_time, esp_timer_get_time());
 
         /* Update the last output time */
         last_output_time_ = std::chrono::steady_clock::now();
-        debug_statistics_.playback_count++;
-
-#if CONFIG_USE_SERVER_AEC
-        /* Record the timestamp for server AEC */
-        if (task->timestamp > 0) {
-            lock.lock();
-            timestamp_queue_.push_back(task->timestamp);
-        }
-#endif
     }
+    output_mixer_->Reset();
 
     ESP_LOGW(TAG, "Audio output task stopped");
 }
 
 void AudioService::OpusCodecTask() {
-    while (true) {
-        std::unique_lock<std::mutex> lock(audio_queue_mutex_);
-        audio_queue_cv_.wait(lock, [this]() {
-            return service_stopped_ ||
-                (!audio_encode_queue_.empty() && audio_send_queue_.size() < MAX_SEND_PACKETS_IN_QUEUE) ||
-                (!audio_decode_queue_.empty() && audio_playback_queue_.size() < MAX_PLAYBACK_TASKS_IN_QUEUE);
-        });
-        if (service_stopped_) {
-            break;
+    while (!service_stopped_) {
+        bool decode_pending, jitter_holding, encode_pending;
+        bool decoded = DecodeNextPacket(decode_pending, jitter_holding);
+        bool encoded = EncodeNextTask(encode_pending);
+
+        if (!decoded && !encoded) {
+            /* Only wait for the "not full" bits of the queues we actually have work for */
+            EventBits_t wait_bits = AS_EVENT_DECODE_NOT_EMPTY | AS_EVENT_ENCODE_NOT_EMPTY;
+            if (decode_pending) {
+                wait_bits |= AS_EVENT_PLAYBACK_NOT_FULL;
+            }
+            if (encode_pending) {
+                wait_bits |= AS_EVENT_SEND_NOT_FULL;
+            }
+            // The jitter buffer may be holding packets back for a gap; look again after a short while
+            TickType_t timeout = jitter_holding ? pdMS_TO_TICKS(JITTER_BUFFER_POLL_MS) : portMAX_DELAY;
+            xEventGroupWaitBits(event_group_, wait_bits, pdTRUE, pdFALSE, timeout);
         }
+    }
 
-        /* Decode the audio from decode queue */
-        if (!audio_decode_queue_.empty() && audio_playback_queue_.size() < MAX_PLAYBACK_TASKS_IN_QUEUE) {
-            auto packet = std::move(audio_decode_queue_.front());
-            audio_decode_queue_.pop_front();
-            audio_queue_cv_.notify_all();
-            lock.unlock();
-
-            auto task = std::make_unique<AudioTask>();
-            task->type = kAudioTaskTypeDecodeToPlaybackQueue;
-            task->timestamp = packet->timestamp;
-
-            SetDecodeSampleRate(packet->sample_rate, packet->frame_duration);
-            if (opus_decoder_->Decode(std::move(packet->payload), task->pcm)) {
-                // Resample if the sample rate is different
-                if (opus_decoder_->sample_rate() != codec_->output_sample_rate()) {
-                    int target_size = output_resampler_.GetOutputSamples(task->pcm.size());
-                    std::vector<int16_t> resampled(target_size);
-                    output_resampler_.Process(task->pcm.data(), task->pcm.size(), resampled.data());
-                    task->pcm = std::move(resampled);
-                }
+    ESP_LOGW(TAG, "Opus codec task stopped");
+}
 
-                lock.lock();
-                audio_playback_queue_.push_back(std::move(task));
-                audio_queue_cv_.notify_all();
-            } else {
-                ESP_LOGE(TAG, "Failed to decode audio");
-                lock.lock();
+void AudioService::OpusDecodeTask() {
+    while (!service_stopped_) {
+        bool decode_pending, jitter_holding;
+        if (!DecodeNextPacket(decode_pending, jitter_holding)) {
+            EventBits_t wait_bits = AS_EVENT_DECODE_NOT_EMPTY;
+            if (decode_pending) {
+                wait_bits |= AS_EVENT_PLAYBACK_NOT_FULL;
             }
-            debug_statistics_.decode_count++;
-        }
-        
-        /* Encode the audio to send queue */
-        if (!audio_encode_queue_.empty() && audio_send_queue_.size() < MAX_SEND_PACKETS_IN_QUEUE) {
-            auto task = std::move(audio_encode_queue_.front());
-            audio_encode_queue_.pop_front();
-            audio_queue_cv_.notify_all();
-            lock.unlock();
-
-            auto packet = std::make_unique<AudioStreamPacket>();
-            packet->frame_duration = OPUS_FRAME_DURATION_MS;
-            packet->sample_rate = 16000;
-            packet->timestamp = task->timestamp;
-            if (!opus_encoder_->Encode(std::move(task->pcm), packet->payload)) {
-                ESP_LOGE(TAG, "Failed to encode audio");
-                continue;
+            TickType_t timeout = jitter_holding ? pdMS_TO_TICKS(JITTER_BUFFER_POLL_MS) : portMAX_DELAY;
+            xEventGroupWaitBits(event_group_, wait_bits, pdTRUE, pdFALSE, timeout);
+        }
+    }
+
+    ESP_LOGW(TAG, "Opus decode task stopped");
+}
+
+void AudioService::OpusEncodeTask() {
+    while (!service_stopped_) {
+        bool encode_pending;
+        if (!EncodeNextTask(encode_pending)) {
+            EventBits_t wait_bits = AS_EVENT_ENCODE_NOT_EMPTY;
+            if (encode_pending) {
+                wait_bits |= AS_EVENT_SEND_NOT_FULL;
             }
+            xEventGroupWaitBits(event_group_, wait_bits, pdTRUE, pdFALSE, portMAX_DELAY);
+        }
+    }
+
+    ESP_LOGW(TAG, "Opus encode task stopped");
+}
+
+bool AudioService::DecodeNextPacket(bool& decode_pending, bool& jitter_holding) {
+    // Only this task touches the decoders, so a reset requested by another task is done here
+    if (decoder_reset_.exchange(false)) {
+        decoder_channels_.ForEach([](DecoderChannel& channel) {
+            channel.decoder->ResetState();
+        });
+    }
 
-            if (task->type == kAudioTaskTypeEncodeToSendQueue) {
-                {
-                    std::lock_guard<std::mutex> lock(audio_queue_mutex_);
-                    audio_send_queue_.push_back(std::move(packet));
+    /* Move arrived packets into the jitter buffer and take the next one to play */
+    int64_t now_ms = esp_timer_get_time() / 1000;
+    std::unique_ptr<AudioStreamPacket> packet;
+    bool conceal = false;
+    bool local = false;
+    std::shared_ptr<const SoundClip> clip;
+    std::shared_ptr<SoundClip> recording;
+    size_t clip_offset = 0;
+    size_t clip_samples = 0;
+    int64_t sound_queued_time = 0;
+    int buffered_ms = 0;
+    {
+        std::lock_guard<std::mutex> lock(decoder_input_mutex_);
+        while (!local_packet_ && !jitter_buffer_.full() && audio_decode_queue_.Pop(packet)) {
+            xEventGroupSetBits(event_group_, AS_EVENT_DECODE_NOT_FULL);
+            if (packet->local) {
+                // Local sounds are not paced by the network, they skip the jitter buffer
+                local_packet_ = std::move(packet);
+                local_packet_is_sound_ = false;
+            } else if (!jitter_buffer_.Put(packet, now_ms)) {
+                packet_pool_.Release(std::move(packet));
+            }
+        }
+        if (!local_packet_ && !playing_clip_) {
+            local_packet_is_sound_ = NextSoundPacket(local_packet_);
+        }
+        // Sounds and the stream have their own playback queues, so one never waits for the other
+        bool sound_room = sound_playback_queue_.size() < MAX_PLAYBACK_TASKS_IN_QUEUE;
+        if (sound_room && (playing_clip_ || local_packet_)) {
+            if (playing_clip_) {
+                // Cached sounds bypass the decoder, one frame at a time
+                clip = playing_clip_;
+                clip_offset = playing_clip_offset_;
+                clip_samples = std::min<size_t>(codec_->output_sample_rate() * OPUS_FRAME_DURATION_MS / 1000,
+                    clip->samples() - clip_offset);
+                playing_clip_offset_ += clip_samples;
+                if (playing_clip_offset_ >= clip->samples()) {
+                    playing_clip_.reset();
+                    sound_active_ = false;
+                    pending_sounds_--;
                 }
-                if (callbacks_.on_send_queue_available) {
-                    callbacks_.on_send_queue_available();
+            } else {
+                packet = std::move(local_packet_);
+                local = true;
+                if (local_packet_is_sound_) {
+                    recording = recording_clip_;
                 }
-            } else if (task->type == kAudioTaskTypeEncodeToTestingQueue) {
-                std::lock_guard<std::mutex> lock(audio_queue_mutex_);
-                audio_testing_queue_.push_back(std::move(packet));
             }
-            debug_statistics_.encode_count++;
-            lock.lock();
+            if (sound_queued_time_ != 0) {
+                sound_queued_time = sound_queued_time_;
+                sound_queued_time_ = 0;
+            }
+        } else if (audio_playback_queue_.size() < MAX_PLAYBACK_TASKS_IN_QUEUE) {
+            conceal = jitter_buffer_.Pop(packet, now_ms) == JitterBuffer::kPopLost;
+            if (packet) {
+                stream_sample_rate_ = packet->sample_rate;
+                stream_frame_duration_ = packet->frame_duration;
+            }
+            buffered_ms = (jitter_buffer_.size() + audio_decode_queue_.size()) * stream_frame_duration_;
         }
+        jitter_holding = !jitter_buffer_.empty();
+        decode_pending = jitter_holding || local_packet_ || playing_clip_ || !audio_decode_queue_.empty();
     }
 
-    ESP_LOGW(TAG, "Opus codec task stopped");
+    if (clip) {
+        auto task = playback_task_pool_.Acquire();
+        task->type = kAudioTaskTypeDecodeToPlaybackQueue;
+        task->timestamp = 0;
+        task->capture_time = 0;
+        task->pcm.assign(clip->data() + clip_offset, clip->data() + clip_offset + clip_samples);
+        task->enqueue_time = esp_timer_get_time();
+        if (sound_queued_time != 0) {
+            sound_first_sample_.Add(task->enqueue_time - sound_queued_time);
+        }
+        sound_playback_queue_.Push(std::move(task));
+        xEventGroupSetBits(event_group_, AS_EVENT_PLAYBACK_NOT_EMPTY);
+        return true;
+    }
+
+    if (!packet && !conceal) {
+        return false;
+    }
+
+    /* Decode the packet, or let the decoder conceal a lost one */
+    int64_t start_time = esp_timer_get_time();
+    auto task = playback_task_pool_.Acquire();
+    task->type = kAudioTaskTypeDecodeToPlaybackQueue;
+    bool decoded;
+    if (packet) {
+        task->timestamp = packet->timestamp;
+        task->capture_time = local ? 0 : packet->queue_time;
+        if (!local) {
+            latency_trace_.Record(kLatencyStageDecodeQueue, packet->queue_time, start_time);
+        }
+        SelectDecoder(local, packet->sample_rate, packet->frame_duration);
+        decoded = opus_decoder_->Decode(std::move(packet->payload), task->pcm);
+        packet_pool_.Release(std::move(packet));
+    } else {
+        // Conceal with the decoder of the network stream, not the one of a sound played in between
+        task->timestamp = 0;
+        task->capture_time = 0;
+        if (stream_sample_rate_ > 0) {
+            SelectDecoder(false, stream_sample_rate_, stream_frame_duration_);
+        }
+        decoded = ConcealLostPacket(task->pcm);
+    }
+
+    if (decoded) {
+        // Resample if the sample rate is different
+        if (opus_decoder_->sample_rate() != codec_->output_sample_rate()) {
+            auto& resampled = output_resample_buffer_;
+            resampled.resize(output_resampler_->GetOutputSamples(task->pcm.size()));
+            output_resampler_->Process(task->pcm.data(), task->pcm.size(), resampled.data());
+            task->pcm.swap(resampled);
+        }
+        if (recording && !recording->Append(task->pcm.data(), task->pcm.size())) {
+            ESP_LOGW(TAG, "No memory to cache sound");
+            StopSoundRecording(recording);
+        }
+#if CONFIG_USE_PLAYBACK_TIME_STRETCH
+        if (!local) {
+            time_stretcher_.Process(task->pcm, codec_->output_sample_rate(), buffered_ms);
+        }
+#endif
+
+        task->enqueue_time = esp_timer_get_time();
+        latency_trace_.Record(kLatencyStageDecode, start_time, task->enqueue_time);
+        if (sound_queued_time != 0) {
+            sound_first_sample_.Add(task->enqueue_time - sound_queued_time);
+        }
+        // The decoder is the only producer, so the room checked above is still there
+        (local ? sound_playback_queue_ : audio_playback_queue_).Push(std::move(task));
+        xEventGroupSetBits(event_group_, AS_EVENT_PLAYBACK_NOT_EMPTY);
+    } else {
+        ESP_LOGE(TAG, "Failed to decode audio");
+        playback_task_pool_.Release(std::move(task));
+        if (recording) {
+            StopSoundRecording(recording);
+        }
+    }
+    debug_statistics_.decode_count++;
+    return true;
+}
+
+bool AudioService::EncodeNextTask(bool& encode_pending) {
+    encode_pending = !audio_encode_queue_.empty();
+
+    /* Encode the audio to send queue */
+    std::unique_ptr<AudioTask> task;
+    if (!encode_pending || audio_send_queue_.size() >= max_send_packets() || !audio_encode_queue_.Pop(task)) {
+        return false;
+    }
+    xEventGroupSetBits(event_group_, AS_EVENT_ENCODE_NOT_FULL);
+
+    int64_t start_time = esp_timer_get_time();
+    latency_trace_.Record(kLatencyStageEncodeQueue, task->enqueue_time, start_time);
+
+    // The frame size of the task decides, so frames queued before a duration change still encode
+    int frame_duration = task->pcm.size() * 1000 / 16000;
+    if (frame_duration != encoder_frame_duration_ && Protocol::IsSupportedFrameDuration(frame_duration)) {
+        SelectEncoder(frame_duration);
+    }
+
+    auto packet = packet_pool_.Acquire();
+    packet->frame_duration = encoder_frame_duration_;
+    packet->sample_rate = 16000;
+    packet->timestamp = task->timestamp;
+    packet->sequence = 0;
+    packet->local = false;
+    packet->capture_time = task->capture_time;
+    auto type = task->type;
+    bool encoded = opus_encoder_->Encode(std::move(task->pcm), packet->payload);
+    encode_task_pool_.Release(std::move(task));
+    packet->queue_time = esp_timer_get_time();
+    latency_trace_.Record(kLatencyStageEncode, start_time, packet->queue_time);
+    UpdateEncoderComplexity(packet->queue_time - start_time);
+    if (!encoded) {
+        ESP_LOGE(TAG, "Failed to encode audio");
+        packet_pool_.Release(std::move(packet));
+        return true;
+    }
+
+    if (type == kAudioTaskTypeEncodeToSendQueue) {
+#if CONFIG_USE_UPLINK_DTX
+        // Hangover and keepalive frames, an estimate of what a suppressed frame would have cost
+        if (uplink_dtx_gating_ && !voice_detected_) {
+            uplink_dtx_.AddSilentFrameBytes(packet->payload.size());
+        }
+#endif
+        audio_send_queue_.Push(std::move(packet));
+        if (callbacks_.on_send_queue_available) {
+            callbacks_.on_send_queue_available();
+        }
+    } else if (type == kAudioTaskTypeEncodeToTestingQueue) {
+        if (!audio_testing_queue_.Push(std::move(packet))) {
+            packet_pool_.Release(std::move(packet));
+        }
+    }
+    debug_statistics_.encode_count++;
+    return true;
+}
+
+void AudioService::UpdateEncoderComplexity(int64_t encode_us) {
+#if CONFIG_USE_ADAPTIVE_OPUS_COMPLEXITY
+#if CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+    // Idle share of the core this task runs on, both counters are in run time ticks
+    int64_t now = esp_timer_get_time();
+    if (now - cpu_idle_sample_time_ >= CPU_IDLE_SAMPLE_INTERVAL_US) {
+        uint32_t idle = ulTaskGetIdleRunTimeCounter();
+        uint32_t total = portGET_RUN_TIME_COUNTER_VALUE();
+        if (cpu_idle_sample_time_ != 0 && total != total_run_time_) {
+            cpu_idle_percent_ = std::min<uint32_t>(100, (uint64_t)(idle - idle_run_time_) * 100 / (total - total_run_time_));
+        }
+        idle_run_time_ = idle;
+        total_run_time_ = total;
+        cpu_idle_sample_time_ = now;
+    }
+#endif
+    int previous = encoder_controller_.complexity();
+    if (encoder_controller_.Update(encode_us, encoder_frame_duration_ * 1000, audio_send_queue_.size(),
+            max_send_packets(), cpu_idle_percent_)) {
+        auto& s = encoder_controller_.statistics();
+        opus_encoder_->SetComplexity(s.complexity);
+        ESP_LOGI(TAG, "Opus complexity %d -> %d (%s): encode load %lu%%, send queue %u/%d, cpu idle %d%%",
+            previous, s.complexity, EncoderController::ReasonName(s.last_reason), s.encode_load_permille / 10,
+            (unsigned)audio_send_queue_.size(), (int)max_send_packets(), s.cpu_idle_percent);
+    }
+#endif
+}
+
+void AudioService::SelectEncoder(int frame_duration) {
+    // Once per session at most, the encoder state does not carry over to another frame size
+    if (opus_encoder_ != nullptr) {
+        ESP_LOGI(TAG, "Opus encoder frame duration %d -> %d ms", encoder_frame_duration_, frame_duration);
+    }
+    opus_encoder_.reset();
+    opus_encoder_ = std::make_unique<OpusEncoderWrapper>(16000, 1, frame_duration);
+    opus_encoder_->SetComplexity(encoder_controller_.complexity());
+    encoder_frame_duration_ = frame_duration;
 }
 
-void AudioService::SetDecodeSampleRate(int sample_rate, int frame_duration) {
-    if (opus_decoder_->sample_rate() == sample_rate && opus_decoder_->duration_ms() == frame_duration) {
+void AudioService::SelectDecoder(bool local, int sample_rate, int frame_duration) {
+    int64_t start_time = esp_timer_get_time();
+    bool created = false;
+    auto channel = decoder_channels_.Select(local, sample_rate, frame_duration, start_time, created);
+    if (channel == decoder_channel_ && !created) {
         return;
     }
 
-    opus_decoder_.reset();
-    opus_decoder_ = std::make_unique<OpusDecoderWrapper>(sample_rate, 1, frame_duration);
+    if (created) {
+        channel->decoder.reset();
+        channel->decoder = std::make_unique<OpusDecoderWrapper>(sample_rate, 1, frame_duration);
+        if (sample_rate != codec_->output_sample_rate()) {
+            ESP_LOGI(TAG, "Resampling audio from %d to %d", sample_rate, codec_->output_sample_rate());
+            channel->resampler.Configure(sample_rate, codec_->output_sample_rate());
+        }
+        debug_statistics_.decoder_creations++;
+    }
+
+    decoder_channel_ = channel;
+    opus_decoder_ = channel->decoder.get();
+    output_resampler_ = &channel->resampler;
+    debug_statistics_.decoder_switches++;
+    debug_statistics_.decoder_switch_time.Add(esp_timer_get_time() - start_time);
+}
 
-    auto codec = Board::GetInstance().GetAudioCodec();
-    if (opus_decoder_->sample_rate() != codec->output_sample_rate()) {
-        ESP_LOGI(TAG, "Resampling audio from %d to %d", opus_decoder_->sample_rate(), codec->output_sample_rate());
-        output_resampler_.Configure(opus_decoder_->sample_rate(), codec->output_sample_rate());
+bool AudioService::ConcealLostPacket(std::vector<int16_t>& pcm) {
+    // An empty packet makes the decoder extrapolate the last frame (PLC)
+    std::vector<uint8_t> empty;
+    if (opus_decoder_->Decode(std::move(empty), pcm) && !pcm.empty()) {
+        return true;
     }
+    // Fall back to silence, so the playback clock still advances by one frame
+    pcm.assign(opus_decoder_->sample_rate() * opus_decoder_->duration_ms() / 1000, 0);
+    return true;
 }
 
 void AudioService::PushTaskToEncodeQueue(AudioTaskType type, std::vector<int16_t>&& pcm, uint32_t timestamp, bool wait) {
-    auto task = std::make_unique<AudioTask>();
+    QueueEncodeTask(MakeEncodeTask(type, std::move(pcm), timestamp), wait);
+}
+
+std::unique_ptr<AudioTask> AudioService::MakeEncodeTask(AudioTaskType type, std::vector<int16_t>&& pcm, uint32_t timestamp) {
+    auto task = encode_task_pool_.Acquire();
     task->type = type;
-    task->pcm = std::move(pcm);
+    // Swap instead of move, so the caller gets back a buffer of the same capacity
+    task->pcm.swap(pcm);
     task->timestamp = timestamp;
-
-    /* Push the task to the encode queue */
-    std::unique_lock<std::mutex> lock(audio_queue_mutex_);
+    task->enqueue_time = esp_timer_get_time();
+    task->capture_time = type == kAudioTaskTypeEncodeToSendQueue ? capture_time_ : 0;
 
     /* If the task is to send queue, we need to set the timestamp */
-    if (type == kAudioTaskTypeEncodeToSendQueue && timestamp == 0xFFFFFFFF && !timestamp_queue_.empty()) {
-        if (timestamp_queue_.size() <= MAX_TIMESTAMPS_IN_QUEUE) {
-            task->timestamp = timestamp_queue_.front();
-        } else {
-            ESP_LOGW(TAG, "Timestamp queue (%zu) is full, dropping timestamp", timestamp_queue_.size());
-        }
-        timestamp_queue_.pop_front();
-    } else if (timestamp == 0xFFFFFFFF) {
+    if (timestamp == 0xFFFFFFFF) {
         task->timestamp = 0;
+        if (type == kAudioTaskTypeEncodeToSendQueue) {
+            std::lock_guard<std::mutex> lock(timestamp_mutex_);
+            if (!timestamp_queue_.empty()) {
+                if (timestamp_queue_.size() <= MAX_TIMESTAMPS_IN_QUEUE) {
+                    task->timestamp = timestamp_queue_.front();
+                } else {
+                    ESP_LOGW(TAG, "Timestamp queue (%zu) is full, dropping timestamp", timestamp_queue_.size());
+                }
+                timestamp_queue_.pop_front();
+            }
+        }
     }
+    return task;
+}
 
-    /* Wait if queue is full and wait is requested */
-    if (wait) {
-        audio_queue_cv_.wait(lock, [this]() {
-            return audio_encode_queue_.size() < MAX_ENCODE_TASKS_IN_QUEUE;
-        });
-    } else {
-        /* Don't wait - drop frame if queue is full */
-        if (audio_encode_queue_.size() >= MAX_ENCODE_TASKS_IN_QUEUE) {
+void AudioService::QueueEncodeTask(std::unique_ptr<AudioTask> task, bool wait) {
+    auto type = task->type;
+
+    /* Push the task to the encode queue, wait if queue is full and wait is requested */
+    while (audio_encode_queue_.size() >= max_encode_tasks() || !audio_encode_queue_.Push(std::move(task))) {
+        if (service_stopped_) {
+            encode_task_pool_.Release(std::move(task));
+            return;
+        }
+        if (!wait) {
+            /* Don't wait - drop frame if queue is full */
             static uint32_t last_log_time = 0;
             uint32_t now = xTaskGetTickCount() * portTICK_PERIOD_MS;
             if (now - last_log_time > 1000) {
                 ESP_LOGW(TAG, "Audio encode queue is full, dropping frame (Type: %d)", type);
                 last_log_time = now;
             }
+            encode_task_pool_.Release(std::move(task));
             return;
         }
+        xEventGroupWaitBits(event_group_, AS_EVENT_ENCODE_NOT_FULL, pdTRUE, pdFALSE, portMAX_DELAY);
+    }
+    xEventGroupSetBits(event_group_, AS_EVENT_ENCODE_NOT_EMPTY);
+}
+
+void AudioService::GateUplinkFrame(std::vector<int16_t>&& pcm) {
+    // The VAD is off while device AEC runs, so there is nothing to gate on
+    bool gating = uplink_dtx_enabled_ && !device_aec_enabled_;
+    int frame_duration = pcm.size() * 1000 / 16000;
+    if (uplink_dtx_reset_.exchange(false) || gating != uplink_dtx_gating_ || frame_duration != uplink_dtx_.frame_duration_ms()) {
+        DiscardUplinkPreroll();
+        uplink_dtx_.Configure(frame_duration);
+        uplink_dtx_gating_ = gating;
+    }
+
+    // Held frames take their timestamp now, so the server AEC timestamps stay in step with playback
+    auto task = MakeEncodeTask(kAudioTaskTypeEncodeToSendQueue, std::move(pcm), 0xFFFFFFFF);
+    if (!gating) {
+        QueueEncodeTask(std::move(task), true);
+        return;
     }
 
-    audio_encode_queue_.push_back(std::move(task));
-    audio_queue_cv_.notify_all();
+    bool suppressing = uplink_dtx_.suppressing();
+    auto action = uplink_dtx_.Next(voice_detected_);
+    switch (action) {
+    case kUplinkDtxResume: {
+        size_t preroll = dtx_preroll_.size();
+        std::unique_ptr<AudioTask> held;
+        while (dtx_preroll_.Pop(held)) {
+            QueueEncodeTask(std::move(held), true);
+        }
+        QueueEncodeTask(std::move(task), true);
+        ESP_LOGD(TAG, "Uplink DTX: speech, resending %u ms of pre-roll", (unsigned)(preroll * frame_duration));
+#if CONFIG_USE_AUDIO_REPLAY
+        if (audio_replayer_->active()) {
+            audio_replayer_->Report("dtx", ("0 " + std::to_string(preroll * frame_duration)).c_str());
+        }
+#endif
+        break;
+    }
+    case kUplinkDtxKeepalive:
+        DiscardUplinkPreroll();
+        QueueEncodeTask(std::move(task), true);
+        break;
+    case kUplinkDtxHold:
+        if (uplink_dtx_.held_frames() == 0) {
+            encode_task_pool_.Release(std::move(task));
+            break;
+        }
+        if (dtx_preroll_.size() >= (size_t)uplink_dtx_.held_frames()) {
+            std::unique_ptr<AudioTask> oldest;
+            dtx_preroll_.Pop(oldest);
+            encode_task_pool_.Release(std::move(oldest));
+        }
+        dtx_preroll_.Push(std::move(task));
+        break;
+    default:
+        QueueEncodeTask(std::move(task), true);
+        break;
+    }
+
+    if (!suppressing && uplink_dtx_.suppressing()) {
+        ESP_LOGD(TAG, "Uplink DTX: silence, suppressing");
+#if CONFIG_USE_AUDIO_REPLAY
+        if (audio_replayer_->active()) {
+            audio_replayer_->Report("dtx", ("1 " + std::to_string(uplink_dtx_.statistics().saved_bytes())).c_str());
+        }
+#endif
+    }
+}
+
+void AudioService::DiscardUplinkPreroll() {
+    std::unique_ptr<AudioTask> task;
+    while (dtx_preroll_.Pop(task)) {
+        encode_task_pool_.Release(std::move(task));
+    }
+}
+
+void AudioService::EnableUplinkDtx(bool enable) {
+    if (uplink_dtx_enabled_ != enable) {
+        ESP_LOGI(TAG, "%s uplink DTX", enable ? "Enabling" : "Disabling");
+        uplink_dtx_enabled_ = enable;
+    }
 }
 
 bool AudioService::PushPacketToDecodeQueue(std::unique_ptr<AudioStreamPacket> packet, bool wait) {
-    std::unique_lock<std::mutex> lock(audio_queue_mutex_);
-    if (audio_decode_queue_.size() >= MAX_DECODE_PACKETS_IN_QUEUE) {
-        if (wait) {
-            audio_queue_cv_.wait(lock, [this]() { return audio_decode_queue_.size() < MAX_DECODE_PACKETS_IN_QUEUE; });
-        } else {
+    /* The decode queue has room for the audio testing replay, MAX_DECODE_PACKETS_IN_QUEUE is the back-pressure limit */
+    while (audio_decode_queue_.size() >= MAX_DECODE_PACKETS_IN_QUEUE) {
+        if (!wait || service_stopped_) {
+            packet_pool_.Release(std::move(packet));
             return false;
         }
+        xEventGroupWaitBits(event_group_, AS_EVENT_DECODE_NOT_FULL, pdTRUE, pdFALSE, portMAX_DELAY);
+    }
+    packet->queue_time = esp_timer_get_time();
+    if (!audio_decode_queue_.Push(std::move(packet))) {
+        packet_pool_.Release(std::move(packet));
+        return false;
+    }
+    xEventGroupSetBits(event_group_, AS_EVENT_DECODE_NOT_EMPTY);
+    return true;
+}
+
+bool AudioService::PushPacketToSendQueue(std::unique_ptr<AudioStreamPacket> packet, bool wait) {
+    while (audio_send_queue_.size() >= max_send_packets()) {
+        if (!wait || service_stopped_) {
+            packet_pool_.Release(std::move(packet));
+            return false;
+        }
+        xEventGroupWaitBits(event_group_, AS_EVENT_SEND_NOT_FULL, pdTRUE, pdFALSE, portMAX_DELAY);
+    }
+    packet->queue_time = esp_timer_get_time();
+    if (!audio_send_queue_.Push(std::move(packet))) {
+        packet_pool_.Release(std::move(packet));
+        return false;
+    }
+    if (callbacks_.on_send_queue_available) {
+        callbacks_.on_send_queue_available();
     }
-    audio_decode_queue_.push_back(std::move(packet));
-    audio_queue_cv_.notify_all();
     return true;
 }
 
 std::unique_ptr<AudioStreamPacket> AudioService::PopPacketFromSendQueue() {
-    std::lock_guard<std::mutex> lock(audio_queue_mutex_);
-    if (audio_send_queue_.empty()) {
+    std::unique_ptr<AudioStreamPacket> packet;
+    if (!audio_send_queue_.Pop(packet)) {
         return nullptr;
     }
-    auto packet = std::move(audio_send_queue_.front());
-    audio_send_queue_.pop_front();
-    audio_queue_cv_.notify_all();
+    xEventGroupSetBits(event_group_, AS_EVENT_SEND_NOT_FULL);
+    int64_t now = esp_timer_get_time();
+    latency_trace_.Record(kLatencyStageSendQueue, packet->queue_time, now);
+    if (packet->capture_time != 0) {
+        latency_trace_.Record(kLatencyStageUplink, packet->capture_time, now);
+    }
     return packet;
 }
 
-void AudioService::EncodeWakeWord() {
-    if (wake_word_) {
-        wake_word_->EncodeWakeWordData();
+size_t AudioService::PopPacketsFromSendQueue(std::vector<std::unique_ptr<AudioStreamPacket>>& packets) {
+    size_t count = 0;
+    while (auto packet = PopPacketFromSendQueue()) {
+        packets.push_back(std::move(packet));
+        count++;
     }
+    return count;
 }
 
 const std::string& AudioService::GetLastWakeWord() const {
@@ -484,13 +1001,28 @@ const std::string& AudioService::GetLastWakeWord() const {
 }
 
 std::unique_ptr<AudioStreamPacket> AudioService::PopWakeWordPacket() {
-    auto packet = std::make_unique<AudioStreamPacket>();
+    auto packet = packet_pool_.Acquire();
     if (wake_word_->GetWakeWordOpus(packet->payload)) {
+        packet->sample_rate = 16000;
+        packet->frame_duration = OPUS_FRAME_DURATION_MS;
+        packet->timestamp = 0;
+        packet->sequence = 0;
+        packet->local = false;
         return packet;
     }
+    packet_pool_.Release(std::move(packet));
     return nullptr;
 }
 
+void AudioService::StopWakeWordBridge() {
+    // The rest of the pre-roll goes out ahead of the processor's first frame, so the server gets
+    // one stream; it overlaps the processor's start by its latency instead of leaving a gap
+    wake_word_->StopBridge();
+    while (auto packet = PopWakeWordPacket()) {
+        PushPacketToSendQueue(std::move(packet));
+    }
+}
+
 void AudioService::EnableWakeWordDetection(bool enable) {
     if (!wake_word_) {
         return;
@@ -498,6 +1030,7 @@ void AudioService::EnableWakeWordDetection(bool enable) {
 
     ESP_LOGD(TAG, "%s wake word detection", enable ? "Enabling" : "Disabling");
     if (enable) {
+        wake_word_bridging_ = false;
         if (!wake_word_initialized_) {
             if (!wake_word_->Initialize(codec_)) {
                 ESP_LOGE(TAG, "Failed to initialize wake word");
@@ -517,13 +1050,16 @@ void AudioService::EnableVoiceProcessing(bool enable) {
     ESP_LOGD(TAG, "%s voice processing", enable ? "Enabling" : "Disabling");
     if (enable) {
         if (!audio_processor_initialized_) {
-            audio_processor_->Initialize(codec_, OPUS_FRAME_DURATION_MS);
+            audio_processor_->Initialize(codec_, frame_duration_ms_);
             audio_processor_initialized_ = true;
         }
 
         /* We should make sure no audio is playing */
         ResetDecoder();
-        audio_input_need_warmup_ = true;
+        // The input already runs while bridging after the wake word, a pause would cut the audio
+        audio_input_need_warmup_ = !wake_word_bridging_;
+        // A new listening turn, frames held from the last one are stale
+        uplink_dtx_reset_ = true;
         audio_processor_->Start();
         xEventGroupSetBits(event_group_, AS_EVENT_AUDIO_PROCESSOR_RUNNING);
     } else {
@@ -538,27 +1074,52 @@ void AudioService::EnableAudioTesting(bool enable) {
         xEventGroupSetBits(event_group_, AS_EVENT_AUDIO_TESTING_RUNNING);
     } else {
         xEventGroupClearBits(event_group_, AS_EVENT_AUDIO_TESTING_RUNNING);
-        /* Copy audio_testing_queue_ to audio_decode_queue_ */
-        std::lock_guard<std::mutex> lock(audio_queue_mutex_);
-        audio_decode_queue_ = std::move(audio_testing_queue_);
-        audio_queue_cv_.notify_all();
+        /* Move audio_testing_queue_ to audio_decode_queue_ */
+        ReleaseQueuedPackets(audio_decode_queue_);
+        std::unique_ptr<AudioStreamPacket> packet;
+        while (audio_testing_queue_.Pop(packet)) {
+            // The recording has no downlink sequence, it plays like a sound
+            packet->local = true;
+            if (!audio_decode_queue_.Push(std::move(packet))) {
+                break;
+            }
+        }
+        ReleaseQueuedPackets(audio_testing_queue_);
+        xEventGroupSetBits(event_group_, AS_EVENT_DECODE_NOT_EMPTY);
     }
 }
 
 void AudioService::EnableDeviceAec(bool enable) {
     ESP_LOGI(TAG, "%s device AEC", enable ? "Enabling" : "Disabling");
     if (!audio_processor_initialized_) {
-        audio_processor_->Initialize(codec_, OPUS_FRAME_DURATION_MS);
+        audio_processor_->Initialize(codec_, frame_duration_ms_);
         audio_processor_initialized_ = true;
     }
 
     audio_processor_->EnableDeviceAec(enable);
+    device_aec_enabled_ = enable;
 }
 
 void AudioService::SetCallbacks(AudioServiceCallbacks& callbacks) {
     callbacks_ = callbacks;
 }
 
+void AudioService::SetFrameDuration(int frame_duration_ms) {
+    if (!Protocol::IsSupportedFrameDuration(frame_duration_ms)) {
+        ESP_LOGW(TAG, "Unsupported frame duration %d ms", frame_duration_ms);
+        return;
+    }
+    if (frame_duration_ms == frame_duration_ms_) {
+        return;
+    }
+    ESP_LOGI(TAG, "Uplink frame duration %d -> %d ms", frame_duration_ms_.load(), frame_duration_ms);
+    frame_duration_ms_ = frame_duration_ms;
+    // The encoder follows the frames it receives, see EncodeNextTask()
+    if (audio_processor_initialized_) {
+        audio_processor_->SetFrameDuration(frame_duration_ms);
+    }
+}
+
 void AudioService::PlaySound(const std::string_view& ogg) {
     if (!codec_->output_enabled()) {
         esp_timer_stop(audio_power_timer_);
@@ -566,111 +1127,157 @@ void AudioService::PlaySound(const std::string_view& ogg) {
         codec_->EnableOutput(true);
     }
 
-    const uint8_t* buf = reinterpret_cast<const uint8_t*>(ogg.data());
-    size_t size = ogg.size();
-    size_t offset = 0;
+    // The decoder demuxes the sound when it gets to it, so this returns immediately
+    pending_sounds_++;
+    if (!sound_queue_.Push(PendingSound{ogg, esp_timer_get_time()})) {
+        pending_sounds_--;
+        ESP_LOGW(TAG, "Sound queue is full, dropping sound");
+        return;
+    }
+    xEventGroupSetBits(event_group_, AS_EVENT_DECODE_NOT_EMPTY);
+}
 
-    auto find_page = [&](size_t start)->size_t {
-        for (size_t i = start; i + 4 <= size; ++i) {
-            if (buf[i] == 'O' && buf[i+1] == 'g' && buf[i+2] == 'g' && buf[i+3] == 'S') return i;
+bool AudioService::NextSoundPacket(std::unique_ptr<AudioStreamPacket>& packet) {
+    std::string_view data;
+    while (!sound_demuxer_.NextPacket(data)) {
+        if (sound_active_) {
+            sound_active_ = false;
+            pending_sounds_--;
+            FinishSoundRecording();
         }
-        return static_cast<size_t>(-1);
-    };
+        PendingSound sound;
+        if (!sound_queue_.Pop(sound)) {
+            return false;
+        }
+        sound_active_ = true;
+        sound_queued_time_ = sound.queued_time;
+        if (StartCachedSound(sound.ogg)) {
+            return false;
+        }
+        sound_demuxer_.Reset(sound.ogg);
+    }
 
-    bool seen_head = false;
-    bool seen_tags = false;
-    int sample_rate = 16000; // 默认值
+    packet = packet_pool_.Acquire();
+    packet->sample_rate = sound_demuxer_.sample_rate();
+    packet->frame_duration = 60;
+    packet->timestamp = 0;
+    packet->sequence = 0;
+    packet->local = true;
+    // The only copy, into a pooled buffer, because the decoder takes a vector
+    packet->payload.assign(data.begin(), data.end());
+    return true;
+}
 
-    while (true) {
-        size_t pos = find_page(offset);
-        if (pos == static_cast<size_t>(-1)) break;
-        offset = pos;
-        if (offset + 27 > size) break;
-
-        const uint8_t* page = buf + offset;
-        uint8_t page_segments = page[26];
-        size_t seg_table_off = offset + 27;
-        if (seg_table_off + page_segments > size) break;
-
-        size_t body_size = 0;
-        for (size_t i = 0; i < page_segments; ++i) body_size += page[27 + i];
-
-        size_t body_off = seg_table_off + page_segments;
-        if (body_off + body_size > size) break;
-
-        // Parse packets using lacing
-        size_t cur = body_off;
-        size_t seg_idx = 0;
-        while (seg_idx < page_segments) {
-            size_t pkt_len = 0;
-            size_t pkt_start = cur;
-            bool continued = false;
-            do {
-                uint8_t l = page[27 + seg_idx++];
-                pkt_len += l;
-                cur += l;
-                continued = (l == 255);
-            } while (continued && seg_idx < page_segments);
-
-            if (pkt_len == 0) continue;
-            const uint8_t* pkt_ptr = buf + pkt_start;
-
-            if (!seen_head) {
-                // 解析OpusHead包
-                if (pkt_len >= 19 && std::memcmp(pkt_ptr, "OpusHead", 8) == 0) {
-                    seen_head = true;
-                    
-                    // OpusHead结构：[0-7] "OpusHead", [8] version, [9] channel_count, [10-11] pre_skip
-                    // [12-15] input_sample_rate, [16-17] output_gain, [18] mapping_family
-                    if (pkt_len >= 12) {
-                        uint8_t version = pkt_ptr[8];
-                        uint8_t channel_count = pkt_ptr[9];
-                        
-                        if (pkt_len >= 16) {
-                            // 读取输入采样率 (little-endian)
-                            sample_rate = pkt_ptr[12] | (pkt_ptr[13] << 8) | 
-                                        (pkt_ptr[14] << 16) | (pkt_ptr[15] << 24);
-                            ESP_LOGI(TAG, "OpusHead: version=%d, channels=%d, sample_rate=%d", 
-                                   version, channel_count, sample_rate);
-                        }
-                    }
-                }
-                continue;
-            }
-            if (!seen_tags) {
-                // Expect OpusTags in second packet
-                if (pkt_len >= 8 && std::memcmp(pkt_ptr, "OpusTags", 8) == 0) {
-                    seen_tags = true;
-                }
-                continue;
-            }
+bool AudioService::StartCachedSound(std::string_view ogg) {
+    if (sound_cache_.budget_bytes() == 0 || ogg.size() > SOUND_CACHE_MAX_CLIP_BYTES) {
+        return false;
+    }
 
-            // Audio packet (Opus)
-            auto packet = std::make_unique<AudioStreamPacket>();
-            packet->sample_rate = sample_rate;
-            packet->frame_duration = 60;
-            packet->payload.resize(pkt_len);
-            std::memcpy(packet->payload.data(), pkt_ptr, pkt_len);
-            PushPacketToDecodeQueue(std::move(packet), true);
-        }
+    int sample_rate = codec_->output_sample_rate();
+    auto clip = sound_cache_.Find(ogg.data(), ogg.size(), sample_rate);
+    if (!clip) {
+        // Not decoded up front, that would hold up the decoder for the length of the clip
+        recording_clip_ = std::make_shared<SoundClip>();
+        recording_ogg_ = ogg;
+        return false;
+    }
+    playing_clip_ = clip;
+    playing_clip_offset_ = 0;
+    return true;
+}
 
-        offset = body_off + body_size;
+void AudioService::FinishSoundRecording() {
+    if (recording_clip_ && recording_clip_->samples() > 0) {
+        recording_clip_->Shrink();
+        sound_cache_.Insert(recording_ogg_.data(), recording_ogg_.size(), codec_->output_sample_rate(), std::move(recording_clip_));
+    }
+    recording_clip_.reset();
+    recording_ogg_ = std::string_view();
+}
+
+void AudioService::StopSoundRecording(const std::shared_ptr<SoundClip>& clip) {
+    // Unless a reset or the next sound has already replaced it
+    std::lock_guard<std::mutex> lock(decoder_input_mutex_);
+    if (recording_clip_ == clip) {
+        recording_clip_.reset();
     }
 }
 
 bool AudioService::IsIdle() {
-    std::lock_guard<std::mutex> lock(audio_queue_mutex_);
-    return audio_encode_queue_.empty() && audio_decode_queue_.empty() && audio_playback_queue_.empty() && audio_testing_queue_.empty();
+    return audio_encode_queue_.empty() && audio_decode_queue_.empty() && audio_playback_queue_.empty() && audio_testing_queue_.empty()
+        && sound_playback_queue_.empty() && pending_sounds_ == 0;
+}
+
+void AudioService::LogDebugStatistics() {
+    auto& s = debug_statistics_;
+    ESP_LOGI(TAG, "Frames: %lu input, %lu encoded, %lu decoded, %lu played",
+        s.input_count, s.encode_count, s.decode_count, s.playback_count);
+    for (int i = 0; i < kLatencyStageCount; i++) {
+        auto stage = static_cast<LatencyStage>(i);
+        auto summary = latency_trace_.Summary(stage);
+        if (summary.count > 0) {
+            ESP_LOGI(TAG, "Latency %s: %lu frames, p50 %lu p95 %lu p99 %lu max %lu us", LatencyTrace::StageName(stage),
+                summary.count, summary.p50_us, summary.p95_us, summary.p99_us, summary.max_us);
+        }
+    }
+    ESP_LOGI(TAG, "Decoder: %lu switches, %lu created, %lu evicted, switch avg %lu max %lu us",
+        s.decoder_switches, s.decoder_creations, decoder_channels_.statistics().evictions,
+        s.decoder_switch_time.average_us(), s.decoder_switch_time.max_us);
+    auto& e = encoder_controller_.statistics();
+    ESP_LOGI(TAG, "Encoder: complexity %d, %lu raises, %lu lowers, last %s, encode load %lu%%, cpu idle %d%%",
+        e.complexity, e.raises, e.lowers, EncoderController::ReasonName(e.last_reason), e.encode_load_permille / 10, e.cpu_idle_percent);
+#if CONFIG_USE_PLAYBACK_TIME_STRETCH
+    auto& t = time_stretcher_.statistics();
+    ESP_LOGI(TAG, "Time stretch: %lu accelerated (%llu samples), %lu expanded (%llu samples), %lu rejected",
+        t.accelerated, (unsigned long long)t.samples_removed, t.expanded, (unsigned long long)t.samples_added, t.rejected);
+#endif
+#if CONFIG_USE_UPLINK_DTX
+    auto& d = uplink_dtx_.statistics();
+    ESP_LOGI(TAG, "Uplink DTX: %lu sent, %lu pre-roll, %lu keepalive, %lu suppressed frames, %lu onsets, about %llu bytes saved",
+        d.sent_frames, d.preroll_frames, d.keepalive_frames, d.suppressed_frames, d.onsets, (unsigned long long)d.saved_bytes());
+#endif
+}
+
+SoundCacheStatistics AudioService::GetSoundCacheStatistics() {
+    SoundCacheStatistics statistics;
+    statistics.hits = sound_cache_.hits();
+    statistics.misses = sound_cache_.misses();
+    statistics.clips = sound_cache_.size();
+    statistics.bytes_used = sound_cache_.bytes_used();
+    statistics.budget_bytes = sound_cache_.budget_bytes();
+    statistics.time_to_first_sample = sound_first_sample_;
+    return statistics;
+}
+
+JitterBufferStatistics AudioService::GetJitterBufferStatistics() {
+    std::lock_guard<std::mutex> lock(decoder_input_mutex_);
+    return jitter_buffer_.statistics();
 }
 
 void AudioService::ResetDecoder() {
-    std::lock_guard<std::mutex> lock(audio_queue_mutex_);
-    opus_decoder_->ResetState();
-    timestamp_queue_.clear();
-    audio_decode_queue_.clear();
-    audio_playback_queue_.clear();
-    audio_testing_queue_.clear();
-    audio_queue_cv_.notify_all();
+    {
+        std::lock_guard<std::mutex> lock(decoder_input_mutex_);
+        jitter_buffer_.Reset([this](std::unique_ptr<AudioStreamPacket> packet) {
+            packet_pool_.Release(std::move(packet));
+        });
+        packet_pool_.Release(std::move(local_packet_));
+        pending_sounds_ -= sound_queue_.Clear() + (sound_active_ ? 1 : 0);
+        sound_demuxer_.Reset(std::string_view());
+        playing_clip_.reset();
+        recording_clip_.reset();
+        sound_active_ = false;
+        sound_queued_time_ = 0;
+    }
+    decoder_reset_ = true;
+    {
+        std::lock_guard<std::mutex> lock(timestamp_mutex_);
+        timestamp_queue_.clear();
+    }
+    ReleaseQueuedPackets(audio_decode_queue_);
+    ReleaseQueuedTasks(audio_playback_queue_, playback_task_pool_);
+    ReleaseQueuedTasks(sound_playback_queue_, playback_task_pool_);
+    ReleaseQueuedPackets(audio_testing_queue_);
+    xEventGroupSetBits(event_group_, AS_EVENT_DECODE_NOT_FULL | AS_EVENT_PLAYBACK_NOT_FULL);
 }
 
 void AudioService::UpdateAudioActivity() {
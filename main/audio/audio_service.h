@@ -3,9 +3,10 @@
 
 #include <memory>
 #include <deque>
-#include <condition_variable>
 #include <chrono>
 #include <mutex>
+#include <atomic>
+#include <string_view>
 
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
@@ -19,28 +20,97 @@
 #include "audio_codec.h"
 #include "audio_processor.h"
 #include "processors/audio_debugger.h"
+#include "processors/audio_replayer.h"
 #include "wake_word.h"
 #include "protocol.h"
+#include "ring_queue.h"
+#include "object_pool.h"
+#include "jitter_buffer.h"
+#include "ogg_demuxer.h"
+#include "sound_cache.h"
+#include "audio_task.h"
+#include "output_mixer.h"
+#include "latency_trace.h"
+#include "encoder_controller.h"
+#include "uplink_dtx.h"
+#include "time_stretcher.h"
+#include "decoder_cache.h"
 
 
 /*
  * There are two types of audio data flow:
  * 1. (MIC) -> [Processors] -> {Encode Queue} -> [Opus Encoder] -> {Send Queue} -> (Server)
- * 2. (Server) -> {Decode Queue} -> [Opus Decoder] -> {Playback Queue} -> (Speaker)
+ * 2. (Server) -> {Decode Queue} -> [Jitter Buffer] -> [Opus Decoder] -> {Playback Queue} -> [Mixer] -> (Speaker)
+ *    (Sounds) -> [Ogg Demuxer / Sound Cache] -> [Opus Decoder] -> {Sound Playback Queue} -> [Mixer]
  *
- * We use one task for MIC / Speaker / Processors, and one task for Opus Encoder / Opus Decoder.
+ * We use one task for MIC / Speaker / Processors, and one task for Opus Encoder / Opus Decoder
+ * (or one task each, pinned to its own core, with CONFIG_USE_SEPARATE_OPUS_TASKS).
  * 
  * Decode Queue and Send Queue are the main queues, because Opus packets are quite smaller than PCM packets.
  * 
+ * Every queue is a RingQueue with its own "not empty" / "not full" event bits, so a push or pop
+ * only wakes the task that is actually waiting on that queue.
+ * 
  */
 
+// Uplink frames are 20, 40 or 60ms as negotiated in the hello (see SetFrameDuration()),
+// 60ms until then; queues are sized for the shortest and limited by duration at runtime
 #define OPUS_FRAME_DURATION_MS 60
-#define MAX_ENCODE_TASKS_IN_QUEUE 2
+#define OPUS_MIN_FRAME_DURATION_MS 20
+#define MAX_ENCODE_QUEUE_DURATION_MS 120
+#define MAX_SEND_QUEUE_DURATION_MS 2400
+#define MAX_ENCODE_TASKS_IN_QUEUE (MAX_ENCODE_QUEUE_DURATION_MS / OPUS_MIN_FRAME_DURATION_MS)
 #define MAX_PLAYBACK_TASKS_IN_QUEUE 2
 #define MAX_DECODE_PACKETS_IN_QUEUE (2400 / OPUS_FRAME_DURATION_MS)
-#define MAX_SEND_PACKETS_IN_QUEUE (2400 / OPUS_FRAME_DURATION_MS)
+#define MAX_SEND_PACKETS_IN_QUEUE (MAX_SEND_QUEUE_DURATION_MS / OPUS_MIN_FRAME_DURATION_MS)
 #define AUDIO_TESTING_MAX_DURATION_MS 10000
 #define MAX_TIMESTAMPS_IN_QUEUE 3
+#define JITTER_BUFFER_POLL_MS 10
+#define MAX_SOUNDS_IN_QUEUE 16
+#define MAX_DECODER_CHANNELS 3
+// Both playback queues, plus a frame held by each mixer voice and one being decoded
+#define PLAYBACK_TASK_POOL_SIZE (2 * MAX_PLAYBACK_TASKS_IN_QUEUE + 3)
+// One task being filled by the producer and one being consumed besides the queued and held ones
+#define ENCODE_TASK_POOL_SIZE (MAX_ENCODE_TASKS_IN_QUEUE + UPLINK_DTX_MAX_PREROLL_FRAMES + 2)
+#define AUDIO_MIXER_DUCK_GAIN (AUDIO_MIXER_UNITY_GAIN / 4)  // About -12dB for TTS under a sound
+#define AUDIO_MIXER_DUCK_RAMP_MS 30
+
+// Short UI sounds are kept decoded; without PSRAM the cache is disabled to save internal RAM
+#if CONFIG_SPIRAM
+#define SOUND_CACHE_BUDGET_BYTES (256 * 1024)
+#else
+#define SOUND_CACHE_BUDGET_BYTES 0
+#endif
+#define SOUND_CACHE_MAX_CLIP_BYTES 4096     // Size of the OGG, about 2 seconds of audio
+
+#ifdef CONFIG_USE_ADAPTIVE_OPUS_COMPLEXITY
+#define OPUS_MAX_COMPLEXITY CONFIG_OPUS_MAX_COMPLEXITY
+#else
+#define OPUS_MAX_COMPLEXITY 0
+#endif
+#define CPU_IDLE_SAMPLE_INTERVAL_US 1000000
+
+#ifdef CONFIG_USE_UPLINK_DTX
+#define UPLINK_DTX_HANGOVER_MS CONFIG_UPLINK_DTX_HANGOVER_MS
+#define UPLINK_DTX_PREROLL_MS CONFIG_UPLINK_DTX_PREROLL_MS
+#define UPLINK_DTX_KEEPALIVE_MS CONFIG_UPLINK_DTX_KEEPALIVE_MS
+#else
+#define UPLINK_DTX_HANGOVER_MS 0
+#define UPLINK_DTX_PREROLL_MS 0
+#define UPLINK_DTX_KEEPALIVE_MS 0
+#endif
+#ifdef CONFIG_USE_PLAYBACK_TIME_STRETCH
+#define TIME_STRETCH_TARGET_MS CONFIG_PLAYBACK_TIME_STRETCH_TARGET_MS
+#define TIME_STRETCH_MAX_SPEEDUP_PERCENT CONFIG_PLAYBACK_TIME_STRETCH_MAX_SPEEDUP
+#define TIME_STRETCH_MAX_SLOWDOWN_PERCENT CONFIG_PLAYBACK_TIME_STRETCH_MAX_SLOWDOWN
+#else
+#define TIME_STRETCH_TARGET_MS 0
+#define TIME_STRETCH_MAX_SPEEDUP_PERCENT 0
+#define TIME_STRETCH_MAX_SLOWDOWN_PERCENT 0
+#endif
+#define TIME_STRETCH_LOW_MS 60              // Less than a packet behind the frame being played
+// Held pre-roll frames at the shortest frame duration, rounded up
+#define UPLINK_DTX_MAX_PREROLL_FRAMES ((UPLINK_DTX_PREROLL_MS + OPUS_MIN_FRAME_DURATION_MS - 1) / OPUS_MIN_FRAME_DURATION_MS)
 
 #define AUDIO_POWER_TIMEOUT_MS 15000
 #define AUDIO_POWER_CHECK_INTERVAL_MS 1000
@@ -50,25 +120,43 @@
 #define AS_EVENT_WAKE_WORD_RUNNING          (1 << 1)
 #define AS_EVENT_AUDIO_PROCESSOR_RUNNING    (1 << 2)
 #define AS_EVENT_PLAYBACK_NOT_EMPTY         (1 << 3)
+#define AS_EVENT_PLAYBACK_NOT_FULL          (1 << 4)
+#define AS_EVENT_ENCODE_NOT_EMPTY           (1 << 5)
+#define AS_EVENT_ENCODE_NOT_FULL            (1 << 6)
+#define AS_EVENT_DECODE_NOT_EMPTY           (1 << 7)
+#define AS_EVENT_DECODE_NOT_FULL            (1 << 8)
+#define AS_EVENT_SEND_NOT_FULL              (1 << 9)
 
 struct AudioServiceCallbacks {
     std::function<void(void)> on_send_queue_available;
     std::function<void(const std::string&)> on_wake_word_detected;
     std::function<void(bool)> on_vad_change;
     std::function<void(void)> on_audio_testing_queue_full;
+    // A replay session asks for the listening pipeline (true) or is done with it (false)
+    std::function<void(bool)> on_replay_listening;
 };
 
 
-enum AudioTaskType {
-    kAudioTaskTypeEncodeToSendQueue,
-    kAudioTaskTypeEncodeToTestingQueue,
-    kAudioTaskTypeDecodeToPlaybackQueue,
+enum AudioVoice {
+    kAudioVoiceStream,
+    kAudioVoiceSound,
+    kAudioVoiceCount,
 };
 
-struct AudioTask {
-    AudioTaskType type;
-    std::vector<int16_t> pcm;
-    uint32_t timestamp;
+// Each stage is written by a single task, readers may see slightly torn totals
+struct StageTiming {
+    uint32_t count = 0;
+    uint32_t max_us = 0;
+    uint64_t total_us = 0;
+
+    void Add(int64_t us) {
+        count++;
+        total_us += us;
+        if (us > max_us) {
+            max_us = us;
+        }
+    }
+    uint32_t average_us() const { return count > 0 ? total_us / count : 0; }
 };
 
 struct DebugStatistics {
@@ -76,6 +164,18 @@ struct DebugStatistics {
     uint32_t decode_count = 0;
     uint32_t encode_count = 0;
     uint32_t playback_count = 0;
+    uint32_t decoder_switches = 0;      // Changes of the stream format
+    uint32_t decoder_creations = 0;     // Of which needed a new decoder
+    StageTiming decoder_switch_time;
+};
+
+struct SoundCacheStatistics {
+    uint32_t hits = 0;
+    uint32_t misses = 0;
+    size_t clips = 0;
+    size_t bytes_used = 0;
+    size_t budget_bytes = 0;
+    StageTiming time_to_first_sample;   // From PlaySound() to the first frame in the playback queue
 };
 
 class AudioService {
@@ -86,7 +186,6 @@ public:
     void Initialize(AudioCodec* codec);
     void Start();
     void Stop();
-    void EncodeWakeWord();
     std::unique_ptr<AudioStreamPacket> PopWakeWordPacket();
     const std::string& GetLastWakeWord() const;
     bool IsVoiceDetected() const { return voice_detected_; }
@@ -100,13 +199,35 @@ public:
     void EnableDeviceAec(bool enable);
 
     void SetCallbacks(AudioServiceCallbacks& callbacks);
+    // Uplink frame duration for the session (20 / 40 / 60ms), applied from the next frame on
+    void SetFrameDuration(int frame_duration_ms);
+    int frame_duration_ms() const { return frame_duration_ms_; }
     void UpdateAudioActivity();  // 更新音频活动时间，防止电源管理禁用音频
 
+    // Packets that do not fit go back to the pool
     bool PushPacketToDecodeQueue(std::unique_ptr<AudioStreamPacket> packet, bool wait = false);
     std::unique_ptr<AudioStreamPacket> PopPacketFromSendQueue();
+    // Appends every queued packet to packets, returns how many
+    size_t PopPacketsFromSendQueue(std::vector<std::unique_ptr<AudioStreamPacket>>& packets);
+    // Already encoded uplink audio (e.g. cached reminder TTS), sent like the encoder's output
+    bool PushPacketToSendQueue(std::unique_ptr<AudioStreamPacket> packet, bool wait = true);
+    // Packets are pooled, return them with ReleasePacket() once sent
+    std::unique_ptr<AudioStreamPacket> AcquirePacket() { return packet_pool_.Acquire(); }
+    void ReleasePacket(std::unique_ptr<AudioStreamPacket> packet) { packet_pool_.Release(std::move(packet)); }
     void PlaySound(const std::string_view& sound);
     bool ReadAudioData(std::vector<int16_t>& data, int sample_rate, int samples);
     void ResetDecoder();
+    JitterBufferStatistics GetJitterBufferStatistics();
+    const DebugStatistics& GetDebugStatistics() const { return debug_statistics_; }
+    // Per-stage latency of the capture -> send and receive -> speaker paths
+    LatencyTrace& GetLatencyTrace() { return latency_trace_; }
+    void LogDebugStatistics();
+    SoundCacheStatistics GetSoundCacheStatistics();
+    const EncoderControlStatistics& GetEncoderControlStatistics() const { return encoder_controller_.statistics(); }
+    // Realtime listening: stop streaming the processor output while the VAD reports silence
+    void EnableUplinkDtx(bool enable);
+    const UplinkDtxStatistics& GetUplinkDtxStatistics() const { return uplink_dtx_.statistics(); }
+    const TimeStretchStatistics& GetTimeStretchStatistics() const { return time_stretcher_.statistics(); }
     void PushTaskToEncodeQueue(AudioTaskType type, std::vector<int16_t>&& pcm, uint32_t timestamp = 0xFFFFFFFF, bool wait = true);
  
 private:
@@ -115,12 +236,41 @@ private:
     std::unique_ptr<AudioProcessor> audio_processor_;
     std::unique_ptr<WakeWord> wake_word_;
     std::unique_ptr<AudioDebugger> audio_debugger_;
+    std::unique_ptr<AudioReplayer> audio_replayer_;
     std::unique_ptr<OpusEncoderWrapper> opus_encoder_;
-    std::unique_ptr<OpusDecoderWrapper> opus_decoder_;
+    std::atomic<int> frame_duration_ms_{OPUS_FRAME_DURATION_MS};
+    int encoder_frame_duration_ = 0;    // Of opus_encoder_, follows the size of the PCM it is given
     OpusResampler input_resampler_;
     OpusResampler reference_resampler_;
-    OpusResampler output_resampler_;
+    // Live decoders, one per source (network stream or local sounds) and format, so a sound
+    // played between TTS sentences neither reallocates nor touches the stream's state.
+    // Used by the decoder task only, ResetDecoder() leaves the reset to it (decoder_reset_)
+    struct DecoderChannel {
+        std::unique_ptr<OpusDecoderWrapper> decoder;
+        OpusResampler resampler;    // Configured only when the rate differs from the codec output
+    };
+    DecoderCache<DecoderChannel> decoder_channels_;
+    DecoderChannel* decoder_channel_ = nullptr;     // The selected channel
+    OpusDecoderWrapper* opus_decoder_ = nullptr;
+    OpusResampler* output_resampler_ = nullptr;
+    std::atomic<bool> decoder_reset_{false};
+    int stream_sample_rate_ = 0;    // Format of the network stream, for PLC
+    int stream_frame_duration_ = 0;
     DebugStatistics debug_statistics_;
+    LatencyTrace latency_trace_;
+    EncoderController encoder_controller_;
+    // Idle time of the encoding core, sampled by the codec task
+    uint32_t idle_run_time_ = 0;
+    uint32_t total_run_time_ = 0;
+    int64_t cpu_idle_sample_time_ = 0;
+    int cpu_idle_percent_ = -1;
+    // Uplink DTX, used by the processor output callback only; the flags are set by other tasks
+    UplinkDtx uplink_dtx_;
+    RingQueue<std::unique_ptr<AudioTask>> dtx_preroll_;
+    std::atomic<bool> uplink_dtx_enabled_{false};
+    std::atomic<bool> uplink_dtx_reset_{false};
+    std::atomic<bool> uplink_dtx_gating_{false};     // Also read by the codec task
+    bool device_aec_enabled_ = false;
 
     EventGroupHandle_t event_group_;
 
@@ -128,14 +278,52 @@ private:
     TaskHandle_t audio_input_task_handle_ = nullptr;
     TaskHandle_t audio_output_task_handle_ = nullptr;
     TaskHandle_t opus_codec_task_handle_ = nullptr;
-    std::mutex audio_queue_mutex_;
-    std::condition_variable audio_queue_cv_;
-    std::deque<std::unique_ptr<AudioStreamPacket>> audio_decode_queue_;
-    std::deque<std::unique_ptr<AudioStreamPacket>> audio_send_queue_;
-    std::deque<std::unique_ptr<AudioStreamPacket>> audio_testing_queue_;
-    std::deque<std::unique_ptr<AudioTask>> audio_encode_queue_;
-    std::deque<std::unique_ptr<AudioTask>> audio_playback_queue_;
+    TaskHandle_t opus_decode_task_handle_ = nullptr;
+    RingQueue<std::unique_ptr<AudioStreamPacket>> audio_decode_queue_;
+    RingQueue<std::unique_ptr<AudioStreamPacket>> audio_send_queue_;
+    RingQueue<std::unique_ptr<AudioStreamPacket>> audio_testing_queue_;
+    RingQueue<std::unique_ptr<AudioTask>> audio_encode_queue_;
+    RingQueue<std::unique_ptr<AudioTask>> audio_playback_queue_;
+    RingQueue<std::unique_ptr<AudioTask>> sound_playback_queue_;
+    std::unique_ptr<OutputMixer> output_mixer_;    // Used by the output task only
+    // Recycled tasks and packets, so the steady state does no heap allocation
+    ObjectPool<AudioStreamPacket> packet_pool_;
+    ObjectPool<AudioTask> encode_task_pool_;
+    ObjectPool<AudioTask> playback_task_pool_;
+    // Scratch buffers of ReadAudioData() and the decoder, only grow once
+    std::vector<int16_t> input_buffer_;
+    std::vector<int16_t> mic_channel_buffer_;
+    std::vector<int16_t> reference_channel_buffer_;
+    std::vector<int16_t> resampled_mic_buffer_;
+    std::vector<int16_t> resampled_reference_buffer_;
+    std::vector<int16_t> output_resample_buffer_;
+    // Decoder inputs, owned by the decoder task; the mutex only guards against ResetDecoder()
+    // and the statistics getters, nothing slow runs under it
+    std::mutex decoder_input_mutex_;
+    JitterBuffer jitter_buffer_;
+    std::unique_ptr<AudioStreamPacket> local_packet_;
+    bool local_packet_is_sound_ = false;    // Not the audio test replay
+    // Keeps the downlink buffer near its target by playing slightly faster or slower
+    TimeStretcher time_stretcher_;
+    // Sounds are demuxed lazily by the decoder, straight from flash, or played from the cache
+    struct PendingSound {
+        std::string_view ogg;
+        int64_t queued_time;
+    };
+    RingQueue<PendingSound> sound_queue_;
+    OggDemuxer sound_demuxer_;
+    bool sound_active_ = false;
+    int64_t sound_queued_time_ = 0;
+    SoundCache sound_cache_;
+    std::shared_ptr<const SoundClip> playing_clip_;
+    size_t playing_clip_offset_ = 0;
+    // A clip missing from the cache plays like any other sound and is recorded as it is decoded
+    std::shared_ptr<SoundClip> recording_clip_;
+    std::string_view recording_ogg_;
+    StageTiming sound_first_sample_;
+    std::atomic<int> pending_sounds_{0};
     // For server AEC
+    std::mutex timestamp_mutex_;
     std::deque<uint32_t> timestamp_queue_;
 
     bool wake_word_initialized_ = false;
@@ -143,16 +331,42 @@ private:
     bool voice_detected_ = false;
     bool service_stopped_ = true;
     bool audio_input_need_warmup_ = false;
+    // From the wake word to the processor's first frame, the input feeds the pre-roll too
+    std::atomic<bool> wake_word_bridging_{false};
 
     esp_timer_handle_t audio_power_timer_ = nullptr;
     std::chrono::steady_clock::time_point last_input_time_;
     std::chrono::steady_clock::time_point last_output_time_;
+    int64_t capture_time_ = 0;          // Start of the last read fed to the processor
+    int64_t processor_feed_time_ = 0;
 
     void AudioInputTask();
     void AudioOutputTask();
     void OpusCodecTask();
-    void SetDecodeSampleRate(int sample_rate, int frame_duration);
+    void OpusEncodeTask();
+    void OpusDecodeTask();
+    bool DecodeNextPacket(bool& decode_pending, bool& jitter_holding);
+    bool EncodeNextTask(bool& encode_pending);
+    void UpdateEncoderComplexity(int64_t encode_us);
+    void SelectEncoder(int frame_duration);
+    std::unique_ptr<AudioTask> MakeEncodeTask(AudioTaskType type, std::vector<int16_t>&& pcm, uint32_t timestamp);
+    void QueueEncodeTask(std::unique_ptr<AudioTask> task, bool wait);
+    void GateUplinkFrame(std::vector<int16_t>&& pcm);
+    void DiscardUplinkPreroll();
+    void StopWakeWordBridge();
+    // Queue limits for the current frame duration
+    size_t max_encode_tasks() const { return MAX_ENCODE_QUEUE_DURATION_MS / frame_duration_ms_; }
+    size_t max_send_packets() const { return MAX_SEND_QUEUE_DURATION_MS / frame_duration_ms_; }
+    bool NextSoundPacket(std::unique_ptr<AudioStreamPacket>& packet);
+    bool StartCachedSound(std::string_view ogg);
+    void FinishSoundRecording();
+    void StopSoundRecording(const std::shared_ptr<SoundClip>& clip);
+    void SelectDecoder(bool local, int sample_rate, int frame_duration);
+    bool ConcealLostPacket(std::vector<int16_t>& pcm);
     void CheckAndUpdateAudioPowerState();
+    void WakeAllQueueWaiters();
+    size_t ReleaseQueuedPackets(RingQueue<std::unique_ptr<AudioStreamPacket>>& queue);
+    size_t ReleaseQueuedTasks(RingQueue<std::unique_ptr<AudioTask>>& queue, ObjectPool<AudioTask>& pool);
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,22 @@
+#ifndef AUDIO_TASK_H
+#define AUDIO_TASK_H
+
+#include <vector>
+#include <cstdint>
+
+enum AudioTaskType {
+    kAudioTaskTypeEncodeToSendQueue,
+    kAudioTaskTypeEncodeToTestingQueue,
+    kAudioTaskTypeDecodeToPlaybackQueue,
+};
+
+// A frame of PCM on its way to the encoder or the output
+struct AudioTask {
+    AudioTaskType type;
+    std::vector<int16_t> pcm;
+    uint32_t timestamp;
+    int64_t enqueue_time = 0;   // esp_timer_get_time() when the task was queued
+    int64_t capture_time = 0;   // Uplink: start of the mic read, downlink: packet receive; 0 if unknown
+};
+
+#endif // AUDIO_TASK_H
@@ -0,0 +1,106 @@
+#ifndef DECODER_CACHE_H
+#define DECODER_CACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+struct DecoderCacheStatistics {
+    uint32_t hits = 0;          // Switches to a channel that was already set up
+    uint32_t misses = 0;        // Switches that needed a new decoder
+    uint32_t evictions = 0;     // Of which replaced a live channel
+};
+
+/*
+ * Up to `capacity` decoder channels, keyed by source (network stream or local sound) and
+ * (sample_rate, frame_duration).
+ *
+ * Select() returns the channel for a key and makes it the selected one. Selecting the same key
+ * again is free. On a miss a free slot is used, or, once all are taken, the least recently
+ * selected channel is replaced, one of the same source if there is one, so a sound does not
+ * evict the decoder of the stream it plays over. The caller (re)creates the decoder of a channel
+ * when Select() reports it as created. Not thread safe, the decoder task owns it.
+ */
+template <typename Channel>
+class DecoderCache {
+public:
+    explicit DecoderCache(size_t capacity) : capacity_(capacity) {
+        entries_.reserve(capacity);
+    }
+
+    // nullptr only with a capacity of 0; created is set when the channel is new or replaced
+    Channel* Select(bool local, int sample_rate, int frame_duration, int64_t now, bool& created) {
+        created = false;
+        if (selected_ != nullptr && selected_->Matches(local, sample_rate, frame_duration)) {
+            return &selected_->channel;
+        }
+
+        Entry* entry = nullptr;
+        for (auto& e : entries_) {
+            if (e->Matches(local, sample_rate, frame_duration)) {
+                entry = e.get();
+                break;
+            }
+        }
+        if (entry != nullptr) {
+            statistics_.hits++;
+        } else if (entries_.size() < capacity_) {
+            entries_.push_back(std::make_unique<Entry>());
+            entry = entries_.back().get();
+            created = true;
+        } else {
+            for (auto& e : entries_) {
+                if (entry == nullptr || (e->local == local && entry->local != local)
+                        || (e->local == entry->local && e->last_used < entry->last_used)) {
+                    entry = e.get();
+                }
+            }
+            if (entry == nullptr) {
+                return nullptr;
+            }
+            statistics_.evictions++;
+            created = true;
+        }
+        if (created) {
+            statistics_.misses++;
+            entry->local = local;
+            entry->sample_rate = sample_rate;
+            entry->frame_duration = frame_duration;
+        }
+        entry->last_used = now;
+        selected_ = entry;
+        return &entry->channel;
+    }
+
+    Channel* selected() const { return selected_ != nullptr ? &selected_->channel : nullptr; }
+    size_t size() const { return entries_.size(); }
+    const DecoderCacheStatistics& statistics() const { return statistics_; }
+
+    template <typename Function>
+    void ForEach(Function function) {
+        for (auto& e : entries_) {
+            function(e->channel);
+        }
+    }
+
+private:
+    struct Entry {
+        bool local = false;
+        int sample_rate = 0;
+        int frame_duration = 0;
+        int64_t last_used = 0;
+        Channel channel;
+
+        bool Matches(bool l, int rate, int duration) const {
+            return local == l && sample_rate == rate && frame_duration == duration;
+        }
+    };
+
+    size_t capacity_;
+    std::vector<std::unique_ptr<Entry>> entries_;
+    Entry* selected_ = nullptr;
+    DecoderCacheStatistics statistics_;
+};
+
+#endif // DECODER_CACHE_H
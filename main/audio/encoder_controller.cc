@@ -0,0 +1,91 @@
+#include "encoder_controller.h"
+
+#include <algorithm>
+
+// Thresholds, encode load in permille of the frame duration
+#define ENCODE_LOAD_HIGH_PERMILLE 500       // Encoding half of every frame leaves too little for the rest
+#define ENCODE_LOAD_RAISE_PERMILLE 250      // A step up costs roughly another third, stay well below high
+#define CPU_IDLE_LOW_PERCENT 15
+#define CPU_IDLE_RAISE_PERCENT 40
+#define RAISE_AFTER_CLEAR_MS 3000
+#define HOLD_AFTER_LOWER_MS 12000
+#define HOLD_AFTER_CHANGE_FRAMES 8          // Let the smoothed load follow the new level, it moves once per frame
+
+// At least one frame, rounded up
+static int FramesFor(int ms, int64_t frame_us) {
+    return (int)std::max<int64_t>(1, ((int64_t)ms * 1000 + frame_us - 1) / frame_us);
+}
+
+EncoderController::EncoderController(int min_complexity, int max_complexity, int initial_complexity)
+    : min_complexity_(min_complexity), max_complexity_(max_complexity) {
+    statistics_.complexity = std::clamp(initial_complexity, min_complexity, max_complexity);
+}
+
+bool EncoderController::Update(int64_t encode_us, int64_t frame_us, size_t send_queue_depth, size_t send_queue_capacity, int cpu_idle_percent) {
+    if (frame_us <= 0) {
+        return false;
+    }
+    uint32_t load = (uint32_t)std::min<int64_t>(encode_us * 1000 / frame_us, 4000);
+    // EWMA with 1/8 weight, quick enough to follow a step within a second
+    load_ewma_permille_ = load_ewma_permille_ == 0 ? load : (load_ewma_permille_ * 7 + load) / 8;
+    statistics_.encode_load_permille = load_ewma_permille_;
+    statistics_.cpu_idle_percent = cpu_idle_percent;
+    if (hold_frames_ > 0) {
+        hold_frames_--;
+    }
+    // The frame duration follows the session, so the durations are converted on every frame
+    int raise_after_frames = FramesFor(RAISE_AFTER_CLEAR_MS, frame_us);
+    int hold_after_lower_frames = FramesFor(HOLD_AFTER_LOWER_MS, frame_us);
+
+    int complexity = statistics_.complexity;
+    // Lower quickly: the send queue half full means audio is about to be dropped
+    if (send_queue_depth * 2 >= send_queue_capacity && send_queue_capacity > 0) {
+        clear_frames_ = 0;
+        if (complexity > min_complexity_ && hold_frames_ < hold_after_lower_frames - HOLD_AFTER_CHANGE_FRAMES) {
+            Change(std::max(min_complexity_, complexity - 2), kEncoderControlSendQueue, hold_after_lower_frames);
+            return true;
+        }
+        return false;
+    }
+    if (load_ewma_permille_ > ENCODE_LOAD_HIGH_PERMILLE || (cpu_idle_percent >= 0 && cpu_idle_percent < CPU_IDLE_LOW_PERCENT)) {
+        clear_frames_ = 0;
+        if (complexity > min_complexity_ && hold_frames_ < hold_after_lower_frames - HOLD_AFTER_CHANGE_FRAMES) {
+            auto reason = load_ewma_permille_ > ENCODE_LOAD_HIGH_PERMILLE ? kEncoderControlEncodeTime : kEncoderControlCpuBusy;
+            Change(complexity - 1, reason, hold_after_lower_frames);
+            return true;
+        }
+        return false;
+    }
+
+    // Raise slowly, only with clear headroom on every signal
+    bool headroom = send_queue_depth <= 1 && load_ewma_permille_ < ENCODE_LOAD_RAISE_PERMILLE &&
+        (cpu_idle_percent < 0 || cpu_idle_percent >= CPU_IDLE_RAISE_PERCENT);
+    clear_frames_ = headroom ? clear_frames_ + 1 : 0;
+    if (clear_frames_ >= raise_after_frames && hold_frames_ == 0 && complexity < max_complexity_) {
+        clear_frames_ = 0;
+        Change(complexity + 1, kEncoderControlHeadroom, HOLD_AFTER_CHANGE_FRAMES);
+        return true;
+    }
+    return false;
+}
+
+void EncoderController::Change(int complexity, EncoderControlReason reason, int hold_frames) {
+    if (complexity > statistics_.complexity) {
+        statistics_.raises++;
+    } else {
+        statistics_.lowers++;
+    }
+    statistics_.complexity = complexity;
+    statistics_.last_reason = reason;
+    hold_frames_ = hold_frames;
+}
+
+const char* EncoderController::ReasonName(EncoderControlReason reason) {
+    switch (reason) {
+    case kEncoderControlSendQueue: return "send queue";
+    case kEncoderControlEncodeTime: return "encode time";
+    case kEncoderControlCpuBusy: return "cpu busy";
+    case kEncoderControlHeadroom: return "headroom";
+    default: return "none";
+    }
+}
@@ -0,0 +1,54 @@
+#ifndef ENCODER_CONTROLLER_H
+#define ENCODER_CONTROLLER_H
+
+#include <cstddef>
+#include <cstdint>
+
+enum EncoderControlReason {
+    kEncoderControlNone,
+    kEncoderControlSendQueue,    // Packets piling up in the send queue: the link is not keeping up
+    kEncoderControlEncodeTime,   // Encoding takes too much of each frame
+    kEncoderControlCpuBusy,      // Little idle time left on the encoding core
+    kEncoderControlHeadroom,     // All clear for long enough, try a better quality
+};
+
+struct EncoderControlStatistics {
+    int complexity = 0;
+    uint32_t raises = 0;
+    uint32_t lowers = 0;
+    EncoderControlReason last_reason = kEncoderControlNone;
+    uint32_t encode_load_permille = 0;  // Smoothed encode time / frame duration
+    int cpu_idle_percent = -1;
+};
+
+/*
+ * Picks the Opus encoder complexity from what the encoder costs and what the link can take.
+ *
+ * Update() is fed after every encoded frame. The complexity drops right away (by two when
+ * the send queue fills up, by one when the encode time or CPU load is too high) and only rises
+ * one step after a long stretch with an empty send queue, low encode load and an idle CPU.
+ * After a drop, the next rise waits longer so the level that overloaded is not retried
+ * at once. Pure logic, the caller applies the result.
+ */
+class EncoderController {
+public:
+    EncoderController(int min_complexity, int max_complexity, int initial_complexity);
+
+    // cpu_idle_percent is -1 when not measured; returns true if complexity() changed
+    bool Update(int64_t encode_us, int64_t frame_us, size_t send_queue_depth, size_t send_queue_capacity, int cpu_idle_percent);
+    int complexity() const { return statistics_.complexity; }
+    const EncoderControlStatistics& statistics() const { return statistics_; }
+    static const char* ReasonName(EncoderControlReason reason);
+
+private:
+    int min_complexity_;
+    int max_complexity_;
+    uint32_t load_ewma_permille_ = 0;
+    int hold_frames_ = 0;           // No rise before this many more frames
+    int clear_frames_ = 0;          // Consecutive frames with headroom
+    EncoderControlStatistics statistics_;
+
+    void Change(int complexity, EncoderControlReason reason, int hold_frames);
+};
+
+#endif // ENCODER_CONTROLLER_H
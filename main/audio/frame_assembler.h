@@ -0,0 +1,60 @@
+#ifndef FRAME_ASSEMBLER_H
+#define FRAME_ASSEMBLER_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+/*
+ * Cuts a stream of processor output chunks into frames of a fixed size.
+ *
+ * Each chunk is copied straight into the frame being filled, which is handed over whenever it is
+ * full; nothing is erased from the front of a buffer. The consumer gets the frame as an rvalue
+ * and may swap in a recycled buffer of the same capacity, so no frame allocates. Changing the
+ * frame size drops the partial frame. Not thread safe, the processor task owns it.
+ */
+class FrameAssembler {
+public:
+    explicit FrameAssembler(size_t frame_samples = 0) {
+        SetFrameSamples(frame_samples);
+    }
+
+    void SetFrameSamples(size_t frame_samples) {
+        frame_samples_ = frame_samples;
+        frame_.resize(frame_samples_);
+        fill_ = 0;
+    }
+
+    // Calls on_frame(std::vector<int16_t>&&) once for every frame completed by the chunk
+    template <typename OnFrame>
+    void Append(const int16_t* data, size_t samples, OnFrame&& on_frame) {
+        if (frame_samples_ == 0) {
+            return;
+        }
+        while (samples > 0) {
+            size_t count = std::min(samples, frame_samples_ - fill_);
+            memcpy(frame_.data() + fill_, data, count * sizeof(int16_t));
+            fill_ += count;
+            data += count;
+            samples -= count;
+
+            if (fill_ == frame_samples_) {
+                on_frame(std::move(frame_));
+                // No allocation when the consumer gave back a buffer of the same capacity
+                frame_.resize(frame_samples_);
+                fill_ = 0;
+            }
+        }
+    }
+
+    size_t frame_samples() const { return frame_samples_; }
+    size_t fill() const { return fill_; }
+
+private:
+    std::vector<int16_t> frame_;
+    size_t frame_samples_ = 0;
+    size_t fill_ = 0;
+};
+
+#endif // FRAME_ASSEMBLER_H
@@ -0,0 +1,147 @@
+#include "jitter_buffer.h"
+
+#include <algorithm>
+
+// A stream that runs dry and continues within this time counts as an underrun, not a new sentence
+#define JITTER_BUFFER_UNDERRUN_WINDOW_MS 1000
+
+JitterBuffer::JitterBuffer(size_t capacity) : slots_(capacity) {
+}
+
+bool JitterBuffer::Put(std::unique_ptr<AudioStreamPacket>& packet, int64_t now_ms) {
+    uint32_t sequence = packet->sequence;
+    if (!started_) {
+        started_ = true;
+        next_sequence_ = sequence;
+    }
+
+    int32_t offset = static_cast<int32_t>(sequence - next_sequence_);
+    if (offset < 0) {
+        statistics_.late++;
+        return false;
+    }
+
+    // Too far ahead (a long gap): give up on the oldest slots, whatever they hold
+    while (offset >= static_cast<int32_t>(slots_.size())) {
+        auto& slot = SlotOf(next_sequence_);
+        if (slot.packet) {
+            slot.packet.reset();
+            count_--;
+        }
+        statistics_.lost++;
+        next_sequence_++;
+        offset--;
+    }
+
+    auto& slot = SlotOf(sequence);
+    if (slot.packet) {
+        statistics_.duplicated++;
+        return false;
+    }
+
+    if (count_ == 0 && !playing_ && drained_at_ms_ >= 0) {
+        if (sequence == next_sequence_ && now_ms - drained_at_ms_ < JITTER_BUFFER_UNDERRUN_WINDOW_MS) {
+            statistics_.underruns++;
+            target_depth_ = std::min(target_depth_ + 1, JITTER_BUFFER_MAX_DEPTH);
+        }
+        drained_at_ms_ = -1;
+    }
+
+    if (packet->frame_duration > 0) {
+        frame_duration_ms_ = packet->frame_duration;
+    }
+    UpdateJitter(sequence, now_ms);
+
+    slot.packet = std::move(packet);
+    slot.arrival_ms = now_ms;
+    count_++;
+    statistics_.received++;
+    return true;
+}
+
+JitterBuffer::PopResult JitterBuffer::Pop(std::unique_ptr<AudioStreamPacket>& packet, int64_t now_ms) {
+    if (count_ == 0) {
+        if (playing_) {
+            playing_ = false;
+            drained_at_ms_ = now_ms;
+        }
+        return kPopNone;
+    }
+
+    int64_t target_delay_ms = static_cast<int64_t>(target_depth_ - 1) * frame_duration_ms_;
+    if (!playing_) {
+        // Prebuffer up to the target depth, but never hold the tail of a short stream forever
+        if (static_cast<int>(count_) < target_depth_ && now_ms - OldestArrival() < target_delay_ms) {
+            return kPopNone;
+        }
+        playing_ = true;
+    }
+
+    auto& slot = SlotOf(next_sequence_);
+    if (slot.packet) {
+        packet = std::move(slot.packet);
+        count_--;
+        next_sequence_++;
+        return kPopPacket;
+    }
+
+    // A gap: wait for the missing packet as long as the target delay allows
+    if (static_cast<int>(count_) < target_depth_ && now_ms - OldestArrival() < target_delay_ms) {
+        return kPopNone;
+    }
+    statistics_.lost++;
+    next_sequence_++;
+    return kPopLost;
+}
+
+void JitterBuffer::Reset(std::function<void(std::unique_ptr<AudioStreamPacket>)> release) {
+    for (auto& slot : slots_) {
+        if (slot.packet && release) {
+            release(std::move(slot.packet));
+        }
+        slot.packet.reset();
+    }
+    count_ = 0;
+    started_ = false;
+    playing_ = false;
+    has_transit_ = false;
+    drained_at_ms_ = -1;
+    // Keep the jitter estimate and target depth, the network doesn't change between turns
+}
+
+int64_t JitterBuffer::OldestArrival() {
+    int64_t oldest = INT64_MAX;
+    for (auto& slot : slots_) {
+        if (slot.packet) {
+            oldest = std::min(oldest, slot.arrival_ms);
+        }
+    }
+    return oldest;
+}
+
+void JitterBuffer::UpdateJitter(uint32_t sequence, int64_t now_ms) {
+    // Transit time relative to the sender's clock, which advances one frame per sequence
+    int64_t transit_ms = now_ms - static_cast<int64_t>(sequence) * frame_duration_ms_;
+    if (has_transit_) {
+        // Only late arrivals count: the server often sends faster than real time,
+        // and early packets are simply buffered
+        int64_t delay = std::max<int64_t>(transit_ms - last_transit_ms_, 0);
+        delay = std::min<int64_t>(delay, 1000);
+        jitter_x16_ += static_cast<int>(delay) - (jitter_x16_ >> 4);
+    }
+    has_transit_ = true;
+    last_transit_ms_ = transit_ms;
+    UpdateTargetDepth();
+}
+
+void JitterBuffer::UpdateTargetDepth() {
+    // Cover about three times the mean late-arrival jitter, plus the frame being played
+    int depth = 1 + (3 * jitter_ms() + frame_duration_ms_ - 1) / frame_duration_ms_;
+    depth = std::clamp(depth, JITTER_BUFFER_MIN_DEPTH, JITTER_BUFFER_MAX_DEPTH);
+    // Underruns push the target up at once, the estimate brings it down one frame at a time
+    if (depth > target_depth_) {
+        target_depth_ = depth;
+    } else if (depth < target_depth_ && statistics_.received % 50 == 0) {
+        target_depth_--;
+    }
+}
@@ -0,0 +1,81 @@
+#ifndef JITTER_BUFFER_H
+#define JITTER_BUFFER_H
+
+#include <memory>
+#include <vector>
+#include <functional>
+#include <cstdint>
+
+#include "protocol.h"
+
+#define JITTER_BUFFER_MIN_DEPTH 1
+#define JITTER_BUFFER_MAX_DEPTH 8
+
+struct JitterBufferStatistics {
+    uint32_t received = 0;
+    uint32_t late = 0;          // arrived after their slot was played or concealed
+    uint32_t duplicated = 0;
+    uint32_t lost = 0;          // concealed gaps
+    uint32_t underruns = 0;     // ran dry in the middle of a stream
+};
+
+/*
+ * Adaptive jitter buffer for downlink Opus packets, keyed on AudioStreamPacket::sequence.
+ *
+ * Packets are reordered by sequence, late ones are dropped, and a gap is reported as lost
+ * (so the caller can run the decoder's PLC) once enough newer packets are buffered or the
+ * gap has waited longer than the target delay. The target depth follows the late-arrival
+ * jitter (RFC 3550 style estimator) and grows after every underrun.
+ *
+ * Not thread safe, all calls come from the Opus codec task. Time is passed in by the caller.
+ */
+class JitterBuffer {
+public:
+    enum PopResult {
+        kPopNone,       // nothing to play yet
+        kPopPacket,     // the next packet in sequence
+        kPopLost,       // the next packet is missing, conceal it
+    };
+
+    explicit JitterBuffer(size_t capacity);
+
+    // Takes the packet on success, leaves it with the caller if it is late or duplicated
+    bool Put(std::unique_ptr<AudioStreamPacket>& packet, int64_t now_ms);
+    PopResult Pop(std::unique_ptr<AudioStreamPacket>& packet, int64_t now_ms);
+    // Drops all packets (handing them to release) and waits for a new stream
+    void Reset(std::function<void(std::unique_ptr<AudioStreamPacket>)> release = nullptr);
+
+    size_t size() const { return count_; }
+    bool empty() const { return count_ == 0; }
+    bool full() const { return count_ >= slots_.size(); }
+    int target_depth() const { return target_depth_; }
+    int jitter_ms() const { return jitter_x16_ / 16; }
+    const JitterBufferStatistics& statistics() const { return statistics_; }
+
+private:
+    struct Slot {
+        std::unique_ptr<AudioStreamPacket> packet;
+        int64_t arrival_ms = 0;
+    };
+
+    std::vector<Slot> slots_;
+    size_t count_ = 0;
+    bool started_ = false;
+    bool playing_ = false;
+    uint32_t next_sequence_ = 0;
+    int frame_duration_ms_ = 60;
+    int target_depth_ = JITTER_BUFFER_MIN_DEPTH;
+
+    bool has_transit_ = false;
+    int64_t last_transit_ms_ = 0;
+    int jitter_x16_ = 0;
+    int64_t drained_at_ms_ = -1;
+    JitterBufferStatistics statistics_;
+
+    inline Slot& SlotOf(uint32_t sequence) { return slots_[sequence % slots_.size()]; }
+    int64_t OldestArrival();
+    void UpdateJitter(uint32_t sequence, int64_t now_ms);
+    void UpdateTargetDepth();
+};
+
+#endif // JITTER_BUFFER_H
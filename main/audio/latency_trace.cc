@@ -0,0 +1,146 @@
+#include "latency_trace.h"
+
+#include <algorithm>
+
+static void PutLe16(uint8_t* p, uint16_t value) {
+    p[0] = value & 0xFF;
+    p[1] = value >> 8;
+}
+
+static void PutLe32(uint8_t* p, uint32_t value) {
+    p[0] = value & 0xFF;
+    p[1] = (value >> 8) & 0xFF;
+    p[2] = (value >> 16) & 0xFF;
+    p[3] = value >> 24;
+}
+
+LatencyTrace::LatencyTrace(size_t ring_size) : ring_(ring_size), histograms_(kLatencyStageCount) {
+}
+
+int LatencyTrace::BucketOf(uint32_t us) {
+    if (us < kBucketsPerOctave) {
+        return us;
+    }
+    int msb = 31 - __builtin_clz(us);
+    int sub = (us >> (msb - 2)) & (kBucketsPerOctave - 1);
+    int bucket = (msb - 1) * kBucketsPerOctave + sub;
+    return std::min(bucket, kBuckets - 1);
+}
+
+uint32_t LatencyTrace::BucketUpperBound(int bucket) {
+    if (bucket >= kBuckets - 1) {
+        return UINT32_MAX;
+    }
+    // The next bucket starts right after this one
+    int next = bucket + 1;
+    if (next < kBucketsPerOctave) {
+        return next - 1;
+    }
+    int msb = next / kBucketsPerOctave + 1;
+    int sub = next % kBucketsPerOctave;
+    return ((kBucketsPerOctave + sub) << (msb - 2)) - 1;
+}
+
+const char* LatencyTrace::StageName(LatencyStage stage) {
+    switch (stage) {
+        case kLatencyStageCodecRead: return "codec_read";
+        case kLatencyStageProcessor: return "processor";
+        case kLatencyStageEncodeQueue: return "encode_queue";
+        case kLatencyStageEncode: return "encode";
+        case kLatencyStageSendQueue: return "send_queue";
+        case kLatencyStageUplink: return "uplink";
+        case kLatencyStageDecodeQueue: return "decode_queue";
+        case kLatencyStageDecode: return "decode";
+        case kLatencyStagePlaybackQueue: return "playback_queue";
+        case kLatencyStageDmaWrite: return "dma_write";
+        case kLatencyStageDownlink: return "downlink";
+        default: return "unknown";
+    }
+}
+
+void LatencyTrace::Record(LatencyStage stage, int64_t start_us, int64_t end_us) {
+    if (stage >= kLatencyStageCount) {
+        return;
+    }
+    int64_t duration = std::max<int64_t>(end_us - start_us, 0);
+    uint32_t us = static_cast<uint32_t>(std::min<int64_t>(duration, UINT32_MAX));
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto& histogram = histograms_[stage];
+    histogram.buckets[BucketOf(us)]++;
+    histogram.count++;
+    histogram.max_us = std::max(histogram.max_us, us);
+
+    if (!ring_.empty()) {
+        ring_[ring_head_] = {static_cast<uint32_t>(end_us), (us & 0xFFFFFF) | (uint32_t(stage) << 24)};
+        ring_head_ = (ring_head_ + 1) % ring_.size();
+        ring_count_ = std::min(ring_count_ + 1, ring_.size());
+    }
+}
+
+uint32_t LatencyTrace::Percentile(const Histogram& histogram, int percent) const {
+    if (histogram.count == 0) {
+        return 0;
+    }
+    // Rank of the sample, rounded up so p99 of a small set is its maximum
+    uint64_t rank = (uint64_t(histogram.count) * percent + 99) / 100;
+    uint64_t seen = 0;
+    for (int i = 0; i < kBuckets; i++) {
+        seen += histogram.buckets[i];
+        if (seen >= rank) {
+            return std::min(BucketUpperBound(i), histogram.max_us);
+        }
+    }
+    return histogram.max_us;
+}
+
+LatencySummary LatencyTrace::Summary(LatencyStage stage) {
+    LatencySummary summary;
+    if (stage >= kLatencyStageCount) {
+        return summary;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto& histogram = histograms_[stage];
+    summary.count = histogram.count;
+    summary.p50_us = Percentile(histogram, 50);
+    summary.p95_us = Percentile(histogram, 95);
+    summary.p99_us = Percentile(histogram, 99);
+    summary.max_us = histogram.max_us;
+    return summary;
+}
+
+size_t LatencyTrace::dump_size() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return kDumpHeaderSize + ring_count_ * kDumpRecordSize;
+}
+
+size_t LatencyTrace::Dump(uint8_t* buffer, size_t size) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (size < kDumpHeaderSize) {
+        return 0;
+    }
+    // Keep the newest records if the buffer is short
+    size_t count = std::min(ring_count_, (size - kDumpHeaderSize) / kDumpRecordSize);
+    PutLe32(buffer, kDumpMagic);
+    PutLe16(buffer + 4, count);
+    PutLe16(buffer + 6, kLatencyStageCount);
+
+    uint8_t* p = buffer + kDumpHeaderSize;
+    size_t index = ring_head_ + ring_.size() - count;
+    for (size_t i = 0; i < count; i++) {
+        auto& record = ring_[(index + i) % ring_.size()];
+        PutLe32(p, record.end_us);
+        PutLe32(p + 4, record.duration_and_stage);
+        p += kDumpRecordSize;
+    }
+    return p - buffer;
+}
+
+void LatencyTrace::Reset() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto& histogram : histograms_) {
+        histogram = Histogram();
+    }
+    ring_head_ = 0;
+    ring_count_ = 0;
+}
@@ -0,0 +1,89 @@
+#ifndef LATENCY_TRACE_H
+#define LATENCY_TRACE_H
+
+#include <mutex>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+// Stage boundaries of the audio paths, stamped with esp_timer_get_time()
+enum LatencyStage : uint8_t {
+    kLatencyStageCodecRead,         // codec InputData()
+    kLatencyStageProcessor,         // Last feed to the processor until its output (AFE feed / fetch)
+    kLatencyStageEncodeQueue,       // Encode queue push until the encoder takes the frame
+    kLatencyStageEncode,            // Opus encode
+    kLatencyStageSendQueue,         // Encode done until the protocol sends the packet
+    kLatencyStageUplink,            // Capture until send
+    kLatencyStageDecodeQueue,       // Receive until the decoder takes the packet, including the jitter buffer
+    kLatencyStageDecode,            // Opus decode or PLC, and resampling
+    kLatencyStagePlaybackQueue,     // Decode done until the frame reaches the mixer
+    kLatencyStageDmaWrite,          // codec OutputData()
+    kLatencyStageDownlink,          // Receive until the first sample is written to DMA
+    kLatencyStageCount,
+};
+
+struct LatencySummary {
+    uint32_t count = 0;
+    uint32_t p50_us = 0;
+    uint32_t p95_us = 0;
+    uint32_t p99_us = 0;
+    uint32_t max_us = 0;
+};
+
+/*
+ * Per-frame latency trace of the audio service.
+ *
+ * Every Record() goes into a fixed ring of the most recent stamps and into a per stage
+ * histogram with 4 buckets per octave (each at most 25% wide, up to 4 seconds), from which
+ * the percentiles are read. The ring can be dumped as compact binary records:
+ *
+ *   header:  uint32 magic 'LTR1', uint16 record count, uint16 stage count  (little endian)
+ *   record:  uint32 end time (us, low 32 bits), uint32 duration (us, low 24 bits) | stage << 24
+ *
+ * Thread safe. Does not depend on ESP-IDF, times are passed in by the caller.
+ */
+class LatencyTrace {
+public:
+    static constexpr uint32_t kDumpMagic = 0x3152544C;  // "LTR1"
+    static constexpr size_t kDumpHeaderSize = 8;
+    static constexpr size_t kDumpRecordSize = 8;
+    static constexpr int kBucketsPerOctave = 4;
+    static constexpr int kOctaves = 22;
+    static constexpr int kBuckets = kOctaves * kBucketsPerOctave;
+
+    explicit LatencyTrace(size_t ring_size = 256);
+
+    void Record(LatencyStage stage, int64_t start_us, int64_t end_us);
+    LatencySummary Summary(LatencyStage stage);
+    // Writes the header and the ring, oldest first; returns the bytes written
+    size_t Dump(uint8_t* buffer, size_t size);
+    size_t dump_size();
+    void Reset();
+
+    static const char* StageName(LatencyStage stage);
+    // Histogram bucket of a duration, and the largest duration in a bucket
+    static int BucketOf(uint32_t us);
+    static uint32_t BucketUpperBound(int bucket);
+
+private:
+    // Same layout as a dumped record
+    struct RingRecord {
+        uint32_t end_us;
+        uint32_t duration_and_stage;
+    };
+    struct Histogram {
+        uint32_t buckets[kBuckets] = {};
+        uint32_t count = 0;
+        uint32_t max_us = 0;
+    };
+
+    std::mutex mutex_;
+    std::vector<RingRecord> ring_;
+    size_t ring_head_ = 0;
+    size_t ring_count_ = 0;
+    std::vector<Histogram> histograms_;     // On the heap, about 4KB
+
+    uint32_t Percentile(const Histogram& histogram, int percent) const;
+};
+
+#endif // LATENCY_TRACE_H
@@ -0,0 +1,60 @@
+#ifndef OBJECT_POOL_H
+#define OBJECT_POOL_H
+
+#include <memory>
+#include <atomic>
+#include <functional>
+
+#include "ring_queue.h"
+
+/*
+ * Fixed-capacity pool of heap objects that keep their buffers between uses.
+ *
+ * Acquire() hands out an idle object (or creates one if the pool is empty), Release() puts
+ * it back. Objects keep whatever std::vector capacity they grew to, so once the pool has
+ * seen the peak number of objects in flight no more heap allocations happen.
+ * Acquired objects keep the contents of their last use; callers overwrite every field.
+ */
+template <typename T>
+class ObjectPool {
+public:
+    explicit ObjectPool(size_t capacity) : free_(capacity) {
+    }
+
+    // Pre-create objects so the first frames don't allocate either
+    void Prefill(size_t count, std::function<void(T&)> init = nullptr) {
+        for (size_t i = 0; i < count && free_.size() < free_.capacity(); i++) {
+            auto object = std::make_unique<T>();
+            if (init) {
+                init(*object);
+            }
+            allocated_++;
+            free_.Push(std::move(object));
+        }
+    }
+
+    std::unique_ptr<T> Acquire() {
+        std::unique_ptr<T> object;
+        if (free_.Pop(object)) {
+            return object;
+        }
+        allocated_++;
+        return std::make_unique<T>();
+    }
+
+    // Objects that don't fit into the pool any more are freed
+    void Release(std::unique_ptr<T> object) {
+        if (object) {
+            free_.Push(std::move(object));
+        }
+    }
+
+    size_t available() const { return free_.size(); }
+    size_t allocated() const { return allocated_; }
+
+private:
+    RingQueue<std::unique_ptr<T>> free_;
+    std::atomic<size_t> allocated_{0};
+};
+
+#endif // OBJECT_POOL_H
@@ -0,0 +1,137 @@
+#include "ogg_demuxer.h"
+
+#include <esp_log.h>
+#include <cstring>
+
+#define TAG "OggDemuxer"
+
+#define OGG_PAGE_HEADER_SIZE 27
+#define OGG_HEADER_TYPE_CONTINUED 0x01
+
+void OggDemuxer::Reset(std::string_view data) {
+    data_ = data;
+    next_page_ = 0;
+    body_offset_ = 0;
+    segments_ = nullptr;
+    segment_count_ = 0;
+    segment_index_ = 0;
+    continued_.clear();
+    continued_returned_ = false;
+    skip_continued_ = false;
+    seen_head_ = false;
+    seen_tags_ = false;
+    sample_rate_ = 16000;
+    channels_ = 1;
+}
+
+bool OggDemuxer::NextPage() {
+    auto buf = reinterpret_cast<const uint8_t*>(data_.data());
+    size_t size = data_.size();
+    size_t offset = next_page_;
+    if (offset + OGG_PAGE_HEADER_SIZE > size) {
+        return false;
+    }
+
+    if (std::memcmp(buf + offset, "OggS", 4) != 0) {
+        // Lost sync, which only happens with corrupt data
+        offset = data_.find("OggS", offset);
+        if (offset == std::string_view::npos || offset + OGG_PAGE_HEADER_SIZE > size) {
+            return false;
+        }
+        ESP_LOGW(TAG, "Resynced at offset %u", (unsigned)offset);
+        continued_.clear();
+    }
+
+    const uint8_t* page = buf + offset;
+    int segment_count = page[26];
+    size_t body_offset = offset + OGG_PAGE_HEADER_SIZE + segment_count;
+    if (body_offset > size) {
+        return false;
+    }
+    size_t body_size = 0;
+    for (int i = 0; i < segment_count; i++) {
+        body_size += page[OGG_PAGE_HEADER_SIZE + i];
+    }
+    if (body_offset + body_size > size) {
+        return false;
+    }
+
+    segments_ = page + OGG_PAGE_HEADER_SIZE;
+    segment_count_ = segment_count;
+    segment_index_ = 0;
+    body_offset_ = body_offset;
+    next_page_ = body_offset + body_size;
+    // The first packet continues one we don't have (e.g. after a resync), drop it
+    skip_continued_ = (page[5] & OGG_HEADER_TYPE_CONTINUED) && continued_.empty();
+    return true;
+}
+
+bool OggDemuxer::NextPacket(std::string_view& packet) {
+    auto buf = reinterpret_cast<const uint8_t*>(data_.data());
+    if (continued_returned_) {
+        continued_.clear();
+        continued_returned_ = false;
+    }
+
+    while (true) {
+        if (segment_index_ >= segment_count_) {
+            if (!NextPage()) {
+                return false;
+            }
+            continue;
+        }
+
+        // Lacing: a packet ends with the first segment shorter than 255 bytes
+        size_t start = body_offset_;
+        size_t length = 0;
+        bool complete = false;
+        while (segment_index_ < segment_count_) {
+            uint8_t lacing = segments_[segment_index_++];
+            length += lacing;
+            if (lacing < 255) {
+                complete = true;
+                break;
+            }
+        }
+        body_offset_ += length;
+
+        if (skip_continued_) {
+            skip_continued_ = !complete;
+            continue;
+        }
+        if (!complete || !continued_.empty()) {
+            continued_.insert(continued_.end(), buf + start, buf + start + length);
+            if (!complete) {
+                continue;
+            }
+            packet = std::string_view(reinterpret_cast<const char*>(continued_.data()), continued_.size());
+            continued_returned_ = true;
+        } else {
+            packet = data_.substr(start, length);
+        }
+
+        if (packet.empty()) {
+            continue;
+        }
+
+        if (!seen_head_) {
+            // OpusHead: [0-7] "OpusHead", [8] version, [9] channel_count, [10-11] pre_skip,
+            // [12-15] input_sample_rate (little-endian), [16-17] output_gain, [18] mapping_family
+            if (packet.size() >= 19 && std::memcmp(packet.data(), "OpusHead", 8) == 0) {
+                seen_head_ = true;
+                auto head = reinterpret_cast<const uint8_t*>(packet.data());
+                channels_ = head[9];
+                sample_rate_ = head[12] | (head[13] << 8) | (head[14] << 16) | (head[15] << 24);
+            }
+            continue;
+        }
+        if (!seen_tags_) {
+            // Expect OpusTags in the second packet
+            if (packet.size() >= 8 && std::memcmp(packet.data(), "OpusTags", 8) == 0) {
+                seen_tags_ = true;
+            }
+            continue;
+        }
+        return true;
+    }
+}
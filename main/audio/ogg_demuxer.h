@@ -0,0 +1,46 @@
+#ifndef OGG_DEMUXER_H
+#define OGG_DEMUXER_H
+
+#include <string_view>
+#include <vector>
+#include <cstdint>
+
+/*
+ * Incremental Ogg/Opus demuxer over data that stays in memory (e.g. sounds embedded in flash).
+ *
+ * Pages are walked by their declared header / segment table sizes, so the data is only scanned
+ * for "OggS" when a page turns out to be corrupt. NextPacket() returns views into the source
+ * data; only a packet that continues onto the next page is assembled in an internal buffer.
+ * OpusHead / OpusTags are consumed internally.
+ */
+class OggDemuxer {
+public:
+    OggDemuxer() = default;
+    explicit OggDemuxer(std::string_view data) { Reset(data); }
+
+    void Reset(std::string_view data);
+    // Returns false at the end of the stream. The view is valid until the next call
+    bool NextPacket(std::string_view& packet);
+
+    int sample_rate() const { return sample_rate_; }
+    int channels() const { return channels_; }
+
+private:
+    std::string_view data_;
+    size_t next_page_ = 0;          // offset of the page after the current one
+    size_t body_offset_ = 0;        // offset of the next unread byte in the current page body
+    const uint8_t* segments_ = nullptr;
+    int segment_count_ = 0;
+    int segment_index_ = 0;
+    std::vector<uint8_t> continued_;
+    bool continued_returned_ = false;
+    bool skip_continued_ = false;
+    bool seen_head_ = false;
+    bool seen_tags_ = false;
+    int sample_rate_ = 16000;
+    int channels_ = 1;
+
+    bool NextPage();
+};
+
+#endif // OGG_DEMUXER_H
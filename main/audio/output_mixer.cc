@@ -0,0 +1,127 @@
+#include "output_mixer.h"
+#include "audio_task.h"
+#include "audio_dsp.h"
+
+#include <algorithm>
+
+OutputMixer::OutputMixer(int voices, size_t block_samples, Source source, Release release)
+    : voices_(voices), block_samples_(block_samples), source_(std::move(source)), release_(std::move(release)) {
+    block_.reserve(block_samples);
+}
+
+OutputMixer::~OutputMixer() {
+    Reset();
+}
+
+void OutputMixer::SetVoice(int voice, int32_t gain_q15, bool ducks_others, bool duckable) {
+    auto& v = voices_[voice];
+    v.gain = gain_q15;
+    v.current_gain = gain_q15;
+    v.ducks_others = ducks_others;
+    v.duckable = duckable;
+}
+
+void OutputMixer::SetDucking(int32_t duck_gain_q15, size_t ramp_samples) {
+    duck_gain_ = duck_gain_q15;
+    ramp_samples_ = std::max<size_t>(ramp_samples, 1);
+}
+
+void OutputMixer::Reset() {
+    for (auto& voice : voices_) {
+        if (voice.task) {
+            release_(std::move(voice.task));
+        }
+        voice.offset = 0;
+        voice.current_gain = voice.gain;
+    }
+}
+
+size_t OutputMixer::active_voices() const {
+    return std::count_if(voices_.begin(), voices_.end(), [](const Voice& voice) { return voice.task != nullptr; });
+}
+
+bool OutputMixer::Refill(Voice& voice, int index) {
+    if (voice.task && voice.offset < voice.task->pcm.size()) {
+        return true;
+    }
+    while (true) {
+        if (voice.task) {
+            release_(std::move(voice.task));
+        }
+        voice.offset = 0;
+        if (!source_(index, voice.task) || !voice.task) {
+            return false;
+        }
+        if (!voice.task->pcm.empty()) {
+            return true;
+        }
+    }
+}
+
+int32_t OutputMixer::TargetGain(const Voice& voice, bool ducking) const {
+    if (voice.duckable && ducking) {
+        return (voice.gain * duck_gain_) >> 15;
+    }
+    return voice.gain;
+}
+
+int32_t OutputMixer::RampGain(int32_t from, int32_t to, size_t samples) const {
+    // A full scale change takes ramp_samples_
+    int32_t max_delta = static_cast<int32_t>(int64_t(AUDIO_MIXER_UNITY_GAIN) * samples / ramp_samples_);
+    if (to > from) {
+        return std::min(to, from + max_delta);
+    }
+    return std::max(to, from - max_delta);
+}
+
+std::vector<int16_t>* OutputMixer::Next() {
+    bool ducking = false;
+    int active = 0;
+    int last_active = -1;
+    for (int i = 0; i < (int)voices_.size(); i++) {
+        if (Refill(voices_[i], i)) {
+            active++;
+            last_active = i;
+            ducking |= voices_[i].ducks_others;
+        }
+    }
+
+    if (active == 0) {
+        return nullptr;
+    }
+
+    if (active == 1 && voices_[last_active].offset == 0) {
+        // A single voice: play its frame directly, no extra latency
+        auto& voice = voices_[last_active];
+        auto& pcm = voice.task->pcm;
+        int32_t gain = RampGain(voice.current_gain, TargetGain(voice, ducking), pcm.size());
+        if (voice.current_gain != AUDIO_MIXER_UNITY_GAIN || gain != AUDIO_MIXER_UNITY_GAIN) {
+            AudioDsp::GainRampQ15(pcm.data(), pcm.data(), pcm.size(), voice.current_gain, gain);
+        }
+        voice.current_gain = gain;
+        voice.offset = pcm.size();
+        return &pcm;
+    }
+
+    block_.assign(block_samples_, 0);
+    for (int i = 0; i < (int)voices_.size(); i++) {
+        auto& voice = voices_[i];
+        int32_t target = TargetGain(voice, ducking);
+        if (!voice.task) {
+            // Idle voices resume at the gain they should have right now
+            voice.current_gain = target;
+            continue;
+        }
+        size_t filled = 0;
+        while (filled < block_samples_ && Refill(voice, i)) {
+            auto& pcm = voice.task->pcm;
+            size_t samples = std::min(block_samples_ - filled, pcm.size() - voice.offset);
+            int32_t gain = RampGain(voice.current_gain, target, samples);
+            AudioDsp::MixRampQ15(pcm.data() + voice.offset, block_.data() + filled, samples, voice.current_gain, gain);
+            voice.current_gain = gain;
+            voice.offset += samples;
+            filled += samples;
+        }
+    }
+    return &block_;
+}
@@ -0,0 +1,65 @@
+#ifndef OUTPUT_MIXER_H
+#define OUTPUT_MIXER_H
+
+#include <memory>
+#include <vector>
+#include <functional>
+#include <cstdint>
+
+struct AudioTask;
+
+#define AUDIO_MIXER_UNITY_GAIN 32768
+
+/*
+ * Software mixer in front of the codec output, owned by the audio output task.
+ *
+ * Each voice is a stream of decoded frames pulled from its own queue through the source
+ * callback. Voices that duck others (e.g. UI sounds) lower the gain of duckable voices
+ * (e.g. TTS) with a linear ramp while they play, and ramp it back up afterwards.
+ *
+ * With a single active voice Next() hands out that voice's frame as is (gain applied in
+ * place if needed), so there is no extra latency or copy. With more voices they are summed
+ * with saturation into blocks of block_samples, which callers align to the codec DMA frame.
+ */
+class OutputMixer {
+public:
+    using Source = std::function<bool(int voice, std::unique_ptr<AudioTask>& task)>;
+    using Release = std::function<void(std::unique_ptr<AudioTask> task)>;
+
+    OutputMixer(int voices, size_t block_samples, Source source, Release release);
+    ~OutputMixer();
+
+    void SetVoice(int voice, int32_t gain_q15, bool ducks_others, bool duckable);
+    void SetDucking(int32_t duck_gain_q15, size_t ramp_samples);
+
+    // PCM to play next, valid until the following call; nullptr if every voice is idle
+    std::vector<int16_t>* Next();
+    // Releases every frame held by the voices
+    void Reset();
+
+    size_t active_voices() const;
+
+private:
+    struct Voice {
+        std::unique_ptr<AudioTask> task;
+        size_t offset = 0;
+        int32_t gain = AUDIO_MIXER_UNITY_GAIN;          // Configured gain
+        int32_t current_gain = AUDIO_MIXER_UNITY_GAIN;  // Including ducking, follows the ramp
+        bool ducks_others = false;
+        bool duckable = false;
+    };
+
+    std::vector<Voice> voices_;
+    size_t block_samples_;
+    Source source_;
+    Release release_;
+    std::vector<int16_t> block_;
+    int32_t duck_gain_ = AUDIO_MIXER_UNITY_GAIN;
+    size_t ramp_samples_ = 1;
+
+    bool Refill(Voice& voice, int index);
+    int32_t TargetGain(const Voice& voice, bool ducking) const;
+    int32_t RampGain(int32_t from, int32_t to, size_t samples) const;
+};
+
+#endif // OUTPUT_MIXER_H
@@ -0,0 +1,167 @@
+#include "paced_pcm_stream.h"
+
+#include <esp_log.h>
+#include <cstring>
+#include <algorithm>
+
+#define TAG "PacedPcmStream"
+
+PacedPcmStream::PacedPcmStream(int sample_rate, int frame_duration_ms, size_t ring_frames, size_t prebuffer_frames)
+    : frame_samples_(sample_rate * frame_duration_ms / 1000),
+      frame_duration_ms_(frame_duration_ms),
+      prebuffer_frames_(std::min(prebuffer_frames, ring_frames)) {
+    slots_.resize(ring_frames);
+    for (auto& slot : slots_) {
+        slot.resize(frame_samples_);
+    }
+
+    esp_timer_create_args_t pace_timer_args = {
+        .callback = [](void* arg) {
+            auto this_ = (PacedPcmStream*)arg;
+            xTaskNotifyGive(this_->pace_task_);
+        },
+        .arg = this,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "pcm_pace_timer",
+        .skip_unhandled_events = true,
+    };
+    esp_timer_create(&pace_timer_args, &pace_timer_);
+
+    xTaskCreate([](void* arg) {
+        auto this_ = (PacedPcmStream*)arg;
+        this_->PaceTask();
+    }, "pcm_pace", 4096, this, 4, &pace_task_);
+}
+
+PacedPcmStream::~PacedPcmStream() {
+    if (pace_timer_ != nullptr) {
+        esp_timer_stop(pace_timer_);
+        esp_timer_delete(pace_timer_);
+    }
+    if (pace_task_ != nullptr) {
+        vTaskDelete(pace_task_);
+    }
+}
+
+bool PacedPcmStream::Run(ReadFunction read, FrameCallback on_frame) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        read_index_ = 0;
+        write_index_ = 0;
+        full_slots_ = 0;
+        end_of_stream_ = false;
+        pacing_ = false;
+        on_frame_ = std::move(on_frame);
+        timestamp_ = 0;
+        start_time_ = esp_timer_get_time();
+        statistics_ = Statistics();
+        running_ = true;
+    }
+
+    bool ok = true;
+    size_t frame_bytes = frame_samples_ * sizeof(int16_t);
+    size_t fill = 0;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            cv_.wait(lock, [this]() { return full_slots_ < slots_.size(); });
+        }
+        // The slot being written is not touched by the pacing task until it is committed
+        char* slot = (char*)slots_[write_index_].data();
+        int bytes_read = read(slot + fill, frame_bytes - fill);
+        if (bytes_read < 0) {
+            ESP_LOGE(TAG, "Failed to read PCM data");
+            ok = false;
+            break;
+        }
+        if (bytes_read == 0) {
+            break;
+        }
+        fill += bytes_read;
+        statistics_.bytes += bytes_read;
+        if (fill == frame_bytes) {
+            CommitSlot();
+            fill = 0;
+        }
+    }
+
+    // Pad the last partial frame with silence rather than cutting it off
+    if (fill > 0) {
+        memset((char*)slots_[write_index_].data() + fill, 0, frame_bytes - fill);
+        CommitSlot();
+    }
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    end_of_stream_ = true;
+    if (full_slots_ == 0) {
+        // Everything has been sent already, or there was nothing to send
+        esp_timer_stop(pace_timer_);
+        pacing_ = false;
+        running_ = false;
+    } else if (!pacing_) {
+        // Shorter than the prebuffer
+        StartPacing();
+    }
+    cv_.wait(lock, [this]() { return !running_; });
+    on_frame_ = nullptr;
+    ESP_LOGI(TAG, "Stream finished: %lu frames, %lu underruns, %lu bytes, first frame after %lld ms",
+        statistics_.frames, statistics_.underruns, statistics_.bytes, statistics_.first_frame_us / 1000);
+    return ok;
+}
+
+void PacedPcmStream::CommitSlot() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    write_index_ = (write_index_ + 1) % slots_.size();
+    full_slots_++;
+    if (!pacing_ && full_slots_ >= prebuffer_frames_) {
+        StartPacing();
+    }
+}
+
+void PacedPcmStream::StartPacing() {
+    pacing_ = true;
+    // The first frame goes out right away, the timer paces the rest
+    xTaskNotifyGive(pace_task_);
+    esp_timer_start_periodic(pace_timer_, frame_duration_ms_ * 1000);
+}
+
+void PacedPcmStream::PaceTask() {
+    std::vector<int16_t> frame;
+    while (true) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        size_t index;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!running_ || !pacing_) {
+                continue;
+            }
+            if (full_slots_ == 0) {
+                // Only reached while the input is still coming, the end is handled below
+                statistics_.underruns++;
+                continue;
+            }
+            index = read_index_;
+        }
+
+        // Hand the slot over; the callback swaps a buffer of its own back into it
+        frame.swap(slots_[index]);
+        on_frame_(std::move(frame), timestamp_);
+        slots_[index].swap(frame);
+        slots_[index].resize(frame_samples_);
+        timestamp_ += frame_duration_ms_;
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (statistics_.frames++ == 0) {
+            statistics_.first_frame_us = esp_timer_get_time() - start_time_;
+        }
+        read_index_ = (read_index_ + 1) % slots_.size();
+        full_slots_--;
+        if (end_of_stream_ && full_slots_ == 0) {
+            esp_timer_stop(pace_timer_);
+            pacing_ = false;
+            running_ = false;
+        }
+        cv_.notify_all();
+    }
+}
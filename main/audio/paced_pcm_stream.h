@@ -0,0 +1,72 @@
+#ifndef PACED_PCM_STREAM_H
+#define PACED_PCM_STREAM_H
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <esp_timer.h>
+
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <cstdint>
+
+/*
+ * Turns a byte stream of 16-bit PCM (e.g. an HTTP response) into fixed frames handed out at 1.0x.
+ *
+ * Run() reads straight into a fixed ring of frame slots, so nothing is appended or erased.
+ * A pacing task takes one frame per timer tick and passes the slot itself to the frame
+ * callback, which swaps it with a buffer of its own (like PushTaskToEncodeQueue()). Frames go
+ * out as soon as the prebuffer is full, long before the response is complete. If the network
+ * stalls, the ticks without a frame are counted as underruns. They are not made up later,
+ * so a stall never turns into a burst.
+ */
+class PacedPcmStream {
+public:
+    // Reads up to size bytes; 0 at the end of the stream, negative on error
+    using ReadFunction = std::function<int(char* buffer, size_t size)>;
+    using FrameCallback = std::function<void(std::vector<int16_t>&& pcm, uint32_t timestamp)>;
+
+    struct Statistics {
+        uint32_t frames = 0;
+        uint32_t underruns = 0;
+        uint32_t bytes = 0;
+        int64_t first_frame_us = 0;     // From Run() to the first frame handed out
+    };
+
+    PacedPcmStream(int sample_rate, int frame_duration_ms, size_t ring_frames, size_t prebuffer_frames);
+    ~PacedPcmStream();
+
+    // Streams until the end of input and every buffered frame is out; false on a read error
+    bool Run(ReadFunction read, FrameCallback on_frame);
+    const Statistics& statistics() const { return statistics_; }
+
+private:
+    size_t frame_samples_;
+    int frame_duration_ms_;
+    size_t prebuffer_frames_;
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::vector<std::vector<int16_t>> slots_;
+    size_t read_index_ = 0;
+    size_t write_index_ = 0;
+    size_t full_slots_ = 0;
+    bool running_ = false;
+    bool end_of_stream_ = false;
+    bool pacing_ = false;
+
+    FrameCallback on_frame_;
+    uint32_t timestamp_ = 0;
+    int64_t start_time_ = 0;
+    Statistics statistics_;
+
+    esp_timer_handle_t pace_timer_ = nullptr;
+    TaskHandle_t pace_task_ = nullptr;
+
+    void PaceTask();
+    void StartPacing();
+    void CommitSlot();
+};
+
+#endif // PACED_PCM_STREAM_H
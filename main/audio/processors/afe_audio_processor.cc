@@ -13,9 +13,10 @@ AfeAudioProcessor::AfeAudioProcessor()
 void AfeAudioProcessor::Initialize(AudioCodec* codec, int frame_duration_ms) {
     codec_ = codec;
     frame_samples_ = frame_duration_ms * 16000 / 1000;
+    next_frame_samples_ = frame_samples_;
 
-    // Pre-allocate output buffer capacity
-    output_buffer_.reserve(frame_samples_);
+    // Pre-allocate the output frame
+    output_frame_.SetFrameSamples(frame_samples_);
 
     int ref_num = codec_->input_reference() ? 1 : 0;
 
@@ -85,6 +86,11 @@ size_t AfeAudioProcessor::GetFeedSize() {
     return afe_iface_->get_feed_chunksize(afe_data_);
 }
 
+void AfeAudioProcessor::SetFrameDuration(int frame_duration_ms) {
+    // Applied by the processor task before its next output
+    next_frame_samples_ = frame_duration_ms * 16000 / 1000;
+}
+
 void AfeAudioProcessor::Feed(std::vector<int16_t>&& data) {
     if (afe_data_ == nullptr) {
         return;
@@ -147,24 +153,16 @@ void AfeAudioProcessor::AudioProcessorTask() {
         }
 
         if (output_callback_) {
-            size_t samples = res->data_size / sizeof(int16_t);
-            
-            // Add data to buffer
-            output_buffer_.insert(output_buffer_.end(), res->data, res->data + samples);
-            
-            // Output complete frames when buffer has enough data
-            while (output_buffer_.size() >= frame_samples_) {
-                if (output_buffer_.size() == frame_samples_) {
-                    // If buffer size equals frame size, move the entire buffer
-                    output_callback_(std::move(output_buffer_));
-                    output_buffer_.clear();
-                    output_buffer_.reserve(frame_samples_);
-                } else {
-                    // If buffer size exceeds frame size, copy one frame and remove it
-                    output_callback_(std::vector<int16_t>(output_buffer_.begin(), output_buffer_.begin() + frame_samples_));
-                    output_buffer_.erase(output_buffer_.begin(), output_buffer_.begin() + frame_samples_);
-                }
+            int next_frame_samples = next_frame_samples_;
+            if (next_frame_samples != frame_samples_) {
+                // The partial frame of the old size is dropped
+                frame_samples_ = next_frame_samples;
+                output_frame_.SetFrameSamples(frame_samples_);
             }
+
+            output_frame_.Append(res->data, res->data_size / sizeof(int16_t), [this](std::vector<int16_t>&& frame) {
+                output_callback_(std::move(frame));
+            });
         }
     }
 }
@@ -9,9 +9,11 @@
 #include <string>
 #include <vector>
 #include <functional>
+#include <atomic>
 
 #include "audio_processor.h"
 #include "audio_codec.h"
+#include "frame_assembler.h"
 
 class AfeAudioProcessor : public AudioProcessor {
 public:
@@ -19,6 +21,7 @@ public:
     ~AfeAudioProcessor();
 
     void Initialize(AudioCodec* codec, int frame_duration_ms) override;
+    void SetFrameDuration(int frame_duration_ms) override;
     void Feed(std::vector<int16_t>&& data) override;
     void Start() override;
     void Stop() override;
@@ -35,9 +38,11 @@ private:
     std::function<void(std::vector<int16_t>&& data)> output_callback_;
     std::function<void(bool speaking)> vad_state_change_callback_;
     AudioCodec* codec_ = nullptr;
-    int frame_samples_ = 0;
+    int frame_samples_ = 0;         // Processor task only
+    std::atomic<int> next_frame_samples_{0};
     bool is_speaking_ = false;
-    std::vector<int16_t> output_buffer_;
+    // The consumer swaps each frame with a recycled buffer of the same size
+    FrameAssembler output_frame_;
 
     void AudioProcessorTask();
 };
@@ -0,0 +1,192 @@
+#include "audio_replayer.h"
+#include "sdkconfig.h"
+
+#if CONFIG_USE_AUDIO_REPLAY
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <errno.h>
+#include <cstring>
+#include <algorithm>
+#endif
+
+#define TAG "AudioReplayer"
+
+#define REPLAY_BUFFER_SAMPLES (16000 * 2)   // 2 seconds
+#define REPLAY_MAX_DATAGRAM 1500
+#define REPLAY_READ_TIMEOUT_MS 2000
+
+
+AudioReplayer::AudioReplayer() {
+#if CONFIG_USE_AUDIO_REPLAY
+    ring_.resize(REPLAY_BUFFER_SAMPLES);
+    udp_sockfd_ = socket(AF_INET, SOCK_DGRAM, 0);
+    if (udp_sockfd_ < 0) {
+        ESP_LOGW(TAG, "Failed to create UDP socket: %d", errno);
+        return;
+    }
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(CONFIG_AUDIO_REPLAY_UDP_PORT);
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    if (bind(udp_sockfd_, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        ESP_LOGW(TAG, "Failed to bind UDP port %d: %d", CONFIG_AUDIO_REPLAY_UDP_PORT, errno);
+        close(udp_sockfd_);
+        udp_sockfd_ = -1;
+        return;
+    }
+
+    xTaskCreate([](void* arg) {
+        auto this_ = (AudioReplayer*)arg;
+        this_->ReceiveTask();
+        vTaskDelete(NULL);
+    }, "audio_replay", 4096, this, 4, &receive_task_);
+    ESP_LOGI(TAG, "Waiting for replay on UDP port %d", CONFIG_AUDIO_REPLAY_UDP_PORT);
+#endif
+}
+
+AudioReplayer::~AudioReplayer() {
+#if CONFIG_USE_AUDIO_REPLAY
+    if (receive_task_ != nullptr) {
+        vTaskDelete(receive_task_);
+    }
+    if (udp_sockfd_ >= 0) {
+        close(udp_sockfd_);
+    }
+#endif
+}
+
+void AudioReplayer::ReceiveTask() {
+#if CONFIG_USE_AUDIO_REPLAY
+    std::vector<uint8_t> datagram(REPLAY_MAX_DATAGRAM);
+    while (true) {
+        struct sockaddr_in from = {};
+        socklen_t from_len = sizeof(from);
+        int len = recvfrom(udp_sockfd_, datagram.data(), datagram.size(), 0, (struct sockaddr*)&from, &from_len);
+        if (len <= 0) {
+            continue;
+        }
+
+        // A listening session that starts or ends, reported once the lock is released
+        int listening_change = -1;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            switch (datagram[0]) {
+            case 'S': {
+                bool was_listening = active_ && listening_;
+                host_addr_ = from;
+                host_known_ = true;
+                ring_head_ = 0;
+                ring_count_ = 0;
+                position_ = 0;
+                dropped_ = 0;
+                feed_us_ = 0;
+                start_time_ = esp_timer_get_time();
+                ending_ = false;
+                listening_ = len > 1 && datagram[1] == 'L';
+                active_ = true;
+                if (listening_ != was_listening) {
+                    listening_change = listening_;
+                }
+                ESP_LOGI(TAG, "Replay%s started by %s", listening_ ? " (listening)" : "", inet_ntoa(from.sin_addr));
+                break;
+            }
+            case 'P': {
+                if (!active_) {
+                    break;
+                }
+                size_t samples = (len - 1) / sizeof(int16_t);
+                const uint8_t* pcm = datagram.data() + 1;
+                for (size_t i = 0; i < samples; i++) {
+                    if (ring_count_ == ring_.size()) {
+                        dropped_ += samples - i;
+                        break;
+                    }
+                    int16_t sample;
+                    memcpy(&sample, pcm + i * sizeof(int16_t), sizeof(sample));
+                    ring_[(ring_head_ + ring_count_) % ring_.size()] = sample;
+                    ring_count_++;
+                }
+                break;
+            }
+            case 'E':
+                ending_ = true;
+                break;
+            default:
+                break;
+            }
+            data_cv_.notify_all();
+        }
+        if (listening_change >= 0 && on_listening_change_) {
+            on_listening_change_(listening_change);
+        }
+    }
+#endif
+}
+
+bool AudioReplayer::Read(int16_t* data, size_t samples) {
+#if CONFIG_USE_AUDIO_REPLAY
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (!active_) {
+        return false;
+    }
+    bool ready = data_cv_.wait_for(lock, std::chrono::milliseconds(REPLAY_READ_TIMEOUT_MS), [this, samples]() {
+        return ring_count_ >= samples || ending_;
+    });
+    if (!ready || ring_count_ < samples) {
+        // The host has finished (or gone away), the microphone takes over again
+        lock.unlock();
+        FinishSession();
+        return false;
+    }
+    for (size_t i = 0; i < samples; i++) {
+        data[i] = ring_[ring_head_];
+        ring_head_ = (ring_head_ + 1) % ring_.size();
+    }
+    ring_count_ -= samples;
+    position_ += samples;
+    return true;
+#else
+    return false;
+#endif
+}
+
+void AudioReplayer::FinishSession() {
+#if CONFIG_USE_AUDIO_REPLAY
+    char line[96];
+    bool listening;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!active_) {
+            return;
+        }
+        active_ = false;
+        listening = listening_;
+        snprintf(line, sizeof(line), "stats %llu %llu %lld %lld", (unsigned long long)position_,
+            (unsigned long long)dropped_, (long long)feed_us_.load(), (long long)(esp_timer_get_time() - start_time_));
+    }
+    ESP_LOGI(TAG, "Replay finished: %s", line);
+    Send(line);
+    if (listening && on_listening_change_) {
+        on_listening_change_(false);
+    }
+#endif
+}
+
+void AudioReplayer::Report(const char* event, const char* value) {
+#if CONFIG_USE_AUDIO_REPLAY
+    char line[96];
+    snprintf(line, sizeof(line), "%s %llu %s", event, (unsigned long long)position_, value);
+    ESP_LOGI(TAG, "Replay event: %s", line);
+    Send(line);
+#endif
+}
+
+void AudioReplayer::Send(const std::string& line) {
+#if CONFIG_USE_AUDIO_REPLAY
+    if (udp_sockfd_ >= 0 && host_known_) {
+        sendto(udp_sockfd_, line.data(), line.size(), 0, (struct sockaddr*)&host_addr_, sizeof(host_addr_));
+    }
+#endif
+}
@@ -0,0 +1,66 @@
+#ifndef AUDIO_REPLAYER_H
+#define AUDIO_REPLAYER_H
+
+#include <vector>
+#include <string>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+#include <cstdint>
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+/*
+ * Replays 16kHz mono PCM streamed from scripts/wake_word_replay.py in place of the microphone,
+ * so wake word and VAD tuning can run on recorded corpora instead of by ear.
+ *
+ * Datagrams from the host start with a type byte: 'S' starts a session, 'P' carries PCM,
+ * 'E' ends the session once the buffered audio has been consumed. "SL" starts a listening
+ * session, which runs the audio processor (VAD, uplink DTX) instead of the wake word. Events are sent back as
+ * text lines "<event> <sample position> <value>", and "stats <samples> <dropped> <feed_us> <wall_us>"
+ * at the end of a session.
+ */
+class AudioReplayer {
+public:
+    AudioReplayer();
+    ~AudioReplayer();
+
+    // Fills samples of replayed audio; false when no session is running
+    bool Read(int16_t* data, size_t samples);
+    void Report(const char* event, const char* value);
+    // Called by the audio input task, so not under the mutex
+    void AddFeedTime(int64_t us) { feed_us_ += us; }
+    bool active() const { return active_; }
+    // Called with true when a listening session starts, false when it ends; from the replay tasks
+    void OnListeningChange(std::function<void(bool listening)> callback) { on_listening_change_ = callback; }
+
+private:
+    int udp_sockfd_ = -1;
+    struct sockaddr_in host_addr_ = {};
+    bool host_known_ = false;
+    TaskHandle_t receive_task_ = nullptr;
+
+    std::mutex mutex_;
+    std::condition_variable data_cv_;
+    std::vector<int16_t> ring_;
+    size_t ring_head_ = 0;
+    size_t ring_count_ = 0;
+    volatile bool active_ = false;
+    bool ending_ = false;
+    bool listening_ = false;
+    uint64_t position_ = 0;     // Samples handed out in this session
+    uint64_t dropped_ = 0;      // Samples lost because the host sent faster than they were consumed
+    std::atomic<int64_t> feed_us_{0};
+    int64_t start_time_ = 0;
+    std::function<void(bool listening)> on_listening_change_;
+
+    void ReceiveTask();
+    void Send(const std::string& line);
+    void FinishSession();
+};
+
+#endif // AUDIO_REPLAYER_H
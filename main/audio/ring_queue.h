@@ -0,0 +1,104 @@
+#ifndef RING_QUEUE_H
+#define RING_QUEUE_H
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <cstddef>
+
+/*
+ * Bounded single-producer / single-consumer ring queue.
+ *
+ * The producer only writes tail_ and the consumer only writes head_, so a push never
+ * waits for a pop and vice versa. If a side has more than one task (e.g. several producers
+ * of the decode queue, or ResetDecoder() clearing from the main task), that side is
+ * serialized by its own mutex, which is uncontended in the steady state and is never
+ * shared with the other side.
+ *
+ * Wakeups are not handled here; the owner signals its own event bits after Push() / Pop().
+ */
+template <typename T>
+class RingQueue {
+public:
+    explicit RingQueue(size_t capacity)
+        : slots_count_(capacity + 1), slots_(new T[capacity + 1]) {
+    }
+
+    RingQueue(const RingQueue&) = delete;
+    RingQueue& operator=(const RingQueue&) = delete;
+
+    // Returns false (and leaves item untouched) if the queue is full
+    bool Push(T&& item) {
+        std::lock_guard<std::mutex> lock(push_mutex_);
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        size_t next = Next(tail);
+        if (next == head_.load(std::memory_order_acquire)) {
+            return false;
+        }
+        slots_[tail] = std::move(item);
+        tail_.store(next, std::memory_order_release);
+        return true;
+    }
+
+    // Returns false if the queue is empty
+    bool Pop(T& item) {
+        std::lock_guard<std::mutex> lock(pop_mutex_);
+        return PopLocked(item);
+    }
+
+    // Drops all queued items, returns the number of items dropped
+    size_t Clear() {
+        return Drain([](T&& item) { item = T(); });
+    }
+
+    // Hands all queued items to release (e.g. back to their pool), returns the number of items
+    template <typename Release>
+    size_t Drain(Release release) {
+        std::lock_guard<std::mutex> lock(pop_mutex_);
+        size_t count = 0;
+        T item;
+        while (PopLocked(item)) {
+            release(std::move(item));
+            count++;
+        }
+        return count;
+    }
+
+    size_t size() const {
+        size_t head = head_.load(std::memory_order_acquire);
+        size_t tail = tail_.load(std::memory_order_acquire);
+        return tail >= head ? tail - head : tail + slots_count_ - head;
+    }
+
+    bool empty() const {
+        return head_.load(std::memory_order_acquire) == tail_.load(std::memory_order_acquire);
+    }
+
+    size_t capacity() const { return slots_count_ - 1; }
+
+private:
+    // One slot is always left empty to tell a full ring from an empty one
+    const size_t slots_count_;
+    std::unique_ptr<T[]> slots_;
+    std::atomic<size_t> head_{0};
+    std::atomic<size_t> tail_{0};
+    std::mutex push_mutex_;
+    std::mutex pop_mutex_;
+
+    inline size_t Next(size_t index) const {
+        return index + 1 == slots_count_ ? 0 : index + 1;
+    }
+
+    bool PopLocked(T& item) {
+        size_t head = head_.load(std::memory_order_relaxed);
+        if (head == tail_.load(std::memory_order_acquire)) {
+            return false;
+        }
+        item = std::move(slots_[head]);
+        slots_[head] = T();
+        head_.store(Next(head), std::memory_order_release);
+        return true;
+    }
+};
+
+#endif // RING_QUEUE_H
@@ -0,0 +1,88 @@
+#include "sound_cache.h"
+
+#include <esp_log.h>
+#include <esp_heap_caps.h>
+#include <cstring>
+
+#define TAG "SoundCache"
+
+SoundClip::~SoundClip() {
+    if (pcm_ != nullptr) {
+        heap_caps_free(pcm_);
+    }
+}
+
+bool SoundClip::Append(const int16_t* data, size_t samples) {
+    if (samples_ + samples > capacity_) {
+        size_t capacity = capacity_ == 0 ? 8192 : capacity_;
+        while (capacity < samples_ + samples) {
+            capacity *= 2;
+        }
+        auto pcm = (int16_t*)heap_caps_realloc(pcm_, capacity * sizeof(int16_t), MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+        if (pcm == nullptr) {
+            pcm = (int16_t*)heap_caps_realloc(pcm_, capacity * sizeof(int16_t), MALLOC_CAP_8BIT);
+        }
+        if (pcm == nullptr) {
+            return false;
+        }
+        pcm_ = pcm;
+        capacity_ = capacity;
+    }
+    memcpy(pcm_ + samples_, data, samples * sizeof(int16_t));
+    samples_ += samples;
+    return true;
+}
+
+void SoundClip::Shrink() {
+    if (pcm_ == nullptr || samples_ == capacity_) {
+        return;
+    }
+    auto pcm = (int16_t*)heap_caps_realloc(pcm_, samples_ * sizeof(int16_t), MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (pcm != nullptr) {
+        pcm_ = pcm;
+        capacity_ = samples_;
+    }
+}
+
+std::shared_ptr<const SoundClip> SoundCache::Find(const void* key, size_t key_size, int sample_rate) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto it = entries_.begin(); it != entries_.end(); ++it) {
+        if (it->key == key && it->key_size == key_size && it->sample_rate == sample_rate) {
+            entries_.splice(entries_.begin(), entries_, it);
+            hits_++;
+            return entries_.front().clip;
+        }
+    }
+    misses_++;
+    return nullptr;
+}
+
+void SoundCache::Insert(const void* key, size_t key_size, int sample_rate, std::shared_ptr<SoundClip> clip) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (clip->bytes() > budget_bytes_) {
+        return;
+    }
+    while (!entries_.empty() && bytes_used_ + clip->bytes() > budget_bytes_) {
+        bytes_used_ -= entries_.back().clip->bytes();
+        entries_.pop_back();
+    }
+    bytes_used_ += clip->bytes();
+    entries_.push_front(Entry{key, key_size, sample_rate, std::move(clip)});
+    ESP_LOGI(TAG, "Cached %u clips, %u / %u bytes", (unsigned)entries_.size(), (unsigned)bytes_used_, (unsigned)budget_bytes_);
+}
+
+void SoundCache::Clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    entries_.clear();
+    bytes_used_ = 0;
+}
+
+size_t SoundCache::bytes_used() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return bytes_used_;
+}
+
+size_t SoundCache::size() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return entries_.size();
+}
@@ -0,0 +1,68 @@
+#ifndef SOUND_CACHE_H
+#define SOUND_CACHE_H
+
+#include <list>
+#include <memory>
+#include <mutex>
+#include <cstdint>
+#include <cstddef>
+
+// Decoded PCM of one clip, allocated in PSRAM when available
+class SoundClip {
+public:
+    SoundClip() = default;
+    ~SoundClip();
+    SoundClip(const SoundClip&) = delete;
+    SoundClip& operator=(const SoundClip&) = delete;
+
+    bool Append(const int16_t* data, size_t samples);
+    // Give back the spare room once the clip is complete
+    void Shrink();
+    const int16_t* data() const { return pcm_; }
+    size_t samples() const { return samples_; }
+    size_t bytes() const { return capacity_ * sizeof(int16_t); }
+
+private:
+    int16_t* pcm_ = nullptr;
+    size_t samples_ = 0;
+    size_t capacity_ = 0;
+};
+
+/*
+ * LRU cache of decoded (and already resampled) sounds within a byte budget.
+ * Clips are keyed by the address and size of their embedded OGG data, which never move.
+ * Playing clips are shared_ptr, so evicting one that is still playing is safe.
+ */
+class SoundCache {
+public:
+    explicit SoundCache(size_t budget_bytes) : budget_bytes_(budget_bytes) {}
+
+    // Counts a hit or a miss
+    std::shared_ptr<const SoundClip> Find(const void* key, size_t key_size, int sample_rate);
+    // Evicts the least recently used clips until the new one fits
+    void Insert(const void* key, size_t key_size, int sample_rate, std::shared_ptr<SoundClip> clip);
+    void Clear();
+
+    size_t budget_bytes() const { return budget_bytes_; }
+    size_t bytes_used();
+    size_t size();
+    uint32_t hits() const { return hits_; }
+    uint32_t misses() const { return misses_; }
+
+private:
+    struct Entry {
+        const void* key;
+        size_t key_size;
+        int sample_rate;
+        std::shared_ptr<SoundClip> clip;
+    };
+
+    std::mutex mutex_;
+    std::list<Entry> entries_;  // Most recently used first
+    size_t budget_bytes_;
+    size_t bytes_used_ = 0;
+    uint32_t hits_ = 0;
+    uint32_t misses_ = 0;
+};
+
+#endif // SOUND_CACHE_H
@@ -0,0 +1,181 @@
+#include "time_stretcher.h"
+
+#include <algorithm>
+#include <cstring>
+
+// Pitch periods searched, 2.5ms (400Hz) to 15ms (67Hz)
+#define MIN_PERIOD_US 2500
+#define MAX_PERIOD_US 15000
+#define SEARCH_SAMPLE_RATE 8000
+#define MIN_CORRELATION_Q14 13107      // 0.8, below that the splice is audible
+#define SILENCE_ENERGY 10000            // Mean square of a sample, about -50dBFS
+
+static uint32_t SquareRoot(uint64_t value) {
+    uint64_t result = 0;
+    uint64_t bit = 1ULL << 62;
+    while (bit > value) {
+        bit >>= 2;
+    }
+    while (bit != 0) {
+        if (value >= result + bit) {
+            value -= result + bit;
+            result = (result >> 1) + bit;
+        } else {
+            result >>= 1;
+        }
+        bit >>= 2;
+    }
+    return (uint32_t)result;
+}
+
+// Correlation of x[0, lag) with x[lag, 2 * lag), normalized to Q14
+static int Correlation(const int16_t* x, int lag, int64_t& energy) {
+    int64_t cross = 0;
+    int64_t energy_a = 0;
+    int64_t energy_b = 0;
+    for (int i = 0; i < lag; i++) {
+        int32_t a = x[i];
+        int32_t b = x[i + lag];
+        cross += a * b;
+        energy_a += a * a;
+        energy_b += b * b;
+    }
+    energy = energy_a + energy_b;
+    int64_t norm = (int64_t)SquareRoot(energy_a) * SquareRoot(energy_b);
+    if (norm == 0) {
+        return 0;
+    }
+    return (int)std::clamp<int64_t>(cross * 16384 / norm, -16384, 16384);
+}
+
+TimeStretcher::TimeStretcher(int target_ms, int low_ms, int max_speedup_percent, int max_slowdown_percent)
+    : target_ms_(target_ms), low_ms_(low_ms),
+      max_speedup_percent_(max_speedup_percent), max_slowdown_percent_(max_slowdown_percent) {
+}
+
+void TimeStretcher::Reset() {
+    speedup_credit_ = 0;
+    slowdown_credit_ = 0;
+}
+
+int TimeStretcher::FindPeriod(const int16_t* pcm, size_t samples, int sample_rate, int& correlation_q14) {
+    correlation_q14 = 0;
+    int factor = std::max(1, sample_rate / SEARCH_SAMPLE_RATE);
+    int search_rate = sample_rate / factor;
+    int min_lag = search_rate * MIN_PERIOD_US / 1000000;
+    int max_lag = std::min<int>(search_rate * MAX_PERIOD_US / 1000000, samples / factor / 2);
+    if (max_lag < min_lag || min_lag <= 0) {
+        return 0;
+    }
+
+    // Coarse search on a decimated copy; averaging is low-pass enough to find a pitch period
+    int decimated_samples = 2 * max_lag;
+    decimated_.resize(decimated_samples);
+    for (int i = 0; i < decimated_samples; i++) {
+        int32_t sum = 0;
+        for (int j = 0; j < factor; j++) {
+            sum += pcm[i * factor + j];
+        }
+        decimated_[i] = sum / factor;
+    }
+    int best_lag = 0;
+    int best_correlation = -16384;
+    int64_t energy = 0;
+    for (int lag = min_lag; lag <= max_lag; lag++) {
+        int correlation = Correlation(decimated_.data(), lag, energy);
+        if (correlation > best_correlation) {
+            best_correlation = correlation;
+            best_lag = lag;
+        }
+    }
+
+    // Silence can be cut anywhere, take the longest period
+    Correlation(decimated_.data(), max_lag, energy);
+    if (energy < (int64_t)SILENCE_ENERGY * 2 * max_lag) {
+        correlation_q14 = 16384;
+        return max_lag * factor;
+    }
+
+    if (factor == 1) {
+        correlation_q14 = best_correlation;
+        return best_lag;
+    }
+    // Refine around the coarse lag at the full rate
+    int center = best_lag * factor;
+    int lowest = std::max(min_lag * factor, center - factor + 1);
+    int highest = std::min<int>(samples / 2, center + factor - 1);
+    best_lag = 0;
+    best_correlation = -16384;
+    for (int lag = lowest; lag <= highest; lag++) {
+        int correlation = Correlation(pcm, lag, energy);
+        if (correlation > best_correlation) {
+            best_correlation = correlation;
+            best_lag = lag;
+        }
+    }
+    correlation_q14 = best_correlation;
+    return best_lag;
+}
+
+void TimeStretcher::CrossFade(const int16_t* fade_out, const int16_t* fade_in, int16_t* dest, int samples) {
+    // dest may be fade_out, each sample is read before it is written
+    int32_t step = (1 << 15) / samples;
+    int32_t weight = 0;
+    for (int i = 0; i < samples; i++) {
+        dest[i] = (int16_t)((fade_out[i] * ((1 << 15) - weight) + fade_in[i] * weight) >> 15);
+        weight += step;
+    }
+}
+
+void TimeStretcher::Process(std::vector<int16_t>& pcm, int sample_rate, int buffered_ms) {
+    int64_t samples = pcm.size();
+    if (samples == 0 || sample_rate <= 0) {
+        return;
+    }
+    bool accelerate;
+    if (buffered_ms > target_ms_ && max_speedup_percent_ > 0) {
+        accelerate = true;
+        slowdown_credit_ = 0;
+        speedup_credit_ = std::min(speedup_credit_ + samples * max_speedup_percent_ / 100, samples / 2);
+    } else if (buffered_ms < low_ms_ && max_slowdown_percent_ > 0) {
+        accelerate = false;
+        speedup_credit_ = 0;
+        slowdown_credit_ = std::min(slowdown_credit_ + samples * max_slowdown_percent_ / 100, samples / 2);
+    } else {
+        Reset();
+        return;
+    }
+
+    int correlation = 0;
+    int lag = FindPeriod(pcm.data(), pcm.size(), sample_rate, correlation);
+    if (lag == 0 || correlation < MIN_CORRELATION_Q14) {
+        statistics_.rejected++;
+        return;
+    }
+
+    if (accelerate) {
+        if (lag > speedup_credit_) {
+            return;
+        }
+        // x[0, lag) fading into x[lag, 2 * lag), then the rest: one period shorter
+        int16_t* x = pcm.data();
+        CrossFade(x, x + lag, x, lag);
+        memmove(x + lag, x + 2 * lag, (samples - 2 * lag) * sizeof(int16_t));
+        pcm.resize(samples - lag);
+        speedup_credit_ -= lag;
+        statistics_.accelerated++;
+        statistics_.samples_removed += lag;
+    } else {
+        if (lag > slowdown_credit_) {
+            return;
+        }
+        // x[0, lag), then x[lag, 2 * lag) fading into x[0, lag), then x[lag, end): one period longer
+        pcm.resize(samples + lag);
+        int16_t* x = pcm.data();
+        memmove(x + 2 * lag, x + lag, (samples - lag) * sizeof(int16_t));
+        CrossFade(x + lag, x, x + lag, lag);
+        slowdown_credit_ -= lag;
+        statistics_.expanded++;
+        statistics_.samples_added += lag;
+    }
+}
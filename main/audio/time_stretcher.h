@@ -0,0 +1,55 @@
+#ifndef TIME_STRETCHER_H
+#define TIME_STRETCHER_H
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+struct TimeStretchStatistics {
+    uint32_t accelerated = 0;       // Frames shortened by one period
+    uint32_t expanded = 0;          // Frames lengthened by one period
+    uint32_t rejected = 0;          // Wanted a change but the frame was not periodic enough
+    uint64_t samples_removed = 0;
+    uint64_t samples_added = 0;
+};
+
+/*
+ * Time-scale modification of the decoded downlink stream, without a pitch change.
+ *
+ * When more audio is buffered than the target, a frame is shortened by one pitch period;
+ * when the buffer is about to run dry, it is lengthened by one. The period is found by
+ * a WSOLA-style search for the lag whose next segment best matches the start of the frame
+ * (normalized cross-correlation, coarse on a ~8kHz decimated copy and refined at full rate),
+ * and the two segments are cross-faded, so the first and last samples of the frame are kept
+ * and no state carries over between frames. Frames that are neither periodic nor quiet are
+ * left alone. A credit per direction limits the speed change to the configured share of the
+ * played audio.
+ *
+ * Integer arithmetic only. Not thread safe, all calls come from the decoder task.
+ */
+class TimeStretcher {
+public:
+    TimeStretcher(int target_ms, int low_ms, int max_speedup_percent, int max_slowdown_percent);
+
+    // Shortens or lengthens pcm in place, buffered_ms is the audio queued behind this frame
+    void Process(std::vector<int16_t>& pcm, int sample_rate, int buffered_ms);
+    void Reset();
+    const TimeStretchStatistics& statistics() const { return statistics_; }
+
+    // Best lag in samples between min_lag and max_lag, 0 if none; correlation in Q14
+    int FindPeriod(const int16_t* pcm, size_t samples, int sample_rate, int& correlation_q14);
+
+private:
+    int target_ms_;
+    int low_ms_;
+    int max_speedup_percent_;
+    int max_slowdown_percent_;
+    int64_t speedup_credit_ = 0;    // Samples that may still be removed
+    int64_t slowdown_credit_ = 0;   // Samples that may still be added
+    std::vector<int16_t> decimated_;
+    TimeStretchStatistics statistics_;
+
+    static void CrossFade(const int16_t* fade_out, const int16_t* fade_in, int16_t* dest, int samples);
+};
+
+#endif // TIME_STRETCHER_H
@@ -0,0 +1,72 @@
+#include "uplink_dtx.h"
+
+UplinkDtx::UplinkDtx(int hangover_ms, int preroll_ms, int keepalive_ms)
+    : hangover_ms_(hangover_ms), preroll_ms_(preroll_ms), keepalive_ms_(keepalive_ms) {
+}
+
+void UplinkDtx::Configure(int frame_duration_ms) {
+    if (frame_duration_ms <= 0) {
+        return;
+    }
+    frame_duration_ms_ = frame_duration_ms;
+    // Round up, a shorter hangover or pre-roll than configured would clip speech
+    hangover_frames_ = (hangover_ms_ + frame_duration_ms - 1) / frame_duration_ms;
+    preroll_frames_ = (preroll_ms_ + frame_duration_ms - 1) / frame_duration_ms;
+    keepalive_frames_ = keepalive_ms_ > 0 ? (keepalive_ms_ + frame_duration_ms - 1) / frame_duration_ms : 0;
+    Reset();
+}
+
+void UplinkDtx::Reset() {
+    statistics_.suppressed_frames += held_frames_;
+    held_frames_ = 0;
+    silent_frames_ = 0;
+    hangover_left_ = hangover_frames_;
+    suppressing_ = false;
+}
+
+UplinkDtxAction UplinkDtx::Next(bool speaking) {
+    if (speaking) {
+        hangover_left_ = hangover_frames_;
+        statistics_.sent_frames++;
+        if (!suppressing_) {
+            return kUplinkDtxSend;
+        }
+        suppressing_ = false;
+        statistics_.onsets++;
+        statistics_.preroll_frames += held_frames_;
+        held_frames_ = 0;
+        return kUplinkDtxResume;
+    }
+
+    if (!suppressing_) {
+        if (hangover_left_ > 0) {
+            hangover_left_--;
+            statistics_.sent_frames++;
+            return kUplinkDtxSend;
+        }
+        suppressing_ = true;
+        silent_frames_ = 0;
+    }
+
+    silent_frames_++;
+    if (keepalive_frames_ > 0 && silent_frames_ >= keepalive_frames_) {
+        // Held frames are older than the keepalive, sending them later would reorder the stream
+        silent_frames_ = 0;
+        statistics_.suppressed_frames += held_frames_;
+        held_frames_ = 0;
+        statistics_.keepalive_frames++;
+        return kUplinkDtxKeepalive;
+    }
+    if (held_frames_ >= preroll_frames_) {
+        statistics_.suppressed_frames++;
+    } else {
+        held_frames_++;
+    }
+    return kUplinkDtxHold;
+}
+
+void UplinkDtx::AddSilentFrameBytes(uint32_t bytes) {
+    // EWMA with 1/8 weight
+    auto& s = statistics_;
+    s.silent_frame_bytes = s.silent_frame_bytes == 0 ? bytes : (s.silent_frame_bytes * 7 + bytes) / 8;
+}
@@ -0,0 +1,65 @@
+#ifndef UPLINK_DTX_H
+#define UPLINK_DTX_H
+
+#include <cstdint>
+
+enum UplinkDtxAction {
+    kUplinkDtxSend,         // Speech or hangover, send the frame
+    kUplinkDtxResume,       // Speech after a silence: send the held pre-roll first, then this frame
+    kUplinkDtxHold,         // Silence, keep the frame as pre-roll; the oldest held frame is dropped when full
+    kUplinkDtxKeepalive,    // Silence, drop the held pre-roll and send this frame as comfort noise
+};
+
+struct UplinkDtxStatistics {
+    uint32_t sent_frames = 0;       // Speech and hangover frames
+    uint32_t keepalive_frames = 0;
+    uint32_t preroll_frames = 0;    // Held frames sent at an onset
+    uint32_t suppressed_frames = 0; // Never sent
+    uint32_t onsets = 0;
+    uint32_t silent_frame_bytes = 0;    // Smoothed size of an encoded non-speech frame
+
+    uint64_t saved_bytes() const { return (uint64_t)suppressed_frames * silent_frame_bytes; }
+};
+
+/*
+ * Decides which uplink frames are sent while the VAD reports silence (discontinuous transmission).
+ *
+ * After speech ends, hangover frames are still sent so trailing syllables are not cut. Then frames
+ * are held instead of sent: the last pre-roll worth of them is kept, so a speech onset that the
+ * VAD reports late still reaches the server, and everything older is dropped. Every keepalive
+ * interval one silent frame is sent anyway, so the server keeps seeing the noise floor and the
+ * stream stays alive. Pure logic; the caller owns the frames and applies the actions in order.
+ */
+class UplinkDtx {
+public:
+    UplinkDtx(int hangover_ms, int preroll_ms, int keepalive_ms);
+
+    // Converts the durations to frames and starts over, nothing is held
+    void Configure(int frame_duration_ms);
+    // Starts over with a full hangover; held frames count as suppressed
+    void Reset();
+    UplinkDtxAction Next(bool speaking);
+    void AddSilentFrameBytes(uint32_t bytes);
+
+    int frame_duration_ms() const { return frame_duration_ms_; }
+    int preroll_frames() const { return preroll_frames_; }
+    int held_frames() const { return held_frames_; }
+    bool suppressing() const { return suppressing_; }
+    const UplinkDtxStatistics& statistics() const { return statistics_; }
+
+private:
+    int hangover_ms_;
+    int preroll_ms_;
+    int keepalive_ms_;
+    int frame_duration_ms_ = 0;
+    int hangover_frames_ = 0;
+    int preroll_frames_ = 0;
+    int keepalive_frames_ = 0;      // 0 disables keepalives
+    int hangover_left_ = 0;
+    int held_frames_ = 0;
+    int silent_frames_ = 0;         // Since the suppression started or the last keepalive
+    bool suppressing_ = false;
+    UplinkDtxStatistics statistics_;
+};
+
+#endif // UPLINK_DTX_H
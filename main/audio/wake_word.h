@@ -17,8 +17,10 @@ public:
     virtual void Start() = 0;
     virtual void Stop() = 0;
     virtual size_t GetFeedSize() = 0;
-    virtual void EncodeWakeWordData() = 0;
+    // Next packet of the audio around the wake word; false once caught up with the live audio
     virtual bool GetWakeWordOpus(std::vector<uint8_t>& opus) = 0;
+    // The listening stream has taken over, stop recording after the detection
+    virtual void StopBridge() = 0;
     virtual const std::string& GetLastDetectedWakeWord() const = 0;
 };
 
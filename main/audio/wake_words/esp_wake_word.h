@@ -24,8 +24,8 @@ public:
     void Start();
     void Stop();
     size_t GetFeedSize();
-    void EncodeWakeWordData();
     bool GetWakeWordOpus(std::vector<uint8_t>& opus);
+    void StopBridge();
     const std::string& GetLastDetectedWakeWord() const { return last_detected_wake_word_; }
 
 private:
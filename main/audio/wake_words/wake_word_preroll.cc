@@ -0,0 +1,201 @@
+#include "wake_word_preroll.h"
+
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <esp_heap_caps.h>
+
+#include <algorithm>
+#include <cstring>
+
+#define TAG "WakeWordPreroll"
+
+#define PREROLL_ENCODE_TASK_STACK_SIZE (4096 * 7)
+#define PREROLL_POP_TIMEOUT_MS 1000
+
+WakeWordPreroll::WakeWordPreroll() {
+}
+
+WakeWordPreroll::~WakeWordPreroll() {
+    if (encode_task_ != nullptr) {
+        vTaskDelete(encode_task_);
+    }
+    if (encode_task_stack_ != nullptr) {
+        heap_caps_free(encode_task_stack_);
+    }
+    if (encode_task_buffer_ != nullptr) {
+        heap_caps_free(encode_task_buffer_);
+    }
+    if (pcm_ != nullptr) {
+        heap_caps_free(pcm_);
+    }
+}
+
+bool WakeWordPreroll::Initialize(int window_ms, int frame_duration_ms) {
+    frame_samples_ = 16000 * frame_duration_ms / 1000;
+    window_frames_ = (window_ms + frame_duration_ms - 1) / frame_duration_ms;
+    // One more frame being written and one being copied out by the encoder
+    pcm_frames_ = window_frames_ + 2;
+    size_t bytes = pcm_frames_ * frame_samples_ * sizeof(int16_t);
+    pcm_ = (int16_t*)heap_caps_malloc(bytes, MALLOC_CAP_SPIRAM);
+    if (pcm_ == nullptr) {
+        pcm_ = (int16_t*)heap_caps_malloc(bytes, MALLOC_CAP_8BIT);
+    }
+    if (pcm_ == nullptr) {
+        ESP_LOGE(TAG, "Failed to allocate %u bytes for the pre-roll", (unsigned)bytes);
+        return false;
+    }
+    // The pre-roll window, plus as long again of audio recorded while the channel opens
+    packets_.resize(window_frames_ * 2);
+
+    encoder_ = std::make_unique<OpusEncoderWrapper>(16000, 1, frame_duration_ms);
+    encoder_->SetComplexity(0); // 0 is the fastest
+
+    encode_task_stack_ = (StackType_t*)heap_caps_malloc(PREROLL_ENCODE_TASK_STACK_SIZE, MALLOC_CAP_SPIRAM);
+    encode_task_buffer_ = (StaticTask_t*)heap_caps_malloc(sizeof(StaticTask_t), MALLOC_CAP_INTERNAL);
+    if (encode_task_stack_ == nullptr || encode_task_buffer_ == nullptr) {
+        ESP_LOGE(TAG, "Failed to allocate the encode task");
+        return false;
+    }
+    encode_task_ = xTaskCreateStatic([](void* arg) {
+        auto this_ = (WakeWordPreroll*)arg;
+        this_->EncodeTask();
+    }, "encode_wake_word", PREROLL_ENCODE_TASK_STACK_SIZE, this, 2, encode_task_stack_, encode_task_buffer_);
+
+    ESP_LOGI(TAG, "Pre-roll %d ms, %u bytes", window_ms, (unsigned)bytes);
+    return true;
+}
+
+void WakeWordPreroll::Store(const int16_t* data, size_t samples) {
+    if (pcm_ == nullptr) {
+        return;
+    }
+    bool frame_completed;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        size_t ring_samples = pcm_frames_ * frame_samples_;
+        uint64_t frames_before = written_samples_ / frame_samples_;
+        while (samples > 0) {
+            size_t position = written_samples_ % ring_samples;
+            size_t count = std::min(samples, ring_samples - position);
+            memcpy(pcm_ + position, data, count * sizeof(int16_t));
+            written_samples_ += count;
+            data += count;
+            samples -= count;
+        }
+        frame_completed = written_samples_ / frame_samples_ > frames_before;
+    }
+    if (frame_completed) {
+        xTaskNotifyGive(encode_task_);
+    }
+}
+
+void WakeWordPreroll::EncodeTask() {
+    while (true) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        while (EncodeNextFrame()) {
+        }
+    }
+}
+
+bool WakeWordPreroll::EncodeNextFrame() {
+    uint64_t frame;
+    uint32_t generation;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        uint64_t complete_frames = written_samples_ / frame_samples_;
+        if (encoded_frames_ >= complete_frames) {
+            return false;
+        }
+        // The frame being written has overwritten the oldest one; skip what is gone
+        if (complete_frames - encoded_frames_ > pcm_frames_ - 1) {
+            encoded_frames_ = complete_frames - (pcm_frames_ - 1);
+        }
+        frame = encoded_frames_;
+        generation = generation_;
+        frame_pcm_.resize(frame_samples_);
+        memcpy(frame_pcm_.data(), pcm_ + (frame % pcm_frames_) * frame_samples_, frame_samples_ * sizeof(int16_t));
+    }
+
+    bool encoded = encoder_->Encode(std::move(frame_pcm_), frame_opus_);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (generation == generation_ && encoded_frames_ == frame) {
+        auto& packet = packets_[frame % packets_.size()];
+        if (encoded) {
+            packet.swap(frame_opus_);
+        } else {
+            packet.clear();
+        }
+        encoded_frames_++;
+        encoded_cv_.notify_all();
+    }
+    return true;
+}
+
+void WakeWordPreroll::Capture() {
+    if (pcm_ == nullptr) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    uint64_t complete_frames = written_samples_ / frame_samples_;
+    next_packet_ = complete_frames > window_frames_ ? complete_frames - window_frames_ : 0;
+    captured_ = true;
+    bridging_ = true;
+    capture_time_ = esp_timer_get_time();
+    first_packet_sent_ = false;
+}
+
+bool WakeWordPreroll::PopPacket(std::vector<uint8_t>& opus) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (captured_) {
+        // Wait for the encoder, unless it has already encoded every complete frame
+        bool ready = encoded_cv_.wait_for(lock, std::chrono::milliseconds(PREROLL_POP_TIMEOUT_MS), [this]() {
+            return !captured_ || next_packet_ < encoded_frames_ || encoded_frames_ >= written_samples_ / frame_samples_;
+        });
+        if (!ready || !captured_ || next_packet_ >= encoded_frames_) {
+            break;
+        }
+        if (encoded_frames_ - next_packet_ > packets_.size()) {
+            ESP_LOGW(TAG, "Pre-roll overrun, skipping %u packets", (unsigned)(encoded_frames_ - next_packet_ - packets_.size()));
+            next_packet_ = encoded_frames_ - packets_.size();
+        }
+        opus.swap(packets_[next_packet_ % packets_.size()]);
+        next_packet_++;
+        if (opus.empty()) {
+            continue;
+        }
+        if (!first_packet_sent_) {
+            first_packet_sent_ = true;
+            ESP_LOGI(TAG, "First packet %ld ms after detection", (long)((esp_timer_get_time() - capture_time_) / 1000));
+        }
+        return true;
+    }
+
+    opus.clear();
+    // Caught up with the live audio; still recording until the listening stream takes over
+    if (bridging_) {
+        return false;
+    }
+    if (captured_) {
+        ESP_LOGI(TAG, "Pre-roll sent, %ld ms after detection", (long)((esp_timer_get_time() - capture_time_) / 1000));
+    }
+    captured_ = false;
+    return false;
+}
+
+void WakeWordPreroll::StopBridge() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    bridging_ = false;
+    encoded_cv_.notify_all();
+}
+
+void WakeWordPreroll::Reset() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    written_samples_ = 0;
+    encoded_frames_ = 0;
+    next_packet_ = 0;
+    captured_ = false;
+    bridging_ = false;
+    generation_++;
+    encoded_cv_.notify_all();
+}
@@ -0,0 +1,71 @@
+#ifndef WAKE_WORD_PREROLL_H
+#define WAKE_WORD_PREROLL_H
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#include <opus_encoder.h>
+
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <condition_variable>
+#include <cstdint>
+
+/*
+ * Audio around the wake word, sent to the server ahead of the listening stream.
+ *
+ * The detector stores 16kHz mono PCM into a fixed PSRAM ring covering the pre-roll window,
+ * and a background task Opus-encodes every complete frame as it arrives, so the packets are
+ * ready when the wake word fires. After Capture() the ring keeps recording (the bridge), through
+ * the time it takes to open the audio channel and start the audio processor, until StopBridge().
+ * PopPacket() hands out the recorded packets as they are encoded, and the rest once it is stopped.
+ */
+class WakeWordPreroll {
+public:
+    WakeWordPreroll();
+    ~WakeWordPreroll();
+
+    bool Initialize(int window_ms, int frame_duration_ms);
+    // Called by the detector with every chunk, and while bridging after detection
+    void Store(const int16_t* data, size_t samples);
+    // The wake word fired: packets from one window before now are to be sent
+    void Capture();
+    // Next packet to send, waiting for the encoder if needed; false once caught up with the live audio,
+    // which is the end of the capture once the bridge is stopped
+    bool PopPacket(std::vector<uint8_t>& opus);
+    // The listening stream has taken over; a partial last frame is dropped
+    void StopBridge();
+    // Drops the capture and the recorded audio, e.g. when detection restarts
+    void Reset();
+    bool bridging() const { return bridging_; }
+
+private:
+    std::mutex mutex_;
+    std::condition_variable encoded_cv_;
+    int16_t* pcm_ = nullptr;            // PSRAM ring, pcm_frames_ whole frames
+    size_t pcm_frames_ = 0;
+    size_t frame_samples_ = 0;
+    size_t window_frames_ = 0;
+    uint64_t written_samples_ = 0;      // Totals since Reset(), ring positions are taken modulo
+    uint64_t encoded_frames_ = 0;
+    std::vector<std::vector<uint8_t>> packets_;    // Ring of encoded frames, by frame number
+    uint64_t next_packet_ = 0;
+    uint32_t generation_ = 0;           // Bumped by Reset(), so a frame encoded before it is dropped
+    bool captured_ = false;
+    volatile bool bridging_ = false;
+    int64_t capture_time_ = 0;
+    bool first_packet_sent_ = false;
+
+    std::unique_ptr<OpusEncoderWrapper> encoder_;
+    std::vector<int16_t> frame_pcm_;
+    std::vector<uint8_t> frame_opus_;
+    TaskHandle_t encode_task_ = nullptr;
+    StaticTask_t* encode_task_buffer_ = nullptr;
+    StackType_t* encode_task_stack_ = nullptr;
+
+    void EncodeTask();
+    bool EncodeNextFrame();
+};
+
+#endif // WAKE_WORD_PREROLL_H
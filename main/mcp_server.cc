@@ -11,6 +11,7 @@
 #include <esp_pthread.h>
 #include <time.h>
 #include <cinttypes> // For PRId64
+#include <mbedtls/base64.h>
 
 #include "application.h"
 #include "display.h"
@@ -91,6 +92,50 @@ void McpServer::AddCommonTools() {
             codec->SetOutputVolume(properties["volume"].value<int>());
             return true;
         });
+
+    AddTool("self.audio.get_latency",
+        "Diagnostics: per-stage audio latency of the device (microphone to network send, network receive to speaker).\n"
+        "Returns p50/p95/p99/max in microseconds for each stage. With dump=true also returns the recent raw stamps "
+        "as a base64 binary record (see latency_trace.h).",
+        PropertyList({
+            Property("dump", kPropertyTypeBoolean, false)
+        }),
+        [](const PropertyList& properties) -> ReturnValue {
+            auto& trace = Application::GetInstance().GetAudioService().GetLatencyTrace();
+            cJSON* root = cJSON_CreateObject();
+            cJSON* stages = cJSON_CreateObject();
+            for (int i = 0; i < kLatencyStageCount; i++) {
+                auto stage = static_cast<LatencyStage>(i);
+                auto summary = trace.Summary(stage);
+                cJSON* item = cJSON_CreateObject();
+                cJSON_AddNumberToObject(item, "count", summary.count);
+                cJSON_AddNumberToObject(item, "p50_us", summary.p50_us);
+                cJSON_AddNumberToObject(item, "p95_us", summary.p95_us);
+                cJSON_AddNumberToObject(item, "p99_us", summary.p99_us);
+                cJSON_AddNumberToObject(item, "max_us", summary.max_us);
+                cJSON_AddItemToObject(stages, LatencyTrace::StageName(stage), item);
+            }
+            cJSON_AddItemToObject(root, "stages", stages);
+
+            if (properties["dump"].value<bool>()) {
+                std::vector<uint8_t> dump(trace.dump_size());
+                dump.resize(trace.Dump(dump.data(), dump.size()));
+                size_t encoded_size = 0;
+                mbedtls_base64_encode(nullptr, 0, &encoded_size, dump.data(), dump.size());
+                std::string encoded(encoded_size, '\0');
+                if (mbedtls_base64_encode(reinterpret_cast<unsigned char*>(encoded.data()), encoded.size(), &encoded_size,
+                        dump.data(), dump.size()) == 0) {
+                    encoded.resize(encoded_size);
+                    cJSON_AddStringToObject(root, "dump", encoded.c_str());
+                }
+            }
+
+            char* json_str = cJSON_PrintUnformatted(root);
+            std::string result(json_str);
+            cJSON_free(json_str);
+            cJSON_Delete(root);
+            return result;
+        });
     
     auto backlight = board.GetBacklight();
     if (backlight) {
@@ -438,27 +483,26 @@ void McpServer::AddTool(const std::string& name, const std::string& description,
 }
 
 void McpServer::ParseMessage(const std::string& message) {
-    cJSON* json = cJSON_Parse(message.c_str());
-    if (json == nullptr) {
+    auto json = JsonValue::Parse(message);
+    if (!json.IsValid()) {
         ESP_LOGE(TAG, "Failed to parse MCP message: %s", message.c_str());
         return;
     }
     ParseMessage(json);
-    cJSON_Delete(json);
 }
 
-void McpServer::ParseCapabilities(const cJSON* capabilities) {
-    auto vision = cJSON_GetObjectItem(capabilities, "vision");
-    if (cJSON_IsObject(vision)) {
-        auto url = cJSON_GetObjectItem(vision, "url");
-        auto token = cJSON_GetObjectItem(vision, "token");
-        if (cJSON_IsString(url)) {
+void McpServer::ParseCapabilities(const JsonValue& capabilities) {
+    auto vision = capabilities.Get("vision");
+    if (vision.IsObject()) {
+        auto url = vision.Get("url");
+        auto token = vision.Get("token");
+        if (url.IsString()) {
             auto camera = Board::GetInstance().GetCamera();
             if (camera) {
-                std::string url_str = std::string(url->valuestring);
+                std::string url_str = url.ToString();
                 std::string token_str;
-                if (cJSON_IsString(token)) {
-                    token_str = std::string(token->valuestring);
+                if (token.IsString()) {
+                    token_str = token.ToString();
                 }
                 camera->SetExplainUrl(url_str, token_str);
             }
@@ -466,45 +510,45 @@ void McpServer::ParseCapabilities(const cJSON* capabilities) {
     }
 }
 
-void McpServer::ParseMessage(const cJSON* json) {
+void McpServer::ParseMessage(const JsonValue& json) {
     // Check JSONRPC version
-    auto version = cJSON_GetObjectItem(json, "jsonrpc");
-    if (version == nullptr || !cJSON_IsString(version) || strcmp(version->valuestring, "2.0") != 0) {
-        ESP_LOGE(TAG, "Invalid JSONRPC version: %s", version ? version->valuestring : "null");
+    auto version = json.Get("jsonrpc");
+    if (!version.Equals("2.0")) {
+        ESP_LOGE(TAG, "Invalid JSONRPC version: %s", version.IsString() ? version.ToString().c_str() : "null");
         return;
     }
     
     // Check method
-    auto method = cJSON_GetObjectItem(json, "method");
-    if (method == nullptr || !cJSON_IsString(method)) {
+    auto method = json.Get("method");
+    if (!method.IsString()) {
         ESP_LOGE(TAG, "Missing method");
         return;
     }
     
-    auto method_str = std::string(method->valuestring);
+    auto method_str = method.ToString();
     ESP_LOGI(TAG, "MCP RPC method: %s", method_str.c_str());  // ✅ 打印方法名
     if (method_str.find("notifications") == 0) {
         return;
     }
     
     // Check params
-    auto params = cJSON_GetObjectItem(json, "params");
-    if (params != nullptr && !cJSON_IsObject(params)) {
+    auto params = json.Get("params");
+    if (params.IsValid() && !params.IsObject()) {
         ESP_LOGE(TAG, "Invalid params for method: %s", method_str.c_str());
         return;
     }
 
-    auto id = cJSON_GetObjectItem(json, "id");
-    if (id == nullptr || !cJSON_IsNumber(id)) {
+    auto id = json.Get("id");
+    if (!id.IsNumber()) {
         ESP_LOGE(TAG, "Invalid id for method: %s", method_str.c_str());
         return;
     }
-    auto id_int = id->valueint;
+    auto id_int = id.ToInt();
     
     if (method_str == "initialize") {
-        if (cJSON_IsObject(params)) {
-            auto capabilities = cJSON_GetObjectItem(params, "capabilities");
-            if (cJSON_IsObject(capabilities)) {
+        if (params.IsObject()) {
+            auto capabilities = params.Get("capabilities");
+            if (capabilities.IsObject()) {
                 ParseCapabilities(capabilities);
             }
         }
@@ -515,38 +559,36 @@ void McpServer::ParseMessage(const cJSON* json) {
         ReplyResult(id_int, message);
     } else if (method_str == "tools/list") {
         std::string cursor_str = "";
-        if (params != nullptr) {
-            auto cursor = cJSON_GetObjectItem(params, "cursor");
-            if (cJSON_IsString(cursor)) {
-                cursor_str = std::string(cursor->valuestring);
-            }
+        auto cursor = params.Get("cursor");
+        if (cursor.IsString()) {
+            cursor_str = cursor.ToString();
         }
         GetToolsList(id_int, cursor_str);
     } else if (method_str == "tools/call") {
-        if (!cJSON_IsObject(params)) {
+        if (!params.IsObject()) {
             ESP_LOGE(TAG, "tools/call: Missing params");
             ReplyError(id_int, "Missing params");
             return;
         }
-        auto tool_name = cJSON_GetObjectItem(params, "name");
-        if (!cJSON_IsString(tool_name)) {
+        auto tool_name = params.Get("name");
+        if (!tool_name.IsString()) {
             ESP_LOGE(TAG, "tools/call: Missing name");
             ReplyError(id_int, "Missing name");
             return;
         }
-        auto tool_arguments = cJSON_GetObjectItem(params, "arguments");
-        if (tool_arguments != nullptr && !cJSON_IsObject(tool_arguments)) {
+        auto tool_arguments = params.Get("arguments");
+        if (tool_arguments.IsValid() && !tool_arguments.IsObject()) {
             ESP_LOGE(TAG, "tools/call: Invalid arguments");
             ReplyError(id_int, "Invalid arguments");
             return;
         }
-        auto stack_size = cJSON_GetObjectItem(params, "stackSize");
-        if (stack_size != nullptr && !cJSON_IsNumber(stack_size)) {
+        auto stack_size = params.Get("stackSize");
+        if (stack_size.IsValid() && !stack_size.IsNumber()) {
             ESP_LOGE(TAG, "tools/call: Invalid stackSize");
             ReplyError(id_int, "Invalid stackSize");
             return;
         }
-        DoToolCall(id_int, std::string(tool_name->valuestring), tool_arguments, stack_size ? stack_size->valueint : DEFAULT_TOOLCALL_STACK_SIZE);
+        DoToolCall(id_int, tool_name.ToString(), tool_arguments, stack_size.IsValid() ? stack_size.ToInt() : DEFAULT_TOOLCALL_STACK_SIZE);
     } else {
         ESP_LOGE(TAG, "Method not implemented: %s", method_str.c_str());
         ReplyError(id_int, "Method not implemented: " + method_str);
@@ -621,7 +663,7 @@ void McpServer::GetToolsList(int id, const std::string& cursor) {
     ReplyResult(id, json);
 }
 
-void McpServer::DoToolCall(int id, const std::string& tool_name, const cJSON* tool_arguments, int stack_size) {
+void McpServer::DoToolCall(int id, const std::string& tool_name, const JsonValue& tool_arguments, int stack_size) {
     auto tool_iter = std::find_if(tools_.begin(), tools_.end(), 
                                  [&tool_name](const McpTool* tool) { 
                                      return tool->name() == tool_name; 
@@ -637,16 +679,16 @@ void McpServer::DoToolCall(int id, const std::string& tool_name, const cJSON* to
     try {
         for (auto& argument : arguments) {
             bool found = false;
-            if (cJSON_IsObject(tool_arguments)) {
-                auto value = cJSON_GetObjectItem(tool_arguments, argument.name().c_str());
-                if (argument.type() == kPropertyTypeBoolean && cJSON_IsBool(value)) {
-                    argument.set_value<bool>(value->valueint == 1);
+            if (tool_arguments.IsObject()) {
+                auto value = tool_arguments.Get(argument.name().c_str());
+                if (argument.type() == kPropertyTypeBoolean && value.IsBool()) {
+                    argument.set_value<bool>(value.IsTrue());
                     found = true;
-                } else if (argument.type() == kPropertyTypeInteger && cJSON_IsNumber(value)) {
-                    argument.set_value<int>(value->valueint);
+                } else if (argument.type() == kPropertyTypeInteger && value.IsNumber()) {
+                    argument.set_value<int>(value.ToInt());
                     found = true;
-                } else if (argument.type() == kPropertyTypeString && cJSON_IsString(value)) {
-                    argument.set_value<std::string>(value->valuestring);
+                } else if (argument.type() == kPropertyTypeString && value.IsString()) {
+                    argument.set_value<std::string>(value.ToString());
                     found = true;
                 }
             }
@@ -12,6 +12,8 @@
 
 #include <cJSON.h>
 
+#include "json_reader.h"
+
 // 添加类型别名
 using ReturnValue = std::variant<bool, int, long long, std::string>;
 
@@ -270,20 +272,21 @@ public:
     void AddCommonTools();
     void AddTool(McpTool* tool);
     void AddTool(const std::string& name, const std::string& description, const PropertyList& properties, std::function<ReturnValue(const PropertyList&)> callback);
-    void ParseMessage(const cJSON* json);
+    // Reads the message in place, json may be a view into a larger protocol message
+    void ParseMessage(const JsonValue& json);
     void ParseMessage(const std::string& message);
 
 private:
     McpServer();
     ~McpServer();
 
-    void ParseCapabilities(const cJSON* capabilities);
+    void ParseCapabilities(const JsonValue& capabilities);
 
     void ReplyResult(int id, const std::string& result);
     void ReplyError(int id, const std::string& message);
 
     void GetToolsList(int id, const std::string& cursor);
-    void DoToolCall(int id, const std::string& tool_name, const cJSON* tool_arguments, int stack_size);
+    void DoToolCall(int id, const std::string& tool_name, const JsonValue& tool_arguments, int stack_size);
 
     std::vector<McpTool*> tools_;
     std::thread tool_call_thread_;
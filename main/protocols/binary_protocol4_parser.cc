@@ -0,0 +1,43 @@
+#include "binary_protocol4_parser.h"
+
+#include <esp_log.h>
+#include <arpa/inet.h>
+
+#define TAG "BP4"
+
+size_t BinaryProtocol4Parser::Parse(const uint8_t* data, size_t len, int default_frame_duration, BinaryProtocol4Frame frames[2]) {
+    auto bp4 = (const BinaryProtocol4*)data;
+    if (len < sizeof(BinaryProtocol4)) {
+        ESP_LOGE(TAG, "Invalid audio packet size: %u", len);
+        return 0;
+    }
+    size_t payload_size = ntohs(bp4->payload_size);
+    size_t redundant_size = (bp4->flags & BINARY_PROTOCOL4_FLAG_REDUNDANT) ? ntohs(bp4->redundant_size) : 0;
+    if (sizeof(BinaryProtocol4) + payload_size + redundant_size > len) {
+        ESP_LOGE(TAG, "Invalid audio packet size: %u, payload: %u, redundant: %u", len, payload_size, redundant_size);
+        return 0;
+    }
+    uint32_t sequence = ntohl(bp4->sequence);
+    uint32_t timestamp = ntohl(bp4->timestamp);
+    int frame_duration = ntohs(bp4->frame_duration);
+    if (frame_duration == 0) {
+        frame_duration = default_frame_duration;
+    }
+
+    size_t count = 0;
+    int32_t delta = (int32_t)(sequence - remote_sequence_);
+    if (has_remote_sequence_ && delta <= 0) {
+        ESP_LOGW(TAG, "Received audio packet with old sequence: %lu, expected: %lu", sequence, remote_sequence_ + 1);
+    } else if (has_remote_sequence_ && delta != 1) {
+        ESP_LOGW(TAG, "Received audio packet with wrong sequence: %lu, expected: %lu", sequence, remote_sequence_ + 1);
+        if (redundant_size > 0 && delta == 2) {
+            frames[count++] = {sequence - 1, timestamp - frame_duration, frame_duration, bp4->payload + payload_size, redundant_size};
+        }
+    }
+    frames[count++] = {sequence, timestamp, frame_duration, bp4->payload, payload_size};
+    if (!has_remote_sequence_ || delta > 0) {
+        remote_sequence_ = sequence;
+        has_remote_sequence_ = true;
+    }
+    return count;
+}
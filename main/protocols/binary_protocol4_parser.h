@@ -0,0 +1,41 @@
+#ifndef BINARY_PROTOCOL4_PARSER_H
+#define BINARY_PROTOCOL4_PARSER_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include "protocol.h"
+
+struct BinaryProtocol4Frame {
+    uint32_t sequence;
+    uint32_t timestamp;
+    int frame_duration;
+    const uint8_t* payload;     // Points into the received packet
+    size_t size;
+};
+
+/*
+ * Receive side of WebSocket protocol version 4 (BinaryProtocol4).
+ *
+ * Tracks the newest sequence received. A packet whose redundant copy fills a single gap yields
+ * the recovered previous frame first; longer gaps are left to the jitter buffer and decoder PLC.
+ * Late and out of order packets are passed on without moving the expected sequence back.
+ * Sequences are compared wrap-safely, like JitterBuffer, and every value including 0 is valid.
+ */
+class BinaryProtocol4Parser {
+public:
+    // A new audio channel, the next packet starts the sequence
+    void Reset() { has_remote_sequence_ = false; }
+
+    // Fills frames in play order and returns how many (1 or 2), 0 for a malformed packet.
+    // A frame_duration of 0 in the header means default_frame_duration
+    size_t Parse(const uint8_t* data, size_t len, int default_frame_duration, BinaryProtocol4Frame frames[2]);
+
+    uint32_t remote_sequence() const { return remote_sequence_; }
+
+private:
+    bool has_remote_sequence_ = false;
+    uint32_t remote_sequence_ = 0;
+};
+
+#endif // BINARY_PROTOCOL4_PARSER_H
@@ -0,0 +1,385 @@
+#include "json_reader.h"
+
+#include <cstdint>
+#include <cstring>
+#include <cstdlib>
+#include <climits>
+
+// Nesting is checked recursively, this bounds the stack it takes on the network tasks
+#define JSON_MAX_DEPTH 32
+
+static inline bool IsSpace(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+static inline bool IsDigit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+static inline int HexValue(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    return -1;
+}
+
+static inline char ToLower(char c) {
+    return c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : c;
+}
+
+static const char* SkipSpace(const char* p, const char* end) {
+    while (p < end && IsSpace(*p)) {
+        p++;
+    }
+    return p;
+}
+
+/* Syntax check, each returns the end of the value or nullptr */
+
+static const char* ValidateValue(const char* p, const char* end, int depth);
+
+static const char* ValidateString(const char* p, const char* end) {
+    p++;
+    while (p < end) {
+        unsigned char c = *p++;
+        if (c == '"') {
+            return p;
+        }
+        if (c < 0x20) {
+            return nullptr;
+        }
+        if (c == '\\') {
+            if (p >= end) {
+                return nullptr;
+            }
+            c = *p++;
+            if (c == 'u') {
+                if (end - p < 4) {
+                    return nullptr;
+                }
+                for (int i = 0; i < 4; i++) {
+                    if (HexValue(*p++) < 0) {
+                        return nullptr;
+                    }
+                }
+            } else if (strchr("\"\\/bfnrt", c) == nullptr || c == '\0') {
+                return nullptr;
+            }
+        }
+    }
+    return nullptr;
+}
+
+static const char* ValidateNumber(const char* p, const char* end) {
+    if (p < end && *p == '-') {
+        p++;
+    }
+    if (p < end && *p == '0') {
+        p++;
+    } else if (p < end && IsDigit(*p)) {
+        while (p < end && IsDigit(*p)) {
+            p++;
+        }
+    } else {
+        return nullptr;
+    }
+    if (p < end && *p == '.') {
+        p++;
+        if (p >= end || !IsDigit(*p)) {
+            return nullptr;
+        }
+        while (p < end && IsDigit(*p)) {
+            p++;
+        }
+    }
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        p++;
+        if (p < end && (*p == '+' || *p == '-')) {
+            p++;
+        }
+        if (p >= end || !IsDigit(*p)) {
+            return nullptr;
+        }
+        while (p < end && IsDigit(*p)) {
+            p++;
+        }
+    }
+    return p;
+}
+
+static const char* ValidateLiteral(const char* p, const char* end, const char* literal) {
+    size_t length = strlen(literal);
+    if ((size_t)(end - p) < length || memcmp(p, literal, length) != 0) {
+        return nullptr;
+    }
+    return p + length;
+}
+
+static const char* ValidateContainer(const char* p, const char* end, int depth) {
+    bool object = *p == '{';
+    char close = object ? '}' : ']';
+    p = SkipSpace(p + 1, end);
+    if (p < end && *p == close) {
+        return p + 1;
+    }
+    while (p < end) {
+        if (object) {
+            if (*p != '"' || (p = ValidateString(p, end)) == nullptr) {
+                return nullptr;
+            }
+            p = SkipSpace(p, end);
+            if (p >= end || *p != ':') {
+                return nullptr;
+            }
+            p = SkipSpace(p + 1, end);
+        }
+        if ((p = ValidateValue(p, end, depth + 1)) == nullptr) {
+            return nullptr;
+        }
+        p = SkipSpace(p, end);
+        if (p < end && *p == close) {
+            return p + 1;
+        }
+        if (p >= end || *p != ',') {
+            return nullptr;
+        }
+        p = SkipSpace(p + 1, end);
+    }
+    return nullptr;
+}
+
+static const char* ValidateValue(const char* p, const char* end, int depth) {
+    if (p >= end || depth > JSON_MAX_DEPTH) {
+        return nullptr;
+    }
+    switch (*p) {
+    case '"':
+        return ValidateString(p, end);
+    case '{':
+    case '[':
+        return ValidateContainer(p, end, depth);
+    case 't':
+        return ValidateLiteral(p, end, "true");
+    case 'f':
+        return ValidateLiteral(p, end, "false");
+    case 'n':
+        return ValidateLiteral(p, end, "null");
+    default:
+        return ValidateNumber(p, end);
+    }
+}
+
+/* Scanning of checked text, no bounds to worry about but the end of the whole text */
+
+static const char* SkipString(const char* p) {
+    p++;
+    while (*p != '"') {
+        if (*p == '\\') {
+            p++;
+        }
+        p++;
+    }
+    return p + 1;
+}
+
+static const char* SkipValue(const char* p, const char* end) {
+    if (*p == '"') {
+        return SkipString(p);
+    }
+    if (*p == '{' || *p == '[') {
+        int depth = 0;
+        while (p < end) {
+            if (*p == '"') {
+                p = SkipString(p);
+                continue;
+            }
+            if (*p == '{' || *p == '[') {
+                depth++;
+            } else if ((*p == '}' || *p == ']') && --depth == 0) {
+                return p + 1;
+            }
+            p++;
+        }
+        return end;
+    }
+    while (p < end && !IsSpace(*p) && *p != ',' && *p != '}' && *p != ']') {
+        p++;
+    }
+    return p;
+}
+
+static void AppendUtf8(std::string& out, uint32_t code_point) {
+    if (code_point < 0x80) {
+        out += (char)code_point;
+    } else if (code_point < 0x800) {
+        out += (char)(0xC0 | (code_point >> 6));
+        out += (char)(0x80 | (code_point & 0x3F));
+    } else if (code_point < 0x10000) {
+        out += (char)(0xE0 | (code_point >> 12));
+        out += (char)(0x80 | ((code_point >> 6) & 0x3F));
+        out += (char)(0x80 | (code_point & 0x3F));
+    } else {
+        out += (char)(0xF0 | (code_point >> 18));
+        out += (char)(0x80 | ((code_point >> 12) & 0x3F));
+        out += (char)(0x80 | ((code_point >> 6) & 0x3F));
+        out += (char)(0x80 | (code_point & 0x3F));
+    }
+}
+
+static uint32_t ReadHex4(const char* p) {
+    return (HexValue(p[0]) << 12) | (HexValue(p[1]) << 8) | (HexValue(p[2]) << 4) | HexValue(p[3]);
+}
+
+// Decodes the checked string content [p, end) onto out
+static void Unescape(const char* p, const char* end, std::string& out) {
+    out.reserve(out.size() + (end - p));
+    while (p < end) {
+        const char* run = p;
+        while (p < end && *p != '\\') {
+            p++;
+        }
+        out.append(run, p - run);
+        if (p >= end) {
+            break;
+        }
+        char c = p[1];
+        p += 2;
+        switch (c) {
+        case 'b': out += '\b'; break;
+        case 'f': out += '\f'; break;
+        case 'n': out += '\n'; break;
+        case 'r': out += '\r'; break;
+        case 't': out += '\t'; break;
+        case 'u': {
+            uint32_t code_point = ReadHex4(p);
+            p += 4;
+            if (code_point >= 0xD800 && code_point < 0xDC00 && end - p >= 6 && p[0] == '\\' && p[1] == 'u') {
+                uint32_t low = ReadHex4(p + 2);
+                if (low >= 0xDC00 && low < 0xE000) {
+                    code_point = 0x10000 + ((code_point - 0xD800) << 10) + (low - 0xDC00);
+                    p += 6;
+                }
+            }
+            if (code_point >= 0xD800 && code_point < 0xE000) {
+                code_point = 0xFFFD;    // Unpaired surrogate
+            }
+            AppendUtf8(out, code_point);
+            break;
+        }
+        default: out += c; break;   // " \ /
+        }
+    }
+}
+
+JsonValue JsonValue::Parse(const char* text, size_t length) {
+    const char* end = text + length;
+    const char* p = SkipSpace(text, end);
+    const char* value_end = ValidateValue(p, end, 0);
+    if (value_end == nullptr) {
+        return JsonValue();
+    }
+    // Some senders count the C string terminator in the length
+    for (const char* q = value_end; q < end; q++) {
+        if (!IsSpace(*q) && *q != '\0') {
+            return JsonValue();
+        }
+    }
+    return At(p, value_end);
+}
+
+JsonValue JsonValue::At(const char* p, const char* end) {
+    JsonType type;
+    switch (*p) {
+    case '"': type = kJsonString; break;
+    case '{': type = kJsonObject; break;
+    case '[': type = kJsonArray; break;
+    case 't':
+    case 'f': type = kJsonBool; break;
+    case 'n': type = kJsonNull; break;
+    default: type = kJsonNumber; break;
+    }
+    return JsonValue(type, p, SkipValue(p, end));
+}
+
+JsonValue JsonValue::Get(const char* key) const {
+    if (type_ != kJsonObject) {
+        return JsonValue();
+    }
+    const char* p = SkipSpace(begin_ + 1, end_);
+    while (p < end_ && *p == '"') {
+        JsonValue name(kJsonString, p, SkipString(p));
+        p = SkipSpace(name.end_, end_) + 1;
+        JsonValue value = At(SkipSpace(p, end_), end_);
+        if (name.NameEquals(key)) {
+            return value;
+        }
+        p = SkipSpace(value.end_, end_);
+        if (p < end_ && *p == ',') {
+            p = SkipSpace(p + 1, end_);
+        }
+    }
+    return JsonValue();
+}
+
+bool JsonValue::Equals(const char* s) const {
+    if (type_ != kJsonString) {
+        return false;
+    }
+    const char* content = begin_ + 1;
+    size_t length = size() - 2;
+    if (memchr(content, '\\', length) == nullptr) {
+        return strlen(s) == length && memcmp(content, s, length) == 0;
+    }
+    return ToString() == s;
+}
+
+bool JsonValue::NameEquals(const char* key) const {
+    const char* content = begin_ + 1;
+    size_t length = size() - 2;
+    std::string decoded;
+    if (memchr(content, '\\', length) != nullptr) {
+        decoded = ToString();
+        content = decoded.data();
+        length = decoded.size();
+    }
+    for (size_t i = 0; i < length; i++) {
+        if (key[i] == '\0' || ToLower(content[i]) != ToLower(key[i])) {
+            return false;
+        }
+    }
+    return key[length] == '\0';
+}
+
+std::string JsonValue::ToString() const {
+    std::string out;
+    if (type_ == kJsonString) {
+        Unescape(begin_ + 1, end_ - 1, out);
+    }
+    return out;
+}
+
+double JsonValue::ToDouble() const {
+    if (type_ != kJsonNumber) {
+        return 0;
+    }
+    // The text is not terminated after the number, strtod gets a copy
+    char buffer[32];
+    size_t length = size();
+    if (length >= sizeof(buffer)) {
+        return strtod(std::string(begin_, length).c_str(), nullptr);
+    }
+    memcpy(buffer, begin_, length);
+    buffer[length] = '\0';
+    return strtod(buffer, nullptr);
+}
+
+int JsonValue::ToInt() const {
+    double value = ToDouble();
+    if (value >= INT_MAX) {
+        return INT_MAX;
+    }
+    if (value <= (double)INT_MIN) {
+        return INT_MIN;
+    }
+    return (int)value;
+}
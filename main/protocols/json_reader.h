@@ -0,0 +1,70 @@
+#ifndef JSON_READER_H
+#define JSON_READER_H
+
+#include <string>
+#include <cstddef>
+
+enum JsonType {
+    kJsonInvalid,       // Missing member, wrong type or malformed text
+    kJsonNull,
+    kJsonBool,
+    kJsonNumber,
+    kJsonString,
+    kJsonArray,
+    kJsonObject,
+};
+
+/*
+ * Read-only view of a value in a JSON text, for inbound control messages.
+ *
+ * Parse() checks the syntax of the whole text once, without building a tree or allocating.
+ * Members are then looked up lazily by scanning the text, so a message is dispatched on its
+ * "type" without touching the rest, and a nested object (e.g. an MCP payload) is handed on as
+ * a view of the same buffer. Values borrow the text: it must outlive them.
+ *
+ * Strings keep their escapes until ToString() decodes them, only that allocates.
+ */
+class JsonValue {
+public:
+    JsonValue() = default;
+
+    // The text must hold exactly one value; invalid (kJsonInvalid) otherwise
+    static JsonValue Parse(const char* text, size_t length);
+    static JsonValue Parse(const std::string& text) { return Parse(text.data(), text.size()); }
+
+    JsonType type() const { return type_; }
+    bool IsValid() const { return type_ != kJsonInvalid; }
+    bool IsNull() const { return type_ == kJsonNull; }
+    bool IsBool() const { return type_ == kJsonBool; }
+    bool IsTrue() const { return type_ == kJsonBool && *begin_ == 't'; }
+    bool IsNumber() const { return type_ == kJsonNumber; }
+    bool IsString() const { return type_ == kJsonString; }
+    bool IsArray() const { return type_ == kJsonArray; }
+    bool IsObject() const { return type_ == kJsonObject; }
+
+    // Member of an object, invalid if this is not an object or has no such member. Like
+    // cJSON_GetObjectItem, the first member whose name matches ignoring ASCII case is returned
+    JsonValue Get(const char* key) const;
+    // Whether this is a string equal to s once decoded
+    bool Equals(const char* s) const;
+    // Decoded string value, empty if this is not a string
+    std::string ToString() const;
+    // Number value truncated and saturated to int like cJSON's valueint, 0 if this is not a number
+    int ToInt() const;
+    double ToDouble() const;
+
+    // The value's JSON text, quotes included for strings
+    const char* data() const { return begin_; }
+    size_t size() const { return end_ - begin_; }
+
+private:
+    JsonType type_ = kJsonInvalid;
+    const char* begin_ = nullptr;
+    const char* end_ = nullptr;
+
+    JsonValue(JsonType type, const char* begin, const char* end) : type_(type), begin_(begin), end_(end) {}
+    static JsonValue At(const char* p, const char* end);
+    bool NameEquals(const char* key) const;
+};
+
+#endif // JSON_READER_H
@@ -0,0 +1,127 @@
+#ifndef JSON_WRITER_H
+#define JSON_WRITER_H
+
+#include <string>
+#include <string_view>
+#include <cstddef>
+
+// JSON text written as is, e.g. an MCP payload that is already serialized
+struct JsonRawValue {
+    std::string_view text;
+};
+
+// A "key":value pair; the key is a literal, so its size is known at compile time
+template <size_t N, typename Value>
+struct JsonMember {
+    const char (&key)[N];
+    Value value;
+};
+
+template <size_t N>
+inline JsonMember<N, std::string_view> Member(const char (&key)[N], std::string_view value) {
+    return {key, value};
+}
+
+template <size_t N>
+inline JsonMember<N, JsonRawValue> Member(const char (&key)[N], JsonRawValue value) {
+    return {key, value};
+}
+
+/*
+ * Writer for the flat objects of the outbound protocol messages.
+ *
+ * The size of the message is summed up first, string values with their escapes, so the buffer
+ * is reserved once and written in a single pass. Strings are escaped like cJSON does (quote,
+ * backslash and control characters, UTF-8 passes through), keys are trusted literals.
+ */
+class JsonWriter {
+public:
+    // Replaces the content of buffer with {"key":value,...}; buffer keeps its capacity, so a
+    // reused one stops allocating once it fits the largest message
+    template <typename... Members>
+    static const std::string& Object(std::string& buffer, const Members&... members) {
+        size_t size = 2 + (sizeof...(members) > 0 ? sizeof...(members) - 1 : 0) + (0 + ... + MemberSize(members));
+        buffer.clear();
+        buffer.reserve(size);
+        buffer += '{';
+        [[maybe_unused]] bool first = true;
+        (AppendMember(buffer, members, first), ...);
+        buffer += '}';
+        return buffer;
+    }
+
+    static size_t EscapedSize(std::string_view value) {
+        size_t size = 2;
+        for (unsigned char c : value) {
+            if (c == '"' || c == '\\' || c == '\b' || c == '\f' || c == '\n' || c == '\r' || c == '\t') {
+                size += 2;
+            } else if (c < 0x20) {
+                size += 6;
+            } else {
+                size += 1;
+            }
+        }
+        return size;
+    }
+
+    static void AppendEscaped(std::string& buffer, std::string_view value) {
+        static const char hex[] = "0123456789abcdef";
+        buffer += '"';
+        size_t run = 0;
+        for (size_t i = 0; i < value.size(); i++) {
+            unsigned char c = value[i];
+            if (c >= 0x20 && c != '"' && c != '\\') {
+                continue;
+            }
+            buffer.append(value.data() + run, i - run);
+            run = i + 1;
+            buffer += '\\';
+            switch (c) {
+            case '"': buffer += '"'; break;
+            case '\\': buffer += '\\'; break;
+            case '\b': buffer += 'b'; break;
+            case '\f': buffer += 'f'; break;
+            case '\n': buffer += 'n'; break;
+            case '\r': buffer += 'r'; break;
+            case '\t': buffer += 't'; break;
+            default:
+                buffer += "u00";
+                buffer += hex[c >> 4];
+                buffer += hex[c & 0xF];
+                break;
+            }
+        }
+        buffer.append(value.data() + run, value.size() - run);
+        buffer += '"';
+    }
+
+private:
+    static size_t ValueSize(std::string_view value) { return EscapedSize(value); }
+    static size_t ValueSize(const JsonRawValue& value) { return value.text.size(); }
+    static void AppendValue(std::string& buffer, std::string_view value) { AppendEscaped(buffer, value); }
+    static void AppendValue(std::string& buffer, const JsonRawValue& value) { buffer.append(value.text); }
+
+    template <size_t N, typename Value>
+    static constexpr size_t KeySize(const JsonMember<N, Value>&) {
+        return N - 1 + 3;   // "key":
+    }
+
+    template <size_t N, typename Value>
+    static size_t MemberSize(const JsonMember<N, Value>& member) {
+        return KeySize(member) + ValueSize(member.value);
+    }
+
+    template <size_t N, typename Value>
+    static void AppendMember(std::string& buffer, const JsonMember<N, Value>& member, bool& first) {
+        if (!first) {
+            buffer += ',';
+        }
+        first = false;
+        buffer += '"';
+        buffer.append(member.key, N - 1);
+        buffer += "\":";
+        AppendValue(buffer, member.value);
+    }
+};
+
+#endif // JSON_WRITER_H
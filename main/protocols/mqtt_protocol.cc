@@ -5,6 +5,7 @@
 
 #include <esp_log.h>
 #include <cstring>
+#include <algorithm>
 #include <arpa/inet.h>
 #include "assets/lang_config.h"
 
@@ -54,24 +55,24 @@ bool MqttProtocol::StartMqttClient(bool report_error) {
     });
 
     mqtt_->OnMessage([this](const std::string& topic, const std::string& payload) {
-        cJSON* root = cJSON_Parse(payload.c_str());
-        if (root == nullptr) {
+        // Read in place, the payload outlives the handlers
+        auto root = JsonValue::Parse(payload);
+        if (!root.IsObject()) {
             ESP_LOGE(TAG, "Failed to parse json message %s", payload.c_str());
             return;
         }
-        cJSON* type = cJSON_GetObjectItem(root, "type");
-        if (!cJSON_IsString(type)) {
+        auto type = root.Get("type");
+        if (!type.IsString()) {
             ESP_LOGE(TAG, "Message type is invalid");
-            cJSON_Delete(root);
             return;
         }
 
-        if (strcmp(type->valuestring, "hello") == 0) {
+        if (type.Equals("hello")) {
             ParseServerHello(root);
-        } else if (strcmp(type->valuestring, "goodbye") == 0) {
-            auto session_id = cJSON_GetObjectItem(root, "session_id");
-            ESP_LOGI(TAG, "Received goodbye message, session_id: %s", session_id ? session_id->valuestring : "null");
-            if (session_id == nullptr || session_id_ == session_id->valuestring) {
+        } else if (type.Equals("goodbye")) {
+            auto session_id = root.Get("session_id");
+            ESP_LOGI(TAG, "Received goodbye message, session_id: %s", session_id.IsString() ? session_id.ToString().c_str() : "null");
+            if (!session_id.IsString() || session_id.Equals(session_id_.c_str())) {
                 Application::GetInstance().Schedule([this]() {
                     CloseAudioChannel();
                 });
@@ -79,7 +80,6 @@ bool MqttProtocol::StartMqttClient(bool report_error) {
         } else if (on_incoming_json_ != nullptr) {
             on_incoming_json_(root);
         }
-        cJSON_Delete(root);
         last_incoming_time_ = std::chrono::steady_clock::now();
     });
 
@@ -115,30 +115,44 @@ bool MqttProtocol::SendText(const std::string& text) {
     return true;
 }
 
-bool MqttProtocol::SendAudio(std::unique_ptr<AudioStreamPacket> packet) {
+bool MqttProtocol::SendAudio(const AudioStreamPacket& packet) {
     std::lock_guard<std::mutex> lock(channel_mutex_);
     if (udp_ == nullptr) {
         return false;
     }
+    if (udp_send_buffers_.empty()) {
+        udp_send_buffers_.resize(1);
+    }
+    auto& datagram = udp_send_buffers_[0];
+    return EncryptAudio(packet, datagram) && udp_->Send(datagram) > 0;
+}
 
-    std::string nonce(aes_nonce_);
-    *(uint16_t*)&nonce[2] = htons(packet->payload.size());
-    *(uint32_t*)&nonce[8] = htonl(packet->timestamp);
-    *(uint32_t*)&nonce[12] = htonl(++local_sequence_);
-
-    std::string encrypted;
-    encrypted.resize(aes_nonce_.size() + packet->payload.size());
-    memcpy(encrypted.data(), nonce.data(), nonce.size());
+size_t MqttProtocol::SendAudioBatch(const std::vector<std::unique_ptr<AudioStreamPacket>>& packets) {
+    // One lock and one encryption pass for the whole backlog, then the datagrams go out back to back
+    std::lock_guard<std::mutex> lock(channel_mutex_);
+    if (udp_ == nullptr) {
+        return 0;
+    }
+    if (udp_send_buffers_.size() < packets.size()) {
+        udp_send_buffers_.resize(packets.size());
+    }
+    size_t encrypted = 0;
+    while (encrypted < packets.size() && EncryptAudio(*packets[encrypted], udp_send_buffers_[encrypted])) {
+        encrypted++;
+    }
+    size_t sent = 0;
+    while (sent < encrypted && udp_->Send(udp_send_buffers_[sent]) > 0) {
+        sent++;
+    }
+    return sent;
+}
 
-    size_t nc_off = 0;
-    uint8_t stream_block[16] = {0};
-    if (mbedtls_aes_crypt_ctr(&aes_ctx_, packet->payload.size(), &nc_off, (uint8_t*)nonce.c_str(), stream_block,
-        (uint8_t*)packet->payload.data(), (uint8_t*)&encrypted[nonce.size()]) != 0) {
+bool MqttProtocol::EncryptAudio(const AudioStreamPacket& packet, std::string& datagram) {
+    if (!udp_cipher_.Encrypt(packet.payload.data(), packet.payload.size(), packet.timestamp, ++local_sequence_, datagram)) {
         ESP_LOGE(TAG, "Failed to encrypt audio data");
         return false;
     }
-
-    return udp_->Send(encrypted) > 0;
+    return true;
 }
 
 void MqttProtocol::CloseAudioChannel() {
@@ -147,11 +161,7 @@ void MqttProtocol::CloseAudioChannel() {
         udp_.reset();
     }
 
-    std::string message = "{";
-    message += "\"session_id\":\"" + session_id_ + "\",";
-    message += "\"type\":\"goodbye\"";
-    message += "}";
-    SendText(message);
+    SendJson(Member("session_id", session_id_), Member("type", "goodbye"));
 
     if (on_audio_channel_closed_ != nullptr) {
         on_audio_channel_closed_();
@@ -192,7 +202,7 @@ bool MqttProtocol::OpenAudioChannel() {
          * |type 1u|flags 1u|payload_len 2u|ssrc 4u|timestamp 4u|sequence 4u|
          * |payload payload_len|
          */
-        if (data.size() < sizeof(aes_nonce_)) {
+        if (data.size() < UdpAudioCipher::kHeaderSize) {
             ESP_LOGE(TAG, "Invalid audio packet size: %u", data.size());
             return;
         }
@@ -202,33 +212,30 @@ bool MqttProtocol::OpenAudioChannel() {
         }
         uint32_t timestamp = ntohl(*(uint32_t*)&data[8]);
         uint32_t sequence = ntohl(*(uint32_t*)&data[12]);
-        if (sequence < remote_sequence_) {
-            ESP_LOGW(TAG, "Received audio packet with old sequence: %lu, expected: %lu", sequence, remote_sequence_);
-            return;
-        }
-        if (sequence != remote_sequence_ + 1) {
+        // Out of order packets are passed on, the audio service's jitter buffer puts them back in order
+        if (sequence <= remote_sequence_) {
+            ESP_LOGW(TAG, "Received audio packet with old sequence: %lu, expected: %lu", sequence, remote_sequence_ + 1);
+        } else if (sequence != remote_sequence_ + 1) {
             ESP_LOGW(TAG, "Received audio packet with wrong sequence: %lu, expected: %lu", sequence, remote_sequence_ + 1);
         }
 
-        size_t decrypted_size = data.size() - aes_nonce_.size();
-        size_t nc_off = 0;
-        uint8_t stream_block[16] = {0};
-        auto nonce = (uint8_t*)data.data();
-        auto encrypted = (uint8_t*)data.data() + aes_nonce_.size();
-        auto packet = std::make_unique<AudioStreamPacket>();
+        // Pooled packets keep their payload capacity, so decrypting does not allocate either
+        auto packet = AcquirePacket();
         packet->sample_rate = server_sample_rate_;
         packet->frame_duration = server_frame_duration_;
         packet->timestamp = timestamp;
-        packet->payload.resize(decrypted_size);
-        int ret = mbedtls_aes_crypt_ctr(&aes_ctx_, decrypted_size, &nc_off, nonce, stream_block, encrypted, (uint8_t*)packet->payload.data());
-        if (ret != 0) {
-            ESP_LOGE(TAG, "Failed to decrypt audio data, ret: %d", ret);
+        packet->sequence = sequence;
+        packet->local = false;
+        packet->capture_time = 0;
+        packet->queue_time = 0;
+        if (!udp_cipher_.Decrypt(data, packet->payload)) {
+            ESP_LOGE(TAG, "Failed to decrypt audio data");
             return;
         }
         if (on_incoming_audio_ != nullptr) {
             on_incoming_audio_(std::move(packet));
         }
-        remote_sequence_ = sequence;
+        remote_sequence_ = std::max(remote_sequence_, sequence);
         last_incoming_time_ = std::chrono::steady_clock::now();
     });
 
@@ -249,6 +256,9 @@ std::string MqttProtocol::GetHelloMessage() {
     cJSON* features = cJSON_CreateObject();
 #if CONFIG_USE_SERVER_AEC
     cJSON_AddBoolToObject(features, "aec", true);
+#endif
+#if CONFIG_USE_UPLINK_DTX
+    cJSON_AddBoolToObject(features, "dtx", true);
 #endif
     cJSON_AddBoolToObject(features, "mcp", true);
     cJSON_AddItemToObject(root, "features", features);
@@ -256,7 +266,7 @@ std::string MqttProtocol::GetHelloMessage() {
     cJSON_AddStringToObject(audio_params, "format", "opus");
     cJSON_AddNumberToObject(audio_params, "sample_rate", 16000);
     cJSON_AddNumberToObject(audio_params, "channels", 1);
-    cJSON_AddNumberToObject(audio_params, "frame_duration", OPUS_FRAME_DURATION_MS);
+    cJSON_AddNumberToObject(audio_params, "frame_duration", preferred_frame_duration_);
     cJSON_AddItemToObject(root, "audio_params", audio_params);
     auto json_str = cJSON_PrintUnformatted(root);
     std::string message(json_str);
@@ -265,47 +275,48 @@ std::string MqttProtocol::GetHelloMessage() {
     return message;
 }
 
-void MqttProtocol::ParseServerHello(const cJSON* root) {
-    auto transport = cJSON_GetObjectItem(root, "transport");
-    if (transport == nullptr || strcmp(transport->valuestring, "udp") != 0) {
-        ESP_LOGE(TAG, "Unsupported transport: %s", transport->valuestring);
+void MqttProtocol::ParseServerHello(const JsonValue& root) {
+    auto transport = root.Get("transport");
+    if (!transport.Equals("udp")) {
+        ESP_LOGE(TAG, "Unsupported transport: %s", transport.ToString().c_str());
         return;
     }
 
-    auto session_id = cJSON_GetObjectItem(root, "session_id");
-    if (cJSON_IsString(session_id)) {
-        session_id_ = session_id->valuestring;
+    auto session_id = root.Get("session_id");
+    if (session_id.IsString()) {
+        session_id_ = session_id.ToString();
         ESP_LOGI(TAG, "Session ID: %s", session_id_.c_str());
     }
 
     // Get sample rate from hello message
-    auto audio_params = cJSON_GetObjectItem(root, "audio_params");
-    if (cJSON_IsObject(audio_params)) {
-        auto sample_rate = cJSON_GetObjectItem(audio_params, "sample_rate");
-        if (cJSON_IsNumber(sample_rate)) {
-            server_sample_rate_ = sample_rate->valueint;
-        }
-        auto frame_duration = cJSON_GetObjectItem(audio_params, "frame_duration");
-        if (cJSON_IsNumber(frame_duration)) {
-            server_frame_duration_ = frame_duration->valueint;
-        }
+    auto audio_params = root.Get("audio_params");
+    auto sample_rate = audio_params.Get("sample_rate");
+    if (sample_rate.IsNumber()) {
+        server_sample_rate_ = sample_rate.ToInt();
+    }
+    auto frame_duration = audio_params.Get("frame_duration");
+    if (frame_duration.IsNumber()) {
+        server_frame_duration_ = frame_duration.ToInt();
     }
+    ParseUplinkFrameDuration(audio_params);
+    ParseUplinkDtx(audio_params);
 
-    auto udp = cJSON_GetObjectItem(root, "udp");
-    if (!cJSON_IsObject(udp)) {
+    auto udp = root.Get("udp");
+    if (!udp.IsObject()) {
         ESP_LOGE(TAG, "UDP is not specified");
         return;
     }
-    udp_server_ = cJSON_GetObjectItem(udp, "server")->valuestring;
-    udp_port_ = cJSON_GetObjectItem(udp, "port")->valueint;
-    auto key = cJSON_GetObjectItem(udp, "key")->valuestring;
-    auto nonce = cJSON_GetObjectItem(udp, "nonce")->valuestring;
+    udp_server_ = udp.Get("server").ToString();
+    udp_port_ = udp.Get("port").ToInt();
+    auto key = udp.Get("key").ToString();
+    auto nonce = udp.Get("nonce").ToString();
 
-    // auto encryption = cJSON_GetObjectItem(udp, "encryption")->valuestring;
+    // auto encryption = udp.Get("encryption").ToString();
     // ESP_LOGI(TAG, "UDP server: %s, port: %d, encryption: %s", udp_server_.c_str(), udp_port_, encryption);
-    aes_nonce_ = DecodeHexString(nonce);
-    mbedtls_aes_init(&aes_ctx_);
-    mbedtls_aes_setkey_enc(&aes_ctx_, (const unsigned char*)DecodeHexString(key).c_str(), 128);
+    if (!udp_cipher_.SetKey(DecodeHexString(key), DecodeHexString(nonce))) {
+        ESP_LOGE(TAG, "Invalid UDP key or nonce");
+        return;
+    }
     local_sequence_ = 0;
     remote_sequence_ = 0;
     xEventGroupSetBits(event_group_handle_, MQTT_PROTOCOL_SERVER_HELLO_EVENT);
@@ -3,10 +3,10 @@
 
 
 #include "protocol.h"
+#include "udp_audio_cipher.h"
 #include <mqtt.h>
 #include <udp.h>
 #include <cJSON.h>
-#include <mbedtls/aes.h>
 #include <freertos/FreeRTOS.h>
 #include <freertos/event_groups.h>
 
@@ -26,7 +26,8 @@ public:
     ~MqttProtocol();
 
     bool Start() override;
-    bool SendAudio(std::unique_ptr<AudioStreamPacket> packet) override;
+    bool SendAudio(const AudioStreamPacket& packet) override;
+    size_t SendAudioBatch(const std::vector<std::unique_ptr<AudioStreamPacket>>& packets) override;
     bool OpenAudioChannel() override;
     void CloseAudioChannel() override;
     bool IsAudioChannelOpened() const override;
@@ -39,18 +40,21 @@ private:
     std::mutex channel_mutex_;
     std::unique_ptr<Mqtt> mqtt_;
     std::unique_ptr<Udp> udp_;
-    mbedtls_aes_context aes_ctx_;
-    std::string aes_nonce_;
+    UdpAudioCipher udp_cipher_;
+    // Header and encrypted payload of the datagrams being sent, reused so sending does not allocate;
+    // only grows, a batch uses the first entries
+    std::vector<std::string> udp_send_buffers_;
     std::string udp_server_;
     int udp_port_;
     uint32_t local_sequence_;
     uint32_t remote_sequence_;
 
     bool StartMqttClient(bool report_error=false);
-    void ParseServerHello(const cJSON* root);
+    void ParseServerHello(const JsonValue& root);
     std::string DecodeHexString(const std::string& hex_string);
 
     bool SendText(const std::string& text) override;
+    bool EncryptAudio(const AudioStreamPacket& packet, std::string& datagram);
     std::string GetHelloMessage();
 };
 
@@ -5,7 +5,7 @@
 
 #define TAG "Protocol"
 
-void Protocol::OnIncomingJson(std::function<void(const cJSON* root)> callback) {
+void Protocol::OnIncomingJson(std::function<void(const JsonValue& root)> callback) {
     on_incoming_json_ = callback;
 }
 
@@ -13,6 +13,25 @@ void Protocol::OnIncomingAudio(std::function<void(std::unique_ptr<AudioStreamPac
     on_incoming_audio_ = callback;
 }
 
+void Protocol::SetPacketAllocator(std::function<std::unique_ptr<AudioStreamPacket>()> allocator) {
+    packet_allocator_ = allocator;
+}
+
+std::unique_ptr<AudioStreamPacket> Protocol::AcquirePacket() {
+    if (packet_allocator_) {
+        return packet_allocator_();
+    }
+    return std::make_unique<AudioStreamPacket>();
+}
+
+size_t Protocol::SendAudioBatch(const std::vector<std::unique_ptr<AudioStreamPacket>>& packets) {
+    size_t sent = 0;
+    while (sent < packets.size() && SendAudio(*packets[sent])) {
+        sent++;
+    }
+    return sent;
+}
+
 void Protocol::OnAudioChannelOpened(std::function<void()> callback) {
     on_audio_channel_opened_ = callback;
 }
@@ -25,6 +44,44 @@ void Protocol::OnNetworkError(std::function<void(const std::string& message)> ca
     on_network_error_ = callback;
 }
 
+void Protocol::SetPreferredFrameDuration(int frame_duration) {
+    if (!IsSupportedFrameDuration(frame_duration)) {
+        ESP_LOGW(TAG, "Unsupported frame duration %d ms, keeping %d ms", frame_duration, preferred_frame_duration_);
+        return;
+    }
+    preferred_frame_duration_ = frame_duration;
+}
+
+bool Protocol::IsSupportedFrameDuration(int frame_duration) {
+    return frame_duration == 20 || frame_duration == 40 || frame_duration == 60;
+}
+
+void Protocol::ParseUplinkFrameDuration(const JsonValue& audio_params) {
+    // The device proposes frame_duration in its hello; the server may answer with another
+    // supported uplink_frame_duration, otherwise the proposal stands
+    uplink_frame_duration_ = preferred_frame_duration_;
+    auto uplink_frame_duration = audio_params.Get("uplink_frame_duration");
+    if (uplink_frame_duration.IsNumber()) {
+        if (IsSupportedFrameDuration(uplink_frame_duration.ToInt())) {
+            uplink_frame_duration_ = uplink_frame_duration.ToInt();
+        } else {
+            ESP_LOGW(TAG, "Server asked for an unsupported uplink frame duration %d ms", uplink_frame_duration.ToInt());
+        }
+    }
+    ESP_LOGI(TAG, "Uplink frame duration: %d ms", uplink_frame_duration_);
+}
+
+void Protocol::ParseUplinkDtx(const JsonValue& audio_params) {
+    // The device offers DTX in its hello features; without the server's "dtx": true its VAD and
+    // ASR would take the gaps for packet loss, so the uplink stays continuous
+#if CONFIG_USE_UPLINK_DTX
+    uplink_dtx_ = audio_params.Get("dtx").IsTrue();
+#else
+    uplink_dtx_ = false;
+#endif
+    ESP_LOGI(TAG, "Uplink DTX: %s", uplink_dtx_ ? "on" : "off");
+}
+
 void Protocol::SetError(const std::string& message) {
     error_occurred_ = true;
     if (on_network_error_ != nullptr) {
@@ -33,42 +90,37 @@ void Protocol::SetError(const std::string& message) {
 }
 
 void Protocol::SendAbortSpeaking(AbortReason reason) {
-    std::string message = "{\"session_id\":\"" + session_id_ + "\",\"type\":\"abort\"";
     if (reason == kAbortReasonWakeWordDetected) {
-        message += ",\"reason\":\"wake_word_detected\"";
+        SendJson(Member("session_id", session_id_), Member("type", "abort"), Member("reason", "wake_word_detected"));
+    } else {
+        SendJson(Member("session_id", session_id_), Member("type", "abort"));
     }
-    message += "}";
-    SendText(message);
 }
 
 void Protocol::SendWakeWordDetected(const std::string& wake_word) {
-    std::string json = "{\"session_id\":\"" + session_id_ + 
-                      "\",\"type\":\"listen\",\"state\":\"detect\",\"text\":\"" + wake_word + "\"}";
-    SendText(json);
+    SendJson(Member("session_id", session_id_), Member("type", "listen"), Member("state", "detect"),
+        Member("text", wake_word));
 }
 
 void Protocol::SendStartListening(ListeningMode mode) {
-    std::string message = "{\"session_id\":\"" + session_id_ + "\"";
-    message += ",\"type\":\"listen\",\"state\":\"start\"";
+    const char* mode_str;
     if (mode == kListeningModeRealtime) {
-        message += ",\"mode\":\"realtime\"";
+        mode_str = "realtime";
     } else if (mode == kListeningModeAutoStop) {
-        message += ",\"mode\":\"auto\"";
+        mode_str = "auto";
     } else {
-        message += ",\"mode\":\"manual\"";
+        mode_str = "manual";
     }
-    message += "}";
-    SendText(message);
+    SendJson(Member("session_id", session_id_), Member("type", "listen"), Member("state", "start"),
+        Member("mode", mode_str));
 }
 
 void Protocol::SendStopListening() {
-    std::string message = "{\"session_id\":\"" + session_id_ + "\",\"type\":\"listen\",\"state\":\"stop\"}";
-    SendText(message);
+    SendJson(Member("session_id", session_id_), Member("type", "listen"), Member("state", "stop"));
 }
 
 void Protocol::SendMcpMessage(const std::string& payload) {
-    std::string message = "{\"session_id\":\"" + session_id_ + "\",\"type\":\"mcp\",\"payload\":" + payload + "}";
-    SendText(message);
+    SendJson(Member("session_id", session_id_), Member("type", "mcp"), Member("payload", JsonRawValue{payload}));
 }
 
 bool Protocol::IsTimeout() const {
@@ -6,11 +6,23 @@
 #include <functional>
 #include <chrono>
 #include <vector>
+#include <memory>
+#include <mutex>
+
+#include "json_reader.h"
+#include "json_writer.h"
 
 struct AudioStreamPacket {
     int sample_rate = 0;
     int frame_duration = 0;
     uint32_t timestamp = 0;
+    // Downlink order as sent by the server, any value including 0 and wrapped ones
+    uint32_t sequence = 0;
+    // Made on the device (sounds, the audio test replay), played without the jitter buffer
+    bool local = false;
+    // esp_timer_get_time() stamps for the latency trace: uplink capture / encode done, downlink receive
+    int64_t capture_time = 0;
+    int64_t queue_time = 0;
     std::vector<uint8_t> payload;
 };
 
@@ -30,6 +42,19 @@ struct BinaryProtocol3 {
     uint8_t payload[];
 } __attribute__((packed));
 
+#define BINARY_PROTOCOL4_FLAG_REDUNDANT 0x01    // The previous frame follows the payload
+
+struct BinaryProtocol4 {
+    uint8_t type;               // Codec (0: OPUS)
+    uint8_t flags;              // BINARY_PROTOCOL4_FLAG_*
+    uint16_t frame_duration;    // Frame duration in milliseconds
+    uint32_t sequence;          // Increments by one per packet, gaps are lost packets
+    uint32_t timestamp;         // Timestamp in milliseconds (used for server-side AEC)
+    uint16_t payload_size;      // Payload size in bytes
+    uint16_t redundant_size;    // Size of the previous frame after the payload, 0 without one
+    uint8_t payload[];          // Payload, then the previous frame
+} __attribute__((packed));
+
 enum AbortReason {
     kAbortReasonNone,
     kAbortReasonWakeWordDetected
@@ -54,9 +79,22 @@ public:
     inline const std::string& session_id() const {
         return session_id_;
     }
+    // Uplink frame duration agreed in the last hello exchange
+    inline int uplink_frame_duration() const {
+        return uplink_frame_duration_;
+    }
+    // The server accepts gaps in the uplink during silence, agreed in the last hello exchange
+    inline bool uplink_dtx() const {
+        return uplink_dtx_;
+    }
+    // Proposed in the next hello, 20 / 40 / 60ms
+    void SetPreferredFrameDuration(int frame_duration);
+    static bool IsSupportedFrameDuration(int frame_duration);
 
     void OnIncomingAudio(std::function<void(std::unique_ptr<AudioStreamPacket> packet)> callback);
-    void OnIncomingJson(std::function<void(const cJSON* root)> callback);
+    // Where incoming audio packets come from, e.g. the audio service's pool; plain allocation if unset
+    void SetPacketAllocator(std::function<std::unique_ptr<AudioStreamPacket>()> allocator);
+    void OnIncomingJson(std::function<void(const JsonValue& root)> callback);
     void OnAudioChannelOpened(std::function<void()> callback);
     void OnAudioChannelClosed(std::function<void()> callback);
     void OnNetworkError(std::function<void(const std::string& message)> callback);
@@ -65,7 +103,10 @@ public:
     virtual bool OpenAudioChannel() = 0;
     virtual void CloseAudioChannel() = 0;
     virtual bool IsAudioChannelOpened() const = 0;
-    virtual bool SendAudio(std::unique_ptr<AudioStreamPacket> packet) = 0;
+    // The packet is only borrowed, the caller returns it to the audio service pool
+    virtual bool SendAudio(const AudioStreamPacket& packet) = 0;
+    // Sends a backlog in order and returns how many were sent; stops at the first failure
+    virtual size_t SendAudioBatch(const std::vector<std::unique_ptr<AudioStreamPacket>>& packets);
     virtual void SendWakeWordDetected(const std::string& wake_word);
     virtual void SendStartListening(ListeningMode mode);
     virtual void SendStopListening();
@@ -76,7 +117,7 @@ public:
     virtual void SendReminder(const std::string& content);
 
 protected:
-    std::function<void(const cJSON* root)> on_incoming_json_;
+    std::function<void(const JsonValue& root)> on_incoming_json_;
     std::function<void(std::unique_ptr<AudioStreamPacket> packet)> on_incoming_audio_;
     std::function<void()> on_audio_channel_opened_;
     std::function<void()> on_audio_channel_closed_;
@@ -84,13 +125,32 @@ protected:
 
     int server_sample_rate_ = 24000;
     int server_frame_duration_ = 60;
+    int preferred_frame_duration_ = 60;
+    int uplink_frame_duration_ = 60;
+    bool uplink_dtx_ = false;
     bool error_occurred_ = false;
     std::string session_id_;
     std::chrono::time_point<std::chrono::steady_clock> last_incoming_time_;
 
+    std::function<std::unique_ptr<AudioStreamPacket>()> packet_allocator_;
+
     virtual bool SendText(const std::string& text) = 0;
+    // Writes the members as a JSON object into the reused text buffer and sends it
+    template <typename... Members>
+    bool SendJson(const Members&... members) {
+        std::lock_guard<std::mutex> lock(text_mutex_);
+        return SendText(JsonWriter::Object(text_buffer_, members...));
+    }
+    std::unique_ptr<AudioStreamPacket> AcquirePacket();
     virtual void SetError(const std::string& message);
+    void ParseUplinkFrameDuration(const JsonValue& audio_params);
+    void ParseUplinkDtx(const JsonValue& audio_params);
     virtual bool IsTimeout() const;
+
+private:
+    // Messages are sent from the main task, the MCP tool call thread and the network tasks
+    std::mutex text_mutex_;
+    std::string text_buffer_;
 };
 
 #endif // PROTOCOL_H
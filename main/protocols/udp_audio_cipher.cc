@@ -0,0 +1,62 @@
+#include "udp_audio_cipher.h"
+
+#include <cstring>
+#include <arpa/inet.h>
+
+UdpAudioCipher::UdpAudioCipher() {
+    mbedtls_aes_init(&aes_ctx_);
+}
+
+UdpAudioCipher::~UdpAudioCipher() {
+    mbedtls_aes_free(&aes_ctx_);
+}
+
+bool UdpAudioCipher::SetKey(const std::string& key, const std::string& nonce) {
+    if (key.size() != 16 || nonce.size() != kHeaderSize) {
+        nonce_.clear();
+        return false;
+    }
+    // A new hello replaces the key of the previous session
+    mbedtls_aes_free(&aes_ctx_);
+    mbedtls_aes_init(&aes_ctx_);
+    if (mbedtls_aes_setkey_enc(&aes_ctx_, (const unsigned char*)key.data(), 128) != 0) {
+        nonce_.clear();
+        return false;
+    }
+    nonce_ = nonce;
+    return true;
+}
+
+bool UdpAudioCipher::Encrypt(const uint8_t* payload, size_t size, uint32_t timestamp, uint32_t sequence, std::string& datagram) {
+    if (nonce_.empty()) {
+        return false;
+    }
+    // The datagram keeps its capacity between packets
+    datagram.resize(kHeaderSize + size);
+    auto header = (uint8_t*)datagram.data();
+    memcpy(header, nonce_.data(), kHeaderSize);
+    *(uint16_t*)&header[2] = htons(size);
+    *(uint32_t*)&header[8] = htonl(timestamp);
+    *(uint32_t*)&header[12] = htonl(sequence);
+
+    // mbedtls advances the counter block, so it gets a copy and the header stays as sent
+    uint8_t counter[kHeaderSize];
+    memcpy(counter, header, kHeaderSize);
+    size_t nc_off = 0;
+    uint8_t stream_block[16] = {0};
+    return mbedtls_aes_crypt_ctr(&aes_ctx_, size, &nc_off, counter, stream_block, payload, header + kHeaderSize) == 0;
+}
+
+bool UdpAudioCipher::Decrypt(const std::string& datagram, std::vector<uint8_t>& payload) {
+    if (nonce_.empty() || datagram.size() < kHeaderSize) {
+        return false;
+    }
+    uint8_t counter[kHeaderSize];
+    memcpy(counter, datagram.data(), kHeaderSize);
+    size_t nc_off = 0;
+    uint8_t stream_block[16] = {0};
+    size_t size = datagram.size() - kHeaderSize;
+    payload.resize(size);
+    return mbedtls_aes_crypt_ctr(&aes_ctx_, size, &nc_off, counter, stream_block,
+        (const uint8_t*)datagram.data() + kHeaderSize, payload.data()) == 0;
+}
@@ -0,0 +1,41 @@
+#ifndef UDP_AUDIO_CIPHER_H
+#define UDP_AUDIO_CIPHER_H
+
+#include <mbedtls/aes.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/*
+ * AES-128-CTR of the MQTT UDP audio channel.
+ *
+ * Each datagram starts with a 16 byte header, the server's nonce with the payload size,
+ * timestamp and sequence filled in; the header is also the initial counter block:
+ *
+ *   |type 1u|flags 1u|payload_len 2u|ssrc 4u|timestamp 4u|sequence 4u|payload payload_len|
+ *
+ * Encrypt() writes header and ciphertext straight into the caller's datagram, and Decrypt()
+ * writes the plaintext into the caller's payload, so with buffers that are reused neither
+ * allocates. The datagram given to Decrypt() is left as received.
+ */
+class UdpAudioCipher {
+public:
+    static constexpr size_t kHeaderSize = 16;
+
+    UdpAudioCipher();
+    ~UdpAudioCipher();
+    UdpAudioCipher(const UdpAudioCipher&) = delete;
+    UdpAudioCipher& operator=(const UdpAudioCipher&) = delete;
+
+    // Raw 16 byte key and nonce from the server hello; false if either has another size
+    bool SetKey(const std::string& key, const std::string& nonce);
+    bool Encrypt(const uint8_t* payload, size_t size, uint32_t timestamp, uint32_t sequence, std::string& datagram);
+    bool Decrypt(const std::string& datagram, std::vector<uint8_t>& payload);
+
+private:
+    mbedtls_aes_context aes_ctx_;
+    std::string nonce_;
+};
+
+#endif // UDP_AUDIO_CIPHER_H
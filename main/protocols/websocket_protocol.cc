@@ -25,36 +25,49 @@ bool WebsocketProtocol::Start() {
     return true;
 }
 
-bool WebsocketProtocol::SendAudio(std::unique_ptr<AudioStreamPacket> packet) {
+bool WebsocketProtocol::SendAudio(const AudioStreamPacket& packet) {
     if (websocket_ == nullptr || !websocket_->IsConnected()) {
         return false;
     }
 
     if (version_ == 2) {
-        std::string serialized;
-        serialized.resize(sizeof(BinaryProtocol2) + packet->payload.size());
-        auto bp2 = (BinaryProtocol2*)serialized.data();
+        send_buffer_.resize(sizeof(BinaryProtocol2) + packet.payload.size());
+        auto bp2 = (BinaryProtocol2*)send_buffer_.data();
         bp2->version = htons(version_);
         bp2->type = 0;
         bp2->reserved = 0;
-        bp2->timestamp = htonl(packet->timestamp);
-        bp2->payload_size = htonl(packet->payload.size());
-        memcpy(bp2->payload, packet->payload.data(), packet->payload.size());
-
-        return websocket_->Send(serialized.data(), serialized.size(), true);
+        bp2->timestamp = htonl(packet.timestamp);
+        bp2->payload_size = htonl(packet.payload.size());
+        memcpy(bp2->payload, packet.payload.data(), packet.payload.size());
     } else if (version_ == 3) {
-        std::string serialized;
-        serialized.resize(sizeof(BinaryProtocol3) + packet->payload.size());
-        auto bp3 = (BinaryProtocol3*)serialized.data();
+        send_buffer_.resize(sizeof(BinaryProtocol3) + packet.payload.size());
+        auto bp3 = (BinaryProtocol3*)send_buffer_.data();
         bp3->type = 0;
         bp3->reserved = 0;
-        bp3->payload_size = htons(packet->payload.size());
-        memcpy(bp3->payload, packet->payload.data(), packet->payload.size());
-
-        return websocket_->Send(serialized.data(), serialized.size(), true);
+        bp3->payload_size = htons(packet.payload.size());
+        memcpy(bp3->payload, packet.payload.data(), packet.payload.size());
+    } else if (version_ == 4) {
+        size_t redundant_size = send_redundancy_ ? last_payload_.size() : 0;
+        send_buffer_.resize(sizeof(BinaryProtocol4) + packet.payload.size() + redundant_size);
+        auto bp4 = (BinaryProtocol4*)send_buffer_.data();
+        bp4->type = 0;
+        bp4->flags = redundant_size > 0 ? BINARY_PROTOCOL4_FLAG_REDUNDANT : 0;
+        bp4->frame_duration = htons(packet.frame_duration);
+        bp4->sequence = htonl(++local_sequence_);
+        bp4->timestamp = htonl(packet.timestamp);
+        bp4->payload_size = htons(packet.payload.size());
+        bp4->redundant_size = htons(redundant_size);
+        memcpy(bp4->payload, packet.payload.data(), packet.payload.size());
+        if (redundant_size > 0) {
+            memcpy(bp4->payload + packet.payload.size(), last_payload_.data(), redundant_size);
+        }
+        if (send_redundancy_) {
+            last_payload_.assign(packet.payload.begin(), packet.payload.end());
+        }
     } else {
-        return websocket_->Send(packet->payload.data(), packet->payload.size(), true);
+        return websocket_->Send(packet.payload.data(), packet.payload.size(), true);
     }
+    return websocket_->Send(send_buffer_.data(), send_buffer_.size(), true);
 }
 
 bool WebsocketProtocol::SendText(const std::string& text) {
@@ -89,6 +102,11 @@ bool WebsocketProtocol::OpenAudioChannel() {
     }
 
     error_occurred_ = false;
+    remote_sequence_ = 0;
+    protocol4_parser_.Reset();
+    local_sequence_ = 0;
+    send_redundancy_ = false;
+    last_payload_.clear();
 
     auto network = Board::GetInstance().GetNetwork();
     websocket_ = network->CreateWebSocket(1);
@@ -118,38 +136,25 @@ bool WebsocketProtocol::OpenAudioChannel() {
                     bp2->timestamp = ntohl(bp2->timestamp);
                     bp2->payload_size = ntohl(bp2->payload_size);
                     auto payload = (uint8_t*)bp2->payload;
-                    on_incoming_audio_(std::make_unique<AudioStreamPacket>(AudioStreamPacket{
-                        .sample_rate = server_sample_rate_,
-                        .frame_duration = server_frame_duration_,
-                        .timestamp = bp2->timestamp,
-                        .payload = std::vector<uint8_t>(payload, payload + bp2->payload_size)
-                    }));
+                    DeliverAudio(++remote_sequence_, bp2->timestamp, server_frame_duration_, payload, bp2->payload_size);
+                } else if (version_ == 4) {
+                    ParseBinaryProtocol4((const uint8_t*)data, len);
                 } else if (version_ == 3) {
                     BinaryProtocol3* bp3 = (BinaryProtocol3*)data;
                     bp3->type = bp3->type;
                     bp3->payload_size = ntohs(bp3->payload_size);
                     auto payload = (uint8_t*)bp3->payload;
-                    on_incoming_audio_(std::make_unique<AudioStreamPacket>(AudioStreamPacket{
-                        .sample_rate = server_sample_rate_,
-                        .frame_duration = server_frame_duration_,
-                        .timestamp = 0,
-                        .payload = std::vector<uint8_t>(payload, payload + bp3->payload_size)
-                    }));
+                    DeliverAudio(++remote_sequence_, 0, server_frame_duration_, payload, bp3->payload_size);
                 } else {
-                    on_incoming_audio_(std::make_unique<AudioStreamPacket>(AudioStreamPacket{
-                        .sample_rate = server_sample_rate_,
-                        .frame_duration = server_frame_duration_,
-                        .timestamp = 0,
-                        .payload = std::vector<uint8_t>((uint8_t*)data, (uint8_t*)data + len)
-                    }));
+                    DeliverAudio(++remote_sequence_, 0, server_frame_duration_, (const uint8_t*)data, len);
                 }
             }
         } else {
-            // Parse JSON data
-            auto root = cJSON_Parse(data);
-            auto type = cJSON_GetObjectItem(root, "type");
-            if (cJSON_IsString(type)) {
-                if (strcmp(type->valuestring, "hello") == 0) {
+            // Read in place, bounded by the frame length
+            auto root = JsonValue::Parse(data, len);
+            auto type = root.Get("type");
+            if (type.IsString()) {
+                if (type.Equals("hello")) {
                     ParseServerHello(root);
                 } else {
                     if (on_incoming_json_ != nullptr) {
@@ -157,9 +162,8 @@ bool WebsocketProtocol::OpenAudioChannel() {
                     }
                 }
             } else {
-                ESP_LOGE(TAG, "Missing message type, data: %s", data);
+                ESP_LOGE(TAG, "Missing message type, data: %.*s", (int)len, data);
             }
-            cJSON_Delete(root);
         }
         last_incoming_time_ = std::chrono::steady_clock::now();
     });
@@ -207,6 +211,9 @@ std::string WebsocketProtocol::GetHelloMessage() {
     cJSON* features = cJSON_CreateObject();
 #if CONFIG_USE_SERVER_AEC
     cJSON_AddBoolToObject(features, "aec", true);
+#endif
+#if CONFIG_USE_UPLINK_DTX
+    cJSON_AddBoolToObject(features, "dtx", true);
 #endif
     cJSON_AddBoolToObject(features, "mcp", true);
     cJSON_AddItemToObject(root, "features", features);
@@ -215,7 +222,7 @@ std::string WebsocketProtocol::GetHelloMessage() {
     cJSON_AddStringToObject(audio_params, "format", "opus");
     cJSON_AddNumberToObject(audio_params, "sample_rate", 16000);
     cJSON_AddNumberToObject(audio_params, "channels", 1);
-    cJSON_AddNumberToObject(audio_params, "frame_duration", OPUS_FRAME_DURATION_MS);
+    cJSON_AddNumberToObject(audio_params, "frame_duration", preferred_frame_duration_);
     cJSON_AddItemToObject(root, "audio_params", audio_params);
     auto json_str = cJSON_PrintUnformatted(root);
     std::string message(json_str);
@@ -224,28 +231,62 @@ std::string WebsocketProtocol::GetHelloMessage() {
     return message;
 }
 
-void WebsocketProtocol::ParseServerHello(const cJSON* root) {
-    auto transport = cJSON_GetObjectItem(root, "transport");
-    if (transport == nullptr || strcmp(transport->valuestring, "websocket") != 0) {
-        ESP_LOGE(TAG, "Unsupported transport: %s", transport->valuestring);
+void WebsocketProtocol::ParseBinaryProtocol4(const uint8_t* data, size_t len) {
+    BinaryProtocol4Frame frames[2];
+    size_t count = protocol4_parser_.Parse(data, len, server_frame_duration_, frames);
+    for (size_t i = 0; i < count; i++) {
+        DeliverAudio(frames[i].sequence, frames[i].timestamp, frames[i].frame_duration, frames[i].payload, frames[i].size);
+    }
+}
+
+void WebsocketProtocol::DeliverAudio(uint32_t sequence, uint32_t timestamp, int frame_duration, const uint8_t* payload, size_t size) {
+    auto packet = AcquirePacket();
+    packet->sample_rate = server_sample_rate_;
+    packet->frame_duration = frame_duration;
+    packet->timestamp = timestamp;
+    packet->sequence = sequence;
+    packet->local = false;
+    packet->capture_time = 0;
+    packet->queue_time = 0;
+    packet->payload.assign(payload, payload + size);
+    on_incoming_audio_(std::move(packet));
+}
+
+void WebsocketProtocol::ParseServerHello(const JsonValue& root) {
+    auto transport = root.Get("transport");
+    if (!transport.Equals("websocket")) {
+        ESP_LOGE(TAG, "Unsupported transport: %s", transport.ToString().c_str());
         return;
     }
 
-    auto session_id = cJSON_GetObjectItem(root, "session_id");
-    if (cJSON_IsString(session_id)) {
-        session_id_ = session_id->valuestring;
+    auto session_id = root.Get("session_id");
+    if (session_id.IsString()) {
+        session_id_ = session_id.ToString();
         ESP_LOGI(TAG, "Session ID: %s", session_id_.c_str());
     }
 
-    auto audio_params = cJSON_GetObjectItem(root, "audio_params");
-    if (cJSON_IsObject(audio_params)) {
-        auto sample_rate = cJSON_GetObjectItem(audio_params, "sample_rate");
-        if (cJSON_IsNumber(sample_rate)) {
-            server_sample_rate_ = sample_rate->valueint;
-        }
-        auto frame_duration = cJSON_GetObjectItem(audio_params, "frame_duration");
-        if (cJSON_IsNumber(frame_duration)) {
-            server_frame_duration_ = frame_duration->valueint;
+    auto audio_params = root.Get("audio_params");
+    auto sample_rate = audio_params.Get("sample_rate");
+    if (sample_rate.IsNumber()) {
+        server_sample_rate_ = sample_rate.ToInt();
+    }
+    auto frame_duration = audio_params.Get("frame_duration");
+    if (frame_duration.IsNumber()) {
+        server_frame_duration_ = frame_duration.ToInt();
+    }
+    ParseUplinkFrameDuration(audio_params);
+    ParseUplinkDtx(audio_params);
+
+    // Version 4 is only used when the server confirms it, other servers get the plain Opus frames
+    // of version 1 unless they name an older version
+    if (version_ == 4) {
+        auto version = root.Get("version");
+        int server_version = version.IsNumber() ? version.ToInt() : 1;
+        if (server_version != 4) {
+            version_ = (server_version >= 1 && server_version <= 3) ? server_version : 1;
+            ESP_LOGW(TAG, "Server does not support binary protocol 4, using version %d", version_);
+        } else {
+            send_redundancy_ = audio_params.Get("redundancy").IsTrue();
         }
     }
 
@@ -3,6 +3,7 @@
 
 
 #include "protocol.h"
+#include "binary_protocol4_parser.h"
 
 #include <web_socket.h>
 #include <freertos/FreeRTOS.h>
@@ -16,7 +17,7 @@ public:
     ~WebsocketProtocol();
 
     bool Start() override;
-    bool SendAudio(std::unique_ptr<AudioStreamPacket> packet) override;
+    bool SendAudio(const AudioStreamPacket& packet) override;
     bool OpenAudioChannel() override;
     void CloseAudioChannel() override;
     bool IsAudioChannelOpened() const override;
@@ -25,8 +26,20 @@ private:
     EventGroupHandle_t event_group_handle_;
     std::unique_ptr<WebSocket> websocket_;
     int version_ = 1;
-
-    void ParseServerHello(const cJSON* root);
+    // TCP keeps the order, so before version 4 incoming packets are simply numbered on arrival
+    uint32_t remote_sequence_ = 0;
+    // Version 4 packets carry their own sequence
+    BinaryProtocol4Parser protocol4_parser_;
+    uint32_t local_sequence_ = 0;
+    // Version 4: the server asked for the previous frame in each packet
+    bool send_redundancy_ = false;
+    std::vector<uint8_t> last_payload_;
+    // Binary frame being sent, reused so serializing does not allocate
+    std::vector<uint8_t> send_buffer_;
+
+    void ParseServerHello(const JsonValue& root);
+    void ParseBinaryProtocol4(const uint8_t* data, size_t len);
+    void DeliverAudio(uint32_t sequence, uint32_t timestamp, int frame_duration, const uint8_t* payload, size_t size);
     bool SendText(const std::string& text) override;
     std::string GetHelloMessage();
 };
@@ -302,6 +302,9 @@ bool ReminderManager::RemoveReminder(const std::string& id) {
              it->id.c_str(), it->content.c_str());
 
     // 2. 从内存中删除
+    if (on_reminder_removed_) {
+        on_reminder_removed_(it->id);
+    }
     reminders_.erase(it);
 
     // 3. 先保存到 NVS
@@ -463,10 +466,24 @@ bool ReminderManager::SyncPull(const std::string& server_url, bool force_replace
 
     ESP_LOGI(TAG, "Parsed %d reminders from server", count);
 
+    std::vector<std::string> known_ids;
+    for (const auto& reminder : reminders_) {
+        known_ids.push_back(reminder.id);
+    }
+
     // 根据模式选择同步策略
     if (force_replace) {
         // 强制替换模式：清空本地，完全使用服务器数据
         ESP_LOGW(TAG, "Force replace mode: clearing local reminders and using server data");
+        if (on_reminder_removed_) {
+            for (const auto& id : known_ids) {
+                bool kept = std::any_of(remote_reminders.begin(), remote_reminders.end(),
+                    [&id](const Reminder& remote) { return remote.id == id; });
+                if (!kept) {
+                    on_reminder_removed_(id);
+                }
+            }
+        }
         reminders_ = remote_reminders;
         SaveToNVS();
     } else {
@@ -481,6 +498,16 @@ bool ReminderManager::SyncPull(const std::string& server_url, bool force_replace
     });
 
     ESP_LOGI(TAG, "Sync pull completed. Total reminders: %d", (int)reminders_.size());
+
+    if (on_upcoming_reminder_) {
+        long long now = std::time(nullptr);
+        for (const auto& reminder : reminders_) {
+            if (reminder.timestamp > now &&
+                std::find(known_ids.begin(), known_ids.end(), reminder.id) == known_ids.end()) {
+                on_upcoming_reminder_(reminder);
+            }
+        }
+    }
     return true;
 }
 
@@ -13,6 +13,7 @@ struct Reminder {
     long long created_at;
     std::string scheduled_time;  // HH:MM format from server
     mutable bool local_alert_shown = false;
+    mutable int tts_prefetch_frame_duration = 0;   // Frame duration of the queued pre-warm prefetch, 0 if none
 
     std::string to_json() const;
     static Reminder from_json(const cJSON* json);
@@ -45,6 +46,10 @@ public:
     bool SyncPull(const std::string& server_url, bool force_replace = false);
     bool SyncPush(const std::string& server_url);
     void SetServerUrl(const std::string& url) { server_url_ = url; }
+    // SyncPull() 拉取到新的、尚未到期的提醒时回调（用于预取提醒语音）
+    void OnUpcomingReminder(std::function<void(const Reminder&)> callback) { on_upcoming_reminder_ = callback; }
+    // 提醒被删除（本地删除或同步时被服务器数据替换）时回调
+    void OnReminderRemoved(std::function<void(const std::string& id)> callback) { on_reminder_removed_ = callback; }
     std::string GetServerUrl() const { return server_url_; }
 
 private:
@@ -53,6 +58,8 @@ private:
 
     std::vector<Reminder> reminders_;
     std::string server_url_;
+    std::function<void(const Reminder&)> on_upcoming_reminder_;
+    std::function<void(const std::string& id)> on_reminder_removed_;
 
     // 静态标志：是否正在处理系统提醒
     static bool processing_system_reminder_;
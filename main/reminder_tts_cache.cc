@@ -0,0 +1,265 @@
+#include "reminder_tts_cache.h"
+
+#include <esp_log.h>
+#include <esp_spiffs.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <cstring>
+#include <cinttypes>
+
+#define TAG "ReminderTtsCache"
+
+#define TTS_CACHE_BASE_PATH "/tts"
+#define TTS_CACHE_PARTITION "tts_cache"
+#define TTS_CACHE_INDEX_PATH TTS_CACHE_BASE_PATH "/index"
+#define TTS_CACHE_MAGIC "RTS1"
+#define TTS_CACHE_MAX_PACKET_BYTES 1500
+
+ReminderTtsCache::ReminderTtsCache(size_t budget_bytes) : budget_bytes_(budget_bytes) {
+    statistics_.budget = budget_bytes;
+}
+
+ReminderTtsCache::~ReminderTtsCache() {
+    EndWrite(false);
+    if (mounted_) {
+        esp_vfs_spiffs_unregister(TTS_CACHE_PARTITION);
+    }
+}
+
+bool ReminderTtsCache::Initialize() {
+    esp_vfs_spiffs_conf_t conf = {
+        .base_path = TTS_CACHE_BASE_PATH,
+        .partition_label = TTS_CACHE_PARTITION,
+        .max_files = 3,
+        .format_if_mount_failed = true,
+    };
+    esp_err_t ret = esp_vfs_spiffs_register(&conf);
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "No %s partition (%s), reminder TTS is not cached", TTS_CACHE_PARTITION, esp_err_to_name(ret));
+        return false;
+    }
+    mounted_ = true;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    LoadIndex();
+    size_t total = 0, used = 0;
+    esp_spiffs_info(TTS_CACHE_PARTITION, &total, &used);
+    ESP_LOGI(TAG, "Mounted, %u entries, %u bytes cached, %u/%u bytes used", (unsigned)statistics_.entries,
+        (unsigned)statistics_.bytes, (unsigned)used, (unsigned)total);
+    return true;
+}
+
+std::string ReminderTtsCache::MakeKey(const std::string& text, const std::string& voice, int frame_duration_ms) {
+    // FNV-1a over "voice\nduration\ntext", short enough for a SPIFFS file name
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    auto mix = [&hash](const std::string& s) {
+        for (unsigned char c : s) {
+            hash ^= c;
+            hash *= 0x100000001b3ULL;
+        }
+    };
+    mix(voice);
+    mix("\n");
+    mix(std::to_string(frame_duration_ms));
+    mix("\n");
+    mix(text);
+    char key[17];
+    snprintf(key, sizeof(key), "%016" PRIx64, hash);
+    return key;
+}
+
+std::string ReminderTtsCache::PathOf(const std::string& key) const {
+    return TTS_CACHE_BASE_PATH "/" + key + ".opus";
+}
+
+ReminderTtsCache::Entry* ReminderTtsCache::Find(const std::string& key) {
+    for (auto& entry : entries_) {
+        if (entry.key == key) {
+            return &entry;
+        }
+    }
+    return nullptr;
+}
+
+bool ReminderTtsCache::Contains(const std::string& key) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return Find(key) != nullptr;
+}
+
+bool ReminderTtsCache::Read(const std::string& key, std::function<void(std::vector<uint8_t>& opus)> on_packet) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto entry = Find(key);
+        if (entry == nullptr) {
+            statistics_.misses++;
+            return false;
+        }
+        entry->last_used = ++use_counter_;
+        statistics_.hits++;
+        SaveIndex();
+    }
+
+    FILE* file = fopen(PathOf(key).c_str(), "rb");
+    char magic[4];
+    if (file == nullptr || fread(magic, 1, sizeof(magic), file) != sizeof(magic) || memcmp(magic, TTS_CACHE_MAGIC, sizeof(magic)) != 0) {
+        ESP_LOGW(TAG, "Entry %s is unreadable, dropping it", key.c_str());
+        if (file != nullptr) {
+            fclose(file);
+        }
+        std::lock_guard<std::mutex> lock(mutex_);
+        statistics_.hits--;
+        statistics_.misses++;
+        entries_.erase(std::remove_if(entries_.begin(), entries_.end(), [&key](const Entry& e) { return e.key == key; }), entries_.end());
+        remove(PathOf(key).c_str());
+        SaveIndex();
+        return false;
+    }
+
+    std::vector<uint8_t> opus;
+    uint8_t header[2];
+    while (fread(header, 1, sizeof(header), file) == sizeof(header)) {
+        size_t size = header[0] | (header[1] << 8);
+        opus.resize(size);
+        if (size > TTS_CACHE_MAX_PACKET_BYTES || fread(opus.data(), 1, size, file) != size) {
+            break;
+        }
+        on_packet(opus);
+    }
+    fclose(file);
+    return true;
+}
+
+bool ReminderTtsCache::BeginWrite(const std::string& key) {
+    EndWrite(false);
+    if (!mounted_) {
+        return false;
+    }
+    {
+        // Replaced, not kept alongside
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto existing = Find(key);
+        if (existing != nullptr) {
+            statistics_.bytes -= existing->size;
+            entries_.erase(entries_.begin() + (existing - entries_.data()));
+            statistics_.entries = entries_.size();
+            SaveIndex();
+        }
+    }
+    writer_ = fopen(PathOf(key).c_str(), "wb");
+    if (writer_ == nullptr) {
+        ESP_LOGW(TAG, "Failed to create entry %s", key.c_str());
+        return false;
+    }
+    writer_key_ = key;
+    writer_bytes_ = 0;
+    writer_failed_ = fwrite(TTS_CACHE_MAGIC, 1, 4, writer_) != 4;
+    return !writer_failed_;
+}
+
+void ReminderTtsCache::Append(const std::vector<uint8_t>& opus) {
+    if (writer_ == nullptr || writer_failed_) {
+        return;
+    }
+    if (opus.size() > TTS_CACHE_MAX_PACKET_BYTES || writer_bytes_ + opus.size() + 6 > budget_bytes_) {
+        writer_failed_ = true;
+        return;
+    }
+    uint8_t header[2] = { (uint8_t)(opus.size() & 0xFF), (uint8_t)(opus.size() >> 8) };
+    if (fwrite(header, 1, sizeof(header), writer_) != sizeof(header) ||
+        fwrite(opus.data(), 1, opus.size(), writer_) != opus.size()) {
+        writer_failed_ = true;
+        return;
+    }
+    writer_bytes_ += sizeof(header) + opus.size();
+}
+
+bool ReminderTtsCache::EndWrite(bool commit) {
+    if (writer_ == nullptr) {
+        return false;
+    }
+    bool ok = fclose(writer_) == 0 && commit && !writer_failed_ && writer_bytes_ > 0;
+    writer_ = nullptr;
+    std::string path = PathOf(writer_key_);
+    if (!ok) {
+        remove(path.c_str());
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    size_t size = writer_bytes_ + 4;
+    Evict(size);
+    entries_.push_back({writer_key_, size, ++use_counter_});
+    statistics_.bytes += size;
+    statistics_.entries = entries_.size();
+    SaveIndex();
+    ESP_LOGI(TAG, "Stored %s, %u bytes, %u entries / %u bytes cached", writer_key_.c_str(), (unsigned)size,
+        (unsigned)statistics_.entries, (unsigned)statistics_.bytes);
+    return true;
+}
+
+void ReminderTtsCache::Evict(size_t needed_bytes) {
+    while (!entries_.empty() && statistics_.bytes + needed_bytes > budget_bytes_) {
+        auto oldest = std::min_element(entries_.begin(), entries_.end(), [](const Entry& a, const Entry& b) {
+            return a.last_used < b.last_used;
+        });
+        ESP_LOGI(TAG, "Evicting %s (%u bytes)", oldest->key.c_str(), (unsigned)oldest->size);
+        remove(PathOf(oldest->key).c_str());
+        statistics_.bytes -= oldest->size;
+        entries_.erase(oldest);
+    }
+}
+
+void ReminderTtsCache::LoadIndex() {
+    entries_.clear();
+    statistics_.bytes = 0;
+    FILE* file = fopen(TTS_CACHE_INDEX_PATH, "r");
+    if (file != nullptr) {
+        char key[20];
+        unsigned size, last_used;
+        while (fscanf(file, "%19s %u %u", key, &size, &last_used) == 3) {
+            struct stat st;
+            if (stat(PathOf(key).c_str(), &st) != 0 || (size_t)st.st_size != size) {
+                continue;
+            }
+            entries_.push_back({key, size, last_used});
+            statistics_.bytes += size;
+            use_counter_ = std::max<uint32_t>(use_counter_, last_used);
+        }
+        fclose(file);
+    }
+
+    // Drop files not in the index, e.g. a write cut short by a reboot
+    DIR* dir = opendir(TTS_CACHE_BASE_PATH);
+    if (dir != nullptr) {
+        struct dirent* de;
+        while ((de = readdir(dir)) != nullptr) {
+            std::string name = de->d_name;
+            size_t dot = name.rfind(".opus");
+            if (dot != std::string::npos && Find(name.substr(0, dot)) == nullptr) {
+                remove((TTS_CACHE_BASE_PATH "/" + name).c_str());
+            }
+        }
+        closedir(dir);
+    }
+
+    Evict(0);
+    statistics_.entries = entries_.size();
+}
+
+void ReminderTtsCache::SaveIndex() {
+    FILE* file = fopen(TTS_CACHE_INDEX_PATH, "w");
+    if (file == nullptr) {
+        ESP_LOGW(TAG, "Failed to write the index");
+        return;
+    }
+    for (const auto& entry : entries_) {
+        fprintf(file, "%s %u %u\n", entry.key.c_str(), (unsigned)entry.size, (unsigned)entry.last_used);
+    }
+    fclose(file);
+}
+
+ReminderTtsCacheStatistics ReminderTtsCache::GetStatistics() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return statistics_;
+}
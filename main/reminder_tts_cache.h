@@ -0,0 +1,74 @@
+#ifndef REMINDER_TTS_CACHE_H
+#define REMINDER_TTS_CACHE_H
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <functional>
+#include <cstdio>
+#include <cstdint>
+
+struct ReminderTtsCacheStatistics {
+    uint32_t hits = 0;
+    uint32_t misses = 0;
+    uint32_t entries = 0;
+    size_t bytes = 0;
+    size_t budget = 0;
+};
+
+/*
+ * Opus packets of reminder TTS kept on the tts_cache SPIFFS partition, so a daily reminder
+ * ("吃药", "喝水") is not downloaded again every day.
+ *
+ * Entries are keyed by a hash of the final TTS text, the voice and the Opus frame duration
+ * (packets must match the duration negotiated for the session). Each entry is one file of
+ * length-prefixed packets, and an index file keeps the sizes and the use order; the least
+ * recently used entries are removed to stay within the budget.
+ */
+class ReminderTtsCache {
+public:
+    explicit ReminderTtsCache(size_t budget_bytes);
+    ~ReminderTtsCache();
+
+    // Mounts the partition and loads the index; without it every lookup is a miss
+    bool Initialize();
+    static std::string MakeKey(const std::string& text, const std::string& voice, int frame_duration_ms);
+
+    bool Contains(const std::string& key);
+    // Hands the packets of an entry to on_packet in order; false (a miss) if there is none
+    bool Read(const std::string& key, std::function<void(std::vector<uint8_t>& opus)> on_packet);
+
+    // Writes a new entry packet by packet, it only becomes visible after EndWrite(true)
+    bool BeginWrite(const std::string& key);
+    void Append(const std::vector<uint8_t>& opus);
+    bool EndWrite(bool commit);
+
+    ReminderTtsCacheStatistics GetStatistics();
+
+private:
+    struct Entry {
+        std::string key;
+        size_t size;
+        uint32_t last_used;
+    };
+
+    std::mutex mutex_;
+    bool mounted_ = false;
+    size_t budget_bytes_;
+    std::vector<Entry> entries_;
+    uint32_t use_counter_ = 0;
+    ReminderTtsCacheStatistics statistics_;
+
+    FILE* writer_ = nullptr;
+    std::string writer_key_;
+    size_t writer_bytes_ = 0;
+    bool writer_failed_ = false;
+
+    std::string PathOf(const std::string& key) const;
+    Entry* Find(const std::string& key);
+    void Evict(size_t needed_bytes);
+    void LoadIndex();
+    void SaveIndex();
+};
+
+#endif // REMINDER_TTS_CACHE_H
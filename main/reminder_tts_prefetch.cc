@@ -0,0 +1,162 @@
+#include "reminder_tts_prefetch.h"
+
+#include <esp_log.h>
+#include <esp_heap_caps.h>
+#include <sys/time.h>
+#include <algorithm>
+#include <cstring>
+
+#define TAG "ReminderTtsPrefetch"
+
+#define MAX_CANCELLED_IDS 8
+
+static int64_t NowMs() {
+    struct timeval tv;
+    gettimeofday(&tv, nullptr);
+    return (int64_t)tv.tv_sec * 1000 + tv.tv_usec / 1000;
+}
+
+ReminderTtsPrefetch::ReminderTtsPrefetch(size_t capacity) : capacity_(capacity) {
+}
+
+ReminderTtsPrefetch::~ReminderTtsPrefetch() {
+    if (buffer_ != nullptr) {
+        heap_caps_free(buffer_);
+    }
+}
+
+bool ReminderTtsPrefetch::Begin(const std::string& key, const std::string& reminder_id, long long due_time, int frame_duration) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = std::find(cancelled_ids_.begin(), cancelled_ids_.end(), reminder_id);
+    if (it != cancelled_ids_.end()) {
+        cancelled_ids_.erase(it);
+        return false;
+    }
+    if (buffer_ == nullptr) {
+        buffer_ = (uint8_t*)heap_caps_malloc(capacity_, MALLOC_CAP_SPIRAM);
+        if (buffer_ == nullptr) {
+            ESP_LOGW(TAG, "Failed to allocate %u bytes in PSRAM", (unsigned)capacity_);
+            return false;
+        }
+    }
+    // Only the next reminder is held, a newer prefetch replaces the previous one
+    key_ = key;
+    reminder_id_ = reminder_id;
+    due_time_ = due_time;
+    frame_duration_ = frame_duration;
+    size_ = 0;
+    overflow_ = false;
+    ready_ = false;
+    fetching_ = true;
+    cancelled_ = false;
+    statistics_.started++;
+    return true;
+}
+
+void ReminderTtsPrefetch::Append(const std::vector<uint8_t>& opus) {
+    // Only the fetching task writes, Take() does not read until ready_
+    if (!fetching_ || overflow_) {
+        return;
+    }
+    if (size_ + 2 + opus.size() > capacity_) {
+        ESP_LOGW(TAG, "Reminder audio is longer than the %u byte buffer", (unsigned)capacity_);
+        overflow_ = true;
+        return;
+    }
+    buffer_[size_] = opus.size() & 0xFF;
+    buffer_[size_ + 1] = opus.size() >> 8;
+    memcpy(buffer_ + size_ + 2, opus.data(), opus.size());
+    size_ += 2 + opus.size();
+}
+
+void ReminderTtsPrefetch::End(bool ok) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!fetching_) {
+        return;
+    }
+    fetching_ = false;
+    if (cancelled_) {
+        statistics_.cancelled++;
+        ESP_LOGI(TAG, "Prefetch of reminder %s cancelled", reminder_id_.c_str());
+        return;
+    }
+    if (!ok || overflow_ || size_ == 0) {
+        return;
+    }
+    ready_ = true;
+    statistics_.completed++;
+    statistics_.last_lead_ms = (int64_t)due_time_ * 1000 - NowMs();
+    if (statistics_.completed == 1 || statistics_.last_lead_ms < statistics_.min_lead_ms) {
+        statistics_.min_lead_ms = statistics_.last_lead_ms;
+    }
+    ESP_LOGI(TAG, "Reminder %s ready %lld ms before due, %u bytes", reminder_id_.c_str(),
+        statistics_.last_lead_ms, (unsigned)size_);
+}
+
+void ReminderTtsPrefetch::Cancel(const std::string& reminder_id) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if ((fetching_ || ready_) && reminder_id_ == reminder_id) {
+        cancelled_ = true;
+        if (ready_) {
+            ready_ = false;
+            statistics_.cancelled++;
+        }
+        return;
+    }
+    // Its prefetch may still be queued
+    cancelled_ids_.push_back(reminder_id);
+    if (cancelled_ids_.size() > MAX_CANCELLED_IDS) {
+        cancelled_ids_.pop_front();
+    }
+}
+
+void ReminderTtsPrefetch::Invalidate(const std::string& reminder_id) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if ((fetching_ || ready_) && reminder_id_ == reminder_id) {
+        cancelled_ = true;
+        if (ready_) {
+            ready_ = false;
+            statistics_.cancelled++;
+        }
+    }
+}
+
+bool ReminderTtsPrefetch::Take(const std::string& key, int frame_duration, std::function<void(std::vector<uint8_t>& opus)> on_packet) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!ready_) {
+            return false;
+        }
+        if (frame_duration_ != frame_duration) {
+            // The key covers the frame duration too, this tells a renegotiated session from another reminder
+            statistics_.stale++;
+            ESP_LOGW(TAG, "Prefetched reminder %s has %d ms frames, the session uses %d ms", reminder_id_.c_str(),
+                frame_duration_, frame_duration);
+            return false;
+        }
+        if (key_ != key) {
+            return false;
+        }
+        ready_ = false;
+        statistics_.used++;
+        ESP_LOGI(TAG, "Sending prefetched reminder %s, %lld ms after due", reminder_id_.c_str(),
+            NowMs() - (int64_t)due_time_ * 1000);
+    }
+
+    // Begin() only runs on the same task, so the buffer stays as it is while it is sent
+    std::vector<uint8_t> opus;
+    size_t offset = 0;
+    while (offset + 2 <= size_) {
+        size_t packet_size = buffer_[offset] | (buffer_[offset + 1] << 8);
+        offset += 2;
+        opus.assign(buffer_ + offset, buffer_ + offset + packet_size);
+        offset += packet_size;
+        on_packet(opus);
+    }
+    return true;
+}
+
+ReminderTtsPrefetchStatistics ReminderTtsPrefetch::GetStatistics() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return statistics_;
+}
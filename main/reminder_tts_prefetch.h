@@ -0,0 +1,71 @@
+#ifndef REMINDER_TTS_PREFETCH_H
+#define REMINDER_TTS_PREFETCH_H
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <functional>
+#include <cstdint>
+
+struct ReminderTtsPrefetchStatistics {
+    uint32_t started = 0;
+    uint32_t completed = 0;
+    uint32_t cancelled = 0;
+    uint32_t used = 0;
+    uint32_t stale = 0;             // Ready, but for another frame duration than the session's
+    int64_t last_lead_ms = 0;       // Due time minus the time the audio was ready, negative if late
+    int64_t min_lead_ms = 0;
+};
+
+/*
+ * Opus packets of the reminder about to fire, fetched during the pre-warm window.
+ *
+ * One reminder at a time is held in a fixed PSRAM buffer as length-prefixed packets, so
+ * they can be sent the moment the reminder is due without waiting for the TTS server.
+ * Cancel() stops a fetch in progress (the fetch loop polls cancelled()) and drops a ready
+ * one, e.g. when the reminder is removed.
+ *
+ * The packets are encoded with the frame duration given to Begin(), which must match the
+ * session's. Invalidate() drops them when the session renegotiates it, so the reminder can
+ * be fetched again with the new one.
+ */
+class ReminderTtsPrefetch {
+public:
+    explicit ReminderTtsPrefetch(size_t capacity);
+    ~ReminderTtsPrefetch();
+
+    // False if the reminder was removed before its prefetch started
+    bool Begin(const std::string& key, const std::string& reminder_id, long long due_time, int frame_duration);
+    void Append(const std::vector<uint8_t>& opus);
+    void End(bool ok);
+    void Cancel(const std::string& reminder_id);
+    // Like Cancel(), but a prefetch of reminder_id that is still queued runs as usual
+    void Invalidate(const std::string& reminder_id);
+    bool cancelled() const { return cancelled_; }
+
+    // Hands the packets for key to on_packet and releases them; false if they are not ready
+    // or not encoded with frame_duration
+    bool Take(const std::string& key, int frame_duration, std::function<void(std::vector<uint8_t>& opus)> on_packet);
+
+    ReminderTtsPrefetchStatistics GetStatistics();
+
+private:
+    std::mutex mutex_;
+    uint8_t* buffer_ = nullptr;
+    size_t capacity_;
+    size_t size_ = 0;
+    bool overflow_ = false;
+    bool ready_ = false;
+    bool fetching_ = false;
+    std::atomic<bool> cancelled_{false};
+    std::string key_;
+    std::string reminder_id_;
+    long long due_time_ = 0;
+    int frame_duration_ = 0;
+    std::deque<std::string> cancelled_ids_;     // Removed while their prefetch was still queued
+    ReminderTtsPrefetchStatistics statistics_;
+};
+
+#endif // REMINDER_TTS_PREFETCH_H
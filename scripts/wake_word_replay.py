@@ -0,0 +1,310 @@
+import socket
+import wave
+import time
+import struct
+import argparse
+import os
+
+
+'''
+  Replay recorded WAV files into the device in place of the microphone (CONFIG_USE_AUDIO_REPLAY),
+  collect the wake word / VAD events it reports back, and score them against labels.
+
+  Labels: a "<file>.wav.labels" file next to each WAV, or --labels with a CSV of "file,seconds" lines,
+  each giving the time a wake word ends. Files without labels count as negatives (false accepts only).
+
+  --stub runs a simple energy detector locally instead of a device, to check corpora and labels
+  without hardware or models.
+
+  --listen starts a listening session ("SL"): the idle device runs the audio processor in place of the wake word,
+  as in realtime listening but without a server, so VAD and DTX events are reported instead of wake words.
+
+  --dtx scores the uplink DTX (CONFIG_USE_UPLINK_DTX, implies --listen): the time and bytes not sent,
+  and how much of each speech onset was clipped. Onsets are taken from a local energy reference with
+  10ms resolution. The device reports "dtx 1 <bytes saved>" when it starts suppressing and
+  "dtx 0 <pre-roll ms>" when speech resumes; with --stub the same decisions are simulated from the stub
+  VAD. Device positions include the AFE delay, so the clipping is an upper bound.
+'''
+
+SAMPLE_RATE = 16000
+CHUNK_SAMPLES = 320         # 20ms per datagram
+REPLAY_BUFFER_SAMPLES = SAMPLE_RATE * 2
+
+
+def read_wav(path):
+    with wave.open(path, "rb") as wav_file:
+        if wav_file.getframerate() != SAMPLE_RATE or wav_file.getnchannels() != 1 or wav_file.getsampwidth() != 2:
+            raise ValueError(f"{path}: 16kHz mono 16-bit required")
+        return wav_file.readframes(wav_file.getnframes())
+
+
+def load_labels(files, labels_csv):
+    labels = {path: [] for path in files}
+    if labels_csv:
+        with open(labels_csv) as f:
+            for line in f:
+                line = line.strip()
+                if not line or line.startswith("#"):
+                    continue
+                name, seconds = line.rsplit(",", 1)
+                for path in files:
+                    if os.path.basename(path) == os.path.basename(name.strip()):
+                        labels[path].append(float(seconds))
+    for path in files:
+        sidecar = path + ".labels"
+        if os.path.exists(sidecar):
+            with open(sidecar) as f:
+                labels[path] += [float(line) for line in f if line.strip()]
+    return labels
+
+
+def build_corpus(files, labels, gap):
+    '''Concatenate the files with silence in between; returns the PCM and the labelled times in seconds'''
+    pcm = bytearray()
+    targets = []
+    silence = bytes(int(gap * SAMPLE_RATE) * 2)
+    for path in files:
+        offset = len(pcm) / 2 / SAMPLE_RATE
+        targets += [offset + t for t in labels[path]]
+        pcm += read_wav(path)
+        pcm += silence
+    return bytes(pcm), targets
+
+
+def replay_device(pcm, device, port, speed, listen):
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.settimeout(0)
+    address = (device, port)
+    events = []
+    stats = None
+
+    def poll():
+        nonlocal stats
+        while True:
+            try:
+                message, _ = sock.recvfrom(256)
+            except (BlockingIOError, socket.timeout):
+                return
+            fields = message.decode(errors="replace").split(" ", 2)
+            if fields[0] == "stats":
+                stats = [int(v) for v in " ".join(fields[1:]).split()]
+            else:
+                events.append((fields[0], int(fields[1]) / SAMPLE_RATE, fields[2] if len(fields) > 2 else ""))
+
+    sock.sendto(b"SL" if listen else b"S", address)
+    time.sleep(0.1)
+    chunk_bytes = CHUNK_SAMPLES * 2
+    interval = CHUNK_SAMPLES / SAMPLE_RATE / speed
+    start = time.monotonic()
+    for i, offset in enumerate(range(0, len(pcm), chunk_bytes)):
+        sock.sendto(b"P" + pcm[offset:offset + chunk_bytes], address)
+        poll()
+        delay = start + (i + 1) * interval - time.monotonic()
+        if delay > 0:
+            time.sleep(delay)
+    sock.sendto(b"E", address)
+
+    deadline = time.monotonic() + 3 + REPLAY_BUFFER_SAMPLES / SAMPLE_RATE
+    while stats is None and time.monotonic() < deadline:
+        poll()
+        time.sleep(0.01)
+    sock.close()
+    return events, stats
+
+
+def replay_stub(pcm, threshold):
+    '''Energy detector: a "wake word" ends where a loud burst of at least 300ms goes quiet'''
+    events = []
+    frame = CHUNK_SAMPLES
+    loud = 0
+    start = time.perf_counter()
+    samples = struct.unpack(f"<{len(pcm) // 2}h", pcm)
+    for offset in range(0, len(samples) - frame + 1, frame):
+        block = samples[offset:offset + frame]
+        energy = sum(s * s for s in block) / frame
+        if energy > threshold * threshold:
+            if loud == 0:
+                events.append(("vad", offset / SAMPLE_RATE, "1"))
+            loud += 1
+        elif loud > 0:
+            events.append(("vad", offset / SAMPLE_RATE, "0"))
+            if loud * frame >= SAMPLE_RATE * 3 // 10:
+                events.append(("wake", offset / SAMPLE_RATE, "stub"))
+            loud = 0
+    feed_us = int((time.perf_counter() - start) * 1e6)
+    return events, [len(samples), 0, feed_us, feed_us]
+
+
+def speech_onsets(pcm, threshold, min_silence):
+    '''Reference onsets: the first loud 10ms block after at least min_silence seconds below threshold'''
+    block = SAMPLE_RATE // 100
+    samples = struct.unpack(f"<{len(pcm) // 2}h", pcm)
+    onsets = []
+    quiet = min_silence
+    for offset in range(0, len(samples) - block + 1, block):
+        chunk = samples[offset:offset + block]
+        if sum(s * s for s in chunk) / block > threshold * threshold:
+            if quiet >= min_silence:
+                onsets.append(offset / SAMPLE_RATE)
+            quiet = 0
+        else:
+            quiet += block / SAMPLE_RATE
+    return onsets
+
+
+def simulate_dtx(events, duration, frame_ms, hangover_ms, preroll_ms, frame_bytes):
+    '''Mirror of UplinkDtx on the stub VAD events, reported the way the device reports them'''
+    frame = frame_ms / 1000
+    vad = sorted((t, value == "1") for name, t, value in events if name == "vad")
+    hangover_frames = -(-hangover_ms // frame_ms)
+    preroll_frames = -(-preroll_ms // frame_ms)
+    dtx_events = []
+    speaking = False
+    suppressing = False
+    hangover_left = hangover_frames
+    held = 0
+    suppressed = 0
+    t = 0.0
+    index = 0
+    while t < duration:
+        while index < len(vad) and vad[index][0] <= t:
+            speaking = vad[index][1]
+            index += 1
+        if speaking:
+            hangover_left = hangover_frames
+            if suppressing:
+                suppressing = False
+                dtx_events.append(("dtx", t, f"0 {held * frame_ms}"))
+                held = 0
+        elif not suppressing and hangover_left > 0:
+            hangover_left -= 1
+        else:
+            if not suppressing:
+                suppressing = True
+                dtx_events.append(("dtx", t, f"1 {suppressed * frame_bytes}"))
+            if held >= preroll_frames:
+                suppressed += 1
+            else:
+                held += 1
+        t += frame
+    return dtx_events, (suppressed + held) * frame_bytes
+
+
+def score_dtx(dtx_events, onsets, duration, saved_bytes):
+    '''Suppressed stretches from the dtx events; an onset inside one is clipped up to where sending resumed'''
+    stretches = []
+    start = None
+    for _, t, value in sorted(dtx_events, key=lambda e: e[1]):
+        fields = value.split()
+        if fields[0] == "1" and start is None:
+            start = t
+        elif fields[0] == "0" and start is not None:
+            stretches.append((start, max(start, t - int(fields[1]) / 1000)))
+            start = None
+    if start is not None:
+        stretches.append((start, duration))
+
+    suppressed = sum(end - begin for begin, end in stretches)
+    print(f"DTX:            {suppressed:.1f} s of {duration:.1f} s not sent ({100 * suppressed / duration:.1f}%), "
+          f"{len(stretches)} silences")
+    if saved_bytes is not None:
+        print(f"Bytes saved:    about {saved_bytes} ({saved_bytes / max(suppressed, 0.001) * 8 / 1000:.1f} kbps while silent)")
+    clipped = []
+    for onset in onsets:
+        stretch = next(((begin, end) for begin, end in stretches if begin <= onset < end), None)
+        if stretch is not None:
+            clipped.append(stretch[1] - onset)
+    print(f"Onsets:         {len(onsets)}, clipped {len(clipped)}")
+    if clipped:
+        clipped.sort()
+        print(f"Clipping:       mean {1000 * sum(clipped) / len(clipped):.0f} ms, "
+              f"p50 {1000 * clipped[len(clipped) // 2]:.0f} ms, max {1000 * clipped[-1]:.0f} ms")
+
+
+def score(events, targets, tolerance, duration):
+    detections = sorted(t for name, t, _ in events if name == "wake")
+    hits = []
+    false_accepts = 0
+    remaining = sorted(targets)
+    for t in detections:
+        match = next((target for target in remaining if 0 <= t - target <= tolerance), None)
+        if match is None:
+            false_accepts += 1
+        else:
+            remaining.remove(match)
+            hits.append(t - match)
+
+    print(f"Audio:          {duration:.1f} s, {len(targets)} labelled wake words")
+    print(f"Detections:     {len(detections)}")
+    if targets:
+        print(f"Hits:           {len(hits)} ({100 * len(hits) / len(targets):.1f}%), misses {len(remaining)}")
+    print(f"False accepts:  {false_accepts} ({false_accepts / (duration / 3600):.2f} per hour)")
+    if hits:
+        hits.sort()
+        print(f"Latency:        mean {1000 * sum(hits) / len(hits):.0f} ms, "
+              f"p50 {1000 * hits[len(hits) // 2]:.0f} ms, max {1000 * hits[-1]:.0f} ms")
+    vad_on = sum(1 for name, _, value in events if name == "vad" and value == "1")
+    print(f"VAD segments:   {vad_on}")
+
+
+def main():
+    parser = argparse.ArgumentParser(description='唤醒词/VAD 回放测试：把录音发送到设备代替麦克风，统计唤醒率、误唤醒和耗时')
+    parser.add_argument('files', nargs='+', help='16kHz 单声道 WAV 文件')
+    parser.add_argument('--device', '-d', help='设备 IP 地址')
+    parser.add_argument('--port', '-p', type=int, default=8001, help='设备回放端口 (默认: 8001)')
+    parser.add_argument('--speed', type=float, default=1.0, help='回放速度倍数 (默认: 1.0, 实时)')
+    parser.add_argument('--labels', help='标注 CSV，每行 "文件名,唤醒词结束秒数"')
+    parser.add_argument('--tolerance', type=float, default=1.0, help='检测相对标注允许的延迟秒数 (默认: 1.0)')
+    parser.add_argument('--gap', type=float, default=1.0, help='文件之间插入的静音秒数 (默认: 1.0)')
+    parser.add_argument('--stub', action='store_true', help='不连接设备，使用本地能量检测代替')
+    parser.add_argument('--threshold', type=int, default=2000, help='--stub 的能量阈值 (默认: 2000)')
+    parser.add_argument('--listen', action='store_true', help='聆听会话：设备运行音频处理器代替唤醒词，回报 VAD 事件')
+    parser.add_argument('--dtx', action='store_true', help='统计上行静音抑制 (DTX) 节省的流量和语音起始截断')
+    parser.add_argument('--onset-threshold', type=int, default=1000, help='--dtx 参考语音起点的能量阈值 (默认: 1000)')
+    parser.add_argument('--frame-ms', type=int, default=20, help='--stub --dtx 模拟的帧长 (默认: 20)')
+    parser.add_argument('--hangover-ms', type=int, default=400, help='--stub --dtx 模拟的拖尾时长 (默认: 400)')
+    parser.add_argument('--preroll-ms', type=int, default=240, help='--stub --dtx 模拟的预录时长 (默认: 240)')
+    parser.add_argument('--frame-bytes', type=int, default=8, help='--stub --dtx 假设的静音帧字节数 (默认: 8)')
+    args = parser.parse_args()
+
+    if not args.stub and not args.device:
+        parser.error("--device is required unless --stub is given")
+
+    labels = load_labels(args.files, args.labels)
+    pcm, targets = build_corpus(args.files, labels, args.gap)
+    duration = len(pcm) / 2 / SAMPLE_RATE
+
+    if args.stub:
+        events, stats = replay_stub(pcm, args.threshold)
+    else:
+        listen = args.listen or args.dtx
+        print(f"Replaying {duration:.1f} s to {args.device}:{args.port} at {args.speed}x"
+              f"{' (listening)' if listen else ''}...")
+        events, stats = replay_device(pcm, args.device, args.port, args.speed, listen)
+
+    score(events, targets, args.tolerance, duration)
+    if args.dtx:
+        if args.stub:
+            dtx_events, saved_bytes = simulate_dtx(events, duration, args.frame_ms, args.hangover_ms,
+                                                   args.preroll_ms, args.frame_bytes)
+        else:
+            dtx_events = [event for event in events if event[0] == "dtx"]
+            reports = [int(value.split()[1]) for _, _, value in dtx_events if value.startswith("1 ")]
+            saved_bytes = reports[-1] if reports else None
+        if not dtx_events:
+            print("No DTX events, the device may not have CONFIG_USE_UPLINK_DTX enabled or was not idle")
+        else:
+            score_dtx(dtx_events, speech_onsets(pcm, args.onset_threshold, 0.3), duration, saved_bytes)
+    if stats is None:
+        print("No stats received, the device may not have CONFIG_USE_AUDIO_REPLAY enabled")
+        return
+    samples, dropped, feed_us, wall_us = stats
+    print(f"Consumed:       {samples / SAMPLE_RATE:.1f} s, dropped {dropped / SAMPLE_RATE:.2f} s")
+    if samples > 0:
+        print(f"Feed time:      {feed_us / (samples / SAMPLE_RATE) / 1000:.1f} ms per second of audio")
+    if wall_us > 0:
+        print(f"Realtime:       {samples / SAMPLE_RATE / (wall_us / 1e6):.2f}x")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,244 @@
+import asyncio
+import base64
+import hashlib
+import json
+import random
+import struct
+import argparse
+import uuid
+
+
+'''
+  A local stand-in for the WebSocket server, to exercise the binary protocols (docs/websocket.md)
+  without the real backend. Standard library only.
+
+  It answers the device hello, confirming version 4 when the device asks for it, and parses the
+  uplink audio of every version. For version 4 it counts lost packets by sequence and how many of
+  them the redundant previous frame recovered.
+
+  --echo plays the uplink audio back: after --echo-seconds of audio it sends "tts start", replays
+  the frames in real time in the negotiated version and sends "tts stop". --drop leaves out that
+  share of the downlink packets, to exercise the device's redundancy recovery and PLC.
+'''
+
+WS_GUID = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11"
+OPCODE_CONTINUATION = 0x0
+OPCODE_TEXT = 0x1
+OPCODE_BINARY = 0x2
+OPCODE_CLOSE = 0x8
+OPCODE_PING = 0x9
+OPCODE_PONG = 0xA
+
+BP2_HEADER = struct.Struct(">HHIII")     # version, type, reserved, timestamp, payload_size
+BP3_HEADER = struct.Struct(">BBH")       # type, reserved, payload_size
+BP4_HEADER = struct.Struct(">BBHIIHH")   # type, flags, frame_duration, sequence, timestamp, payload_size, redundant_size
+BP4_FLAG_REDUNDANT = 0x01
+
+
+async def read_frame(reader):
+    '''Returns (opcode, payload) of a whole message, fragments joined.'''
+    message_opcode = None
+    data = b""
+    while True:
+        b0, b1 = await reader.readexactly(2)
+        fin = b0 & 0x80
+        opcode = b0 & 0x0F
+        length = b1 & 0x7F
+        if length == 126:
+            length = struct.unpack(">H", await reader.readexactly(2))[0]
+        elif length == 127:
+            length = struct.unpack(">Q", await reader.readexactly(8))[0]
+        mask = await reader.readexactly(4) if b1 & 0x80 else None
+        payload = await reader.readexactly(length)
+        if mask:
+            payload = bytes(c ^ mask[i % 4] for i, c in enumerate(payload))
+        if opcode >= OPCODE_CLOSE:
+            return opcode, payload
+        if opcode != OPCODE_CONTINUATION:
+            message_opcode = opcode
+        data += payload
+        if fin:
+            return message_opcode, data
+
+
+def make_frame(opcode, payload):
+    header = bytes([0x80 | opcode])
+    if len(payload) < 126:
+        header += bytes([len(payload)])
+    elif len(payload) < 65536:
+        header += bytes([126]) + struct.pack(">H", len(payload))
+    else:
+        header += bytes([127]) + struct.pack(">Q", len(payload))
+    return header + payload
+
+
+def parse_audio(version, data):
+    '''Returns a list of (sequence, payload, redundant previous frame); sequence is None before version 4.'''
+    if version == 2:
+        _, _, _, _, size = BP2_HEADER.unpack_from(data)
+        return [(None, data[BP2_HEADER.size:BP2_HEADER.size + size], b"")]
+    if version == 3:
+        _, _, size = BP3_HEADER.unpack_from(data)
+        return [(None, data[BP3_HEADER.size:BP3_HEADER.size + size], b"")]
+    if version == 4:
+        _, flags, _, sequence, _, size, redundant_size = BP4_HEADER.unpack_from(data)
+        payload = data[BP4_HEADER.size:BP4_HEADER.size + size]
+        redundant = b""
+        if flags & BP4_FLAG_REDUNDANT:
+            redundant = data[BP4_HEADER.size + size:BP4_HEADER.size + size + redundant_size]
+        return [(sequence, payload, redundant)]
+    return [(None, data, b"")]
+
+
+class Session:
+    def __init__(self, args, reader, writer):
+        self.args = args
+        self.reader = reader
+        self.writer = writer
+        self.version = 1
+        self.frame_duration = 60
+        self.received = 0
+        self.lost = 0
+        self.recovered = 0
+        self.last_sequence = 0
+        self.frames = []
+        self.sequence = 0
+        self.previous_frame = b""
+        self.echo_task = None
+
+    async def send(self, opcode, payload):
+        self.writer.write(make_frame(opcode, payload))
+        await self.writer.drain()
+
+    async def send_json(self, message):
+        await self.send(OPCODE_TEXT, json.dumps(message).encode())
+
+    async def on_hello(self, hello):
+        requested = hello.get("version", 1)
+        self.version = requested if requested in (1, 2, 3) or (requested == 4 and self.args.max_version >= 4) else 1
+        self.frame_duration = hello.get("audio_params", {}).get("frame_duration", 60)
+        audio_params = {"format": "opus", "sample_rate": 16000, "channels": 1, "frame_duration": self.frame_duration}
+        if self.version == 4:
+            audio_params["redundancy"] = self.args.redundancy
+        if self.args.dtx and hello.get("features", {}).get("dtx"):
+            audio_params["dtx"] = True
+        await self.send_json({"type": "hello", "transport": "websocket", "version": self.version,
+                              "session_id": str(uuid.uuid4()), "audio_params": audio_params})
+        print(f"Hello: device asked for version {requested}, using {self.version}, frame {self.frame_duration}ms")
+
+    def on_audio(self, data):
+        for sequence, payload, redundant in parse_audio(self.version, data):
+            if sequence is not None and self.last_sequence != 0 and sequence != self.last_sequence + 1:
+                gap = sequence - self.last_sequence - 1
+                self.lost += gap
+                print(f"Uplink gap: {gap} packet(s) before sequence {sequence}")
+                if gap == 1 and redundant:
+                    self.recovered += 1
+                    self.frames.append(redundant)
+            if sequence is not None:
+                self.last_sequence = sequence
+            self.received += 1
+            self.frames.append(payload)
+        if self.args.echo and self.echo_task is None and \
+                len(self.frames) * self.frame_duration >= self.args.echo_seconds * 1000:
+            frames, self.frames = self.frames, []
+            self.echo_task = asyncio.create_task(self.echo(frames))
+
+    def serialize(self, payload):
+        if self.version == 2:
+            return BP2_HEADER.pack(2, 0, 0, 0, len(payload)) + payload
+        if self.version == 3:
+            return BP3_HEADER.pack(0, 0, len(payload)) + payload
+        if self.version == 4:
+            redundant = self.previous_frame if self.args.redundancy else b""
+            self.previous_frame = payload
+            self.sequence += 1
+            header = BP4_HEADER.pack(0, BP4_FLAG_REDUNDANT if redundant else 0, self.frame_duration, self.sequence,
+                                     self.sequence * self.frame_duration, len(payload), len(redundant))
+            return header + payload + redundant
+        return payload
+
+    async def echo(self, frames):
+        await self.send_json({"type": "tts", "state": "start"})
+        dropped = 0
+        for payload in frames:
+            # Serialized even when dropped, so the sequence shows the gap
+            packet = self.serialize(payload)
+            if random.random() < self.args.drop:
+                dropped += 1
+            else:
+                await self.send(OPCODE_BINARY, packet)
+            await asyncio.sleep(self.frame_duration / 1000)
+        await self.send_json({"type": "tts", "state": "stop"})
+        print(f"Echoed {len(frames)} frames, dropped {dropped}")
+        self.echo_task = None
+
+    async def run(self):
+        while True:
+            opcode, payload = await read_frame(self.reader)
+            if opcode == OPCODE_CLOSE:
+                await self.send(OPCODE_CLOSE, payload[:2])
+                return
+            if opcode == OPCODE_PING:
+                await self.send(OPCODE_PONG, payload)
+            elif opcode == OPCODE_TEXT:
+                message = json.loads(payload)
+                print(f"Text: {payload.decode()}")
+                if message.get("type") == "hello":
+                    await self.on_hello(message)
+            elif opcode == OPCODE_BINARY:
+                self.on_audio(payload)
+
+    def report(self):
+        print(f"Uplink: {self.received} packets, {self.lost} lost, {self.recovered} recovered from redundancy")
+
+
+async def handshake(reader, writer):
+    request = await reader.readuntil(b"\r\n\r\n")
+    headers = {}
+    for line in request.decode().split("\r\n")[1:]:
+        if ":" in line:
+            name, value = line.split(":", 1)
+            headers[name.strip().lower()] = value.strip()
+    accept = base64.b64encode(hashlib.sha1((headers["sec-websocket-key"] + WS_GUID).encode()).digest()).decode()
+    writer.write(("HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+                  f"Sec-WebSocket-Accept: {accept}\r\n\r\n").encode())
+    await writer.drain()
+    print(f"Connected: device {headers.get('device-id')}, protocol version {headers.get('protocol-version')}")
+
+
+def main(args):
+    async def on_connection(reader, writer):
+        session = Session(args, reader, writer)
+        try:
+            await handshake(reader, writer)
+            await session.run()
+        except (asyncio.IncompleteReadError, ConnectionError):
+            pass
+        finally:
+            session.report()
+            writer.close()
+
+    async def serve():
+        server = await asyncio.start_server(on_connection, args.host, args.port)
+        print(f"Listening on ws://{args.host}:{args.port}")
+        async with server:
+            await server.serve_forever()
+
+    try:
+        asyncio.run(serve())
+    except KeyboardInterrupt:
+        pass
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description='本地 WebSocket 测试服务器，用于验证二进制协议版本 1-4')
+    parser.add_argument('--host', default='0.0.0.0', help='监听地址 (默认: 0.0.0.0)')
+    parser.add_argument('--port', '-p', type=int, default=8000, help='监听端口 (默认: 8000)')
+    parser.add_argument('--max-version', type=int, default=4, help='支持的最高协议版本 (默认: 4)')
+    parser.add_argument('--redundancy', action='store_true', help='版本4：要求设备上行附带上一帧，下行也附带')
+    parser.add_argument('--dtx', action='store_true', help='接受设备的上行 DTX（实时对话静音期间不连续上传）')
+    parser.add_argument('--echo', action='store_true', help='把上行音频作为 TTS 回放给设备')
+    parser.add_argument('--echo-seconds', type=float, default=3.0, help='攒够多少秒上行音频后回放 (默认: 3.0)')
+    parser.add_argument('--drop', type=float, default=0.0, help='回放时丢弃的下行包比例 (默认: 0)')
+    main(parser.parse_args())
@@ -0,0 +1,42 @@
+#include "jitter_replay.h"
+
+#include <cstdio>
+#include <cstdlib>
+
+// Replays arrival traces (see tests/data/jitter_*.txt) and prints what the listener would get
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s <trace>... [--frame-duration ms] [--capacity packets]\n", argv[0]);
+        return 1;
+    }
+
+    int frame_duration_ms = 60;
+    size_t capacity = 40;
+    std::vector<std::string> traces;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--frame-duration" && i + 1 < argc) {
+            frame_duration_ms = atoi(argv[++i]);
+        } else if (arg == "--capacity" && i + 1 < argc) {
+            capacity = atoi(argv[++i]);
+        } else {
+            traces.push_back(arg);
+        }
+    }
+
+    for (auto& path : traces) {
+        std::vector<JitterTraceEvent> events;
+        if (!LoadJitterTrace(path, events)) {
+            fprintf(stderr, "Failed to read %s\n", path.c_str());
+            return 1;
+        }
+        auto result = ReplayJitterTrace(events, frame_duration_ms, capacity);
+        auto& s = result.statistics;
+        printf("%s: %zu packets, %zu played, %d concealed, start delay %lld ms, max target depth %d\n",
+            path.c_str(), events.size(), result.played.size(), result.concealed,
+            (long long)(result.first_play_ms - result.first_arrival_ms), result.max_target_depth);
+        printf("  received %u, late %u, duplicated %u, lost %u, underruns %u\n",
+            s.received, s.late, s.duplicated, s.lost, s.underruns);
+    }
+    return 0;
+}
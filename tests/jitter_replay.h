@@ -0,0 +1,100 @@
+#ifndef JITTER_REPLAY_H
+#define JITTER_REPLAY_H
+
+#include <cstdint>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "jitter_buffer.h"
+
+/*
+ * Replays a downlink arrival trace through the JitterBuffer, on a simulated clock.
+ *
+ * A trace has one "arrival_ms sequence" line per packet, '#' starts a comment. The decoder
+ * side is modelled like the Opus codec task: it polls every JITTER_REPLAY_POLL_MS and, once
+ * playing, takes one frame per frame duration.
+ */
+
+#define JITTER_REPLAY_POLL_MS 10
+
+struct JitterTraceEvent {
+    int64_t arrival_ms;
+    uint32_t sequence;
+};
+
+struct JitterReplayResult {
+    std::vector<uint32_t> played;   // Sequences in play order
+    int concealed = 0;
+    int64_t first_arrival_ms = -1;
+    int64_t first_play_ms = -1;
+    int max_target_depth = 0;
+    JitterBufferStatistics statistics;
+};
+
+inline bool LoadJitterTrace(const std::string& path, std::vector<JitterTraceEvent>& events) {
+    std::ifstream file(path);
+    if (!file) {
+        return false;
+    }
+    std::string line;
+    while (std::getline(file, line)) {
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+        std::istringstream fields(line);
+        JitterTraceEvent event;
+        if (!(fields >> event.arrival_ms >> event.sequence)) {
+            return false;
+        }
+        events.push_back(event);
+    }
+    return true;
+}
+
+inline JitterReplayResult ReplayJitterTrace(const std::vector<JitterTraceEvent>& events, int frame_duration_ms,
+        size_t capacity) {
+    JitterReplayResult result;
+    JitterBuffer buffer(capacity);
+    if (events.empty()) {
+        return result;
+    }
+
+    size_t next_event = 0;
+    int64_t now_ms = events.front().arrival_ms;
+    int64_t next_frame_ms = now_ms;
+    result.first_arrival_ms = now_ms;
+    while (next_event < events.size() || !buffer.empty()) {
+        while (next_event < events.size() && events[next_event].arrival_ms <= now_ms) {
+            auto packet = std::make_unique<AudioStreamPacket>();
+            packet->sequence = events[next_event].sequence;
+            packet->frame_duration = frame_duration_ms;
+            buffer.Put(packet, now_ms);
+            next_event++;
+        }
+        if (now_ms >= next_frame_ms) {
+            std::unique_ptr<AudioStreamPacket> packet;
+            auto pop = buffer.Pop(packet, now_ms);
+            if (pop != JitterBuffer::kPopNone) {
+                if (result.first_play_ms < 0) {
+                    result.first_play_ms = now_ms;
+                }
+                if (pop == JitterBuffer::kPopPacket) {
+                    result.played.push_back(packet->sequence);
+                } else {
+                    result.concealed++;
+                }
+                next_frame_ms = now_ms + frame_duration_ms;
+            }
+        }
+        if (buffer.target_depth() > result.max_target_depth) {
+            result.max_target_depth = buffer.target_depth();
+        }
+        now_ms += JITTER_REPLAY_POLL_MS;
+    }
+    result.statistics = buffer.statistics();
+    return result;
+}
+
+#endif // JITTER_REPLAY_H
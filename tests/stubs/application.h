@@ -0,0 +1,19 @@
+#ifndef APPLICATION_STUB_H
+#define APPLICATION_STUB_H
+
+#include <string>
+
+// protocol.cc hands reminders to the application; the host tests record them
+class Application {
+public:
+    static Application& GetInstance() {
+        static Application instance;
+        return instance;
+    }
+
+    void QueueReminderTts(const std::string& content) { last_reminder = content; }
+
+    std::string last_reminder;
+};
+
+#endif // APPLICATION_STUB_H
@@ -0,0 +1,7 @@
+#ifndef CJSON_STUB_H
+#define CJSON_STUB_H
+
+// protocol.h includes cJSON for the firmware; nothing the host tests build uses it
+typedef struct cJSON cJSON;
+
+#endif // CJSON_STUB_H
@@ -0,0 +1,7 @@
+#ifndef DRIVER_I2S_STD_STUB_H
+#define DRIVER_I2S_STD_STUB_H
+
+// Types only, audio_codec.h keeps the channel handles as members
+typedef struct i2s_channel_obj_t* i2s_chan_handle_t;
+
+#endif // DRIVER_I2S_STD_STUB_H
@@ -0,0 +1,14 @@
+#ifndef ESP_LOG_STUB_H
+#define ESP_LOG_STUB_H
+
+// Logging is dropped on the host; the arguments are still checked by the compiler
+template <typename... Args>
+inline void esp_log_discard(const char*, const char*, Args&&...) {}
+
+#define ESP_LOGE(tag, format, ...) esp_log_discard(tag, format, ##__VA_ARGS__)
+#define ESP_LOGW(tag, format, ...) esp_log_discard(tag, format, ##__VA_ARGS__)
+#define ESP_LOGI(tag, format, ...) esp_log_discard(tag, format, ##__VA_ARGS__)
+#define ESP_LOGD(tag, format, ...) esp_log_discard(tag, format, ##__VA_ARGS__)
+#define ESP_LOGV(tag, format, ...) esp_log_discard(tag, format, ##__VA_ARGS__)
+
+#endif // ESP_LOG_STUB_H
@@ -0,0 +1,33 @@
+#ifndef ESP_TIMER_STUB_H
+#define ESP_TIMER_STUB_H
+
+// Timers run on a simulated clock that only moves with HostClockAdvance() (see host_rtos.h)
+#include <cstdint>
+
+typedef int esp_err_t;
+#define ESP_OK 0
+
+typedef void (*esp_timer_cb_t)(void* arg);
+typedef struct HostTimer* esp_timer_handle_t;
+
+typedef enum {
+    ESP_TIMER_TASK,
+    ESP_TIMER_ISR,
+} esp_timer_dispatch_t;
+
+typedef struct {
+    esp_timer_cb_t callback;
+    void* arg;
+    esp_timer_dispatch_t dispatch_method;
+    const char* name;
+    bool skip_unhandled_events;
+} esp_timer_create_args_t;
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t* args, esp_timer_handle_t* handle);
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t period_us);
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us);
+esp_err_t esp_timer_stop(esp_timer_handle_t timer);
+esp_err_t esp_timer_delete(esp_timer_handle_t timer);
+int64_t esp_timer_get_time();
+
+#endif // ESP_TIMER_STUB_H
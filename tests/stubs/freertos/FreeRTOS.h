@@ -0,0 +1,16 @@
+#ifndef FREERTOS_STUB_H
+#define FREERTOS_STUB_H
+
+// Just enough FreeRTOS for the host tests, tasks are threads (see host_rtos.cc)
+#include <cstdint>
+
+typedef int BaseType_t;
+typedef uint32_t UBaseType_t;
+typedef uint32_t TickType_t;
+
+#define pdTRUE 1
+#define pdFALSE 0
+#define pdPASS pdTRUE
+#define portMAX_DELAY ((TickType_t)0xffffffffUL)
+
+#endif // FREERTOS_STUB_H
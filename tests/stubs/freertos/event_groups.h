@@ -0,0 +1,10 @@
+#ifndef FREERTOS_EVENT_GROUPS_STUB_H
+#define FREERTOS_EVENT_GROUPS_STUB_H
+
+// Types only, for headers that declare event group members
+#include "FreeRTOS.h"
+
+typedef struct HostEventGroup* EventGroupHandle_t;
+typedef uint32_t EventBits_t;
+
+#endif // FREERTOS_EVENT_GROUPS_STUB_H
@@ -0,0 +1,167 @@
+#include "host_rtos.h"
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+#include <algorithm>
+
+struct HostTask {
+    std::thread thread;
+    std::condition_variable cv;
+    uint32_t notifications = 0;
+    bool waiting = false;
+    bool deleted = false;
+};
+
+struct HostTimer {
+    esp_timer_cb_t callback;
+    void* arg;
+    bool active = false;
+    int64_t next_us = 0;
+    int64_t period_us = 0;
+};
+
+// Unwinds a deleted task out of its (endless) task function
+struct HostTaskDeleted {};
+
+static std::mutex mutex_;
+static std::condition_variable idle_cv_;
+static std::vector<HostTask*> tasks_;
+static std::vector<HostTimer*> timers_;
+static int64_t now_us_ = 0;
+static thread_local HostTask* current_task_ = nullptr;
+
+BaseType_t xTaskCreate(TaskFunction_t function, const char*, uint32_t, void* arg, UBaseType_t, TaskHandle_t* handle) {
+    auto task = new HostTask();
+    if (handle != nullptr) {
+        *handle = task;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        tasks_.push_back(task);
+    }
+    task->thread = std::thread([task, function, arg]() {
+        current_task_ = task;
+        try {
+            function(arg);
+        } catch (const HostTaskDeleted&) {
+        }
+    });
+    return pdPASS;
+}
+
+void vTaskDelete(TaskHandle_t task) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        task->deleted = true;
+        task->cv.notify_all();
+        tasks_.erase(std::remove(tasks_.begin(), tasks_.end(), task), tasks_.end());
+    }
+    task->thread.join();
+    delete task;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    task->notifications++;
+    task->cv.notify_all();
+    return pdPASS;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t) {
+    auto task = current_task_;
+    std::unique_lock<std::mutex> lock(mutex_);
+    task->waiting = true;
+    idle_cv_.notify_all();
+    task->cv.wait(lock, [task]() { return task->notifications > 0 || task->deleted; });
+    task->waiting = false;
+    if (task->deleted) {
+        throw HostTaskDeleted();
+    }
+    uint32_t value = task->notifications;
+    task->notifications = clear_on_exit ? 0 : value - 1;
+    return value;
+}
+
+void HostTasksWaitIdle() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    idle_cv_.wait(lock, []() {
+        return std::all_of(tasks_.begin(), tasks_.end(), [](HostTask* task) {
+            return task->waiting && task->notifications == 0;
+        });
+    });
+}
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t* args, esp_timer_handle_t* handle) {
+    auto timer = new HostTimer();
+    timer->callback = args->callback;
+    timer->arg = args->arg;
+    std::lock_guard<std::mutex> lock(mutex_);
+    timers_.push_back(timer);
+    *handle = timer;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t period_us) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    timer->active = true;
+    timer->period_us = period_us;
+    timer->next_us = now_us_ + period_us;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    timer->active = true;
+    timer->period_us = 0;
+    timer->next_us = now_us_ + timeout_us;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    timer->active = false;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_delete(esp_timer_handle_t timer) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    timers_.erase(std::remove(timers_.begin(), timers_.end(), timer), timers_.end());
+    delete timer;
+    return ESP_OK;
+}
+
+int64_t esp_timer_get_time() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return now_us_;
+}
+
+void HostClockAdvance(int64_t us) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    int64_t target_us = now_us_ + us;
+    while (true) {
+        HostTimer* due = nullptr;
+        for (auto timer : timers_) {
+            if (timer->active && timer->next_us <= target_us && (due == nullptr || timer->next_us < due->next_us)) {
+                due = timer;
+            }
+        }
+        if (due == nullptr) {
+            break;
+        }
+        now_us_ = due->next_us;
+        if (due->period_us > 0) {
+            due->next_us += due->period_us;
+        } else {
+            due->active = false;
+        }
+        auto callback = due->callback;
+        auto arg = due->arg;
+        // Callbacks may start, stop or notify, which takes the lock again
+        lock.unlock();
+        callback(arg);
+        lock.lock();
+    }
+    now_us_ = target_us;
+}
@@ -0,0 +1,13 @@
+#ifndef HOST_RTOS_H
+#define HOST_RTOS_H
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <esp_timer.h>
+
+// Moves the simulated clock forward, running every timer callback that falls due on the way
+void HostClockAdvance(int64_t us);
+// Waits until every task has taken all its notifications and is blocked waiting for the next one
+void HostTasksWaitIdle();
+
+#endif // HOST_RTOS_H
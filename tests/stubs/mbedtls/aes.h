@@ -0,0 +1,51 @@
+#ifndef MBEDTLS_AES_STUB_H
+#define MBEDTLS_AES_STUB_H
+
+// The part of the mbedtls AES API the firmware uses, on top of the OpenSSL block cipher.
+// The CTR mode is mbedtls' own loop: big-endian increment of the whole 16 byte counter block
+#define OPENSSL_SUPPRESS_DEPRECATED
+#include <openssl/aes.h>
+#include <cstddef>
+
+#define MBEDTLS_ERR_AES_INVALID_KEY_LENGTH -0x0020
+#define MBEDTLS_ERR_AES_BAD_INPUT_DATA -0x0021
+
+typedef struct {
+    AES_KEY key;
+} mbedtls_aes_context;
+
+inline void mbedtls_aes_init(mbedtls_aes_context* ctx) {
+    *ctx = mbedtls_aes_context();
+}
+
+inline void mbedtls_aes_free(mbedtls_aes_context* ctx) {
+    *ctx = mbedtls_aes_context();
+}
+
+inline int mbedtls_aes_setkey_enc(mbedtls_aes_context* ctx, const unsigned char* key, unsigned int keybits) {
+    return AES_set_encrypt_key(key, keybits, &ctx->key) == 0 ? 0 : MBEDTLS_ERR_AES_INVALID_KEY_LENGTH;
+}
+
+inline int mbedtls_aes_crypt_ctr(mbedtls_aes_context* ctx, size_t length, size_t* nc_off, unsigned char nonce_counter[16],
+    unsigned char stream_block[16], const unsigned char* input, unsigned char* output) {
+    size_t n = *nc_off;
+    if (n > 0x0F) {
+        return MBEDTLS_ERR_AES_BAD_INPUT_DATA;
+    }
+    while (length--) {
+        if (n == 0) {
+            AES_encrypt(nonce_counter, stream_block, &ctx->key);
+            for (int i = 16; i > 0; i--) {
+                if (++nonce_counter[i - 1] != 0) {
+                    break;
+                }
+            }
+        }
+        *output++ = static_cast<unsigned char>(*input++ ^ stream_block[n]);
+        n = (n + 1) & 0x0F;
+    }
+    *nc_off = n;
+    return 0;
+}
+
+#endif // MBEDTLS_AES_STUB_H
@@ -0,0 +1,6 @@
+#ifndef SDKCONFIG_STUB_H
+#define SDKCONFIG_STUB_H
+
+// No CONFIG_ options on the host: portable code paths only
+
+#endif // SDKCONFIG_STUB_H
@@ -0,0 +1,163 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <cstdint>
+
+#include "object_pool.h"
+#include "ring_queue.h"
+#include "protocol.h"
+
+#define MAX_SEND_PACKETS_IN_QUEUE 120
+#define PACKET_POOL_SIZE 160
+
+// Records what goes on the wire; SendAudio() fails once fail_after packets went out
+class TestProtocol : public Protocol {
+public:
+    bool Start() override { return true; }
+    bool OpenAudioChannel() override { return true; }
+    void CloseAudioChannel() override {}
+    bool IsAudioChannelOpened() const override { return true; }
+    bool SendAudio(const AudioStreamPacket& packet) override {
+        if (wire.size() >= fail_after) {
+            return false;
+        }
+        wire.push_back(packet.timestamp);
+        return true;
+    }
+
+    std::vector<uint32_t> wire;     // Timestamps in the order they were sent
+    size_t fail_after = SIZE_MAX;
+
+protected:
+    bool SendText(const std::string&) override { return true; }
+};
+
+// The send side of AudioService and Application: the codec task queues encoded packets, the main
+// task drains the queue into one batch per MAIN_EVENT_SEND_AUDIO and gives the packets back
+class Uplink {
+public:
+    Uplink() : packet_pool(PACKET_POOL_SIZE), send_queue(MAX_SEND_PACKETS_IN_QUEUE) {}
+
+    // OpusCodecTask, one encoded frame
+    void Encode(uint32_t timestamp) {
+        auto packet = packet_pool.Acquire();
+        packet->timestamp = timestamp;
+        packet->payload.assign(40, timestamp & 0xFF);
+        ASSERT_TRUE(send_queue.Push(std::move(packet)));
+    }
+
+    // Application::OnWakeWordDetected(): the pre-roll goes out first, as its own batch
+    void SendWakeWordPackets(uint32_t first, size_t count) {
+        for (size_t i = 0; i < count; i++) {
+            auto packet = packet_pool.Acquire();
+            packet->timestamp = first + i;
+            batch.push_back(std::move(packet));
+        }
+        SendBatch();
+    }
+
+    // MainEventLoop() on MAIN_EVENT_SEND_AUDIO, with AudioService::PopPacketsFromSendQueue()
+    size_t Flush() {
+        std::unique_ptr<AudioStreamPacket> packet;
+        while (send_queue.Pop(packet)) {
+            batch.push_back(std::move(packet));
+        }
+        return batch.empty() ? 0 : SendBatch();
+    }
+
+    TestProtocol protocol;
+    ObjectPool<AudioStreamPacket> packet_pool;
+    RingQueue<std::unique_ptr<AudioStreamPacket>> send_queue;
+    std::vector<std::unique_ptr<AudioStreamPacket>> batch;
+    size_t batches = 0;
+
+private:
+    // Application::SendAudioBatch(): unsent packets are dropped, all go back to the pool
+    size_t SendBatch() {
+        size_t sent = protocol.SendAudioBatch(batch);
+        for (auto& packet : batch) {
+            packet_pool.Release(std::move(packet));
+        }
+        batch.clear();
+        batches++;
+        return sent;
+    }
+};
+
+static std::vector<uint32_t> Range(uint32_t first, uint32_t count) {
+    std::vector<uint32_t> range(count);
+    for (uint32_t i = 0; i < count; i++) {
+        range[i] = first + i;
+    }
+    return range;
+}
+
+TEST(AudioBatchTest, StallBacklogGoesOutInOneBatchInOrder) {
+    Uplink uplink;
+    // 2.4s of 20ms frames queued while the main task was blocked on the network
+    for (uint32_t t = 0; t < MAX_SEND_PACKETS_IN_QUEUE; t++) {
+        uplink.Encode(t);
+    }
+    EXPECT_EQ(uplink.Flush(), (size_t)MAX_SEND_PACKETS_IN_QUEUE);
+    EXPECT_EQ(uplink.batches, 1u);
+    EXPECT_EQ(uplink.protocol.wire, Range(0, MAX_SEND_PACKETS_IN_QUEUE));
+    EXPECT_TRUE(uplink.send_queue.empty());
+    EXPECT_EQ(uplink.packet_pool.available(), (size_t)MAX_SEND_PACKETS_IN_QUEUE);
+}
+
+TEST(AudioBatchTest, BatchesKeepTheQueueOrderAcrossFlushes) {
+    Uplink uplink;
+    uint32_t t = 0;
+    // Bursts of 1 to 7 frames between main loop wakeups
+    for (int burst = 0; burst < 50; burst++) {
+        for (int i = 0; i <= burst % 7; i++) {
+            uplink.Encode(t++);
+        }
+        uplink.Flush();
+    }
+    EXPECT_EQ(uplink.protocol.wire, Range(0, t));
+    EXPECT_EQ(uplink.batches, 50u);
+    // Nothing queued, nothing sent
+    EXPECT_EQ(uplink.Flush(), 0u);
+    EXPECT_EQ(uplink.batches, 50u);
+}
+
+TEST(AudioBatchTest, WakeWordPacketsGoAheadOfTheStream) {
+    Uplink uplink;
+    // The listening stream starts queueing while the pre-roll is being collected
+    uplink.Encode(1000);
+    uplink.Encode(1001);
+    uplink.SendWakeWordPackets(0, 25);
+    uplink.Encode(1002);
+    uplink.Flush();
+
+    auto expected = Range(0, 25);
+    for (uint32_t t : Range(1000, 3)) {
+        expected.push_back(t);
+    }
+    EXPECT_EQ(uplink.protocol.wire, expected);
+    EXPECT_EQ(uplink.batches, 2u);
+}
+
+TEST(AudioBatchTest, FailedSendDropsTheRestOfTheBatchOnly) {
+    Uplink uplink;
+    for (uint32_t t = 0; t < 10; t++) {
+        uplink.Encode(t);
+    }
+    uplink.protocol.fail_after = 4;
+    EXPECT_EQ(uplink.Flush(), 4u);
+    // Nothing after a failure goes out of order: the rest of the batch is dropped, not retried later
+    EXPECT_EQ(uplink.protocol.wire, Range(0, 4));
+    EXPECT_EQ(uplink.packet_pool.available(), 10u);
+
+    uplink.protocol.fail_after = SIZE_MAX;
+    for (uint32_t t = 10; t < 15; t++) {
+        uplink.Encode(t);
+    }
+    EXPECT_EQ(uplink.Flush(), 5u);
+    auto expected = Range(0, 4);
+    for (uint32_t t : Range(10, 5)) {
+        expected.push_back(t);
+    }
+    EXPECT_EQ(uplink.protocol.wire, expected);
+    EXPECT_TRUE(std::is_sorted(uplink.protocol.wire.begin(), uplink.protocol.wire.end()));
+}
@@ -0,0 +1,206 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <random>
+
+#include "audio_dsp.h"
+
+// The per-sample loops the kernels replaced, as they were in the callers, and the plain Q15 product
+namespace reference {
+
+static void Deinterleave(const std::vector<int16_t>& data, std::vector<int16_t>& mic_channel, std::vector<int16_t>& reference_channel) {
+    for (size_t i = 0, j = 0; i < mic_channel.size(); ++i, j += 2) {
+        mic_channel[i] = data[j];
+        reference_channel[i] = data[j + 1];
+    }
+}
+
+static void Interleave(const std::vector<int16_t>& resampled_mic, const std::vector<int16_t>& resampled_reference, std::vector<int16_t>& data) {
+    for (size_t i = 0, j = 0; i < resampled_mic.size(); ++i, j += 2) {
+        data[j] = resampled_mic[i];
+        data[j + 1] = resampled_reference[i];
+    }
+}
+
+static void ExtractLeftInPlace(std::vector<int16_t>& data) {
+    for (size_t i = 0, j = 0; j < data.size(); ++i, j += 2) {
+        data[i] = data[j];
+    }
+}
+
+static void ScaleToS32(const int16_t* data, std::vector<int32_t>& buffer, int samples, int32_t volume_factor) {
+    for (int i = 0; i < samples; i++) {
+        int64_t temp = int64_t(data[i]) * volume_factor;
+        if (temp > INT32_MAX) {
+            buffer[i] = INT32_MAX;
+        } else if (temp < INT32_MIN) {
+            buffer[i] = INT32_MIN;
+        } else {
+            buffer[i] = static_cast<int32_t>(temp);
+        }
+    }
+}
+
+static void ShiftSaturateToS16(const std::vector<int32_t>& bit32_buffer, int16_t* dest, int samples) {
+    for (int i = 0; i < samples; i++) {
+        int32_t value = bit32_buffer[i] >> 12;
+        dest[i] = (value > INT16_MAX) ? INT16_MAX : (value < -INT16_MAX) ? -INT16_MAX : (int16_t)value;
+    }
+}
+
+static void GainQ15(const int16_t* src, int16_t* dest, size_t samples, int32_t gain) {
+    for (size_t i = 0; i < samples; i++) {
+        dest[i] = gain >= 32768 ? src[i] : static_cast<int16_t>((src[i] * std::max(gain, 0)) >> 15);
+    }
+}
+
+} // namespace reference
+
+static std::vector<int16_t> RandomPcm(size_t samples, uint32_t seed) {
+    std::mt19937 rng(seed);
+    std::uniform_int_distribution<int> dist(INT16_MIN, INT16_MAX);
+    std::vector<int16_t> pcm(samples);
+    for (auto& sample : pcm) {
+        sample = dist(rng);
+    }
+    // The extremes, where saturation and the sign of the shift matter
+    if (samples >= 4) {
+        pcm[0] = INT16_MIN;
+        pcm[1] = INT16_MAX;
+        pcm[2] = -1;
+        pcm[3] = 0;
+    }
+    return pcm;
+}
+
+// Frame counts around the unroll width, and 60ms at 16kHz
+static const size_t kFrameCounts[] = {0, 1, 3, 4, 5, 7, 8, 161, 960};
+
+TEST(AudioDspTest, ChannelSplitMatchesTheReplacedLoops) {
+    for (size_t frames : kFrameCounts) {
+        SCOPED_TRACE(frames);
+        auto stereo = RandomPcm(frames * 2, frames);
+
+        std::vector<int16_t> left(frames), right(frames), expected_left(frames), expected_right(frames);
+        AudioDsp::Deinterleave(stereo.data(), left.data(), right.data(), frames);
+        reference::Deinterleave(stereo, expected_left, expected_right);
+        EXPECT_EQ(left, expected_left);
+        EXPECT_EQ(right, expected_right);
+
+        std::vector<int16_t> interleaved(frames * 2), expected_interleaved(frames * 2);
+        AudioDsp::Interleave(left.data(), right.data(), interleaved.data(), frames);
+        reference::Interleave(expected_left, expected_right, expected_interleaved);
+        EXPECT_EQ(interleaved, expected_interleaved);
+        EXPECT_EQ(interleaved, stereo);
+
+        // In place, as in ReadAudioData() and NoAudioProcessor; the tail beyond frames is left alone
+        auto in_place = stereo;
+        auto expected_in_place = stereo;
+        AudioDsp::ExtractLeft(in_place.data(), in_place.data(), frames);
+        reference::ExtractLeftInPlace(expected_in_place);
+        EXPECT_EQ(in_place, expected_in_place);
+
+        std::vector<int16_t> mono(frames);
+        AudioDsp::ExtractLeft(stereo.data(), mono.data(), frames);
+        EXPECT_EQ(mono, expected_left);
+    }
+}
+
+TEST(AudioDspTest, ConversionsMatchTheReplacedLoops) {
+    for (size_t samples : kFrameCounts) {
+        SCOPED_TRACE(samples);
+        auto pcm = RandomPcm(samples, samples + 100);
+        // NoAudioCodec::Write() volume factors: silent, a typical volume and full scale
+        for (int32_t factor : {0, 1, 25000, 65535, 65536}) {
+            std::vector<int32_t> scaled(samples), expected(samples);
+            AudioDsp::ScaleToS32(pcm.data(), scaled.data(), samples, factor);
+            reference::ScaleToS32(pcm.data(), expected, samples, factor);
+            ASSERT_EQ(scaled, expected) << factor;
+        }
+
+        // 32-bit I2S slots, from silence to well past int16 after the shift
+        std::mt19937 rng(samples);
+        std::uniform_int_distribution<int32_t> dist(INT32_MIN, INT32_MAX);
+        std::vector<int32_t> slots(samples);
+        for (auto& slot : slots) {
+            slot = dist(rng);
+        }
+        if (samples >= 2) {
+            slots[0] = INT32_MIN;
+            slots[1] = INT32_MAX;
+        }
+        std::vector<int16_t> shifted(samples), expected_shifted(samples);
+        AudioDsp::ShiftSaturateToS16(slots.data(), shifted.data(), samples, 12);
+        reference::ShiftSaturateToS16(slots, expected_shifted.data(), samples);
+        EXPECT_EQ(shifted, expected_shifted);
+    }
+}
+
+TEST(AudioDspTest, GainMatchesThePerSampleProduct) {
+    for (size_t samples : kFrameCounts) {
+        SCOPED_TRACE(samples);
+        auto pcm = RandomPcm(samples, samples + 200);
+        for (int32_t gain : {-5, 0, 1, 9830, 16384, 32767, 32768, 40000}) {
+            std::vector<int16_t> out(samples), expected(samples);
+            AudioDsp::GainQ15(pcm.data(), out.data(), samples, gain);
+            reference::GainQ15(pcm.data(), expected.data(), samples, gain);
+            ASSERT_EQ(out, expected) << gain;
+
+            auto in_place = pcm;
+            AudioDsp::GainQ15(in_place.data(), in_place.data(), samples, gain);
+            ASSERT_EQ(in_place, expected) << gain;
+
+            // A flat ramp is the plain gain
+            if (gain >= 0 && gain <= 32768) {
+                AudioDsp::GainRampQ15(pcm.data(), out.data(), samples, gain, gain);
+                ASSERT_EQ(out, expected) << gain;
+            }
+        }
+    }
+}
+
+// Nanoseconds per call, the best of several rounds so a preempted round does not count
+static double BestNsPerCall(const std::function<void()>& call, int calls = 2000, int rounds = 5) {
+    double best = 0;
+    for (int round = 0; round < rounds; round++) {
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < calls; i++) {
+            call();
+        }
+        double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / calls;
+        best = round == 0 ? ns : std::min(best, ns);
+    }
+    return best;
+}
+
+TEST(AudioDspTest, Benchmark) {
+    // One 60ms frame of 16kHz stereo, as the input task reads it with a reference channel
+    const size_t frames = 960;
+    auto stereo = RandomPcm(frames * 2, 1);
+    std::vector<int16_t> left(frames), right(frames), scratch(frames * 2), out(frames);
+    volatile int16_t sink = 0;
+
+    struct Result {
+        const char* name;
+        double kernel_ns;
+        double reference_ns;
+    };
+    std::vector<Result> results;
+    results.push_back({"Deinterleave",
+        BestNsPerCall([&]() { AudioDsp::Deinterleave(stereo.data(), left.data(), right.data(), frames); sink = left[frames - 1]; }),
+        BestNsPerCall([&]() { reference::Deinterleave(stereo, left, right); sink = left[frames - 1]; })});
+    results.push_back({"ExtractLeft in place",
+        BestNsPerCall([&]() { scratch = stereo; AudioDsp::ExtractLeft(scratch.data(), scratch.data(), frames); sink = scratch[frames - 1]; }),
+        BestNsPerCall([&]() { scratch = stereo; reference::ExtractLeftInPlace(scratch); sink = scratch[frames - 1]; })});
+    results.push_back({"GainQ15",
+        BestNsPerCall([&]() { AudioDsp::GainQ15(stereo.data(), out.data(), frames, 9830); sink = out[frames - 1]; }),
+        BestNsPerCall([&]() { reference::GainQ15(stereo.data(), out.data(), frames, 9830); sink = out[frames - 1]; })});
+    (void)sink;
+
+    for (auto& result : results) {
+        std::cout << result.name << ": " << result.kernel_ns << " ns per 60ms frame, the plain loop "
+                  << result.reference_ns << " ns" << std::endl;
+        EXPECT_GT(result.kernel_ns, 0);
+    }
+}
@@ -0,0 +1,189 @@
+#include <gtest/gtest.h>
+#include <arpa/inet.h>
+#include <cstring>
+#include <random>
+
+#include "binary_protocol4_parser.h"
+
+#define FRAME_DURATION_MS 60
+
+// Payload of a frame, recognisable by its sequence
+static std::vector<uint8_t> FramePayload(uint32_t sequence) {
+    std::vector<uint8_t> payload(20 + sequence % 7);
+    for (size_t i = 0; i < payload.size(); i++) {
+        payload[i] = (uint8_t)(sequence * 31 + i);
+    }
+    return payload;
+}
+
+// A packet as the server sends it, with the previous frame after the payload when redundant
+static std::vector<uint8_t> Packet(uint32_t sequence, bool redundant, int frame_duration = FRAME_DURATION_MS) {
+    auto payload = FramePayload(sequence);
+    auto previous = redundant ? FramePayload(sequence - 1) : std::vector<uint8_t>();
+    std::vector<uint8_t> packet(sizeof(BinaryProtocol4) + payload.size() + previous.size());
+    auto bp4 = (BinaryProtocol4*)packet.data();
+    bp4->type = 0;
+    bp4->flags = redundant ? BINARY_PROTOCOL4_FLAG_REDUNDANT : 0;
+    bp4->frame_duration = htons(frame_duration);
+    bp4->sequence = htonl(sequence);
+    bp4->timestamp = htonl(sequence * FRAME_DURATION_MS);
+    bp4->payload_size = htons(payload.size());
+    bp4->redundant_size = htons(previous.size());
+    memcpy(bp4->payload, payload.data(), payload.size());
+    memcpy(bp4->payload + payload.size(), previous.data(), previous.size());
+    return packet;
+}
+
+// What WebsocketProtocol hands to the audio service
+struct Delivered {
+    uint32_t sequence;
+    uint32_t timestamp;
+    int frame_duration;
+    std::vector<uint8_t> payload;
+};
+
+class BinaryProtocol4ParserTest : public ::testing::Test {
+protected:
+    size_t Receive(const std::vector<uint8_t>& packet) {
+        BinaryProtocol4Frame frames[2];
+        size_t count = parser_.Parse(packet.data(), packet.size(), FRAME_DURATION_MS, frames);
+        for (size_t i = 0; i < count; i++) {
+            delivered_.push_back({frames[i].sequence, frames[i].timestamp, frames[i].frame_duration,
+                std::vector<uint8_t>(frames[i].payload, frames[i].payload + frames[i].size)});
+        }
+        return count;
+    }
+
+    std::vector<uint32_t> Sequences() const {
+        std::vector<uint32_t> sequences;
+        for (auto& frame : delivered_) {
+            sequences.push_back(frame.sequence);
+        }
+        return sequences;
+    }
+
+    BinaryProtocol4Parser parser_;
+    std::vector<Delivered> delivered_;
+};
+
+TEST_F(BinaryProtocol4ParserTest, SingleLossIsRecoveredFromTheRedundantCopy) {
+    EXPECT_EQ(Receive(Packet(100, true)), 1u);
+    EXPECT_EQ(Receive(Packet(101, true)), 1u);
+    // 102 lost
+    EXPECT_EQ(Receive(Packet(103, true)), 2u);
+    EXPECT_EQ(Receive(Packet(104, true)), 1u);
+    EXPECT_EQ(Sequences(), (std::vector<uint32_t>{100, 101, 102, 103, 104}));
+
+    // The recovered frame is the one the server sent as 102, in play order before 103
+    auto& recovered = delivered_[2];
+    EXPECT_EQ(recovered.payload, FramePayload(102));
+    EXPECT_EQ(recovered.timestamp, 102u * FRAME_DURATION_MS);
+    EXPECT_EQ(recovered.frame_duration, FRAME_DURATION_MS);
+    EXPECT_EQ(delivered_[3].payload, FramePayload(103));
+    EXPECT_EQ(parser_.remote_sequence(), 104u);
+}
+
+TEST_F(BinaryProtocol4ParserTest, LongerGapsAreLeftToTheJitterBuffer) {
+    Receive(Packet(10, true));
+    // 11 and 12 lost, the copy in 13 only holds 12
+    EXPECT_EQ(Receive(Packet(13, true)), 1u);
+    // Without redundancy nothing can be recovered
+    EXPECT_EQ(Receive(Packet(15, false)), 1u);
+    EXPECT_EQ(Sequences(), (std::vector<uint32_t>{10, 13, 15}));
+}
+
+TEST_F(BinaryProtocol4ParserTest, LatePacketsDoNotMoveTheSequenceBack) {
+    for (uint32_t sequence : {1, 2, 4}) {
+        Receive(Packet(sequence, true));
+    }
+    // 3 was recovered from 4; the original arrives late and is passed on for the jitter buffer to drop
+    EXPECT_EQ(Receive(Packet(3, true)), 1u);
+    EXPECT_EQ(parser_.remote_sequence(), 4u);
+    // So 5 is in order: no recovery, no duplicate of 4
+    EXPECT_EQ(Receive(Packet(5, true)), 1u);
+    // A packet delayed past the next one
+    Receive(Packet(7, true));
+    EXPECT_EQ(Receive(Packet(6, true)), 1u);
+    EXPECT_EQ(Receive(Packet(8, true)), 1u);
+    EXPECT_EQ(Sequences(), (std::vector<uint32_t>{1, 2, 3, 4, 3, 5, 6, 7, 6, 8}));
+    EXPECT_EQ(parser_.remote_sequence(), 8u);
+}
+
+TEST_F(BinaryProtocol4ParserTest, SequenceZeroAndTheWrapAreOrdinaryValues) {
+    // A stream that starts at 0 and loses 1
+    Receive(Packet(0, false));
+    EXPECT_EQ(Receive(Packet(2, true)), 2u);
+    EXPECT_EQ(Sequences(), (std::vector<uint32_t>{0, 1, 2}));
+
+    // Across the 32-bit wrap, losing 0
+    parser_.Reset();
+    delivered_.clear();
+    Receive(Packet(0xFFFFFFFE, true));
+    Receive(Packet(0xFFFFFFFF, true));
+    EXPECT_EQ(Receive(Packet(1, true)), 2u);
+    // Late ones from before the wrap are old, not ahead
+    EXPECT_EQ(Receive(Packet(0xFFFFFFFF, true)), 1u);
+    EXPECT_EQ(parser_.remote_sequence(), 1u);
+    EXPECT_EQ(Receive(Packet(3, true)), 2u);
+    EXPECT_EQ(Sequences(), (std::vector<uint32_t>{0xFFFFFFFE, 0xFFFFFFFF, 0, 1, 0xFFFFFFFF, 2, 3}));
+    EXPECT_EQ(delivered_[2].payload, FramePayload(0));
+}
+
+TEST_F(BinaryProtocol4ParserTest, RandomSingleLossesAreAllRecovered) {
+    // 1% loss, never two in a row, across the wrap: every frame reaches the audio service once,
+    // in order, with the server's payload
+    std::mt19937 rng(23);
+    uint32_t first = 0xFFFFFFFF - 5000;
+    bool lost_previous = false;
+    size_t losses = 0;
+    for (uint32_t i = 0; i < 10000; i++) {
+        if (i > 0 && !lost_previous && rng() % 100 == 0) {
+            lost_previous = true;
+            losses++;
+            continue;
+        }
+        lost_previous = false;
+        Receive(Packet(first + i, true));
+    }
+    // The last one was not lost, or its copy would be missing
+    ASSERT_FALSE(lost_previous);
+    EXPECT_GT(losses, 50u);
+    ASSERT_EQ(delivered_.size(), 10000u);
+    for (uint32_t i = 0; i < delivered_.size(); i++) {
+        ASSERT_EQ(delivered_[i].sequence, first + i);
+        ASSERT_EQ(delivered_[i].payload, FramePayload(first + i)) << i;
+    }
+}
+
+TEST_F(BinaryProtocol4ParserTest, MalformedPacketsAreDroppedWithoutState) {
+    Receive(Packet(50, true));
+    auto packet = Packet(52, true);
+    // Header cut short, then payload and copy cut short
+    EXPECT_EQ(Receive(std::vector<uint8_t>(packet.begin(), packet.begin() + sizeof(BinaryProtocol4) - 1)), 0u);
+    EXPECT_EQ(Receive(std::vector<uint8_t>(packet.begin(), packet.end() - 1)), 0u);
+    EXPECT_EQ(parser_.remote_sequence(), 50u);
+    // Without the flag the redundant size is ignored, the trailing bytes are not a frame
+    auto unflagged = packet;
+    ((BinaryProtocol4*)unflagged.data())->flags = 0;
+    EXPECT_EQ(Receive(unflagged), 1u);
+    EXPECT_EQ(delivered_.back().payload, FramePayload(52));
+}
+
+TEST_F(BinaryProtocol4ParserTest, FrameDurationDefaultsToTheServerHello) {
+    Receive(Packet(1, false, 0));
+    Receive(Packet(3, true, 20));
+    ASSERT_EQ(delivered_.size(), 3u);
+    EXPECT_EQ(delivered_[0].frame_duration, FRAME_DURATION_MS);
+    // The recovered frame has the duration and timestamp of the packet it came in
+    EXPECT_EQ(delivered_[1].frame_duration, 20);
+    EXPECT_EQ(delivered_[1].timestamp, 3u * FRAME_DURATION_MS - 20);
+}
+
+TEST_F(BinaryProtocol4ParserTest, ResetStartsANewSequence) {
+    Receive(Packet(500, true));
+    parser_.Reset();
+    // A new channel may start anywhere, even below the old sequence, and has nothing to recover yet
+    EXPECT_EQ(Receive(Packet(7, true)), 1u);
+    EXPECT_EQ(parser_.remote_sequence(), 7u);
+    EXPECT_EQ(Receive(Packet(9, true)), 2u);
+}
@@ -0,0 +1,133 @@
+#include <gtest/gtest.h>
+
+#include "decoder_cache.h"
+
+#define CHANNELS 3
+
+// Stands in for the decoder / resampler pair; builds counts how often AudioService would create one
+struct FakeChannel {
+    int sample_rate = 0;
+    int frame_duration = 0;
+    int builds = 0;
+};
+
+class DecoderCacheTest : public ::testing::Test {
+protected:
+    // Like AudioService::SelectDecoder(), one call per decoded packet
+    FakeChannel* Select(bool local, int sample_rate, int frame_duration) {
+        bool created = false;
+        auto channel = cache_.Select(local, sample_rate, frame_duration, ++now_, created);
+        if (created) {
+            channel->sample_rate = sample_rate;
+            channel->frame_duration = frame_duration;
+            channel->builds++;
+        }
+        EXPECT_EQ(channel->sample_rate, sample_rate);
+        EXPECT_EQ(channel->frame_duration, frame_duration);
+        return channel;
+    }
+
+    DecoderCache<FakeChannel> cache_{CHANNELS};
+    int64_t now_ = 0;
+};
+
+TEST_F(DecoderCacheTest, SameFormatIsOneMiss) {
+    auto stream = Select(false, 24000, 60);
+    for (int i = 0; i < 100; i++) {
+        EXPECT_EQ(Select(false, 24000, 60), stream);
+    }
+    EXPECT_EQ(stream->builds, 1);
+    EXPECT_EQ(cache_.statistics().misses, 1u);
+    // Selecting the selected channel again is not a switch
+    EXPECT_EQ(cache_.statistics().hits, 0u);
+    EXPECT_EQ(cache_.selected(), stream);
+}
+
+TEST_F(DecoderCacheTest, SoundBetweenSentencesHitsBothWays) {
+    auto stream = Select(false, 24000, 60);
+    auto sound = Select(true, 16000, 60);
+    EXPECT_NE(stream, sound);
+    for (int sentence = 0; sentence < 10; sentence++) {
+        EXPECT_EQ(Select(false, 24000, 60), stream);
+        EXPECT_EQ(Select(true, 16000, 60), sound);
+    }
+    EXPECT_EQ(stream->builds, 1);
+    EXPECT_EQ(sound->builds, 1);
+    EXPECT_EQ(cache_.statistics().misses, 2u);
+    EXPECT_EQ(cache_.statistics().hits, 20u);
+    EXPECT_EQ(cache_.statistics().evictions, 0u);
+}
+
+TEST_F(DecoderCacheTest, SameFormatFromTheOtherSourceIsAnotherChannel) {
+    auto stream = Select(false, 16000, 60);
+    auto sound = Select(true, 16000, 60);
+    EXPECT_NE(stream, sound);
+    EXPECT_EQ(cache_.size(), 2u);
+    EXPECT_EQ(cache_.statistics().misses, 2u);
+}
+
+TEST_F(DecoderCacheTest, SoundsEvictTheLeastRecentlyUsedSound) {
+    auto stream = Select(false, 24000, 60);
+    auto chime = Select(true, 16000, 60);
+    auto digit = Select(true, 16000, 20);
+    EXPECT_EQ(cache_.size(), (size_t)CHANNELS);
+
+    // chime is the older sound, the stream is older still but not a sound
+    EXPECT_EQ(Select(true, 8000, 60), chime);
+    EXPECT_EQ(chime->builds, 2);
+    EXPECT_EQ(cache_.statistics().evictions, 1u);
+    EXPECT_EQ(Select(false, 24000, 60), stream);
+    EXPECT_EQ(stream->builds, 1);
+    EXPECT_EQ(Select(true, 16000, 20), digit);
+    EXPECT_EQ(digit->builds, 1);
+}
+
+TEST_F(DecoderCacheTest, StreamEvictsAStreamChannelFirst) {
+    auto old_stream = Select(false, 16000, 60);
+    auto sound = Select(true, 16000, 60);
+    Select(false, 24000, 60);
+    // A renegotiated stream format takes the older stream channel, the sound stays
+    EXPECT_EQ(Select(false, 24000, 20), old_stream);
+    EXPECT_EQ(Select(true, 16000, 60), sound);
+    EXPECT_EQ(sound->builds, 1);
+}
+
+TEST_F(DecoderCacheTest, OnlyTheOtherSourceLeftEvictsItsLeastRecentlyUsed) {
+    auto first = Select(true, 16000, 60);
+    Select(true, 16000, 20);
+    Select(true, 8000, 60);
+    EXPECT_EQ(Select(false, 24000, 60), first);
+    EXPECT_EQ(first->builds, 2);
+}
+
+TEST_F(DecoderCacheTest, HitAndMissCountsOverAConversation) {
+    // Greeting sound, three TTS sentences with a chime between them, then a renegotiated stream
+    Select(true, 16000, 60);
+    for (int sentence = 0; sentence < 3; sentence++) {
+        for (int packet = 0; packet < 50; packet++) {
+            Select(false, 24000, 60);
+        }
+        Select(true, 16000, 60);
+    }
+    for (int packet = 0; packet < 50; packet++) {
+        Select(false, 16000, 20);
+    }
+    Select(true, 16000, 60);
+
+    auto& s = cache_.statistics();
+    // 16k/60 sound, 24k/60 stream, 16k/20 stream
+    EXPECT_EQ(s.misses, 3u);
+    EXPECT_EQ(s.evictions, 0u);
+    // Each switch between the sound and the 24k stream after the first two, and the last sound
+    EXPECT_EQ(s.hits, 6u);
+    int builds = 0;
+    cache_.ForEach([&builds](FakeChannel& channel) { builds += channel.builds; });
+    EXPECT_EQ(builds, 3);
+}
+
+TEST(DecoderCacheCapacityTest, ZeroCapacityHasNoChannel) {
+    DecoderCache<FakeChannel> cache(0);
+    bool created = true;
+    EXPECT_EQ(cache.Select(false, 16000, 60, 1, created), nullptr);
+    EXPECT_FALSE(created);
+}
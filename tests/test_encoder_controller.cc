@@ -0,0 +1,61 @@
+#include <gtest/gtest.h>
+
+#include "encoder_controller.h"
+
+#define MAX_COMPLEXITY 5
+#define SEND_QUEUE_CAPACITY 10
+
+// Feeds frames with full headroom until the complexity changes, returns the audio time that took
+static int64_t UsUntilChange(EncoderController& controller, int64_t frame_us, size_t send_queue_depth = 0) {
+    int64_t elapsed_us = 0;
+    for (int i = 0; i < 10000; i++) {
+        elapsed_us += frame_us;
+        if (controller.Update(0, frame_us, send_queue_depth, SEND_QUEUE_CAPACITY, -1)) {
+            return elapsed_us;
+        }
+    }
+    return -1;
+}
+
+TEST(EncoderControllerTest, RaisesAfterThreeSecondsAtAnyFrameDuration) {
+    for (int frame_ms : {20, 40, 60, 120}) {
+        EncoderController controller(0, MAX_COMPLEXITY, 0);
+        EXPECT_EQ(UsUntilChange(controller, frame_ms * 1000), 3000000) << frame_ms;
+        EXPECT_EQ(controller.complexity(), 1) << frame_ms;
+        EXPECT_EQ(controller.statistics().last_reason, kEncoderControlHeadroom) << frame_ms;
+    }
+}
+
+TEST(EncoderControllerTest, WaitsTwelveSecondsAfterADropAtAnyFrameDuration) {
+    for (int frame_ms : {20, 60}) {
+        EncoderController controller(0, MAX_COMPLEXITY, MAX_COMPLEXITY);
+        // Half full send queue: two steps down at once
+        ASSERT_TRUE(controller.Update(0, frame_ms * 1000, SEND_QUEUE_CAPACITY / 2, SEND_QUEUE_CAPACITY, -1));
+        EXPECT_EQ(controller.complexity(), MAX_COMPLEXITY - 2);
+        EXPECT_EQ(controller.statistics().last_reason, kEncoderControlSendQueue);
+
+        EXPECT_EQ(UsUntilChange(controller, frame_ms * 1000), 12000000) << frame_ms;
+        EXPECT_EQ(controller.complexity(), MAX_COMPLEXITY - 1) << frame_ms;
+        EXPECT_EQ(controller.statistics().lowers, 1u);
+        EXPECT_EQ(controller.statistics().raises, 1u);
+    }
+}
+
+TEST(EncoderControllerTest, SendQueueKeepsLoweringAfterTheLoadSettles) {
+    const int64_t frame_us = 20000;
+    EncoderController controller(0, MAX_COMPLEXITY, MAX_COMPLEXITY);
+    ASSERT_TRUE(controller.Update(0, frame_us, SEND_QUEUE_CAPACITY, SEND_QUEUE_CAPACITY, -1));
+    // Not again until the smoothed load had more than 8 frames to follow, then right away
+    EXPECT_EQ(UsUntilChange(controller, frame_us, SEND_QUEUE_CAPACITY), 9 * frame_us);
+    EXPECT_EQ(controller.complexity(), MAX_COMPLEXITY - 4);
+}
+
+TEST(EncoderControllerTest, HighEncodeLoadLowersByOne) {
+    const int64_t frame_us = 60000;
+    EncoderController controller(0, MAX_COMPLEXITY, 3);
+    // 60% of the frame spent encoding
+    ASSERT_TRUE(controller.Update(frame_us * 6 / 10, frame_us, 0, SEND_QUEUE_CAPACITY, -1));
+    EXPECT_EQ(controller.complexity(), 2);
+    EXPECT_EQ(controller.statistics().last_reason, kEncoderControlEncodeTime);
+    EXPECT_FALSE(controller.Update(0, 0, 0, SEND_QUEUE_CAPACITY, -1));
+}
@@ -0,0 +1,138 @@
+#include <gtest/gtest.h>
+#include <cstdlib>
+#include <new>
+
+#include "frame_assembler.h"
+
+// Counts every allocation of the test binary, read around the calls being measured
+static size_t allocations = 0;
+
+void* operator new(size_t size) {
+    allocations++;
+    if (void* p = malloc(size ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    free(p);
+}
+
+// Stands in for the AFE: fetch() returns chunks of fetch_samples of a running sample counter
+class FakeAfe {
+public:
+    explicit FakeAfe(size_t fetch_samples) : chunk_(fetch_samples) {}
+
+    const std::vector<int16_t>& Fetch() {
+        for (auto& sample : chunk_) {
+            sample = static_cast<int16_t>(next_++);
+        }
+        return chunk_;
+    }
+
+    void Resize(size_t fetch_samples) { chunk_.resize(fetch_samples); }
+    uint32_t fetched() const { return next_; }
+
+private:
+    std::vector<int16_t> chunk_;
+    uint32_t next_ = 0;
+};
+
+// Like PushTaskToEncodeQueue(): swaps every frame with a recycled buffer of the same capacity
+class Consumer {
+public:
+    explicit Consumer(size_t frame_samples) : recycled_(frame_samples) {}
+
+    void operator()(std::vector<int16_t>&& frame) {
+        frames.push_back({first_sample(frame), frame.size()});
+        for (size_t i = 1; i < frame.size(); i++) {
+            if (frame[i] != static_cast<int16_t>(frame[0] + i)) {
+                discontinuities++;
+            }
+        }
+        recycled_.swap(frame);
+    }
+
+    struct Frame {
+        int16_t first;
+        size_t size;
+    };
+    std::vector<Frame> frames;
+    size_t discontinuities = 0;
+
+private:
+    std::vector<int16_t> recycled_;
+
+    static int16_t first_sample(const std::vector<int16_t>& frame) { return frame.empty() ? 0 : frame[0]; }
+};
+
+class FrameAssemblerTest : public ::testing::TestWithParam<std::tuple<size_t, int>> {};
+
+TEST_P(FrameAssemblerTest, FramesStartOnEveryFrameBoundary) {
+    auto [fetch_samples, frame_ms] = GetParam();
+    const size_t frame_samples = frame_ms * 16;
+    FakeAfe afe(fetch_samples);
+    FrameAssembler assembler(frame_samples);
+    Consumer consumer(frame_samples);
+    consumer.frames.reserve(1000);
+
+    // Ten seconds of processor output
+    const size_t fetches = 160000 / fetch_samples;
+    size_t before = allocations;
+    for (size_t i = 0; i < fetches; i++) {
+        auto& chunk = afe.Fetch();
+        assembler.Append(chunk.data(), chunk.size(), consumer);
+    }
+    EXPECT_EQ(allocations - before, 0u);
+
+    ASSERT_EQ(consumer.frames.size(), afe.fetched() / frame_samples);
+    for (size_t i = 0; i < consumer.frames.size(); i++) {
+        ASSERT_EQ(consumer.frames[i].size, frame_samples) << i;
+        ASSERT_EQ(consumer.frames[i].first, static_cast<int16_t>(i * frame_samples)) << i;
+    }
+    EXPECT_EQ(consumer.discontinuities, 0u);
+    // What is left waits for the next fetch
+    EXPECT_EQ(assembler.fill(), afe.fetched() % frame_samples);
+}
+
+// AFE fetch sizes (32ms, 16ms, and an odd one) against every uplink frame duration
+INSTANTIATE_TEST_SUITE_P(FetchAndFrameSizes, FrameAssemblerTest,
+    ::testing::Combine(::testing::Values(512, 256, 333), ::testing::Values(20, 40, 60)));
+
+TEST(FrameAssemblerResizeTest, NewFrameSizeDropsThePartialFrame) {
+    FakeAfe afe(512);
+    FrameAssembler assembler(960);
+    Consumer consumer(960);
+
+    // 1024 samples: one 960 frame and 64 left over
+    for (int i = 0; i < 2; i++) {
+        auto& chunk = afe.Fetch();
+        assembler.Append(chunk.data(), chunk.size(), consumer);
+    }
+    ASSERT_EQ(consumer.frames.size(), 1u);
+    EXPECT_EQ(assembler.fill(), 64u);
+
+    // Renegotiated to 20ms: the next frame starts with the next fetch
+    assembler.SetFrameSamples(320);
+    EXPECT_EQ(assembler.fill(), 0u);
+    auto& chunk = afe.Fetch();
+    assembler.Append(chunk.data(), chunk.size(), consumer);
+    ASSERT_EQ(consumer.frames.size(), 2u);
+    EXPECT_EQ(consumer.frames[1].first, 1024);
+    EXPECT_EQ(consumer.frames[1].size, 320u);
+    EXPECT_EQ(assembler.fill(), 192u);
+}
+
+TEST(FrameAssemblerResizeTest, NoFrameSizeTakesNothing) {
+    FrameAssembler assembler;
+    int16_t samples[16] = {};
+    int frames = 0;
+    assembler.Append(samples, 16, [&frames](std::vector<int16_t>&&) { frames++; });
+    EXPECT_EQ(frames, 0);
+    EXPECT_EQ(assembler.fill(), 0u);
+}
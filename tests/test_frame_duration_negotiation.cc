@@ -0,0 +1,131 @@
+#include <gtest/gtest.h>
+
+#include "protocol.h"
+
+// The defaults of CONFIG_OPUS_REALTIME_FRAME_DURATION_MS and CONFIG_OPUS_AUTO_FRAME_DURATION_MS
+#define REALTIME_FRAME_DURATION_MS 20
+#define AUTO_FRAME_DURATION_MS 60
+
+// A transport looped back to a fake server: OpenAudioChannel() sends the hello with the proposed
+// frame_duration, as WebsocketProtocol / MqttProtocol::GetHelloMessage() do, and the server hello
+// goes through ParseUplinkFrameDuration() like their ParseServerHello()
+class LoopbackProtocol : public Protocol {
+public:
+    bool Start() override { return true; }
+    bool OpenAudioChannel() override {
+        std::string audio_params = "{\"format\":\"opus\",\"sample_rate\":16000,\"channels\":1,\"frame_duration\":" +
+            std::to_string(preferred_frame_duration_) + "}";
+        if (!SendJson(Member("type", "hello"), Member("transport", "websocket"),
+                Member("audio_params", JsonRawValue{audio_params}))) {
+            return false;
+        }
+        auto root = JsonValue::Parse(server_hello);
+        if (!root.Get("type").Equals("hello")) {
+            return false;
+        }
+        ParseUplinkFrameDuration(root.Get("audio_params"));
+        opened_ = true;
+        return true;
+    }
+    void CloseAudioChannel() override { opened_ = false; }
+    bool IsAudioChannelOpened() const override { return opened_; }
+    bool SendAudio(const AudioStreamPacket&) override { return true; }
+
+    // What the server answers to a hello; set by the server before the reply is read
+    std::function<std::string(const JsonValue& hello)> server;
+    std::string hello;
+    std::string server_hello;
+
+protected:
+    bool SendText(const std::string& text) override {
+        hello = text;
+        auto root = JsonValue::Parse(hello);
+        server_hello = server ? server(root) : "";
+        return true;
+    }
+
+private:
+    bool opened_ = false;
+};
+
+// Server hello with the given audio_params members after the downlink ones
+static std::string ServerHello(const std::string& extra = "") {
+    return "{\"type\":\"hello\",\"transport\":\"websocket\",\"session_id\":\"s1\",\"audio_params\":"
+        "{\"format\":\"opus\",\"sample_rate\":24000,\"channels\":1,\"frame_duration\":60" + extra + "}}";
+}
+
+class FrameDurationNegotiationTest : public ::testing::Test {
+protected:
+    // Application::UpdatePreferredFrameDuration() before the channel opens
+    int Open(bool aec, const std::function<std::string(const JsonValue& hello)>& server) {
+        protocol_.SetPreferredFrameDuration(aec ? REALTIME_FRAME_DURATION_MS : AUTO_FRAME_DURATION_MS);
+        protocol_.server = server;
+        EXPECT_TRUE(protocol_.OpenAudioChannel());
+        proposed_ = JsonValue::Parse(protocol_.hello).Get("audio_params").Get("frame_duration").ToInt();
+        protocol_.CloseAudioChannel();
+        return protocol_.uplink_frame_duration();
+    }
+
+    LoopbackProtocol protocol_;
+    int proposed_ = 0;
+};
+
+TEST_F(FrameDurationNegotiationTest, ProposalStandsWithoutAnAnswer) {
+    // Servers that do not know the field keep whatever the device proposed
+    EXPECT_EQ(Open(true, [](const JsonValue&) { return ServerHello(); }), REALTIME_FRAME_DURATION_MS);
+    EXPECT_EQ(proposed_, REALTIME_FRAME_DURATION_MS);
+    EXPECT_EQ(Open(false, [](const JsonValue&) { return ServerHello(); }), AUTO_FRAME_DURATION_MS);
+    EXPECT_EQ(proposed_, AUTO_FRAME_DURATION_MS);
+}
+
+TEST_F(FrameDurationNegotiationTest, ServerChoiceWins) {
+    // A server that wants 40ms frames whatever the device proposes
+    auto server = [](const JsonValue& hello) {
+        EXPECT_TRUE(hello.Get("audio_params").Get("frame_duration").IsNumber());
+        return ServerHello(",\"uplink_frame_duration\":40");
+    };
+    EXPECT_EQ(Open(true, server), 40);
+    EXPECT_EQ(Open(false, server), 40);
+
+    // A server that echoes the proposal
+    auto echo = [](const JsonValue& hello) {
+        int proposed = hello.Get("audio_params").Get("frame_duration").ToInt();
+        return ServerHello(",\"uplink_frame_duration\":" + std::to_string(proposed));
+    };
+    EXPECT_EQ(Open(true, echo), REALTIME_FRAME_DURATION_MS);
+    EXPECT_EQ(Open(false, echo), AUTO_FRAME_DURATION_MS);
+}
+
+TEST_F(FrameDurationNegotiationTest, UnsupportedAnswersKeepTheProposal) {
+    for (const char* answer : {"33", "0", "-20", "120", "\"40\"", "null"}) {
+        EXPECT_EQ(Open(true, [&](const JsonValue&) {
+            return ServerHello(std::string(",\"uplink_frame_duration\":") + answer);
+        }), REALTIME_FRAME_DURATION_MS) << answer;
+    }
+}
+
+TEST_F(FrameDurationNegotiationTest, EverySessionNegotiatesAgain) {
+    EXPECT_EQ(Open(true, [](const JsonValue&) { return ServerHello(",\"uplink_frame_duration\":60"); }), 60);
+    // The previous session's answer does not carry over to a server that does not answer
+    EXPECT_EQ(Open(true, [](const JsonValue&) { return ServerHello(); }), REALTIME_FRAME_DURATION_MS);
+    // Nor does the previous proposal, when AEC was turned off in between
+    EXPECT_EQ(Open(false, [](const JsonValue&) { return ServerHello(); }), AUTO_FRAME_DURATION_MS);
+}
+
+TEST_F(FrameDurationNegotiationTest, OnlyTheKconfigChoicesCanBeProposed) {
+    for (int duration : {20, 40, 60}) {
+        EXPECT_TRUE(Protocol::IsSupportedFrameDuration(duration));
+        protocol_.SetPreferredFrameDuration(duration);
+        protocol_.server = [](const JsonValue&) { return ServerHello(); };
+        ASSERT_TRUE(protocol_.OpenAudioChannel());
+        EXPECT_EQ(protocol_.uplink_frame_duration(), duration);
+    }
+    // Anything else is refused and the previous proposal stays
+    for (int duration : {0, 10, 33, 50, 80, 120}) {
+        EXPECT_FALSE(Protocol::IsSupportedFrameDuration(duration));
+        protocol_.SetPreferredFrameDuration(duration);
+        ASSERT_TRUE(protocol_.OpenAudioChannel());
+        EXPECT_EQ(JsonValue::Parse(protocol_.hello).Get("audio_params").Get("frame_duration").ToInt(), 60);
+        EXPECT_EQ(protocol_.uplink_frame_duration(), 60);
+    }
+}
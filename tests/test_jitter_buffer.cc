@@ -0,0 +1,73 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+
+#include "jitter_replay.h"
+
+#define FRAME_DURATION_MS 60
+#define CAPACITY 40     // MAX_DECODE_PACKETS_IN_QUEUE
+
+static JitterReplayResult Replay(const char* name) {
+    std::vector<JitterTraceEvent> events;
+    EXPECT_TRUE(LoadJitterTrace(std::string(TEST_DATA_DIR "/") + name, events)) << name;
+    return ReplayJitterTrace(events, FRAME_DURATION_MS, CAPACITY);
+}
+
+static void ExpectInOrder(const std::vector<uint32_t>& played) {
+    for (size_t i = 1; i < played.size(); i++) {
+        EXPECT_GT(static_cast<int32_t>(played[i] - played[i - 1]), 0) << "at " << i;
+    }
+}
+
+TEST(JitterBufferTest, CleanNetworkPlaysEverythingWithoutDelay) {
+    auto result = Replay("jitter_clean.txt");
+    EXPECT_EQ(result.played.size(), 100u);
+    EXPECT_EQ(result.concealed, 0);
+    EXPECT_EQ(result.statistics.lost, 0u);
+    EXPECT_EQ(result.first_play_ms, result.first_arrival_ms);
+    // A real time stream drains once at the start, one more frame of depth covers it for good
+    EXPECT_LE(result.statistics.underruns, 1u);
+    EXPECT_LE(result.max_target_depth, JITTER_BUFFER_MIN_DEPTH + 1);
+    ExpectInOrder(result.played);
+}
+
+TEST(JitterBufferTest, StallGrowsTheTargetDepthWithoutLosingPackets) {
+    auto result = Replay("jitter_burst_stall.txt");
+    EXPECT_EQ(result.played.size(), 150u);
+    EXPECT_EQ(result.statistics.lost, 0u);
+    EXPECT_EQ(result.statistics.late, 0u);
+    // The stall shows up in the jitter estimate, which keeps a few frames in reserve afterwards
+    EXPECT_GE(result.max_target_depth, 3);
+    EXPECT_LE(result.max_target_depth, JITTER_BUFFER_MAX_DEPTH);
+    ExpectInOrder(result.played);
+}
+
+TEST(JitterBufferTest, ReordersConcealsGapsAndFollowsTheSequenceThroughZero) {
+    auto result = Replay("jitter_reorder_wrap.txt");
+    // Overtaken packets are put back in order, each lost one is concealed exactly once
+    EXPECT_EQ(result.played.size(), 117u);
+    EXPECT_EQ(result.concealed, 3);
+    EXPECT_EQ(result.statistics.lost, 3u);
+    EXPECT_EQ(result.statistics.late, 0u);
+    ExpectInOrder(result.played);
+    // Sequence 0 is a network packet like any other
+    EXPECT_NE(std::find(result.played.begin(), result.played.end(), 0u), result.played.end());
+}
+
+TEST(JitterBufferTest, DropsLateAndDuplicatedPackets) {
+    JitterBuffer buffer(CAPACITY);
+    auto put = [&buffer](uint32_t sequence, int64_t now_ms) {
+        auto packet = std::make_unique<AudioStreamPacket>();
+        packet->sequence = sequence;
+        packet->frame_duration = FRAME_DURATION_MS;
+        return buffer.Put(packet, now_ms);
+    };
+    std::unique_ptr<AudioStreamPacket> packet;
+
+    EXPECT_TRUE(put(5, 0));
+    EXPECT_FALSE(put(5, 1));
+    EXPECT_EQ(buffer.Pop(packet, 1), JitterBuffer::kPopPacket);
+    EXPECT_EQ(packet->sequence, 5u);
+    EXPECT_FALSE(put(4, 2));
+    EXPECT_EQ(buffer.statistics().duplicated, 1u);
+    EXPECT_EQ(buffer.statistics().late, 1u);
+}
@@ -0,0 +1,186 @@
+#include <gtest/gtest.h>
+#include <chrono>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <random>
+
+#include "json_reader.h"
+
+// Counts every allocation of the test binary, read around the calls being measured
+static size_t allocations = 0;
+
+void* operator new(size_t size) {
+    allocations++;
+    if (void* p = malloc(size ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    free(p);
+}
+
+// Messages as the servers send them
+static const char* kServerHello = R"({"type":"hello","transport":"websocket","session_id":"a1b2c3",)"
+    R"("audio_params":{"format":"opus","sample_rate":24000,"channels":1,"frame_duration":60,)"
+    R"("uplink_frame_duration":20,"dtx":true}})";
+static const char* kTts = R"({"type":"tts","state":"sentence_start","text":"\u4f60\u597d\uff0c\"world\"\n","session_id":"a1b2c3"})";
+static const char* kMcp = R"({"session_id":"a1b2c3","type":"mcp","payload":{"jsonrpc":"2.0","id":7,"method":"tools/call",)"
+    R"("params":{"name":"self.audio_speaker.set_volume","arguments":{"volume":80}}}})";
+
+TEST(JsonReaderTest, MalformedTextIsInvalid) {
+    const char* cases[] = {
+        "", " ", "{", "}", "[", "]", "{]", "[}", "{\"a\"}", "{\"a\":}", "{\"a\" 1}", "{a:1}", "{'a':1}",
+        "{\"a\":1,}", "[1,]", "[,1]", "[1 2]", "{\"a\":1 \"b\":2}", "\"abc", "\"a\\\"", "\"\\x\"", "\"\\u12\"",
+        "\"\\u12g4\"", "\"tab\there\"", "01", "-", "1.", ".5", "1e", "1e+", "+1", "0x10", "NaN", "Infinity",
+        "tru", "nul", "True", "null1", "{\"a\":1}x", "{\"a\":1}{}", "[\"a\"]]", "{\"a\":[1,2}", "{\"a\":{\"b\":1}",
+    };
+    for (const char* text : cases) {
+        EXPECT_FALSE(JsonValue::Parse(text, strlen(text)).IsValid()) << text;
+    }
+    // Bytes after the length do not count
+    EXPECT_FALSE(JsonValue::Parse("{\"a\":1}", 6).IsValid());
+}
+
+TEST(JsonReaderTest, WellFormedTextIsValid) {
+    const char* cases[] = {
+        "{}", "[]", " { } ", "0", "-0", "1.5e-3", "-12E+2", "\"\"", "\"\\u00e9\\ud83d\\ude00\"", "true", "false",
+        "null", "[1,\"a\",{},[],null]", "{\"a\":{\"b\":[{\"c\":\"d\"}]}}", "\t\r\n{\"a\" : 1 }\n",
+    };
+    for (const char* text : cases) {
+        EXPECT_TRUE(JsonValue::Parse(text, strlen(text)).IsValid()) << text;
+    }
+    // Senders that count the C string terminator in the length
+    EXPECT_TRUE(JsonValue::Parse("{\"a\":1}", 8).IsObject());
+}
+
+TEST(JsonReaderTest, EveryTruncationOfAMessageIsInvalid) {
+    for (const char* message : {kServerHello, kTts, kMcp}) {
+        std::string text = message;
+        ASSERT_TRUE(JsonValue::Parse(text).IsObject()) << text;
+        for (size_t length = 0; length < text.size(); length++) {
+            ASSERT_FALSE(JsonValue::Parse(text.data(), length).IsValid()) << text.substr(0, length);
+        }
+    }
+}
+
+TEST(JsonReaderTest, CorruptedMessagesNeverReadOutOfBounds) {
+    // Each mutation is parsed from an exactly sized heap copy, so a read past the end shows up
+    // under ASan or valgrind; whatever is accepted must be walkable like a real message
+    std::mt19937 rng(11);
+    size_t accepted = 0;
+    for (int round = 0; round < 20000; round++) {
+        std::string text = round % 3 == 0 ? kServerHello : round % 3 == 1 ? kTts : kMcp;
+        for (int i = 0; i < 1 + (int)(rng() % 3); i++) {
+            text[rng() % text.size()] = "{}[]\",:\\0a \x01"[rng() % 13];
+        }
+        std::unique_ptr<char[]> copy(new char[text.size()]);
+        memcpy(copy.get(), text.data(), text.size());
+        auto root = JsonValue::Parse(copy.get(), text.size());
+        if (root.IsValid()) {
+            accepted++;
+            root.Get("type").ToString();
+            root.Get("audio_params").Get("sample_rate").ToInt();
+            root.Get("payload").Get("params").Get("arguments").Get("volume").ToInt();
+            root.Get("text").ToString();
+        }
+    }
+    EXPECT_GT(accepted, 0u);
+}
+
+TEST(JsonReaderTest, NestingDepthIsBounded) {
+    auto nested = [](int depth) { return std::string(depth, '[') + std::string(depth, ']'); };
+    std::string deepest = nested(33), too_deep = nested(34);
+    EXPECT_TRUE(JsonValue::Parse(deepest).IsArray());
+    EXPECT_FALSE(JsonValue::Parse(too_deep).IsValid());
+    EXPECT_FALSE(JsonValue::Parse(std::string(100000, '[')).IsValid());
+}
+
+TEST(JsonReaderTest, MembersOfAServerHello) {
+    std::string hello = kServerHello;
+    auto root = JsonValue::Parse(hello);
+    ASSERT_TRUE(root.IsObject());
+    EXPECT_TRUE(root.Get("type").Equals("hello"));
+    EXPECT_EQ(root.Get("session_id").ToString(), "a1b2c3");
+    auto audio_params = root.Get("audio_params");
+    ASSERT_TRUE(audio_params.IsObject());
+    EXPECT_EQ(audio_params.Get("sample_rate").ToInt(), 24000);
+    EXPECT_EQ(audio_params.Get("uplink_frame_duration").ToInt(), 20);
+    EXPECT_TRUE(audio_params.Get("dtx").IsTrue());
+    EXPECT_FALSE(audio_params.Get("redundancy").IsValid());
+    // Members of nested objects are not members of the outer one
+    EXPECT_FALSE(root.Get("sample_rate").IsValid());
+    EXPECT_FALSE(root.Get("type").Get("x").IsValid());
+
+    std::string tts = kTts;
+    EXPECT_EQ(JsonValue::Parse(tts).Get("text").ToString(), "\xe4\xbd\xa0\xe5\xa5\xbd\xef\xbc\x8c\"world\"\n");
+    std::string mcp = kMcp;
+    auto arguments = JsonValue::Parse(mcp).Get("payload").Get("params").Get("arguments");
+    EXPECT_EQ(arguments.Get("volume").ToInt(), 80);
+    EXPECT_EQ(std::string(arguments.data(), arguments.size()), "{\"volume\":80}");
+}
+
+TEST(JsonReaderTest, MemberNamesIgnoreCaseLikeCJson) {
+    // The values point into the text, which has to outlive them
+    std::string text = R"({"Type":"tts","SAMPLE_RATE":16000,"stackSize":4096,"st\u0041te":"start"})";
+    auto root = JsonValue::Parse(text);
+    EXPECT_TRUE(root.Get("type").Equals("tts"));
+    EXPECT_EQ(root.Get("sample_rate").ToInt(), 16000);
+    EXPECT_EQ(root.Get("stacksize").ToInt(), 4096);
+    EXPECT_EQ(root.Get("stackSize").ToInt(), 4096);
+    EXPECT_TRUE(root.Get("state").Equals("start"));
+    // Only the name, a value still compares exactly
+    EXPECT_FALSE(root.Get("type").Equals("TTS"));
+    // Prefixes and longer keys do not match
+    EXPECT_FALSE(root.Get("typ").IsValid());
+    EXPECT_FALSE(root.Get("types").IsValid());
+
+    // The first match wins, as in cJSON_GetObjectItem
+    std::string duplicate_text = R"({"ID":1,"id":2})";
+    auto duplicate = JsonValue::Parse(duplicate_text);
+    EXPECT_EQ(duplicate.Get("id").ToInt(), 1);
+}
+
+TEST(JsonReaderTest, NumbersConvertLikeValueInt) {
+    std::string text = R"({"a":-7.9,"b":1e10,"c":-1e10,"d":"5","e":2.5e1})";
+    auto root = JsonValue::Parse(text);
+    EXPECT_EQ(root.Get("a").ToInt(), -7);
+    EXPECT_EQ(root.Get("b").ToInt(), INT_MAX);
+    EXPECT_EQ(root.Get("c").ToInt(), INT_MIN);
+    EXPECT_EQ(root.Get("d").ToInt(), 0);
+    EXPECT_EQ(root.Get("e").ToInt(), 25);
+    EXPECT_DOUBLE_EQ(root.Get("a").ToDouble(), -7.9);
+}
+
+TEST(JsonReaderTest, Benchmark) {
+    // What a text message costs the receive task: parse, dispatch on "type", read a few members
+    const int rounds = 20000;
+    std::string messages[] = {kServerHello, kTts, kMcp};
+    volatile int sink = 0;
+    size_t before = allocations;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < rounds; i++) {
+        auto& text = messages[i % 3];
+        auto root = JsonValue::Parse(text);
+        auto type = root.Get("type");
+        if (type.Equals("hello")) {
+            sink = root.Get("audio_params").Get("sample_rate").ToInt();
+        } else if (type.Equals("tts")) {
+            sink = root.Get("state").Equals("sentence_start");
+        } else if (type.Equals("mcp")) {
+            sink = root.Get("payload").Get("id").ToInt();
+        }
+    }
+    double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / rounds;
+    (void)sink;
+    std::cout << ns << " ns per message, " << (double)(allocations - before) / rounds << " allocations per message" << std::endl;
+    EXPECT_EQ(allocations - before, 0u);
+}
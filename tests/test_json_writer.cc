@@ -0,0 +1,210 @@
+#include <gtest/gtest.h>
+#include <cstdlib>
+#include <new>
+
+#include "protocol.h"
+
+// Counts every allocation of the test binary, read around the calls being measured
+static size_t allocations = 0;
+
+void* operator new(size_t size) {
+    allocations++;
+    if (void* p = malloc(size ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    free(p);
+}
+
+static const char* kSessionId = "c6a1e2f0-5a3b-4d8e-9f21-7b0c3d4e5f60";
+static const std::string kMcpPayload =
+    "{\"jsonrpc\":\"2.0\",\"id\":3,\"result\":{\"content\":[{\"type\":\"text\",\"text\":\"true\"}],\"isError\":false}}";
+
+// The messages as they were built before JsonWriter, by string concatenation
+namespace concatenated {
+
+static std::string Abort(const std::string& session_id_, AbortReason reason) {
+    std::string message = "{\"session_id\":\"" + session_id_ + "\",\"type\":\"abort\"";
+    if (reason == kAbortReasonWakeWordDetected) {
+        message += ",\"reason\":\"wake_word_detected\"";
+    }
+    message += "}";
+    return message;
+}
+
+static std::string WakeWordDetected(const std::string& session_id_, const std::string& wake_word) {
+    return "{\"session_id\":\"" + session_id_ +
+        "\",\"type\":\"listen\",\"state\":\"detect\",\"text\":\"" + wake_word + "\"}";
+}
+
+static std::string StartListening(const std::string& session_id_, ListeningMode mode) {
+    std::string message = "{\"session_id\":\"" + session_id_ + "\"";
+    message += ",\"type\":\"listen\",\"state\":\"start\"";
+    if (mode == kListeningModeRealtime) {
+        message += ",\"mode\":\"realtime\"";
+    } else if (mode == kListeningModeAutoStop) {
+        message += ",\"mode\":\"auto\"";
+    } else {
+        message += ",\"mode\":\"manual\"";
+    }
+    message += "}";
+    return message;
+}
+
+static std::string StopListening(const std::string& session_id_) {
+    return "{\"session_id\":\"" + session_id_ + "\",\"type\":\"listen\",\"state\":\"stop\"}";
+}
+
+static std::string Mcp(const std::string& session_id_, const std::string& payload) {
+    return "{\"session_id\":\"" + session_id_ + "\",\"type\":\"mcp\",\"payload\":" + payload + "}";
+}
+
+static std::string Goodbye(const std::string& session_id_) {
+    std::string message = "{";
+    message += "\"session_id\":\"" + session_id_ + "\",";
+    message += "\"type\":\"goodbye\"";
+    message += "}";
+    return message;
+}
+
+} // namespace concatenated
+
+// Keeps the last text sent, in a buffer that is allocated once
+class TestProtocol : public Protocol {
+public:
+    TestProtocol() {
+        session_id_ = kSessionId;
+        sent.reserve(1024);
+    }
+
+    bool Start() override { return true; }
+    bool OpenAudioChannel() override { return true; }
+    void CloseAudioChannel() override {}
+    bool IsAudioChannelOpened() const override { return true; }
+    bool SendAudio(const AudioStreamPacket&) override { return true; }
+
+    // Like MqttProtocol::CloseAudioChannel()
+    void SendGoodbye() {
+        SendJson(Member("session_id", session_id_), Member("type", "goodbye"));
+    }
+
+    std::string sent;
+
+protected:
+    bool SendText(const std::string& text) override {
+        sent.assign(text);
+        return true;
+    }
+};
+
+struct MessageCase {
+    const char* name;
+    std::function<void(TestProtocol&)> send;
+    std::function<std::string(const std::string&)> concatenate;
+};
+
+static std::vector<MessageCase> MessageCases() {
+    return {
+        {"abort", [](TestProtocol& p) { p.SendAbortSpeaking(kAbortReasonNone); },
+            [](const std::string& id) { return concatenated::Abort(id, kAbortReasonNone); }},
+        {"abort wake word", [](TestProtocol& p) { p.SendAbortSpeaking(kAbortReasonWakeWordDetected); },
+            [](const std::string& id) { return concatenated::Abort(id, kAbortReasonWakeWordDetected); }},
+        {"listen detect", [](TestProtocol& p) { p.SendWakeWordDetected("你好小智"); },
+            [](const std::string& id) { return concatenated::WakeWordDetected(id, "你好小智"); }},
+        {"listen start auto", [](TestProtocol& p) { p.SendStartListening(kListeningModeAutoStop); },
+            [](const std::string& id) { return concatenated::StartListening(id, kListeningModeAutoStop); }},
+        {"listen start manual", [](TestProtocol& p) { p.SendStartListening(kListeningModeManualStop); },
+            [](const std::string& id) { return concatenated::StartListening(id, kListeningModeManualStop); }},
+        {"listen start realtime", [](TestProtocol& p) { p.SendStartListening(kListeningModeRealtime); },
+            [](const std::string& id) { return concatenated::StartListening(id, kListeningModeRealtime); }},
+        {"listen stop", [](TestProtocol& p) { p.SendStopListening(); },
+            [](const std::string& id) { return concatenated::StopListening(id); }},
+        {"mcp", [](TestProtocol& p) { p.SendMcpMessage(kMcpPayload); },
+            [](const std::string& id) { return concatenated::Mcp(id, kMcpPayload); }},
+        {"goodbye", [](TestProtocol& p) { p.SendGoodbye(); },
+            [](const std::string& id) { return concatenated::Goodbye(id); }},
+    };
+}
+
+TEST(JsonWriterTest, MessagesMatchTheConcatenatedOnes) {
+    TestProtocol protocol;
+    for (auto& message : MessageCases()) {
+        message.send(protocol);
+        EXPECT_EQ(protocol.sent, message.concatenate(kSessionId)) << message.name;
+        EXPECT_TRUE(JsonValue::Parse(protocol.sent).IsObject()) << message.name;
+    }
+}
+
+TEST(JsonWriterTest, ReusedBufferStopsAllocating) {
+    TestProtocol protocol;
+    std::string session_id = kSessionId;
+    // Grows the text buffer to the largest message
+    for (auto& message : MessageCases()) {
+        message.send(protocol);
+    }
+    for (auto& message : MessageCases()) {
+        size_t before = allocations;
+        message.send(protocol);
+        size_t written = allocations - before;
+
+        before = allocations;
+        std::string concatenated = message.concatenate(session_id);
+        size_t concatenated_allocations = allocations - before;
+
+        EXPECT_EQ(written, 0u) << message.name;
+        EXPECT_GT(concatenated_allocations, 0u) << message.name;
+        EXPECT_EQ(protocol.sent, concatenated) << message.name;
+    }
+}
+
+TEST(JsonWriterTest, ReservesExactlyTheWrittenSize) {
+    std::string buffer;
+    std::string text = "tab\there \"quoted\" \x01 小智";
+    auto& json = JsonWriter::Object(buffer, Member("a", text), Member("raw", JsonRawValue{"[1,2]"}), Member("b", ""));
+    EXPECT_EQ(json, "{\"a\":\"tab\\there \\\"quoted\\\" \\u0001 小智\",\"raw\":[1,2],\"b\":\"\"}");
+    // Braces, two commas, then each "key": and its value
+    EXPECT_EQ(json.size(), 2 + 2 + (4 + JsonWriter::EscapedSize(text)) + (6 + 5) + (4 + 2));
+    EXPECT_EQ(json.capacity(), json.size());
+    EXPECT_EQ(JsonWriter::Object(buffer), "{}");
+}
+
+TEST(JsonWriterTest, EscapesLikeCJson) {
+    struct {
+        const char* in;
+        const char* out;
+    } cases[] = {
+        {"", "\"\""},
+        {"plain", "\"plain\""},
+        {"a\"b", "\"a\\\"b\""},
+        {"back\\slash", "\"back\\\\slash\""},
+        {"tab\tnl\nret\r", "\"tab\\tnl\\nret\\r\""},
+        {"\b\f", "\"\\b\\f\""},
+        {"\x01\x1f", "\"\\u0001\\u001f\""},
+        {"/ and \x7f", "\"/ and \x7f\""},
+        {"hi 😀 小智", "\"hi 😀 小智\""},
+    };
+    for (auto& c : cases) {
+        std::string out;
+        JsonWriter::AppendEscaped(out, c.in);
+        EXPECT_EQ(out, c.out) << c.in;
+        EXPECT_EQ(out.size(), JsonWriter::EscapedSize(c.in)) << c.in;
+        // And reads back as the same string
+        EXPECT_EQ(JsonValue::Parse(out).ToString(), c.in) << c.in;
+    }
+}
+
+TEST(JsonWriterTest, WakeWordAndSessionIdAreEscaped) {
+    TestProtocol protocol;
+    protocol.SendWakeWordDetected("小\"智\"\n");
+    auto root = JsonValue::Parse(protocol.sent);
+    ASSERT_TRUE(root.IsObject()) << protocol.sent;
+    EXPECT_EQ(root.Get("text").ToString(), "小\"智\"\n");
+    EXPECT_TRUE(root.Get("session_id").Equals(kSessionId));
+}
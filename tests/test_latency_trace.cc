@@ -0,0 +1,121 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <random>
+
+#include "latency_trace.h"
+
+static uint32_t GetLe32(const uint8_t* p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | (uint32_t(p[3]) << 24);
+}
+
+// The exact percentile of a sorted set, with the same rank rounding as LatencyTrace
+static uint32_t ExactPercentile(const std::vector<uint32_t>& sorted, int percent) {
+    size_t rank = (sorted.size() * percent + 99) / 100;
+    return sorted[std::max<size_t>(rank, 1) - 1];
+}
+
+TEST(LatencyTraceTest, BucketsTileTheRangeWithoutGaps) {
+    EXPECT_EQ(LatencyTrace::BucketOf(0), 0);
+    for (int bucket = 0; bucket < LatencyTrace::kBuckets - 1; bucket++) {
+        uint32_t upper = LatencyTrace::BucketUpperBound(bucket);
+        ASSERT_EQ(LatencyTrace::BucketOf(upper), bucket) << upper;
+        ASSERT_EQ(LatencyTrace::BucketOf(upper + 1), bucket + 1) << upper + 1;
+        // A bucket spans a quarter of its octave, so a percentile reads at most 25% high
+        uint32_t lower = bucket == 0 ? 0 : LatencyTrace::BucketUpperBound(bucket - 1) + 1;
+        if (lower >= LatencyTrace::kBucketsPerOctave) {
+            ASSERT_LE((double)(upper + 1) / lower, 1.25) << bucket;
+        }
+    }
+    // Everything past about 4 seconds lands in the last bucket
+    EXPECT_GT(LatencyTrace::BucketUpperBound(LatencyTrace::kBuckets - 2), 4000000u);
+    EXPECT_EQ(LatencyTrace::BucketOf(UINT32_MAX), LatencyTrace::kBuckets - 1);
+    EXPECT_EQ(LatencyTrace::BucketUpperBound(LatencyTrace::kBuckets - 1), UINT32_MAX);
+}
+
+TEST(LatencyTraceTest, PercentilesFollowTheExactOnesWithinABucket) {
+    std::mt19937 rng(7);
+    // A decode stage: mostly 2-4ms, with a tail of slow frames
+    std::lognormal_distribution<double> dist(std::log(3000.0), 0.5);
+    LatencyTrace trace(0);
+    std::vector<uint32_t> samples;
+    for (int i = 0; i < 5000; i++) {
+        uint32_t us = (uint32_t)dist(rng);
+        trace.Record(kLatencyStageDecode, 1000000 + i * 60000, 1000000 + i * 60000 + us);
+        samples.push_back(us);
+    }
+    std::sort(samples.begin(), samples.end());
+
+    auto summary = trace.Summary(kLatencyStageDecode);
+    EXPECT_EQ(summary.count, samples.size());
+    EXPECT_EQ(summary.max_us, samples.back());
+    for (auto [percent, value] : {std::pair{50, summary.p50_us}, {95, summary.p95_us}, {99, summary.p99_us}}) {
+        uint32_t exact = ExactPercentile(samples, percent);
+        // Reported as the upper bound of the bucket holding the exact value
+        EXPECT_GE(value, exact) << "p" << percent;
+        EXPECT_EQ(LatencyTrace::BucketOf(value), LatencyTrace::BucketOf(exact)) << "p" << percent;
+    }
+    EXPECT_LE(summary.p50_us, summary.p95_us);
+    EXPECT_LE(summary.p95_us, summary.p99_us);
+    EXPECT_LE(summary.p99_us, summary.max_us);
+
+    // Other stages are untouched
+    EXPECT_EQ(trace.Summary(kLatencyStageEncode).count, 0u);
+    EXPECT_EQ(trace.Summary(kLatencyStageEncode).p99_us, 0u);
+}
+
+TEST(LatencyTraceTest, SmallSetsAndOutOfRangeDurations) {
+    LatencyTrace trace(4);
+    trace.Record(kLatencyStageEncode, 0, 1000);
+    trace.Record(kLatencyStageEncode, 0, 5000);
+    // p99 of a small set is its maximum, never above it
+    auto summary = trace.Summary(kLatencyStageEncode);
+    EXPECT_EQ(summary.p50_us, LatencyTrace::BucketUpperBound(LatencyTrace::BucketOf(1000)));
+    EXPECT_EQ(summary.p99_us, 5000u);
+    EXPECT_EQ(summary.max_us, 5000u);
+
+    // An end before the start counts as 0, an unknown stage is ignored
+    trace.Record(kLatencyStageUplink, 2000, 1000);
+    EXPECT_EQ(trace.Summary(kLatencyStageUplink).max_us, 0u);
+    EXPECT_EQ(trace.Summary(kLatencyStageUplink).count, 1u);
+    trace.Record(kLatencyStageCount, 0, 1000);
+    EXPECT_EQ(trace.Summary(kLatencyStageCount).count, 0u);
+
+    // A stall longer than the histogram goes to the last bucket and keeps its real maximum
+    trace.Record(kLatencyStageDownlink, 0, 10000000);
+    EXPECT_EQ(trace.Summary(kLatencyStageDownlink).p50_us, 10000000u);
+}
+
+TEST(LatencyTraceTest, DumpKeepsTheNewestRecordsOldestFirst) {
+    LatencyTrace trace(4);
+    for (int i = 0; i < 6; i++) {
+        // Durations past 24 bits keep their low bits in the record, the histogram has them whole
+        uint32_t duration = i == 5 ? 0x1000010 : 100 * (i + 1);
+        trace.Record(static_cast<LatencyStage>(i), 5000000000LL + i, 5000000000LL + i + duration);
+    }
+    ASSERT_EQ(trace.dump_size(), LatencyTrace::kDumpHeaderSize + 4 * LatencyTrace::kDumpRecordSize);
+
+    std::vector<uint8_t> buffer(trace.dump_size());
+    ASSERT_EQ(trace.Dump(buffer.data(), buffer.size()), buffer.size());
+    EXPECT_EQ(GetLe32(buffer.data()), LatencyTrace::kDumpMagic);
+    EXPECT_EQ(buffer[4] | (buffer[5] << 8), 4);
+    EXPECT_EQ(buffer[6] | (buffer[7] << 8), (int)kLatencyStageCount);
+    for (int r = 0; r < 4; r++) {
+        int i = r + 2;
+        const uint8_t* record = buffer.data() + LatencyTrace::kDumpHeaderSize + r * LatencyTrace::kDumpRecordSize;
+        uint32_t duration = i == 5 ? 0x1000010 : 100 * (i + 1);
+        EXPECT_EQ(GetLe32(record), (uint32_t)(5000000000LL + i + duration)) << r;
+        EXPECT_EQ(GetLe32(record + 4) >> 24, (uint32_t)i) << r;
+        EXPECT_EQ(GetLe32(record + 4) & 0xFFFFFF, duration & 0xFFFFFF) << r;
+    }
+
+    // A short buffer keeps the newest records
+    std::vector<uint8_t> small(LatencyTrace::kDumpHeaderSize + LatencyTrace::kDumpRecordSize + 3);
+    ASSERT_EQ(trace.Dump(small.data(), small.size()), LatencyTrace::kDumpHeaderSize + LatencyTrace::kDumpRecordSize);
+    EXPECT_EQ(small[4], 1);
+    EXPECT_EQ(GetLe32(small.data() + LatencyTrace::kDumpHeaderSize + 4) >> 24, 5u);
+    EXPECT_EQ(trace.Dump(small.data(), LatencyTrace::kDumpHeaderSize - 1), 0u);
+
+    trace.Reset();
+    EXPECT_EQ(trace.dump_size(), LatencyTrace::kDumpHeaderSize);
+    EXPECT_EQ(trace.Summary(kLatencyStageDecodeQueue).count, 0u);
+}
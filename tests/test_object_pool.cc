@@ -0,0 +1,172 @@
+#include <gtest/gtest.h>
+#include <cstdlib>
+#include <new>
+
+#include "audio_task.h"
+#include "object_pool.h"
+#include "ring_queue.h"
+#include "protocol.h"
+
+// Counts every allocation of the test binary, read around the calls being measured
+static size_t allocations = 0;
+
+void* operator new(size_t size) {
+    allocations++;
+    if (void* p = malloc(size ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    free(p);
+}
+
+// Sizes as in audio_service.h
+#define FRAME_DURATION_MS 60
+#define MIN_FRAME_DURATION_MS 20
+#define MAX_ENCODE_TASKS_IN_QUEUE (120 / MIN_FRAME_DURATION_MS)
+#define DTX_PREROLL_FRAMES (240 / MIN_FRAME_DURATION_MS)
+#define ENCODE_TASK_POOL_SIZE (MAX_ENCODE_TASKS_IN_QUEUE + DTX_PREROLL_FRAMES + 2)
+#define MAX_SEND_PACKETS_IN_QUEUE (2400 / MIN_FRAME_DURATION_MS)
+#define MAX_DECODE_PACKETS_IN_QUEUE (2400 / FRAME_DURATION_MS)
+#define PACKET_POOL_SIZE (2 * MAX_DECODE_PACKETS_IN_QUEUE + MAX_SEND_PACKETS_IN_QUEUE)
+#define PLAYBACK_TASK_POOL_SIZE 7
+
+// The uplink and downlink of AudioService with the codec replaced by copies
+class Pipeline {
+public:
+    Pipeline()
+        : encode_task_pool(ENCODE_TASK_POOL_SIZE),
+          playback_task_pool(PLAYBACK_TASK_POOL_SIZE),
+          packet_pool(PACKET_POOL_SIZE),
+          encode_queue(MAX_ENCODE_TASKS_IN_QUEUE),
+          send_queue(MAX_SEND_PACKETS_IN_QUEUE),
+          decode_queue(MAX_DECODE_PACKETS_IN_QUEUE),
+          playback_queue(2) {
+        encode_task_pool.Prefill(ENCODE_TASK_POOL_SIZE, [](AudioTask& task) {
+            task.pcm.reserve(FRAME_DURATION_MS * 16);
+        });
+        playback_task_pool.Prefill(PLAYBACK_TASK_POOL_SIZE, [](AudioTask& task) {
+            task.pcm.reserve((FRAME_DURATION_MS + 15) * 24);
+        });
+        mic.resize(FRAME_DURATION_MS * 16);
+    }
+
+    // ReadAudioData() into a pooled task, then the encoder, then the send queue
+    void Uplink(int frame_ms) {
+        auto task = encode_task_pool.Acquire();
+        task->type = kAudioTaskTypeEncodeToSendQueue;
+        task->pcm.assign(mic.begin(), mic.begin() + frame_ms * 16);
+        ASSERT_TRUE(encode_queue.Push(std::move(task)));
+
+        ASSERT_TRUE(encode_queue.Pop(task));
+        auto packet = packet_pool.Acquire();
+        packet->frame_duration = frame_ms;
+        packet->payload.assign((const uint8_t*)task->pcm.data(), (const uint8_t*)task->pcm.data() + frame_ms);
+        encode_task_pool.Release(std::move(task));
+        ASSERT_TRUE(send_queue.Push(std::move(packet)));
+
+        ASSERT_TRUE(send_queue.Pop(packet));
+        packet_pool.Release(std::move(packet));
+    }
+
+    // A received packet through the decoder into a pooled playback task
+    void Downlink(size_t payload_size) {
+        auto packet = packet_pool.Acquire();
+        packet->payload.assign(payload_size, 0x5a);
+        ASSERT_TRUE(decode_queue.Push(std::move(packet)));
+
+        ASSERT_TRUE(decode_queue.Pop(packet));
+        auto task = playback_task_pool.Acquire();
+        task->type = kAudioTaskTypeDecodeToPlaybackQueue;
+        task->pcm.resize(FRAME_DURATION_MS * 24);
+        packet_pool.Release(std::move(packet));
+        ASSERT_TRUE(playback_queue.Push(std::move(task)));
+
+        ASSERT_TRUE(playback_queue.Pop(task));
+        playback_task_pool.Release(std::move(task));
+    }
+
+    ObjectPool<AudioTask> encode_task_pool;
+    ObjectPool<AudioTask> playback_task_pool;
+    ObjectPool<AudioStreamPacket> packet_pool;
+    RingQueue<std::unique_ptr<AudioTask>> encode_queue;
+    RingQueue<std::unique_ptr<AudioStreamPacket>> send_queue;
+    RingQueue<std::unique_ptr<AudioStreamPacket>> decode_queue;
+    RingQueue<std::unique_ptr<AudioTask>> playback_queue;
+    std::vector<int16_t> mic;
+};
+
+TEST(ObjectPoolTest, SteadyStateFramesDoNotAllocate) {
+    Pipeline pipeline;
+    // The pooled packets grow their payloads to the largest size once
+    for (int i = 0; i < 4; i++) {
+        pipeline.Uplink(FRAME_DURATION_MS);
+        pipeline.Downlink(400);
+    }
+
+    const int frames = 1000;
+    size_t before = allocations;
+    for (int i = 0; i < frames; i++) {
+        pipeline.Uplink(i % 2 ? FRAME_DURATION_MS : MIN_FRAME_DURATION_MS);
+        pipeline.Downlink(100 + i % 300);
+    }
+    EXPECT_EQ(allocations - before, 0u) << "per frame: " << (double)(allocations - before) / frames;
+    EXPECT_EQ(pipeline.encode_task_pool.allocated(), (size_t)ENCODE_TASK_POOL_SIZE);
+}
+
+TEST(ObjectPoolTest, PrefillCoversEveryTaskInFlightAtTheShortestFrame) {
+    Pipeline pipeline;
+    // The encode queue and the DTX pre-roll full of 20ms frames, one task being filled, one being encoded
+    std::vector<std::unique_ptr<AudioTask>> in_flight;
+    in_flight.reserve(ENCODE_TASK_POOL_SIZE);
+    size_t before = allocations;
+    for (int i = 0; i < ENCODE_TASK_POOL_SIZE; i++) {
+        auto task = pipeline.encode_task_pool.Acquire();
+        task->pcm.assign(pipeline.mic.begin(), pipeline.mic.begin() + MIN_FRAME_DURATION_MS * 16);
+        in_flight.push_back(std::move(task));
+    }
+    EXPECT_EQ(allocations - before, 0u);
+    EXPECT_EQ(pipeline.encode_task_pool.allocated(), (size_t)ENCODE_TASK_POOL_SIZE);
+    EXPECT_EQ(pipeline.encode_task_pool.available(), 0u);
+}
+
+TEST(ObjectPoolTest, DrainedQueuesGoBackToTheirPool) {
+    Pipeline pipeline;
+    for (int i = 0; i < MAX_DECODE_PACKETS_IN_QUEUE; i++) {
+        auto packet = pipeline.packet_pool.Acquire();
+        packet->payload.assign(200, 0);
+        ASSERT_TRUE(pipeline.decode_queue.Push(std::move(packet)));
+    }
+    size_t allocated = pipeline.packet_pool.allocated();
+
+    // Like ResetDecoder(): the queued packets keep their payloads for the next turn
+    EXPECT_EQ(pipeline.decode_queue.Drain([&pipeline](std::unique_ptr<AudioStreamPacket>&& packet) {
+        pipeline.packet_pool.Release(std::move(packet));
+    }), (size_t)MAX_DECODE_PACKETS_IN_QUEUE);
+    EXPECT_TRUE(pipeline.decode_queue.empty());
+    EXPECT_EQ(pipeline.packet_pool.available(), (size_t)MAX_DECODE_PACKETS_IN_QUEUE);
+
+    size_t before = allocations;
+    for (int i = 0; i < MAX_DECODE_PACKETS_IN_QUEUE; i++) {
+        pipeline.Downlink(200);
+    }
+    EXPECT_EQ(allocations - before, 0u);
+    EXPECT_EQ(pipeline.packet_pool.allocated(), allocated);
+}
+
+TEST(ObjectPoolTest, ClearFreesWhatDrainWouldKeep) {
+    RingQueue<std::unique_ptr<AudioTask>> queue(4);
+    ObjectPool<AudioTask> pool(4);
+    for (int i = 0; i < 3; i++) {
+        queue.Push(pool.Acquire());
+    }
+    EXPECT_EQ(queue.Clear(), 3u);
+    EXPECT_EQ(pool.available(), 0u);
+    EXPECT_EQ(pool.allocated(), 3u);
+}
@@ -0,0 +1,180 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+
+#include "ogg_demuxer.h"
+
+namespace fs = std::filesystem;
+
+// A whole-file parse for comparison: every page's lacing values in order, a packet ends at the
+// first value below 255, whichever page it is on
+namespace reference {
+
+struct Stream {
+    std::vector<std::string> packets;   // Audio packets, OpusHead and OpusTags left out
+    int sample_rate = 0;
+    int channels = 0;
+    size_t pages = 0;
+    size_t spanning_packets = 0;        // Continued onto the next page
+};
+
+static bool Parse(const std::string& data, Stream& stream) {
+    auto buf = reinterpret_cast<const uint8_t*>(data.data());
+    std::vector<std::string> packets;
+    std::string packet;
+    size_t offset = 0;
+    while (offset < data.size()) {
+        if (offset + 27 > data.size() || memcmp(buf + offset, "OggS", 4) != 0) {
+            return false;
+        }
+        int segment_count = buf[offset + 26];
+        size_t body = offset + 27 + segment_count;
+        for (int i = 0; i < segment_count; i++) {
+            uint8_t lacing = buf[offset + 27 + i];
+            if (body + lacing > data.size()) {
+                return false;
+            }
+            packet.append(data, body, lacing);
+            body += lacing;
+            if (lacing < 255) {
+                packets.push_back(std::move(packet));
+                packet.clear();
+            } else if (i == segment_count - 1) {
+                stream.spanning_packets++;
+            }
+        }
+        stream.pages++;
+        offset = body;
+    }
+    if (packets.size() < 2 || packets[0].compare(0, 8, "OpusHead") != 0 || packets[1].compare(0, 8, "OpusTags") != 0) {
+        return false;
+    }
+    auto head = reinterpret_cast<const uint8_t*>(packets[0].data());
+    stream.channels = head[9];
+    stream.sample_rate = head[12] | (head[13] << 8) | (head[14] << 16) | (head[15] << 24);
+    for (size_t i = 2; i < packets.size(); i++) {
+        if (!packets[i].empty()) {
+            stream.packets.push_back(std::move(packets[i]));
+        }
+    }
+    return true;
+}
+
+} // namespace reference
+
+static std::vector<fs::path> BundledOggFiles() {
+    std::vector<fs::path> files;
+    for (auto& entry : fs::recursive_directory_iterator(ASSETS_DIR)) {
+        if (entry.is_regular_file() && entry.path().extension() == ".ogg") {
+            files.push_back(entry.path());
+        }
+    }
+    std::sort(files.begin(), files.end());
+    return files;
+}
+
+static std::string ReadFile(const fs::path& path) {
+    std::ifstream file(path, std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+TEST(OggDemuxerTest, EveryBundledAssetMatchesTheReferenceParse) {
+    auto files = BundledOggFiles();
+    ASSERT_FALSE(files.empty()) << ASSETS_DIR;
+
+    size_t packets = 0, pages = 0, spanning = 0, bytes = 0;
+    std::chrono::nanoseconds demux_time{0};
+    for (auto& path : files) {
+        SCOPED_TRACE(path.string());
+        std::string data = ReadFile(path);
+        reference::Stream expected;
+        ASSERT_TRUE(reference::Parse(data, expected));
+
+        auto start = std::chrono::steady_clock::now();
+        OggDemuxer demuxer(data);
+        std::vector<std::string> demuxed;
+        std::string_view packet;
+        size_t views = 0;
+        while (demuxer.NextPacket(packet)) {
+            // Packets on one page are views into the clip, only spanning ones are copied
+            if (packet.data() >= data.data() && packet.data() < data.data() + data.size()) {
+                views++;
+            }
+            demuxed.emplace_back(packet);
+        }
+        demux_time += std::chrono::steady_clock::now() - start;
+
+        ASSERT_EQ(demuxed.size(), expected.packets.size());
+        for (size_t i = 0; i < demuxed.size(); i++) {
+            ASSERT_EQ(demuxed[i].size(), expected.packets[i].size()) << "packet " << i;
+            ASSERT_EQ(demuxed[i], expected.packets[i]) << "packet " << i;
+        }
+        EXPECT_EQ(demuxer.sample_rate(), expected.sample_rate);
+        EXPECT_EQ(demuxer.channels(), expected.channels);
+        EXPECT_GE(views + expected.spanning_packets, demuxed.size());
+
+        packets += demuxed.size();
+        pages += expected.pages;
+        spanning += expected.spanning_packets;
+        bytes += data.size();
+    }
+    std::cout << files.size() << " clips, " << bytes << " bytes, " << pages << " pages, " << packets
+              << " packets (" << spanning << " spanning pages), demuxed in "
+              << std::chrono::duration_cast<std::chrono::microseconds>(demux_time).count() << " us" << std::endl;
+}
+
+TEST(OggDemuxerTest, PacketSpanningPagesIsReassembled) {
+    // OpusHead, OpusTags, then a 600 byte packet split over two pages and a 10 byte one
+    auto page = [](uint8_t flags, std::vector<uint8_t> lacing, std::string body) {
+        std::string page = "OggS";
+        page += '\0';
+        page += (char)flags;
+        page += std::string(20, '\0');
+        page += (char)lacing.size();
+        page.append(lacing.begin(), lacing.end());
+        return page + body;
+    };
+    std::string head = "OpusHead";
+    head += std::string("\x01\x01\x38\x01\x80\x3e\x00\x00\x00\x00\x00", 11);
+    std::string tags = "OpusTags" + std::string(8, '\0');
+    std::string big(600, 'a');
+    for (size_t i = 0; i < big.size(); i++) {
+        big[i] = (char)('a' + i % 26);
+    }
+    std::string data = page(0x02, {19}, head) + page(0, {16}, tags) +
+        page(0, {255, 255}, big.substr(0, 510)) + page(0x01, {90, 10}, big.substr(510) + std::string(10, 'z'));
+
+    OggDemuxer demuxer(data);
+    std::string_view packet;
+    ASSERT_TRUE(demuxer.NextPacket(packet));
+    EXPECT_EQ(packet, big);
+    ASSERT_TRUE(demuxer.NextPacket(packet));
+    EXPECT_EQ(packet, std::string(10, 'z'));
+    EXPECT_FALSE(demuxer.NextPacket(packet));
+    EXPECT_EQ(demuxer.sample_rate(), 16000);
+    EXPECT_EQ(demuxer.channels(), 1);
+}
+
+TEST(OggDemuxerTest, ResyncsAfterGarbage) {
+    auto files = BundledOggFiles();
+    ASSERT_FALSE(files.empty());
+    std::string data = ReadFile(files.front());
+    reference::Stream expected;
+    ASSERT_TRUE(reference::Parse(data, expected));
+
+    // Garbage in front of the first page is skipped like a lost sync
+    std::string shifted = "garbage" + data;
+    OggDemuxer demuxer(shifted);
+    std::string_view packet;
+    size_t count = 0;
+    while (demuxer.NextPacket(packet)) {
+        ASSERT_LT(count, expected.packets.size());
+        EXPECT_EQ(packet, expected.packets[count]);
+        count++;
+    }
+    EXPECT_EQ(count, expected.packets.size());
+}
@@ -0,0 +1,185 @@
+#include <gtest/gtest.h>
+#include <deque>
+#include <cstdlib>
+
+#include "audio_task.h"
+#include "output_mixer.h"
+
+#define BLOCK_SAMPLES 240
+#define RAMP_SAMPLES 480
+#define DUCK_GAIN 8192      // 0.25
+
+enum {
+    kStream,
+    kSound,
+    kVoices,
+};
+
+// Voice queues feeding the mixer, and the frames it hands back
+class MixerHarness {
+public:
+    MixerHarness()
+        : mixer_(kVoices, BLOCK_SAMPLES,
+            [this](int voice, std::unique_ptr<AudioTask>& task) {
+                if (queues_[voice].empty()) {
+                    return false;
+                }
+                task = std::move(queues_[voice].front());
+                queues_[voice].pop_front();
+                return true;
+            },
+            [this](std::unique_ptr<AudioTask>) { released++; }) {
+        mixer_.SetVoice(kStream, AUDIO_MIXER_UNITY_GAIN, false, true);
+        mixer_.SetVoice(kSound, AUDIO_MIXER_UNITY_GAIN, true, false);
+        mixer_.SetDucking(DUCK_GAIN, RAMP_SAMPLES);
+    }
+
+    std::vector<int16_t>* Push(int voice, std::vector<int16_t> pcm) {
+        auto task = std::make_unique<AudioTask>();
+        task->type = kAudioTaskTypeDecodeToPlaybackQueue;
+        task->pcm = std::move(pcm);
+        task->timestamp = 0;
+        auto data = &task->pcm;
+        queues_[voice].push_back(std::move(task));
+        return data;
+    }
+
+    // Plays until every voice is idle or max_calls frames are out
+    std::vector<int16_t> Play(int max_calls = 1000) {
+        std::vector<int16_t> out;
+        for (int i = 0; i < max_calls; i++) {
+            auto pcm = mixer_.Next();
+            if (pcm == nullptr) {
+                break;
+            }
+            out.insert(out.end(), pcm->begin(), pcm->end());
+        }
+        return out;
+    }
+
+    OutputMixer& mixer() { return mixer_; }
+    int released = 0;
+
+private:
+    std::deque<std::unique_ptr<AudioTask>> queues_[kVoices];
+    OutputMixer mixer_;
+};
+
+static std::vector<int16_t> Ramp(size_t samples, int start, int step) {
+    std::vector<int16_t> pcm(samples);
+    for (size_t i = 0; i < samples; i++) {
+        pcm[i] = (int16_t)((start + (int)i * step) % 20000 - 10000);
+    }
+    return pcm;
+}
+
+TEST(OutputMixerTest, SingleVoiceIsHandedOutWithoutCopy) {
+    MixerHarness harness;
+    auto frame = Ramp(960, 0, 37);
+    auto data = harness.Push(kStream, frame);
+
+    auto pcm = harness.mixer().Next();
+    ASSERT_EQ(pcm, data);
+    EXPECT_EQ(*pcm, frame);
+    EXPECT_EQ(harness.mixer().Next(), nullptr);
+    EXPECT_EQ(harness.released, 1);
+}
+
+TEST(OutputMixerTest, VoicesAreSummedSampleExactAcrossFrameAndBlockEdges) {
+    MixerHarness harness;
+    // Frame sizes that do not line up with each other or with the blocks
+    std::vector<int16_t> stream, sound;
+    for (size_t samples : {320, 200, 440}) {
+        auto pcm = Ramp(samples, stream.size() * 37, 37);
+        stream.insert(stream.end(), pcm.begin(), pcm.end());
+        harness.Push(kStream, pcm);
+    }
+    for (size_t samples : {100, 500, 360}) {
+        auto pcm = Ramp(samples, 5000 + sound.size() * 11, 11);
+        sound.insert(sound.end(), pcm.begin(), pcm.end());
+        harness.Push(kSound, pcm);
+    }
+    // The sound ducks the stream, with ducking at unity the sum is exact
+    harness.mixer().SetDucking(AUDIO_MIXER_UNITY_GAIN, RAMP_SAMPLES);
+
+    auto out = harness.Play();
+    ASSERT_EQ(out.size(), 960u);
+    for (size_t i = 0; i < out.size(); i++) {
+        ASSERT_EQ(out[i], stream[i] + sound[i]) << "at " << i;
+    }
+    EXPECT_EQ(harness.released, 6);
+}
+
+TEST(OutputMixerTest, SumsSaturate) {
+    MixerHarness harness;
+    harness.mixer().SetDucking(AUDIO_MIXER_UNITY_GAIN, RAMP_SAMPLES);
+    std::vector<int16_t> loud(BLOCK_SAMPLES), other(BLOCK_SAMPLES);
+    for (size_t i = 0; i < loud.size(); i++) {
+        loud[i] = (i % 2) ? 30000 : -30000;
+        other[i] = (i % 2) ? 20000 : -20000;
+    }
+    harness.Push(kStream, loud);
+    harness.Push(kSound, other);
+
+    auto out = harness.Play();
+    ASSERT_EQ(out.size(), (size_t)BLOCK_SAMPLES);
+    for (size_t i = 0; i < out.size(); i++) {
+        EXPECT_EQ(out[i], (i % 2) ? INT16_MAX : INT16_MIN) << "at " << i;
+    }
+}
+
+TEST(OutputMixerTest, SoundDucksTheStreamWithALinearRamp) {
+    MixerHarness harness;
+    const int16_t level = 10000;
+    const int16_t ducked = (level * DUCK_GAIN) >> 15;
+    for (int i = 0; i < 12; i++) {
+        harness.Push(kStream, std::vector<int16_t>(BLOCK_SAMPLES, level));
+    }
+    auto out = harness.Play(2);
+    // A silent sound, so only the stream's envelope is heard
+    for (int i = 0; i < 4; i++) {
+        harness.Push(kSound, std::vector<int16_t>(BLOCK_SAMPLES, 0));
+    }
+    auto rest = harness.Play();
+    out.insert(out.end(), rest.begin(), rest.end());
+    ASSERT_EQ(out.size(), 12u * BLOCK_SAMPLES);
+
+    // The gain moves at most full scale per RAMP_SAMPLES, spread evenly over each block
+    const size_t duck_start = 2 * BLOCK_SAMPLES;
+    const size_t release_start = 6 * BLOCK_SAMPLES;
+    const int max_step = level / RAMP_SAMPLES + 2;
+    const int half_level = level / 2;
+
+    for (size_t i = 0; i < duck_start; i++) {
+        ASSERT_EQ(out[i], level) << "at " << i;
+    }
+    for (size_t i = duck_start; i < release_start; i++) {
+        ASSERT_LE(out[i], out[i - 1]) << "at " << i;
+        ASSERT_LE(out[i - 1] - out[i], max_step) << "at " << i;
+    }
+    // Half of full scale in the first block, the rest of the way to 0.25 in the second
+    EXPECT_NEAR(out[duck_start + BLOCK_SAMPLES - 1], half_level, max_step);
+    for (size_t i = duck_start + 2 * BLOCK_SAMPLES; i < release_start; i++) {
+        ASSERT_EQ(out[i], ducked) << "at " << i;
+    }
+
+    for (size_t i = release_start; i < out.size(); i++) {
+        ASSERT_GE(out[i], out[i - 1]) << "at " << i;
+        ASSERT_LE(out[i] - out[i - 1], max_step) << "at " << i;
+    }
+    EXPECT_NEAR(out[release_start + BLOCK_SAMPLES - 1], ducked + half_level, max_step);
+    for (size_t i = release_start + 2 * BLOCK_SAMPLES; i < out.size(); i++) {
+        ASSERT_EQ(out[i], level) << "at " << i;
+    }
+}
+
+TEST(OutputMixerTest, ResetReleasesHeldFrames) {
+    MixerHarness harness;
+    harness.Push(kStream, Ramp(BLOCK_SAMPLES * 2, 0, 3));
+    harness.Push(kSound, Ramp(BLOCK_SAMPLES * 2, 0, 5));
+    ASSERT_NE(harness.mixer().Next(), nullptr);
+    EXPECT_EQ(harness.mixer().active_voices(), 2u);
+    harness.mixer().Reset();
+    EXPECT_EQ(harness.mixer().active_voices(), 0u);
+    EXPECT_EQ(harness.released, 2);
+}
@@ -0,0 +1,247 @@
+#include <gtest/gtest.h>
+#include <thread>
+#include <random>
+#include <cstring>
+
+#include "host_rtos.h"
+#include "paced_pcm_stream.h"
+
+#define SAMPLE_RATE 16000
+#define FRAME_DURATION_MS 60
+#define FRAME_SAMPLES (SAMPLE_RATE * FRAME_DURATION_MS / 1000)
+#define FRAME_BYTES (FRAME_SAMPLES * 2)
+#define PREBUFFER_FRAMES 3
+
+struct Chunk {
+    int64_t arrival_us;     // From the start of the response
+    size_t size;
+};
+
+// An HTTP response on the simulated clock, each chunk can be read once the clock reaches it
+class FakeHttp {
+public:
+    FakeHttp(std::vector<uint8_t> body, std::vector<Chunk> chunks, int64_t start_us)
+        : body_(std::move(body)), chunks_(std::move(chunks)), start_us_(start_us) {}
+
+    // Called by PacedPcmStream::Run(), which may ask for less than the chunk holds
+    int Read(char* buffer, size_t size) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (chunk_ == chunks_.size()) {
+            ended_ = true;
+            cv_.notify_all();
+            return 0;
+        }
+        while (esp_timer_get_time() - start_us_ < chunks_[chunk_].arrival_us) {
+            parked_ = true;
+            cv_.notify_all();
+            cv_.wait(lock);
+        }
+        size_t bytes = std::min(size, chunks_[chunk_].size - chunk_offset_);
+        memcpy(buffer, body_.data() + position_, bytes);
+        position_ += bytes;
+        chunk_offset_ += bytes;
+        if (chunk_offset_ == chunks_[chunk_].size) {
+            chunk_++;
+            chunk_offset_ = 0;
+        }
+        return bytes;
+    }
+
+    // Waits until the reader needs a chunk that has not arrived yet, or has read everything
+    void WaitParked() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cv_.wait(lock, [this]() { return parked_ || ended_ || finished_; });
+    }
+
+    // After the clock moved
+    void Wake() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        parked_ = false;
+        cv_.notify_all();
+    }
+
+    void Finish() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        finished_ = true;
+        cv_.notify_all();
+    }
+
+    bool finished() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return finished_;
+    }
+
+private:
+    std::vector<uint8_t> body_;
+    std::vector<Chunk> chunks_;
+    int64_t start_us_;
+    size_t chunk_ = 0;
+    size_t chunk_offset_ = 0;
+    size_t position_ = 0;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    bool parked_ = false;
+    bool ended_ = false;
+    bool finished_ = false;
+};
+
+struct Frame {
+    int64_t time_us;
+    uint32_t timestamp;
+    std::vector<int16_t> pcm;
+};
+
+struct StreamResult {
+    bool ok;
+    std::vector<Frame> frames;
+    PacedPcmStream::Statistics statistics;
+};
+
+static std::vector<uint8_t> RampBody(size_t bytes) {
+    std::vector<uint8_t> body(bytes);
+    for (size_t i = 0; i < bytes; i++) {
+        int16_t sample = (int16_t)((i / 2) * 7);
+        body[i] = (i % 2 == 0) ? (sample & 0xff) : ((sample >> 8) & 0xff);
+    }
+    return body;
+}
+
+// Random chunk sizes, arriving at twice the playback rate except for an optional stall
+static std::vector<Chunk> MakeChunks(size_t bytes, unsigned seed, size_t stall_at = 0, int64_t stall_us = 0) {
+    std::mt19937 random(seed);
+    std::uniform_int_distribution<size_t> sizes(1, 1500);
+    std::vector<Chunk> chunks;
+    size_t offset = 0;
+    while (offset < bytes) {
+        size_t size = std::min(sizes(random), bytes - offset);
+        // 64 bytes per millisecond, on whole milliseconds
+        int64_t arrival_us = (int64_t)(offset / 64) * 1000;
+        if (stall_us > 0 && offset >= stall_at) {
+            arrival_us += stall_us;
+        }
+        chunks.push_back({arrival_us, size});
+        offset += size;
+    }
+    return chunks;
+}
+
+// Steps the simulated clock by 1ms and lets every thread settle before the next step, so the
+// order of timer ticks and reads is the same on every run
+static StreamResult Stream(const std::vector<uint8_t>& body, const std::vector<Chunk>& chunks, size_t ring_frames) {
+    PacedPcmStream stream(SAMPLE_RATE, FRAME_DURATION_MS, ring_frames, PREBUFFER_FRAMES);
+    StreamResult result;
+    int64_t start_us = esp_timer_get_time();
+    FakeHttp http(body, chunks, start_us);
+
+    std::thread runner([&]() {
+        result.ok = stream.Run([&http](char* buffer, size_t size) { return http.Read(buffer, size); },
+            [&result, start_us](std::vector<int16_t>&& pcm, uint32_t timestamp) {
+                // Takes the buffer like PushTaskToEncodeQueue() does
+                result.frames.push_back({esp_timer_get_time() - start_us, timestamp, std::move(pcm)});
+            });
+        http.Finish();
+    });
+
+    for (int step = 0; step < 600000; step++) {
+        http.WaitParked();
+        HostTasksWaitIdle();
+        if (http.finished()) {
+            break;
+        }
+        // Ticks that fall due are handled before the data arriving at the same time
+        HostClockAdvance(1000);
+        HostTasksWaitIdle();
+        http.Wake();
+    }
+    runner.join();
+    result.statistics = stream.statistics();
+    return result;
+}
+
+static void ExpectSamples(const std::vector<Frame>& frames, const std::vector<uint8_t>& body) {
+    std::vector<uint8_t> played;
+    for (auto& frame : frames) {
+        ASSERT_EQ(frame.pcm.size(), (size_t)FRAME_SAMPLES);
+        played.insert(played.end(), (const uint8_t*)frame.pcm.data(), (const uint8_t*)(frame.pcm.data() + frame.pcm.size()));
+    }
+    ASSERT_EQ(played.size() % FRAME_BYTES, 0u);
+    ASSERT_GE(played.size(), body.size());
+    ASSERT_LT(played.size() - body.size(), (size_t)FRAME_BYTES);
+    EXPECT_TRUE(std::equal(body.begin(), body.end(), played.begin()));
+    // The last partial frame is padded with silence
+    EXPECT_TRUE(std::all_of(played.begin() + body.size(), played.end(), [](uint8_t byte) { return byte == 0; }));
+}
+
+TEST(PacedPcmStreamTest, RandomChunksComeOutAsExactFramesOnTheFrameClock) {
+    for (unsigned seed : {1, 2, 3}) {
+        SCOPED_TRACE(seed);
+        auto body = RampBody(20 * FRAME_BYTES + 501);
+        auto chunks = MakeChunks(body.size(), seed);
+        auto result = Stream(body, chunks, 32);
+
+        ASSERT_TRUE(result.ok);
+        ASSERT_EQ(result.frames.size(), 21u);
+        ExpectSamples(result.frames, body);
+        EXPECT_EQ(result.statistics.frames, 21u);
+        EXPECT_EQ(result.statistics.bytes, body.size());
+        EXPECT_EQ(result.statistics.underruns, 0u);
+
+        // The first frame goes out as soon as the prebuffer is full
+        size_t offset = 0;
+        int64_t prebuffered_us = 0;
+        for (auto& chunk : chunks) {
+            offset += chunk.size;
+            if (offset >= PREBUFFER_FRAMES * FRAME_BYTES) {
+                prebuffered_us = chunk.arrival_us;
+                break;
+            }
+        }
+        EXPECT_EQ(result.frames[0].time_us, prebuffered_us);
+        EXPECT_EQ(result.statistics.first_frame_us, prebuffered_us);
+        for (size_t i = 0; i < result.frames.size(); i++) {
+            EXPECT_EQ(result.frames[i].timestamp, i * FRAME_DURATION_MS);
+            EXPECT_EQ(result.frames[i].time_us, prebuffered_us + (int64_t)i * FRAME_DURATION_MS * 1000) << "frame " << i;
+        }
+    }
+}
+
+TEST(PacedPcmStreamTest, StallCountsUnderrunsAndDoesNotBurstAfterwards) {
+    auto body = RampBody(30 * FRAME_BYTES);
+    auto chunks = MakeChunks(body.size(), 4, 8 * FRAME_BYTES, 1000000);
+    auto result = Stream(body, chunks, 32);
+
+    ASSERT_TRUE(result.ok);
+    ASSERT_EQ(result.frames.size(), 30u);
+    ExpectSamples(result.frames, body);
+    EXPECT_GT(result.statistics.underruns, 0u);
+
+    // Every frame is on the tick grid, and a tick without a frame is an underrun, never made up later
+    int64_t first_us = result.frames[0].time_us;
+    for (size_t i = 1; i < result.frames.size(); i++) {
+        int64_t interval_us = result.frames[i].time_us - result.frames[i - 1].time_us;
+        EXPECT_GE(interval_us, FRAME_DURATION_MS * 1000) << "frame " << i;
+        EXPECT_EQ(interval_us % (FRAME_DURATION_MS * 1000), 0) << "frame " << i;
+        EXPECT_EQ(result.frames[i].timestamp, i * FRAME_DURATION_MS);
+    }
+    int64_t ticks = (result.frames.back().time_us - first_us) / (FRAME_DURATION_MS * 1000);
+    EXPECT_EQ((int64_t)result.statistics.underruns, ticks - (int64_t)(result.frames.size() - 1));
+}
+
+TEST(PacedPcmStreamTest, ShortStreamIsSentWithoutFillingThePrebuffer) {
+    auto body = RampBody(FRAME_BYTES + 100);
+    auto result = Stream(body, MakeChunks(body.size(), 5), 32);
+
+    ASSERT_TRUE(result.ok);
+    ASSERT_EQ(result.frames.size(), 2u);
+    ExpectSamples(result.frames, body);
+    EXPECT_EQ(result.frames[1].time_us - result.frames[0].time_us, FRAME_DURATION_MS * 1000);
+}
+
+TEST(PacedPcmStreamTest, ReadErrorStopsTheStream) {
+    PacedPcmStream stream(SAMPLE_RATE, FRAME_DURATION_MS, 8, PREBUFFER_FRAMES);
+    int frames = 0;
+    bool ok = stream.Run([](char*, size_t) { return -1; },
+        [&frames](std::vector<int16_t>&&, uint32_t) { frames++; });
+    EXPECT_FALSE(ok);
+    EXPECT_EQ(frames, 0);
+}
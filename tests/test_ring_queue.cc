@@ -0,0 +1,163 @@
+#include <gtest/gtest.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <thread>
+
+#include "ring_queue.h"
+
+using Clock = std::chrono::steady_clock;
+
+// An event bit like AS_EVENT_*_NOT_EMPTY: set by the producer after Push(), taken by the consumer
+class EventBit {
+public:
+    void Set() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        set_ = true;
+        cv_.notify_one();
+    }
+
+    // False on timeout
+    bool Wait(std::chrono::milliseconds timeout) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (!cv_.wait_for(lock, timeout, [this]() { return set_; })) {
+            return false;
+        }
+        set_ = false;
+        return true;
+    }
+
+private:
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    bool set_ = false;
+};
+
+// Counts live items, so a dropped or cleared one that is never freed shows up
+struct Item {
+    static std::atomic<int> alive;
+    uint32_t sequence;
+    Clock::time_point pushed;
+    explicit Item(uint32_t sequence) : sequence(sequence), pushed(Clock::now()) { alive++; }
+    ~Item() { alive--; }
+};
+std::atomic<int> Item::alive{0};
+
+TEST(RingQueueTest, FrameCadenceWakesOncePerFrame) {
+    const int frames = 25;
+    const auto cadence = std::chrono::milliseconds(60);
+    RingQueue<std::unique_ptr<Item>> queue(2);
+    EventBit not_empty;
+    std::atomic<bool> done{false};
+
+    int wakeups = 0, received = 0;
+    Clock::duration worst = Clock::duration::zero();
+    std::thread consumer([&]() {
+        while (!done || !queue.empty()) {
+            if (!not_empty.Wait(std::chrono::milliseconds(500))) {
+                continue;
+            }
+            wakeups++;
+            std::unique_ptr<Item> item;
+            while (queue.Pop(item)) {
+                EXPECT_EQ(item->sequence, (uint32_t)received);
+                worst = std::max(worst, Clock::now() - item->pushed);
+                received++;
+            }
+        }
+    });
+
+    auto next = Clock::now();
+    for (int i = 0; i < frames; i++) {
+        next += cadence;
+        std::this_thread::sleep_until(next);
+        ASSERT_TRUE(queue.Push(std::make_unique<Item>(i)));
+        not_empty.Set();
+    }
+    done = true;
+    not_empty.Set();
+    consumer.join();
+
+    auto worst_us = std::chrono::duration_cast<std::chrono::microseconds>(worst).count();
+    std::cout << "wakeups per frame " << (double)wakeups / frames << ", worst latency " << worst_us << " us" << std::endl;
+    EXPECT_EQ(received, frames);
+    // One wakeup per frame, plus the final one that ends the consumer
+    EXPECT_LE(wakeups, frames + 1);
+    // Far below a frame even on a loaded build machine
+    EXPECT_LT(worst_us, 30000);
+    EXPECT_EQ(Item::alive, 0);
+}
+
+TEST(RingQueueTest, PushPopAndClearUnderStress) {
+    const uint32_t items = 200000;
+    RingQueue<std::unique_ptr<Item>> queue(8);
+    std::atomic<bool> done{false};
+    std::atomic<size_t> popped{0}, cleared{0};
+
+    std::thread consumer([&]() {
+        uint32_t last = 0;
+        bool first = true;
+        std::unique_ptr<Item> item;
+        while (!done || !queue.empty()) {
+            if (!queue.Pop(item)) {
+                std::this_thread::yield();
+                continue;
+            }
+            // Clearing drops items but never reorders the rest
+            if (!first) {
+                ASSERT_GT(item->sequence, last);
+            }
+            first = false;
+            last = item->sequence;
+            item.reset();
+            popped++;
+        }
+    });
+    // Like ResetDecoder() from the main task, on the pop side of the queue
+    std::thread clearer([&]() {
+        while (!done) {
+            cleared += queue.Clear();
+            std::this_thread::sleep_for(std::chrono::microseconds(50));
+        }
+    });
+
+    size_t full = 0;
+    for (uint32_t i = 0; i < items; i++) {
+        auto item = std::make_unique<Item>(i);
+        while (!queue.Push(std::move(item))) {
+            // Push() leaves the item untouched when the queue is full
+            ASSERT_NE(item, nullptr);
+            full++;
+            std::this_thread::yield();
+        }
+    }
+    done = true;
+    consumer.join();
+    clearer.join();
+    cleared += queue.Clear();
+
+    std::cout << popped << " popped, " << cleared << " cleared, " << full << " pushes on a full queue" << std::endl;
+    EXPECT_EQ(popped + cleared, items);
+    EXPECT_GT(cleared, 0u);
+    EXPECT_TRUE(queue.empty());
+    EXPECT_EQ(queue.size(), 0u);
+    EXPECT_EQ(Item::alive, 0);
+}
+
+TEST(RingQueueTest, CapacityAndDrainOrder) {
+    RingQueue<std::unique_ptr<Item>> queue(3);
+    for (uint32_t i = 0; i < 3; i++) {
+        EXPECT_TRUE(queue.Push(std::make_unique<Item>(i)));
+    }
+    auto extra = std::make_unique<Item>(3);
+    EXPECT_FALSE(queue.Push(std::move(extra)));
+    EXPECT_NE(extra, nullptr);
+    EXPECT_EQ(queue.size(), 3u);
+
+    std::vector<uint32_t> drained;
+    EXPECT_EQ(queue.Drain([&drained](std::unique_ptr<Item>&& item) { drained.push_back(item->sequence); }), 3u);
+    EXPECT_EQ(drained, (std::vector<uint32_t>{0, 1, 2}));
+    EXPECT_TRUE(queue.empty());
+    extra.reset();
+    EXPECT_EQ(Item::alive, 0);
+}
@@ -0,0 +1,143 @@
+#include <gtest/gtest.h>
+#include <cmath>
+#include <cstdlib>
+#include <algorithm>
+#include <vector>
+
+#include "time_stretcher.h"
+
+#define TARGET_MS 360
+#define LOW_MS 60
+
+static std::vector<int16_t> Sine(int sample_rate, double frequency, size_t samples, double amplitude = 8000) {
+    std::vector<int16_t> pcm(samples);
+    for (size_t i = 0; i < samples; i++) {
+        pcm[i] = (int16_t)lround(amplitude * sin(2 * M_PI * frequency * i / sample_rate));
+    }
+    return pcm;
+}
+
+static std::vector<int16_t> Noise(size_t samples, unsigned seed) {
+    std::vector<int16_t> pcm(samples);
+    srand(seed);
+    for (auto& sample : pcm) {
+        sample = (int16_t)(rand() % 16001 - 8000);
+    }
+    return pcm;
+}
+
+// Largest step between neighbouring samples, a click shows up as a jump
+static int MaxStep(const std::vector<int16_t>& pcm) {
+    int step = 0;
+    for (size_t i = 1; i < pcm.size(); i++) {
+        step = std::max(step, std::abs(pcm[i] - pcm[i - 1]));
+    }
+    return step;
+}
+
+TEST(TimeStretcherTest, FindsThePitchPeriod) {
+    TimeStretcher stretcher(TARGET_MS, LOW_MS, 10, 10);
+    for (int sample_rate : {16000, 24000}) {
+        // 200Hz: a 5ms period
+        auto pcm = Sine(sample_rate, 200, sample_rate * 60 / 1000);
+        int correlation = 0;
+        int lag = stretcher.FindPeriod(pcm.data(), pcm.size(), sample_rate, correlation);
+        int period = sample_rate / 200;
+        ASSERT_GT(lag, 0) << sample_rate;
+        int offset = lag % period;
+        EXPECT_LE(std::min(offset, period - offset), 1) << "lag " << lag << " at " << sample_rate;
+        EXPECT_GT(correlation, 16000) << sample_rate;
+    }
+}
+
+TEST(TimeStretcherTest, AcceleratedSineStaysContinuous) {
+    const int sample_rate = 16000;
+    TimeStretcher stretcher(TARGET_MS, LOW_MS, 25, 25);
+    auto pcm = Sine(sample_rate, 200, 960);
+    auto reference = pcm;
+
+    stretcher.Process(pcm, sample_rate, TARGET_MS + 100);
+    ASSERT_LT(pcm.size(), reference.size());
+    EXPECT_EQ(stretcher.statistics().accelerated, 1u);
+    size_t removed = reference.size() - pcm.size();
+    EXPECT_EQ(removed % (sample_rate / 200), 0u);
+
+    // Whole periods removed: the output is the same sine, phase continuous across the splice
+    EXPECT_EQ(pcm.front(), reference.front());
+    EXPECT_EQ(pcm.back(), reference.back());
+    for (size_t i = 0; i < pcm.size(); i++) {
+        EXPECT_NEAR(pcm[i], reference[i], 80) << "at " << i;
+    }
+    EXPECT_LE(MaxStep(pcm), MaxStep(reference) + 80);
+}
+
+TEST(TimeStretcherTest, ExpandedSineStaysContinuous) {
+    const int sample_rate = 24000;
+    TimeStretcher stretcher(TARGET_MS, LOW_MS, 25, 25);
+    auto pcm = Sine(sample_rate, 200, 1440);
+    auto reference = Sine(sample_rate, 200, 1440 + 480);
+    size_t samples = pcm.size();
+
+    stretcher.Process(pcm, sample_rate, LOW_MS - 20);
+    ASSERT_GT(pcm.size(), samples);
+    EXPECT_EQ(stretcher.statistics().expanded, 1u);
+    EXPECT_EQ((pcm.size() - samples) % (sample_rate / 200), 0u);
+    for (size_t i = 0; i < pcm.size(); i++) {
+        EXPECT_NEAR(pcm[i], reference[i], 80) << "at " << i;
+    }
+}
+
+TEST(TimeStretcherTest, LeavesUncorrelatedAudioAlone) {
+    const int sample_rate = 16000;
+    TimeStretcher stretcher(TARGET_MS, LOW_MS, 25, 25);
+    auto pcm = Noise(960, 1);
+    auto reference = pcm;
+
+    stretcher.Process(pcm, sample_rate, TARGET_MS + 100);
+    EXPECT_EQ(pcm, reference);
+    EXPECT_EQ(stretcher.statistics().rejected, 1u);
+    EXPECT_EQ(stretcher.statistics().accelerated, 0u);
+}
+
+TEST(TimeStretcherTest, CutsSilenceAnywhere) {
+    TimeStretcher stretcher(TARGET_MS, LOW_MS, 25, 25);
+    std::vector<int16_t> pcm(960, 0);
+    stretcher.Process(pcm, 16000, TARGET_MS + 100);
+    EXPECT_LT(pcm.size(), 960u);
+    EXPECT_EQ(stretcher.statistics().rejected, 0u);
+}
+
+TEST(TimeStretcherTest, CreditLimitsTheSpeedChange) {
+    const int sample_rate = 16000;
+    const int frames = 100;
+    for (int percent : {0, 2, 5, 10}) {
+        TimeStretcher stretcher(TARGET_MS, LOW_MS, percent, percent);
+        size_t played = 0;
+        for (int i = 0; i < frames; i++) {
+            auto pcm = Sine(sample_rate, 200, 960);
+            stretcher.Process(pcm, sample_rate, TARGET_MS + 100);
+            played += pcm.size();
+        }
+        auto& s = stretcher.statistics();
+        EXPECT_EQ(played + s.samples_removed, (size_t)frames * 960) << percent;
+        EXPECT_LE(s.samples_removed, (uint64_t)frames * 960 * percent / 100) << percent;
+        if (percent == 0) {
+            EXPECT_EQ(s.accelerated, 0u);
+        } else {
+            // Within a period of the allowance, or of one period per frame, which is the most it takes
+            uint64_t period = sample_rate / 200;
+            uint64_t expected = std::min<uint64_t>((uint64_t)frames * 960 * percent / 100, frames * period);
+            EXPECT_GE(s.samples_removed + period, expected) << percent;
+        }
+    }
+}
+
+TEST(TimeStretcherTest, NothingChangesNearTheTarget) {
+    TimeStretcher stretcher(TARGET_MS, LOW_MS, 10, 10);
+    for (int i = 0; i < 50; i++) {
+        auto pcm = Sine(16000, 200, 960);
+        stretcher.Process(pcm, 16000, (TARGET_MS + LOW_MS) / 2);
+        EXPECT_EQ(pcm.size(), 960u);
+    }
+    EXPECT_EQ(stretcher.statistics().accelerated + stretcher.statistics().expanded + stretcher.statistics().rejected, 0u);
+}
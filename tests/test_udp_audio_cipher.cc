@@ -0,0 +1,192 @@
+#include <gtest/gtest.h>
+#include <arpa/inet.h>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <random>
+
+#include "udp_audio_cipher.h"
+
+// Counts every allocation of the test binary, read around the calls being measured
+static size_t allocations = 0;
+
+void* operator new(size_t size) {
+    allocations++;
+    if (void* p = malloc(size ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    free(p);
+}
+
+static std::string FromHex(const char* hex) {
+    std::string bytes;
+    for (size_t i = 0; hex[i] && hex[i + 1]; i += 2) {
+        bytes.push_back((char)strtol(std::string(hex + i, 2).c_str(), nullptr, 16));
+    }
+    return bytes;
+}
+
+// MqttProtocol before the in-place change: a new nonce, datagram and packet for every packet
+namespace reference {
+
+struct Session {
+    mbedtls_aes_context aes_ctx_;
+    std::string aes_nonce_;
+    uint32_t local_sequence_ = 0;
+
+    Session(const std::string& key, const std::string& nonce) : aes_nonce_(nonce) {
+        mbedtls_aes_init(&aes_ctx_);
+        mbedtls_aes_setkey_enc(&aes_ctx_, (const unsigned char*)key.c_str(), 128);
+    }
+    ~Session() { mbedtls_aes_free(&aes_ctx_); }
+
+    std::string SendAudio(const std::vector<uint8_t>& payload, uint32_t timestamp) {
+        std::string nonce(aes_nonce_);
+        *(uint16_t*)&nonce[2] = htons(payload.size());
+        *(uint32_t*)&nonce[8] = htonl(timestamp);
+        *(uint32_t*)&nonce[12] = htonl(++local_sequence_);
+
+        std::string encrypted;
+        encrypted.resize(aes_nonce_.size() + payload.size());
+        memcpy(encrypted.data(), nonce.data(), nonce.size());
+
+        size_t nc_off = 0;
+        uint8_t stream_block[16] = {0};
+        mbedtls_aes_crypt_ctr(&aes_ctx_, payload.size(), &nc_off, (uint8_t*)nonce.c_str(), stream_block,
+            (uint8_t*)payload.data(), (uint8_t*)&encrypted[nonce.size()]);
+        return encrypted;
+    }
+
+    // The receive path decrypted with the datagram's own header as the counter, advancing it
+    std::unique_ptr<std::vector<uint8_t>> OnMessage(std::string data) {
+        size_t decrypted_size = data.size() - aes_nonce_.size();
+        size_t nc_off = 0;
+        uint8_t stream_block[16] = {0};
+        auto nonce = (uint8_t*)data.data();
+        auto encrypted = (uint8_t*)data.data() + aes_nonce_.size();
+        auto payload = std::make_unique<std::vector<uint8_t>>(decrypted_size);
+        mbedtls_aes_crypt_ctr(&aes_ctx_, decrypted_size, &nc_off, nonce, stream_block, encrypted, payload->data());
+        return payload;
+    }
+};
+
+} // namespace reference
+
+class UdpAudioCipherTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        ASSERT_TRUE(cipher_.SetKey(key_, nonce_));
+    }
+
+    // Opus packet sizes of a 60ms stream, and the odd empty one
+    static std::vector<std::vector<uint8_t>> Packets(size_t count) {
+        std::mt19937 rng(3);
+        std::vector<std::vector<uint8_t>> packets(count);
+        for (size_t i = 0; i < count; i++) {
+            packets[i].resize(i == 7 ? 0 : 20 + rng() % 400);
+            for (auto& byte : packets[i]) {
+                byte = rng();
+            }
+        }
+        return packets;
+    }
+
+    std::string key_ = FromHex("2b7e151628aed2a6abf7158809cf4f3c");
+    std::string nonce_ = FromHex("01000000aabbccdd0000000000000000");
+    UdpAudioCipher cipher_;
+};
+
+TEST_F(UdpAudioCipherTest, DatagramsMatchTheAllocatingVersion) {
+    reference::Session old_session(key_, nonce_);
+    auto packets = Packets(500);
+    std::string datagram;
+    for (size_t i = 0; i < packets.size(); i++) {
+        uint32_t timestamp = 1000 + i * 60;
+        auto expected = old_session.SendAudio(packets[i], timestamp);
+        ASSERT_TRUE(cipher_.Encrypt(packets[i].data(), packets[i].size(), timestamp, i + 1, datagram));
+        ASSERT_EQ(datagram, expected) << "packet " << i;
+    }
+}
+
+TEST_F(UdpAudioCipherTest, DecryptMatchesTheAllocatingVersionAndKeepsTheDatagram) {
+    reference::Session old_session(key_, nonce_);
+    auto packets = Packets(500);
+    std::string datagram;
+    std::vector<uint8_t> payload;
+    for (size_t i = 0; i < packets.size(); i++) {
+        ASSERT_TRUE(cipher_.Encrypt(packets[i].data(), packets[i].size(), i * 60, i + 1, datagram));
+        std::string received = datagram;
+        ASSERT_TRUE(cipher_.Decrypt(received, payload));
+        EXPECT_EQ(payload, packets[i]) << "packet " << i;
+        EXPECT_EQ(*old_session.OnMessage(received), packets[i]) << "packet " << i;
+        // The old path advanced the counter inside the received buffer, this one leaves it alone
+        EXPECT_EQ(received, datagram) << "packet " << i;
+    }
+}
+
+TEST_F(UdpAudioCipherTest, ReusedBuffersDoNotAllocate) {
+    auto packets = Packets(200);
+    std::string datagram;
+    std::vector<uint8_t> payload;
+    datagram.reserve(UdpAudioCipher::kHeaderSize + 512);
+    payload.reserve(512);
+
+    size_t before = allocations;
+    for (auto& packet : packets) {
+        ASSERT_TRUE(cipher_.Encrypt(packet.data(), packet.size(), 0, 1, datagram));
+        ASSERT_TRUE(cipher_.Decrypt(datagram, payload));
+    }
+    EXPECT_EQ(allocations - before, 0u);
+
+    // What every packet cost before
+    reference::Session old_session(key_, nonce_);
+    before = allocations;
+    for (auto& packet : packets) {
+        old_session.OnMessage(old_session.SendAudio(packet, 0));
+    }
+    std::cout << "allocating version: " << (double)(allocations - before) / packets.size() << " allocations per packet round trip" << std::endl;
+}
+
+TEST_F(UdpAudioCipherTest, HeaderIsTheCounterBlock) {
+    // NIST SP 800-38A F.5.1, AES-128 CTR: the datagram header is used as the initial counter as is
+    std::string datagram = FromHex("f0f1f2f3f4f5f6f7f8f9fafbfcfdfeff") +
+        FromHex("874d6191b620e3261bef6864990db6ce" "9806f66b7970fdff8617187bb9fffdff");
+    std::vector<uint8_t> payload;
+    ASSERT_TRUE(cipher_.Decrypt(datagram, payload));
+    std::string plaintext = FromHex("6bc1bee22e409f96e93d7e117393172a" "ae2d8a571e03ac9c9eb76fac45af8e51");
+    EXPECT_EQ(std::string(payload.begin(), payload.end()), plaintext);
+
+    // The header fields land where the server reads them
+    std::string sent;
+    uint8_t byte = 0x42;
+    ASSERT_TRUE(cipher_.Encrypt(&byte, 1, 0x01020304, 0x0a0b0c0d, sent));
+    ASSERT_EQ(sent.size(), UdpAudioCipher::kHeaderSize + 1);
+    EXPECT_EQ(sent.substr(0, 2), nonce_.substr(0, 2));
+    EXPECT_EQ(sent.substr(2, 2), FromHex("0001"));
+    EXPECT_EQ(sent.substr(4, 4), nonce_.substr(4, 4));
+    EXPECT_EQ(sent.substr(8, 4), FromHex("01020304"));
+    EXPECT_EQ(sent.substr(12, 4), FromHex("0a0b0c0d"));
+}
+
+TEST(UdpAudioCipherKeyTest, NothingWithoutAValidKey) {
+    UdpAudioCipher cipher;
+    std::string datagram;
+    std::vector<uint8_t> payload;
+    uint8_t byte = 0;
+    EXPECT_FALSE(cipher.Encrypt(&byte, 1, 0, 1, datagram));
+    EXPECT_FALSE(cipher.SetKey(std::string(16, 'k'), std::string(8, 'n')));
+    EXPECT_FALSE(cipher.Encrypt(&byte, 1, 0, 1, datagram));
+    ASSERT_TRUE(cipher.SetKey(std::string(16, 'k'), std::string(16, 'n')));
+    EXPECT_FALSE(cipher.Decrypt(std::string(15, 0), payload));
+    EXPECT_TRUE(cipher.Decrypt(std::string(16, 0), payload));
+    EXPECT_TRUE(payload.empty());
+}
@@ -0,0 +1,207 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <deque>
+#include <fstream>
+#include <sstream>
+
+#include "uplink_dtx.h"
+
+#define HANGOVER_MS 400
+#define PREROLL_MS 240
+#define KEEPALIVE_MS 1000
+#define SILENT_FRAME_BYTES 8
+
+// One VAD decision per frame, from a trace of "duration_ms speech" runs
+static std::vector<bool> LoadVadTrace(const std::string& path, int frame_ms) {
+    std::vector<bool> frames;
+    std::ifstream file(path);
+    std::string line;
+    while (std::getline(file, line)) {
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+        std::istringstream fields(line);
+        int duration_ms = 0, speech = 0;
+        if (fields >> duration_ms >> speech) {
+            frames.insert(frames.end(), duration_ms / frame_ms, speech != 0);
+        }
+    }
+    return frames;
+}
+
+struct SentFrame {
+    size_t index;           // Frame number in the trace
+    UplinkDtxAction action; // The action of the frame that sent it
+};
+
+// Applies the actions the way AudioService::GateUplinkFrame() does
+static std::vector<SentFrame> Gate(UplinkDtx& dtx, const std::vector<bool>& vad) {
+    std::vector<SentFrame> sent;
+    std::deque<size_t> preroll;
+    for (size_t i = 0; i < vad.size(); i++) {
+        auto action = dtx.Next(vad[i]);
+        switch (action) {
+        case kUplinkDtxResume:
+            for (auto held : preroll) {
+                sent.push_back({held, action});
+            }
+            preroll.clear();
+            sent.push_back({i, action});
+            break;
+        case kUplinkDtxKeepalive:
+            preroll.clear();
+            sent.push_back({i, action});
+            break;
+        case kUplinkDtxHold:
+            if (dtx.held_frames() == 0) {
+                break;
+            }
+            if (preroll.size() >= (size_t)dtx.held_frames()) {
+                preroll.pop_front();
+            }
+            preroll.push_back(i);
+            break;
+        default:
+            sent.push_back({i, action});
+            break;
+        }
+        if (action != kUplinkDtxHold) {
+            // What the codec task feeds back for hangover and keepalive frames
+            if (!vad[i]) {
+                dtx.AddSilentFrameBytes(SILENT_FRAME_BYTES);
+            }
+        }
+    }
+    return sent;
+}
+
+class UplinkDtxTraceTest : public ::testing::TestWithParam<int> {};
+
+TEST_P(UplinkDtxTraceTest, RecordedTurn) {
+    const int frame_ms = GetParam();
+    auto vad = LoadVadTrace(TEST_DATA_DIR "/vad_realtime_turn.txt", frame_ms);
+    ASSERT_GT(vad.size(), 0u);
+    UplinkDtx dtx(HANGOVER_MS, PREROLL_MS, KEEPALIVE_MS);
+    dtx.Configure(frame_ms);
+    const size_t hangover_frames = (HANGOVER_MS + frame_ms - 1) / frame_ms;
+    const size_t preroll_frames = (PREROLL_MS + frame_ms - 1) / frame_ms;
+    const size_t keepalive_frames = (KEEPALIVE_MS + frame_ms - 1) / frame_ms;
+
+    auto sent = Gate(dtx, vad);
+
+    // What should go out, worked out from each silence run of the trace
+    std::vector<SentFrame> expected;
+    size_t keepalives = 0, onsets = 0;
+    for (size_t i = 0; i < vad.size();) {
+        if (vad[i]) {
+            expected.push_back({i, kUplinkDtxSend});
+            i++;
+            continue;
+        }
+        size_t start = i, end = i;
+        while (end < vad.size() && !vad[end]) {
+            end++;
+        }
+        // The hangover, also at the start of a turn
+        size_t suppressed = std::min(end, start + hangover_frames);
+        for (size_t k = start; k < suppressed; k++) {
+            expected.push_back({k, kUplinkDtxSend});
+        }
+        // Then one keepalive per interval; each one drops what was held before it
+        size_t held_from = suppressed;
+        for (size_t k = suppressed + keepalive_frames - 1; k < end; k += keepalive_frames) {
+            expected.push_back({k, kUplinkDtxKeepalive});
+            keepalives++;
+            held_from = k + 1;
+        }
+        // At the onset, the last pre-roll worth of held frames goes out first
+        if (end < vad.size() && suppressed < end) {
+            held_from = std::max(held_from, end - std::min(end, preroll_frames));
+            for (size_t k = held_from; k < end; k++) {
+                expected.push_back({k, kUplinkDtxResume});
+            }
+            expected.push_back({end, kUplinkDtxResume});
+            onsets++;
+            end++;
+        }
+        i = end;
+    }
+    std::sort(expected.begin(), expected.end(), [](const SentFrame& a, const SentFrame& b) {
+        return a.index < b.index;
+    });
+
+    ASSERT_EQ(sent.size(), expected.size());
+    for (size_t i = 0; i < sent.size(); i++) {
+        ASSERT_EQ(sent[i].index, expected[i].index) << "at " << i;
+        ASSERT_EQ(sent[i].action, expected[i].action) << "frame " << sent[i].index;
+    }
+    EXPECT_GT(onsets, 1u);
+    EXPECT_GT(keepalives, 1u);
+
+    auto& s = dtx.statistics();
+    size_t held = dtx.held_frames();
+    EXPECT_EQ(s.onsets, onsets);
+    EXPECT_EQ(s.keepalive_frames, keepalives);
+    // Every frame is counted once
+    EXPECT_EQ(s.sent_frames + s.keepalive_frames + s.preroll_frames + s.suppressed_frames + held, vad.size());
+    EXPECT_EQ(s.sent_frames + s.keepalive_frames + s.preroll_frames, sent.size());
+    EXPECT_EQ(s.silent_frame_bytes, (uint32_t)SILENT_FRAME_BYTES);
+    EXPECT_EQ(s.saved_bytes(), (uint64_t)s.suppressed_frames * SILENT_FRAME_BYTES);
+
+    // At the end of the turn the held frames count as suppressed
+    dtx.Reset();
+    EXPECT_EQ(dtx.statistics().suppressed_frames, s.suppressed_frames);
+    EXPECT_EQ(s.sent_frames + s.keepalive_frames + s.preroll_frames + s.suppressed_frames, vad.size());
+}
+
+INSTANTIATE_TEST_SUITE_P(FrameDurations, UplinkDtxTraceTest, ::testing::Values(20, 40, 60));
+
+TEST(UplinkDtxTest, HangoverThenHoldThenResume) {
+    UplinkDtx dtx(HANGOVER_MS, PREROLL_MS, 0);
+    dtx.Configure(60);
+    EXPECT_EQ(dtx.Next(true), kUplinkDtxSend);
+    // 400ms of hangover at 60ms frames is 7 frames
+    for (int i = 0; i < 7; i++) {
+        EXPECT_EQ(dtx.Next(false), kUplinkDtxSend) << i;
+    }
+    EXPECT_FALSE(dtx.suppressing());
+    for (int i = 0; i < 10; i++) {
+        EXPECT_EQ(dtx.Next(false), kUplinkDtxHold) << i;
+    }
+    EXPECT_TRUE(dtx.suppressing());
+    // 240ms of pre-roll is 4 frames, the other 6 are gone
+    EXPECT_EQ(dtx.held_frames(), 4);
+    EXPECT_EQ(dtx.statistics().suppressed_frames, 6u);
+    EXPECT_EQ(dtx.Next(true), kUplinkDtxResume);
+    EXPECT_EQ(dtx.statistics().preroll_frames, 4u);
+    EXPECT_EQ(dtx.statistics().onsets, 1u);
+    EXPECT_EQ(dtx.held_frames(), 0);
+    EXPECT_EQ(dtx.Next(true), kUplinkDtxSend);
+}
+
+TEST(UplinkDtxTest, KeepaliveDropsTheHeldFrames) {
+    UplinkDtx dtx(0, PREROLL_MS, 200);
+    dtx.Configure(20);
+    // Nothing spoken yet, the first frame is already held; a keepalive every 10th frame
+    for (int round = 0; round < 3; round++) {
+        for (int i = 0; i < 9; i++) {
+            EXPECT_EQ(dtx.Next(false), kUplinkDtxHold) << round << " " << i;
+        }
+        EXPECT_EQ(dtx.Next(false), kUplinkDtxKeepalive) << round;
+        EXPECT_EQ(dtx.held_frames(), 0);
+    }
+    EXPECT_EQ(dtx.statistics().keepalive_frames, 3u);
+    EXPECT_EQ(dtx.statistics().suppressed_frames, 27u);
+}
+
+TEST(UplinkDtxTest, ConfigureRoundsUpAndStartsOver) {
+    UplinkDtx dtx(HANGOVER_MS, 100, KEEPALIVE_MS);
+    dtx.Configure(60);
+    EXPECT_EQ(dtx.preroll_frames(), 2);
+    dtx.Next(false);
+    dtx.Configure(40);
+    EXPECT_EQ(dtx.frame_duration_ms(), 40);
+    EXPECT_EQ(dtx.preroll_frames(), 3);
+    EXPECT_FALSE(dtx.suppressing());
+    EXPECT_EQ(dtx.held_frames(), 0);
+}
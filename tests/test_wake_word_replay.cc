@@ -0,0 +1,122 @@
+#include <gtest/gtest.h>
+#include <cmath>
+#include <random>
+
+#include "wake_word_replay.h"
+
+#define AMBIENT_AMPLITUDE 300
+#define SPEECH_AMPLITUDE 6000
+#define THRESHOLD 2000
+
+// Room noise with tone bursts of the given (start, length) in seconds
+static std::vector<int16_t> Corpus(double duration, const std::vector<std::pair<double, double>>& bursts) {
+    std::mt19937 rng(5);
+    std::uniform_int_distribution<int> noise(-AMBIENT_AMPLITUDE, AMBIENT_AMPLITUDE);
+    std::vector<int16_t> pcm((size_t)(duration * REPLAY_SAMPLE_RATE));
+    for (auto& sample : pcm) {
+        sample = noise(rng);
+    }
+    for (auto& burst : bursts) {
+        size_t begin = (size_t)(burst.first * REPLAY_SAMPLE_RATE);
+        size_t end = std::min(pcm.size(), (size_t)((burst.first + burst.second) * REPLAY_SAMPLE_RATE));
+        for (size_t i = begin; i < end; i++) {
+            pcm[i] = (int16_t)(SPEECH_AMPLITUDE * sin(2 * M_PI * 440 * i / REPLAY_SAMPLE_RATE));
+        }
+    }
+    return pcm;
+}
+
+TEST(WakeWordReplayTest, ScoresDetectionsAgainstLabels) {
+    // Three 0.6s "wake words" and two 0.1s knocks that must not trigger
+    auto pcm = Corpus(20, {{2, 0.6}, {5, 0.1}, {8, 0.6}, {11, 0.1}, {15, 0.6}});
+    EnergyWakeWord wake_word(THRESHOLD);
+    auto result = ReplayWakeWord(pcm, wake_word);
+
+    // Every whole chunk fed, in GetFeedSize() steps
+    EXPECT_EQ(result.samples, pcm.size() / 512 * 512);
+    auto score = ScoreWakeWord(result.events, {2.6, 8.6, 15.6}, 1.0, 20);
+    EXPECT_EQ(score.detections, 3u);
+    EXPECT_EQ(score.hits, 3u);
+    EXPECT_EQ(score.misses(), 0u);
+    EXPECT_EQ(score.false_accepts, 0u);
+    // One 20ms decision frame to notice the end, reported at the end of the 32ms feed that completes it
+    ASSERT_EQ(score.latencies.size(), 3u);
+    for (double latency : score.latencies) {
+        EXPECT_GE(latency, 0.0);
+        EXPECT_LE(latency, 0.020 + 0.032 + 0.001);
+    }
+    EXPECT_EQ(wake_word.GetLastDetectedWakeWord(), "stub");
+}
+
+TEST(WakeWordReplayTest, UnlabelledDetectionsAreFalseAccepts) {
+    auto pcm = Corpus(30, {{2, 0.6}, {10, 0.6}, {20, 0.6}});
+    EnergyWakeWord wake_word(THRESHOLD);
+    auto result = ReplayWakeWord(pcm, wake_word);
+
+    // Only the middle one labelled, a label with no detection, and one the detection comes too late for
+    auto score = ScoreWakeWord(result.events, {10.6, 25.0, 19.0}, 1.0, 30);
+    EXPECT_EQ(score.detections, 3u);
+    EXPECT_EQ(score.hits, 1u);
+    EXPECT_EQ(score.misses(), 2u);
+    EXPECT_EQ(score.false_accepts, 2u);
+    EXPECT_DOUBLE_EQ(score.false_accepts_per_hour(), 2 * 3600.0 / 30);
+
+    // One detection can only hit one label, and detections before their label do not count
+    std::vector<ReplayEvent> events = {{"wake", 16000, "a"}, {"wake", 16800, "b"}};
+    score = ScoreWakeWord(events, {0.9, 1.2}, 0.5, 10);
+    EXPECT_EQ(score.hits, 1u);
+    EXPECT_EQ(score.false_accepts, 1u);
+    EXPECT_NEAR(score.latencies[0], 0.1, 1e-9);
+}
+
+TEST(WakeWordReplayTest, ListeningSessionReportsVadSegmentsAndFrames) {
+    auto pcm = Corpus(10, {{1, 0.5}, {3, 0.1}, {6, 1.5}});
+    EnergyVadProcessor processor(THRESHOLD);
+    processor.Initialize(nullptr, 60);
+    size_t output_samples = 0;
+    auto result = ReplayAudioProcessor(pcm, processor, &output_samples);
+
+    std::vector<std::pair<double, bool>> vad;
+    for (auto& event : result.events) {
+        ASSERT_EQ(event.name, "vad");
+        vad.push_back({(double)event.position / REPLAY_SAMPLE_RATE, event.value == "1"});
+    }
+    ASSERT_EQ(vad.size(), 6u);
+    double expected[] = {1, 1.5, 3, 3.1, 6, 7.5};
+    for (size_t i = 0; i < vad.size(); i++) {
+        EXPECT_EQ(vad[i].second, i % 2 == 0);
+        EXPECT_NEAR(vad[i].first, expected[i], 0.020 + 0.032 + 0.001) << i;
+    }
+    EXPECT_EQ(ScoreWakeWord(result.events, {}, 1.0, 10).vad_segments, 3u);
+    // Output in whole 60ms frames, only the last partial frame held back
+    EXPECT_EQ(output_samples % 960, 0u);
+    EXPECT_GT(output_samples + 960, (size_t)result.samples);
+}
+
+TEST(WakeWordReplayTest, ReplaysRecordedWavFasterThanRealtime) {
+    std::vector<int16_t> pcm;
+    ASSERT_TRUE(LoadReplayWav(REPO_DIR "/test_reminder.wav", pcm));
+    size_t clip = pcm.size();
+    ASSERT_GT(clip, (size_t)REPLAY_SAMPLE_RATE);
+    ASSERT_TRUE(LoadReplayWav(REPO_DIR "/test_edge_tts.wav", pcm));
+    EXPECT_GT(pcm.size(), clip);
+    EXPECT_FALSE(LoadReplayWav(REPO_DIR "/README.md", pcm));
+
+    EnergyWakeWord wake_word(THRESHOLD);
+    auto result = ReplayWakeWord(pcm, wake_word);
+    double seconds = (double)result.samples / REPLAY_SAMPLE_RATE;
+    auto score = ScoreWakeWord(result.events, {}, 1.0, seconds);
+    // TTS speech, so the energy stub fires on it; every firing is unlabelled
+    EXPECT_GT(score.detections, 0u);
+    EXPECT_EQ(score.false_accepts, score.detections);
+    EXPECT_LT(result.feed_us, seconds * 1e6);
+
+    // The same audio in a listening session gives VAD segments instead
+    EnergyVadProcessor processor(THRESHOLD);
+    processor.Initialize(nullptr, 20);
+    auto listening = ReplayAudioProcessor(pcm, processor);
+    size_t vad_segments = ScoreWakeWord(listening.events, {}, 1.0, seconds).vad_segments;
+    EXPECT_GE(vad_segments, score.detections);
+    std::cout << seconds << " s of audio, " << score.detections << " detections, " << vad_segments
+        << " VAD segments, " << result.feed_us / seconds / 1000 << " ms feed time per second of audio" << std::endl;
+}
@@ -0,0 +1,82 @@
+#include "wake_word_replay.h"
+
+#include <cstdio>
+#include <cstdlib>
+
+// Replays WAV corpora (labels from "<file>.labels" sidecars) and prints the score, as
+// scripts/wake_word_replay.py --stub does, without a device
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s <wav>... [--threshold n] [--tolerance s] [--gap s] [--listen]\n", argv[0]);
+        return 1;
+    }
+
+    int threshold = 2000;
+    double tolerance = 1.0;
+    double gap = 1.0;
+    bool listen = false;
+    std::vector<std::string> files;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--threshold" && i + 1 < argc) {
+            threshold = atoi(argv[++i]);
+        } else if (arg == "--tolerance" && i + 1 < argc) {
+            tolerance = atof(argv[++i]);
+        } else if (arg == "--gap" && i + 1 < argc) {
+            gap = atof(argv[++i]);
+        } else if (arg == "--listen") {
+            listen = true;
+        } else {
+            files.push_back(arg);
+        }
+    }
+
+    // The files back to back with silence in between, labels moved to their place in the corpus
+    std::vector<int16_t> pcm;
+    std::vector<double> targets;
+    for (auto& path : files) {
+        double offset = (double)pcm.size() / REPLAY_SAMPLE_RATE;
+        if (!LoadReplayWav(path, pcm)) {
+            fprintf(stderr, "%s: 16kHz mono 16-bit WAV required\n", path.c_str());
+            return 1;
+        }
+        for (double t : LoadReplayLabels(path)) {
+            targets.push_back(offset + t);
+        }
+        pcm.resize(pcm.size() + (size_t)(gap * REPLAY_SAMPLE_RATE));
+    }
+    double duration = (double)pcm.size() / REPLAY_SAMPLE_RATE;
+
+    ReplayResult result;
+    if (listen) {
+        EnergyVadProcessor processor(threshold);
+        processor.Initialize(nullptr, 20);
+        result = ReplayAudioProcessor(pcm, processor);
+    } else {
+        EnergyWakeWord wake_word(threshold);
+        result = ReplayWakeWord(pcm, wake_word);
+    }
+    auto score = ScoreWakeWord(result.events, targets, tolerance, duration);
+
+    printf("Audio:          %.1f s, %zu labelled wake words\n", duration, score.targets);
+    printf("Detections:     %zu\n", score.detections);
+    if (score.targets > 0) {
+        printf("Hits:           %zu (%.1f%%), misses %zu\n", score.hits, 100.0 * score.hits / score.targets, score.misses());
+    }
+    printf("False accepts:  %zu (%.2f per hour)\n", score.false_accepts, score.false_accepts_per_hour());
+    if (!score.latencies.empty()) {
+        double sum = 0;
+        for (double latency : score.latencies) {
+            sum += latency;
+        }
+        printf("Latency:        mean %.0f ms, p50 %.0f ms, max %.0f ms\n", 1000 * sum / score.latencies.size(),
+            1000 * score.latencies[score.latencies.size() / 2], 1000 * score.latencies.back());
+    }
+    printf("VAD segments:   %zu\n", score.vad_segments);
+    double seconds = (double)result.samples / REPLAY_SAMPLE_RATE;
+    printf("Consumed:       %.1f s\n", seconds);
+    if (result.samples > 0) {
+        printf("Feed time:      %.3f ms per second of audio\n", result.feed_us / seconds / 1000);
+    }
+    return 0;
+}
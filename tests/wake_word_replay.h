@@ -0,0 +1,294 @@
+#ifndef WAKE_WORD_REPLAY_H
+#define WAKE_WORD_REPLAY_H
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "wake_word.h"
+#include "audio_processor.h"
+#include "frame_assembler.h"
+
+/*
+ * Host side of scripts/wake_word_replay.py: replays 16kHz mono PCM through a WakeWord or
+ * AudioProcessor as fast as it runs, in chunks of GetFeedSize() like AudioService::AudioInputTask(),
+ * and scores the events against labelled wake word times the way the script does.
+ *
+ * The ESP-SR detectors only exist as device libraries, so on the host the detector is
+ * EnergyWakeWord / EnergyVadProcessor, the same energy rule as the script's --stub. Events carry
+ * the sample position at which the Feed() call that raised them returned.
+ */
+
+#define REPLAY_SAMPLE_RATE 16000
+#define REPLAY_STUB_FRAME_SAMPLES 320       // 20ms decisions
+#define REPLAY_STUB_WAKE_WORD_MS 300        // A loud burst at least this long is a "wake word"
+
+struct ReplayEvent {
+    std::string name;       // "wake" or "vad"
+    uint64_t position;      // Samples fed when it was raised
+    std::string value;      // Wake word, or "1"/"0" for speech start/end
+};
+
+struct ReplayResult {
+    std::vector<ReplayEvent> events;
+    uint64_t samples = 0;   // Samples fed, whole feed chunks only
+    int64_t feed_us = 0;    // Time spent inside Feed()
+};
+
+struct WakeWordScore {
+    size_t targets = 0;
+    size_t detections = 0;
+    size_t hits = 0;
+    size_t false_accepts = 0;
+    size_t vad_segments = 0;
+    std::vector<double> latencies;  // Seconds from the labelled end to the detection, sorted
+    double duration = 0;
+
+    size_t misses() const { return targets - hits; }
+    double false_accepts_per_hour() const { return duration > 0 ? false_accepts * 3600.0 / duration : 0; }
+};
+
+// Energy detector: a "wake word" ends where a loud burst of at least REPLAY_STUB_WAKE_WORD_MS goes quiet
+class EnergyDetector {
+public:
+    explicit EnergyDetector(int threshold) : threshold_(threshold), frames_(REPLAY_STUB_FRAME_SAMPLES) {}
+
+    // Calls on_event(name, value) for every decision completed by the chunk
+    template <typename OnEvent>
+    void Feed(const int16_t* data, size_t samples, OnEvent&& on_event) {
+        frames_.Append(data, samples, [&](std::vector<int16_t>&& frame) {
+            int64_t energy = 0;
+            for (auto sample : frame) {
+                energy += (int32_t)sample * sample;
+            }
+            if (energy / (int64_t)frame.size() > (int64_t)threshold_ * threshold_) {
+                if (loud_frames_++ == 0) {
+                    on_event("vad", "1");
+                }
+            } else if (loud_frames_ > 0) {
+                on_event("vad", "0");
+                if (loud_frames_ * REPLAY_STUB_FRAME_SAMPLES >= REPLAY_SAMPLE_RATE * REPLAY_STUB_WAKE_WORD_MS / 1000) {
+                    on_event("wake", "stub");
+                }
+                loud_frames_ = 0;
+            }
+        });
+    }
+
+private:
+    int threshold_;
+    FrameAssembler frames_;
+    int loud_frames_ = 0;
+};
+
+class EnergyWakeWord : public WakeWord {
+public:
+    // 512 samples per feed like the AFE wake word, so the detector frames do not line up with the feeds
+    explicit EnergyWakeWord(int threshold, size_t feed_size = 512) : detector_(threshold), feed_size_(feed_size) {}
+
+    bool Initialize(AudioCodec*) override { return true; }
+    void Feed(const std::vector<int16_t>& data) override {
+        if (!running_) {
+            return;
+        }
+        detector_.Feed(data.data(), data.size(), [this](const char* name, const char*) {
+            if (strcmp(name, "wake") == 0 && callback_) {
+                last_detected_wake_word_ = "stub";
+                callback_(last_detected_wake_word_);
+            }
+        });
+    }
+    void OnWakeWordDetected(std::function<void(const std::string& wake_word)> callback) override { callback_ = callback; }
+    void Start() override { running_ = true; }
+    void Stop() override { running_ = false; }
+    size_t GetFeedSize() override { return feed_size_; }
+    bool GetWakeWordOpus(std::vector<uint8_t>&) override { return false; }
+    void StopBridge() override {}
+    const std::string& GetLastDetectedWakeWord() const override { return last_detected_wake_word_; }
+
+private:
+    EnergyDetector detector_;
+    size_t feed_size_;
+    bool running_ = false;
+    std::function<void(const std::string& wake_word)> callback_;
+    std::string last_detected_wake_word_;
+};
+
+class EnergyVadProcessor : public AudioProcessor {
+public:
+    explicit EnergyVadProcessor(int threshold) : detector_(threshold) {}
+
+    void Initialize(AudioCodec*, int frame_duration_ms) override { SetFrameDuration(frame_duration_ms); }
+    void SetFrameDuration(int frame_duration_ms) override {
+        output_.SetFrameSamples(frame_duration_ms * REPLAY_SAMPLE_RATE / 1000);
+    }
+    void Feed(std::vector<int16_t>&& data) override {
+        if (!running_) {
+            return;
+        }
+        detector_.Feed(data.data(), data.size(), [this](const char* name, const char* value) {
+            if (strcmp(name, "vad") == 0 && vad_callback_) {
+                vad_callback_(value[0] == '1');
+            }
+        });
+        output_.Append(data.data(), data.size(), [this](std::vector<int16_t>&& frame) {
+            if (output_callback_) {
+                output_callback_(std::move(frame));
+            }
+        });
+    }
+    void Start() override { running_ = true; }
+    void Stop() override { running_ = false; }
+    bool IsRunning() override { return running_; }
+    void OnOutput(std::function<void(std::vector<int16_t>&& data)> callback) override { output_callback_ = callback; }
+    void OnVadStateChange(std::function<void(bool speaking)> callback) override { vad_callback_ = callback; }
+    size_t GetFeedSize() override { return 512; }
+    void EnableDeviceAec(bool) override {}
+
+private:
+    EnergyDetector detector_;
+    FrameAssembler output_;
+    bool running_ = false;
+    std::function<void(std::vector<int16_t>&& data)> output_callback_;
+    std::function<void(bool speaking)> vad_callback_;
+};
+
+// Feeds pcm in GetFeedSize() chunks as AudioInputTask does; a trailing partial chunk is not fed.
+// samples counts the current chunk while it is fed, so its events are placed at its end
+template <typename Feed>
+inline void ReplayChunks(const std::vector<int16_t>& pcm, size_t feed_size, ReplayResult& result, Feed&& feed) {
+    if (feed_size == 0) {
+        return;
+    }
+    std::vector<int16_t> data;
+    for (size_t offset = 0; offset + feed_size <= pcm.size(); offset += feed_size) {
+        data.assign(pcm.begin() + offset, pcm.begin() + offset + feed_size);
+        result.samples = offset + feed_size;
+        auto start = std::chrono::steady_clock::now();
+        feed(data);
+        result.feed_us += std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start).count();
+    }
+}
+
+inline ReplayResult ReplayWakeWord(const std::vector<int16_t>& pcm, WakeWord& wake_word) {
+    ReplayResult result;
+    wake_word.OnWakeWordDetected([&result](const std::string& name) {
+        result.events.push_back({"wake", result.samples, name});
+    });
+    wake_word.Start();
+    ReplayChunks(pcm, wake_word.GetFeedSize(), result, [&](std::vector<int16_t>& data) {
+        wake_word.Feed(data);
+    });
+    wake_word.Stop();
+    return result;
+}
+
+// Listening session: the processor runs instead of the wake word and reports VAD; output_samples
+// adds up the frames it hands on
+inline ReplayResult ReplayAudioProcessor(const std::vector<int16_t>& pcm, AudioProcessor& processor,
+        size_t* output_samples = nullptr) {
+    ReplayResult result;
+    processor.OnVadStateChange([&result](bool speaking) {
+        result.events.push_back({"vad", result.samples, speaking ? "1" : "0"});
+    });
+    processor.OnOutput([output_samples](std::vector<int16_t>&& frame) {
+        if (output_samples) {
+            *output_samples += frame.size();
+        }
+    });
+    processor.Start();
+    ReplayChunks(pcm, processor.GetFeedSize(), result, [&](std::vector<int16_t>& data) {
+        processor.Feed(std::move(data));
+    });
+    processor.Stop();
+    return result;
+}
+
+// Detections are matched in time order to the earliest unmatched label they follow within tolerance
+inline WakeWordScore ScoreWakeWord(const std::vector<ReplayEvent>& events, std::vector<double> targets,
+        double tolerance, double duration) {
+    WakeWordScore score;
+    score.targets = targets.size();
+    score.duration = duration;
+    std::vector<double> detections;
+    for (auto& event : events) {
+        if (event.name == "wake") {
+            detections.push_back((double)event.position / REPLAY_SAMPLE_RATE);
+        } else if (event.name == "vad" && event.value == "1") {
+            score.vad_segments++;
+        }
+    }
+    std::sort(detections.begin(), detections.end());
+    std::sort(targets.begin(), targets.end());
+    score.detections = detections.size();
+    for (double t : detections) {
+        auto match = std::find_if(targets.begin(), targets.end(), [&](double target) {
+            return t - target >= 0 && t - target <= tolerance;
+        });
+        if (match == targets.end()) {
+            score.false_accepts++;
+        } else {
+            score.latencies.push_back(t - *match);
+            targets.erase(match);
+        }
+    }
+    score.hits = score.latencies.size();
+    std::sort(score.latencies.begin(), score.latencies.end());
+    return score;
+}
+
+// 16kHz mono 16-bit PCM WAV, the format the script requires; false for anything else
+inline bool LoadReplayWav(const std::string& path, std::vector<int16_t>& pcm) {
+    std::ifstream file(path, std::ios::binary);
+    char riff[12];
+    if (!file.read(riff, sizeof(riff)) || memcmp(riff, "RIFF", 4) != 0 || memcmp(riff + 8, "WAVE", 4) != 0) {
+        return false;
+    }
+    bool format_ok = false;
+    char chunk[8];
+    while (file.read(chunk, sizeof(chunk))) {
+        uint32_t size;
+        memcpy(&size, chunk + 4, sizeof(size));
+        if (memcmp(chunk, "fmt ", 4) == 0) {
+            std::vector<char> fmt(size);
+            if (size < 16 || !file.read(fmt.data(), size)) {
+                return false;
+            }
+            uint16_t format, channels, bits;
+            uint32_t sample_rate;
+            memcpy(&format, &fmt[0], 2);
+            memcpy(&channels, &fmt[2], 2);
+            memcpy(&sample_rate, &fmt[4], 4);
+            memcpy(&bits, &fmt[14], 2);
+            format_ok = format == 1 && channels == 1 && sample_rate == REPLAY_SAMPLE_RATE && bits == 16;
+        } else if (memcmp(chunk, "data", 4) == 0) {
+            if (!format_ok) {
+                return false;
+            }
+            size_t offset = pcm.size();
+            pcm.resize(offset + size / 2);
+            return (bool)file.read((char*)(pcm.data() + offset), size / 2 * 2);
+        } else {
+            file.seekg(size + (size & 1), std::ios::cur);
+        }
+    }
+    return false;
+}
+
+// Labels of a file from its "<file>.labels" sidecar, one wake word end time in seconds per line
+inline std::vector<double> LoadReplayLabels(const std::string& wav_path) {
+    std::vector<double> labels;
+    std::ifstream file(wav_path + ".labels");
+    double seconds;
+    while (file >> seconds) {
+        labels.push_back(seconds);
+    }
+    return labels;
+}
+
+#endif // WAKE_WORD_REPLAY_H